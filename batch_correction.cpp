@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <glob.h>
+#include <ogr_spatialref.h>
+#include "batch_correction.h"
+
+using namespace std;
+
+namespace ksg
+{
+    vector<BatchItem> readManifest(istream &in)
+    {
+        vector<BatchItem> items;
+        string line;
+        for (int lineNumber = 1; getline(in, line); lineNumber++)
+        {
+            istringstream words(line);
+            BatchItem item;
+            if (!(words >> item.input) || item.input[0] == '#')
+                continue;
+
+            string extra;
+            if (!(words >> item.output) || words >> extra)
+                throw logic_error("Manifest line " + to_string(lineNumber) + " should contain input and output location");
+
+            items.push_back(item);
+        }
+        return items;
+    }
+
+    vector<BatchItem> expandGlob(const string &pattern, const string &outputDirectory)
+    {
+        glob_t matches;
+        int status = glob(pattern.c_str(), 0, nullptr, &matches);
+        if (status == GLOB_NOMATCH)
+        {
+            globfree(&matches);
+            return {};
+        }
+        if (status != 0)
+        {
+            globfree(&matches);
+            throw runtime_error("Cannot expand " + pattern);
+        }
+
+        string directory = outputDirectory.empty() || outputDirectory.back() == '/' ? outputDirectory : outputDirectory + "/";
+
+        vector<BatchItem> items;
+        for (size_t i = 0; i < matches.gl_pathc; i++)
+        {
+            string input = matches.gl_pathv[i];
+            auto slash = input.find_last_of('/');
+            BatchItem item{input, directory + (slash == string::npos ? input : input.substr(slash + 1))};
+            if (item.output == item.input)
+            {
+                globfree(&matches);
+                throw logic_error("Output of " + input + " would overwrite it");
+            }
+            items.push_back(item);
+        }
+
+        globfree(&matches);
+        return items;
+    }
+
+    vector<BatchResult> runBatch(const vector<BatchItem> &items, int workers,
+                                 const function<void(const BatchItem &)> &task,
+                                 const function<void(const BatchResult &)> &report)
+    {
+        vector<BatchResult> results(items.size());
+        atomic<size_t> next(0);
+        mutex reportMutex;
+
+        auto work = [&]() {
+            for (size_t i = next++; i < items.size(); i = next++)
+            {
+                auto &result = results[i];
+                result.item = items[i];
+
+                auto start = chrono::steady_clock::now();
+                try
+                {
+                    task(items[i]);
+                    result.succeeded = true;
+                }
+                catch (exception &ex)
+                {
+                    result.error = ex.what();
+                }
+                catch (...)
+                {
+                    result.error = "Unknown error";
+                }
+                result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                lock_guard<mutex> lock(reportMutex);
+                report(result);
+            }
+        };
+
+        workers = max(1, min(workers, static_cast<int>(items.size())));
+        vector<thread> threads;
+        for (int w = 1; w < workers; w++)
+            threads.emplace_back(work);
+        work();
+
+        for (auto &t : threads)
+            t.join();
+
+        return results;
+    }
+
+    shared_ptr<CorrectorPool::Entry> CorrectorPool::get(GDALDataset *raster)
+    {
+        double geotransform[6];
+        raster->GetGeoTransform(geotransform);
+
+        string wkt = raster->GetProjectionRef();
+        ostringstream key;
+        key.precision(17);
+        key << wkt << ";";
+        for (int i = 0; i < 6; i++)
+            key << geotransform[i] << (i < 5 ? "," : "");
+        // Cache and lattice of entry cover raster of single size
+        key << ";" << raster->GetRasterXSize() << "x" << raster->GetRasterYSize();
+
+        lock_guard<mutex> lock(entriesMutex);
+        auto found = entries.find(key.str());
+        if (found != entries.end())
+            return found->second;
+
+        OGRSpatialReference srs;
+        auto srs_c = wkt.c_str();
+        srs.importFromWkt(&srs_c);
+
+        auto projectionName = srs.GetAttrValue("PROJECTION");
+        if (projectionName == nullptr || string(projectionName) != "Geostationary_Satellite")
+            throw runtime_error("Height correction requires Geostationary_Satellite projection.");
+
+        auto entry = make_shared<Entry>();
+        entry->corrector.reset(new GEOSHeightCorrector(srs));
+        entry->index = entries.size();
+        entries[key.str()] = entry;
+        return entry;
+    }
+
+    size_t CorrectorPool::size() const
+    {
+        lock_guard<mutex> lock(entriesMutex);
+        return entries.size();
+    }
+}
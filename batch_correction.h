@@ -0,0 +1,83 @@
+#pragma once
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <gdal_priv.h>
+#include "correction.h"
+#include "displacement_cache.h"
+#include "sparse_lattice.h"
+
+namespace ksg
+{
+    ///
+    /// Raster requiring correction and location of its result.
+    struct BatchItem
+    {
+        std::string input;
+        std::string output;
+    };
+
+    ///
+    /// Reads manifest with one pair of input and output locations per line, separated with whitespace.
+    /// Empty lines and lines starting with # are skipped.
+    std::vector<BatchItem> readManifest(std::istream &in);
+
+    ///
+    /// Finds inputs matching glob pattern. Result of every input is placed in outputDirectory under the same name.
+    std::vector<BatchItem> expandGlob(const std::string &pattern, const std::string &outputDirectory);
+
+    struct BatchResult
+    {
+        BatchItem item;
+        bool succeeded = false;
+        std::string error;
+        /// Wall time of task [s]
+        double seconds = 0;
+    };
+
+    ///
+    /// Runs task for every item on pool of worker threads. Exception thrown by task fails only its item.
+    /// @param workers number of worker threads, never more than number of items
+    /// @param report called after every item is finished, calls are serialised
+    /// @return results in order of items
+    std::vector<BatchResult> runBatch(const std::vector<BatchItem> &items, int workers,
+                                      const std::function<void(const BatchItem &)> &task,
+                                      const std::function<void(const BatchResult &)> &report);
+
+    ///
+    /// Correctors shared by rasters with the same SRS, geotransform and size, so SRS parsing and transformations setup
+    /// are paid once per geometry. Safe to use from many threads.
+    class CorrectorPool
+    {
+    public:
+        struct Entry
+        {
+            std::unique_ptr<GEOSHeightCorrector> corrector;
+            /// Order in which geometry was met, starting from 0
+            size_t index = 0;
+
+            /// Displacement cache of geometry, created by user of pool. It is filled in place,
+            /// so rasters using it should be corrected one at a time, while holding mutex.
+            std::unique_ptr<DisplacementCache> cache;
+            /// Sparse lattice of geometry, built by user of pool while holding mutex. It is not changed afterwards.
+            std::unique_ptr<SparseLattice> lattice;
+            std::mutex mutex;
+        };
+
+        ///
+        /// Returns entry of raster geometry, creating its corrector on first use.
+        /// @throws std::runtime_error if raster is not in geostationary projection
+        std::shared_ptr<Entry> get(GDALDataset *raster);
+
+        size_t size() const;
+
+    private:
+        mutable std::mutex entriesMutex;
+        std::map<std::string, std::shared_ptr<Entry>> entries;
+    };
+}
@@ -0,0 +1,330 @@
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include "batched_solver.h"
+
+using namespace std;
+
+namespace ksg
+{
+    constexpr int LANES = PARALLAX_BATCH_LANES;
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define KSG_BATCH_TARGETS __attribute__((target_clones("avx512f", "avx2", "default")))
+#define KSG_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define KSG_BATCH_TARGETS
+#define KSG_ALWAYS_INLINE inline
+#endif
+
+    // Every arithmetic operation on those types is performed on all lanes at once.
+    // Depending on target compiler lowers them to single AVX-512, two AVX2 or four SSE2 instructions.
+    typedef double VDouble __attribute__((vector_size(LANES * sizeof(double))));
+    typedef long long VMask __attribute__((vector_size(LANES * sizeof(long long))));
+
+    KSG_ALWAYS_INLINE VDouble load(const double *values)
+    {
+        VDouble ret;
+        memcpy(&ret, values, sizeof(ret));
+        return ret;
+    }
+
+    KSG_ALWAYS_INLINE void store(double *values, VDouble v)
+    {
+        memcpy(values, &v, sizeof(v));
+    }
+
+    KSG_ALWAYS_INLINE VDouble broadcast(double value)
+    {
+        return VDouble{} + value;
+    }
+
+    KSG_ALWAYS_INLINE VDouble vsqrt(VDouble v)
+    {
+        VDouble ret;
+        for (int i = 0; i < LANES; i++)
+            ret[i] = __builtin_sqrt(v[i]);
+        return ret;
+    }
+
+    KSG_ALWAYS_INLINE bool any(VMask mask)
+    {
+        long long ret = 0;
+        for (int i = 0; i < LANES; i++)
+            ret |= mask[i];
+        return ret != 0;
+    }
+
+    ///
+    /// Branch free sine and cosine of all lanes.
+    /// Argument is reduced to [-pi/4, pi/4] and both functions are evaluated with Taylor series.
+    KSG_ALWAYS_INLINE void vsincos(VDouble x, VDouble &s, VDouble &c)
+    {
+        constexpr double PIO2_HI = 1.57079632673412561417e+00;
+        constexpr double PIO2_LO = 6.07710050650619224932e-11;
+        // Adding and subtracting 1.5 * 2^52 rounds to nearest integer
+        constexpr double ROUNDING = 6755399441055744.0;
+
+        VDouble k = (x * M_2_PI + ROUNDING) - ROUNDING;
+        VDouble r = (x - k * PIO2_HI) - k * PIO2_LO;
+        VDouble r2 = r * r;
+
+        VDouble ps = r + r * r2 * (-1.0 / 6 + r2 * (1.0 / 120 + r2 * (-1.0 / 5040 + r2 * (1.0 / 362880 + r2 * (-1.0 / 39916800 +
+                     r2 * (1.0 / 6227020800 + r2 * (-1.0 / 1307674368000 + r2 * (1.0 / 355687428096000))))))));
+        VDouble pc = 1 + r2 * (-1.0 / 2 + r2 * (1.0 / 24 + r2 * (-1.0 / 720 + r2 * (1.0 / 40320 + r2 * (-1.0 / 3628800 +
+                     r2 * (1.0 / 479001600 + r2 * (-1.0 / 87178291200 + r2 * (1.0 / 20922789888000 + r2 * (-1.0 / 6402373705728000)))))))));
+
+        VMask quadrant = __builtin_convertvector(k, VMask);
+        VMask swap = (quadrant & 1) != 0;
+        VDouble sq = swap ? pc : ps;
+        VDouble cq = swap ? ps : pc;
+        s = ((quadrant & 2) != 0) ? -sq : sq;
+        c = (((quadrant + 1) & 2) != 0) ? -cq : cq;
+    }
+
+    ///
+    /// Object height and trigonometric functions of satellite view angles for all lanes.
+    struct BatchView
+    {
+        VDouble h, cos_phi_s, sin_phi_s, cos_lambda_s, sin_lambda_s;
+    };
+
+    ///
+    /// Evaluates target function (and optionally its Jacobian) of ParallaxProblem for all lanes.
+    /// Jacobian is stored row-major, columns ordered as phi_e, lambda_e, q.
+    template <bool SQUARED, bool JACOBIAN>
+    KSG_ALWAYS_INLINE void batchTargetFunction(
+        const BatchView &v, double eSqr, double l,
+        VDouble phi, VDouble lambda, VDouble q,
+        VDouble f[3], VDouble j[9])
+    {
+        VDouble sin_phi, cos_phi, sin_lambda, cos_lambda;
+        vsincos(phi, sin_phi, cos_phi);
+        vsincos(lambda, sin_lambda, cos_lambda);
+
+        VDouble w = 1 - eSqr * sin_phi * sin_phi;
+        VDouble sqrt_w = vsqrt(w);
+        VDouble n = 1 / sqrt_w;
+
+        f[0] = (n + v.h) * cos_phi * cos_lambda + v.cos_phi_s * v.cos_lambda_s * q - l;
+        f[1] = (n + v.h) * cos_phi * sin_lambda - v.cos_phi_s * v.sin_lambda_s * q;
+        f[2] = (n * (1 - eSqr) + v.h) * sin_phi - v.sin_phi_s * q;
+
+        if (JACOBIAN)
+        {
+            VDouble dndphi = eSqr * sin_phi * cos_phi / (w * sqrt_w);
+            VDouble tmp = dndphi * cos_phi - (n + v.h) * sin_phi;
+
+            j[0] = cos_lambda * tmp;
+            j[1] = -(n + v.h) * cos_phi * sin_lambda;
+            j[2] = v.cos_phi_s * v.cos_lambda_s;
+            j[3] = sin_lambda * tmp;
+            j[4] = (n + v.h) * cos_phi * cos_lambda;
+            j[5] = -v.cos_phi_s * v.sin_lambda_s;
+            j[6] = (1 - eSqr) * dndphi * sin_phi + (n * (1 - eSqr) + v.h) * cos_phi;
+            j[7] = broadcast(0);
+            j[8] = -v.sin_phi_s;
+
+            if (SQUARED)
+            {
+                for (int fun = 0; fun < 3; fun++)
+                    for (int var = 0; var < 3; var++)
+                        j[fun * 3 + var] *= 2 * f[fun];
+            }
+        }
+
+        if (SQUARED)
+        {
+            for (int fun = 0; fun < 3; fun++)
+                f[fun] *= f[fun];
+        }
+    }
+
+    ///
+    /// Calculates J^T*J and J^T*f used by Levenberg-Marquard method.
+    KSG_ALWAYS_INLINE void batchNormalEquations(const VDouble j[9], const VDouble f[3], VDouble a[9], VDouble g[3])
+    {
+        for (int r = 0; r < 3; r++)
+        {
+            for (int c = 0; c < 3; c++)
+                a[r * 3 + c] = j[r] * j[c] + j[3 + r] * j[3 + c] + j[6 + r] * j[6 + c];
+            g[r] = j[r] * f[0] + j[3 + r] * f[1] + j[6 + r] * f[2];
+        }
+    }
+
+    ///
+    /// Solves 3x3 systems m * x = v of all lanes with Cramer's rule.
+    KSG_ALWAYS_INLINE void batchSolve3x3(const VDouble m[9], const VDouble v[3], VDouble x[3])
+    {
+        VDouble c0 = m[4] * m[8] - m[5] * m[7];
+        VDouble c1 = m[5] * m[6] - m[3] * m[8];
+        VDouble c2 = m[3] * m[7] - m[4] * m[6];
+        VDouble invDet = 1 / (m[0] * c0 + m[1] * c1 + m[2] * c2);
+
+        x[0] = (v[0] * c0 + m[1] * (v[2] * m[5] - v[1] * m[8]) + m[2] * (v[1] * m[7] - v[2] * m[4])) * invDet;
+        x[1] = (m[0] * (v[1] * m[8] - v[2] * m[5]) + v[0] * c1 + m[2] * (v[2] * m[3] - v[1] * m[6])) * invDet;
+        x[2] = (m[0] * (v[2] * m[4] - v[1] * m[7]) + m[1] * (v[1] * m[6] - v[2] * m[3]) + v[0] * c2) * invDet;
+    }
+
+    KSG_ALWAYS_INLINE VDouble batchNorm(const VDouble f[3])
+    {
+        return vsqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+    }
+
+    ///
+    /// Counterpart of findTargetFunctionRootByLM and findTargetFunctionRootByNewton executed for all lanes at once.
+    /// Every lane keeps its own damping (or step length) and iterations counter.
+    /// Lanes which are not active anymore are still evaluated, but their results are discarded.
+    template <bool SQUARED, bool LM>
+    KSG_ALWAYS_INLINE void batchSolve(ParallaxBatch &batch, double eSqr, double l, double requiredAccuracy, int iterationsLimit)
+    {
+        double threshold = SQUARED ? requiredAccuracy * requiredAccuracy / 2 : requiredAccuracy;
+
+        BatchView view;
+        view.h = load(batch.h);
+        vsincos(load(batch.phi_s), view.sin_phi_s, view.cos_phi_s);
+        vsincos(load(batch.lambda_s), view.sin_lambda_s, view.cos_lambda_s);
+
+        VDouble phi = load(batch.phi_e), lambda = load(batch.lambda_e), q = load(batch.q);
+
+        VDouble f[3], j[9];
+        batchTargetFunction<SQUARED, true>(view, eSqr, l, phi, lambda, q, f, j);
+        VDouble residualNorm = batchNorm(f);
+
+        VDouble factor = broadcast(1);
+        if (LM)
+        {
+            VDouble hessian[9], grad[3];
+            batchNormalEquations(j, f, hessian, grad);
+            factor = hessian[0];
+            for (int k = 1; k < 9; k++)
+                factor = hessian[k] > factor ? hessian[k] : factor;
+        }
+
+        VMask used;
+        for (int i = 0; i < LANES; i++)
+            used[i] = i < batch.size ? -1 : 0;
+
+        VMask converged = residualNorm <= threshold;
+        VMask active = used & ~converged;
+        VDouble counter = broadcast(0);
+
+        while (any(active))
+        {
+            // Failed step leaves lane in place, so Jacobian is recomputed at the same point as in previous iteration.
+            batchTargetFunction<SQUARED, true>(view, eSqr, l, phi, lambda, q, f, j);
+
+            VDouble step[3];
+            if (LM)
+            {
+                VDouble damped[9], grad[3];
+                batchNormalEquations(j, f, damped, grad);
+                damped[0] += factor;
+                damped[4] += factor;
+                damped[8] += factor;
+                batchSolve3x3(damped, grad, step);
+            }
+            else
+            {
+                batchSolve3x3(j, f, step);
+                for (int k = 0; k < 3; k++)
+                    step[k] *= factor;
+            }
+
+            VDouble nextPhi = phi - step[0], nextLambda = lambda - step[1], nextQ = q - step[2];
+            VDouble nextResidual[3];
+            batchTargetFunction<SQUARED, false>(view, eSqr, l, nextPhi, nextLambda, nextQ, nextResidual, j);
+            VDouble nextNorm = batchNorm(nextResidual);
+
+            VMask succeed = active & (nextNorm < residualNorm);
+
+            VDouble decreased = LM ? factor / 2 : factor * 2;
+            VDouble increased = LM ? factor * 2 : factor / 2;
+            factor = active ? (succeed ? decreased : increased) : factor;
+
+            phi = succeed ? nextPhi : phi;
+            lambda = succeed ? nextLambda : lambda;
+            q = succeed ? nextQ : q;
+            residualNorm = succeed ? nextNorm : residualNorm;
+
+            counter = active ? counter + 1 : counter;
+            VMask limitReached = active & (counter >= iterationsLimit);
+            converged |= succeed & ~limitReached & (nextNorm <= threshold);
+            active &= ~limitReached & ~converged;
+        }
+
+        store(batch.phi_e, phi);
+        store(batch.lambda_e, lambda);
+        store(batch.q, q);
+        for (int i = 0; i < LANES; i++)
+        {
+            batch.converged[i] = used[i] && converged[i];
+            batch.iterations[i] = static_cast<int>(counter[i]);
+        }
+    }
+
+    KSG_BATCH_TARGETS
+    static void solveBatchForTarget(ParallaxBatch &batch, double eSqr, double l, double requiredAccuracy, int iterationsLimit, bool lm, bool squared)
+    {
+        if (lm)
+        {
+            if (squared)
+                batchSolve<true, true>(batch, eSqr, l, requiredAccuracy, iterationsLimit);
+            else
+                batchSolve<false, true>(batch, eSqr, l, requiredAccuracy, iterationsLimit);
+        }
+        else
+        {
+            if (squared)
+                batchSolve<true, false>(batch, eSqr, l, requiredAccuracy, iterationsLimit);
+            else
+                batchSolve<false, false>(batch, eSqr, l, requiredAccuracy, iterationsLimit);
+        }
+    }
+
+    bool isBatchedSolverSupported()
+    {
+#if defined(__GNUC__) && defined(__x86_64__)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") || __builtin_cpu_supports("avx512f");
+#else
+        return false;
+#endif
+    }
+
+    void solveParallaxBatch(
+        ParallaxBatch &batch,
+        double eSqr,
+        double l,
+        double requiredAccuracy,
+        int iterationsLimit,
+        NumericMethod numericMethod,
+        bool useQuadraticForm)
+    {
+        // Unused lanes are filled with copy of first one, so they do not produce invalid floating point values.
+        for (int i = batch.size; i < LANES && batch.size > 0; i++)
+        {
+            batch.h[i] = batch.h[0];
+            batch.phi_s[i] = batch.phi_s[0];
+            batch.lambda_s[i] = batch.lambda_s[0];
+            batch.phi_e[i] = batch.phi_e[0];
+            batch.lambda_e[i] = batch.lambda_e[0];
+            batch.q[i] = batch.q[0];
+        }
+
+        switch (numericMethod)
+        {
+        case NumericMethod::LEVENBERG_MARQUARD:
+            solveBatchForTarget(batch, eSqr, l, requiredAccuracy, iterationsLimit, true, useQuadraticForm);
+            break;
+        case NumericMethod::NETWON:
+            solveBatchForTarget(batch, eSqr, l, requiredAccuracy, iterationsLimit, false, useQuadraticForm);
+            break;
+        default:
+            stringstream str;
+            str << numericMethod;
+            throw std::logic_error("Numeric method not supported by batched solver: " + str.str());
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "correction_utils.h"
+
+namespace ksg
+{
+    /// Number of pixels solved together by batched parallax solver.
+    /// It fills two AVX2 registers or single AVX-512 register with doubles.
+    constexpr int PARALLAX_BATCH_LANES = 8;
+
+    ///
+    /// Parallax problems of up to PARALLAX_BATCH_LANES pixels in structure of arrays layout.
+    /// Lengths are normalised with ellipsoid semi-major axis, angles are expressed in radians.
+    struct ParallaxBatch
+    {
+        /// Object height above surface
+        alignas(64) double h[PARALLAX_BATCH_LANES];
+        /// Satellite vertical view angle
+        alignas(64) double phi_s[PARALLAX_BATCH_LANES];
+        /// Satellite horizontal view angle
+        alignas(64) double lambda_s[PARALLAX_BATCH_LANES];
+
+        /// Start point on input, solution on output
+        alignas(64) double phi_e[PARALLAX_BATCH_LANES];
+        alignas(64) double lambda_e[PARALLAX_BATCH_LANES];
+        alignas(64) double q[PARALLAX_BATCH_LANES];
+
+        /// Set by solver for lanes which satisfied required accuracy within iterations limit
+        bool converged[PARALLAX_BATCH_LANES];
+        /// Set by solver to number of iterations performed in every lane
+        int iterations[PARALLAX_BATCH_LANES];
+
+        /// Number of used lanes
+        int size = 0;
+    };
+
+    ///
+    /// @return true if CPU provides vector extensions (AVX2 or AVX-512) used by batched solver
+    bool isBatchedSolverSupported();
+
+    ///
+    /// Solves all problems in batch at once. Lanes which satisfied required accuracy are masked off,
+    /// while remaining ones continue iterating.
+    /// @param batch problems to solve, updated with solutions
+    /// @param eSqr Ellipsoid flattering coefficient squared
+    /// @param l Satellite distance from center of ellipsoid
+    /// @param requiredAccuracy required accuracy (normalised)
+    /// @param iterationsLimit maximum number of iterations per lane
+    void solveParallaxBatch(
+        ParallaxBatch &batch,
+        double eSqr,
+        double l,
+        double requiredAccuracy,
+        int iterationsLimit,
+        NumericMethod numericMethod,
+        bool useQuadraticForm
+    );
+}
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <gdal_priv.h>
+#include <ogr_spatialref.h>
+#include <boost/program_options.hpp>
+#include "correction.h"
+#include "correction_utils.h"
+#include "parallax_problem.h"
+#include "cloud_simulation.h"
+
+using namespace std;
+using namespace ksg;
+
+static const char *geosProj = "+proj=geos +lon_0=0 +h=35785831 +x_0=0 +y_0=0 +datum=WGS84 +units=m +no_defs";
+
+/// Positions of correction tests, in degrees
+static const vector<pair<double, double>> positions = {
+    {18.4239, 33.9253}, // Cape Town
+    {3.6947, 40.4177},  // Madrit
+    {47.9142, 15.7839}, // Brasília
+    {18.6453, 54.3475}, // Gdańsk
+    {18.9333, 69.6667}  // Tromsø
+};
+
+///
+/// Cloud of correction tests: observed geos and ellipsoid coordinates and parallax problem at its solution.
+struct Case
+{
+    double height;
+    pair<double, double> geos, ellips;
+    /// View angles and solution, normalised with semi-major axis
+    double phi_s, lambda_s, h;
+    TargetFunctionArg solution;
+};
+
+struct Result
+{
+    string name;
+    /// Pixels processed
+    size_t items = 0;
+    double seconds = 0;
+};
+
+boost::program_options::variables_map init(int argc, char **argv)
+{
+    boost::program_options::options_description options("GEOS Height correction benchmarks options");
+    options.add_options()
+    ("help", "Shows help message")
+    ("raster", boost::program_options::value<std::string>()->default_value(BENCHMARK_DATA_DIR "/h_201507251300.tif"), "Height raster corrected by raster benchmark.")
+    ("filter", boost::program_options::value<std::string>()->default_value(""), "Runs only benchmarks whose name contains given text.")
+    ("min-time", boost::program_options::value<double>()->default_value(0.5), "Minimal time of every benchmark [s].")
+    ("format", boost::program_options::value<std::string>()->default_value("text"), "Format of results. Either text or json.")
+    ("output", boost::program_options::value<std::string>(), "Location of results. Standard output if missing.")
+    ("threads", boost::program_options::value<int>()->default_value(0), "Number of worker threads of raster benchmark. 0 means all available cores.");
+
+    auto ret = boost::program_options::variables_map();
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options), ret);
+    boost::program_options::notify(ret);
+
+    if (ret.count("help") >= 1)
+    {
+        std::cout << options << std::endl;
+        exit(1);
+    }
+
+    return ret;
+}
+
+///
+/// Repeats task until minimal time passes.
+/// @param task processes some pixels and returns their number
+Result measure(const string &name, double minTime, const function<size_t()> &task)
+{
+    Result result;
+    result.name = name;
+
+    auto start = chrono::steady_clock::now();
+    do
+    {
+        result.items += task();
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (result.seconds < minTime);
+
+    return result;
+}
+
+vector<Case> prepareCases(GEOSHeightCorrector &corrector, OGRSpatialReference &srs)
+{
+    double a = srs.GetSemiMajor(), b = srs.GetSemiMinor();
+    double eSqr = (a * a - b * b) / (a * a);
+    double centralMeridian = srs.GetProjParm("central_meridian");
+    double satelliteHeight = srs.GetProjParm("satellite_height", 35785831);
+    double l = 1 + satelliteHeight / a;
+
+    vector<Case> cases;
+    for (auto &position : positions)
+        for (double height = 1000; height < 20000; height += 1000)
+        {
+            double lat = position.second * M_PI / 180, lon = position.first * M_PI / 180;
+            auto cloud = calculateCloudPosition(lat, lon, height, a, eSqr, centralMeridian * M_PI / 180);
+
+            Case c;
+            c.height = height;
+            c.geos = calculateGEOSCorrdsFromXYZ(cloud, a, satelliteHeight);
+            c.ellips = corrector.transformToEllipsCoordinates(c.geos);
+
+            // Line of sight from satellite at (l, 0, 0) to cloud
+            double x = cloud(X) / a, y = cloud(Y) / a, z = cloud(Z) / a;
+            double q = sqrt(pow(l - x, 2) + y * y + z * z);
+            c.phi_s = asin(z / q);
+            c.lambda_s = atan2(y, l - x);
+            c.h = height / a;
+            c.solution = createTargetFunctionArg(lat, lon - centralMeridian * M_PI / 180, q);
+            cases.push_back(c);
+        }
+
+    return cases;
+}
+
+int main(int argc, char **argv)
+{
+    auto variablesMap = init(argc, argv);
+    double minTime = variablesMap["min-time"].as<double>();
+    auto filter = variablesMap["filter"].as<std::string>();
+
+    GDALAllRegister();
+
+    OGRSpatialReference srs;
+    srs.importFromProj4(geosProj);
+    GEOSHeightCorrector corrector(srs);
+
+    double a = srs.GetSemiMajor(), b = srs.GetSemiMinor();
+    double eSqr = (a * a - b * b) / (a * a);
+    double l = 1 + srs.GetProjParm("satellite_height", 35785831) / a;
+
+    auto cases = prepareCases(corrector, srs);
+
+    vector<Result> results;
+    auto run = [&](const string &name, const function<size_t()> &task) {
+        if (name.find(filter) == string::npos)
+            return;
+        results.push_back(measure(name, minTime, task));
+        cerr << name << " done" << endl;
+    };
+
+    // Sink of results, so evaluations are not optimised away
+    volatile double sink = 0;
+
+    // Evaluated slightly off the solution, as numeric method does
+    TargetFunctionArg offset = createTargetFunctionArg(1e-5, -1e-5, 1e-4);
+
+    run("parallax_problem/residual", [&]() {
+        double sum = 0;
+        for (auto &c : cases)
+        {
+            ParallaxProblem problem(1, eSqr, c.h, c.phi_s, c.lambda_s, l);
+            auto value = problem.targetFunctionVectorValue(c.solution + offset);
+            sum += value(0) + value(1) + value(2);
+        }
+        sink = sink + sum;
+        return cases.size();
+    });
+
+    run("parallax_problem/jacobian", [&]() {
+        double sum = 0;
+        for (auto &c : cases)
+        {
+            ParallaxProblem problem(1, eSqr, c.h, c.phi_s, c.lambda_s, l);
+            auto jacobian = problem.targetFunctionJacobian(c.solution + offset);
+            for (int r = 0; r < 3; r++)
+                for (int k = 0; k < 3; k++)
+                    sum += jacobian(r, k);
+        }
+        sink = sink + sum;
+        return cases.size();
+    });
+
+    for (auto method : {NumericMethod::NETWON, NumericMethod::LEVENBERG_MARQUARD, NumericMethod::LINE_OF_SIGHT})
+        for (bool squared : {false, true})
+        {
+            // Squared target function does not apply to line of sight method
+            if (squared && method == NumericMethod::LINE_OF_SIGHT)
+                continue;
+
+            ostringstream name;
+            name << "pixel/" << method << (squared ? "/squared" : "");
+            run(name.str(), [&]() {
+                double sum = 0;
+                for (auto &c : cases)
+                    sum += corrector.calculateNewCoordinates(c.geos, c.ellips, c.height, 10, 100, method, squared).first;
+                sink = sink + sum;
+                return cases.size();
+            });
+        }
+
+    run("transform/geos_to_ellipsoid", [&]() {
+        double sum = 0;
+        for (auto &c : cases)
+            sum += corrector.transformToEllipsCoordinates(c.geos).first;
+        sink = sink + sum;
+        return cases.size();
+    });
+
+    run("transform/ellipsoid_to_geos", [&]() {
+        double sum = 0;
+        for (auto &c : cases)
+            sum += corrector.transformToGeosCoordinates(c.ellips).first;
+        sink = sink + sum;
+        return cases.size();
+    });
+
+    auto rasterPath = variablesMap["raster"].as<std::string>();
+    auto raster = (GDALDataset *)GDALOpen(rasterPath.c_str(), GA_ReadOnly);
+    if (raster == nullptr)
+    {
+        cerr << "Cannot open " << rasterPath << ", raster benchmark is skipped." << endl;
+    }
+    else
+    {
+#ifdef _OPENMP
+        if (variablesMap["threads"].as<int>() > 0)
+            omp_set_num_threads(variablesMap["threads"].as<int>());
+#endif
+        OGRSpatialReference rasterSrs;
+        auto wkt = raster->GetProjectionRef();
+        rasterSrs.importFromWkt(&wkt);
+        GEOSHeightCorrector rasterCorrector(rasterSrs);
+
+        auto memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+        auto name = rasterPath.substr(rasterPath.find_last_of('/') + 1);
+        run("raster/" + name.substr(0, name.find_last_of('.')), [&]() {
+            auto output = memDriver->Create("", raster->GetRasterXSize(), raster->GetRasterYSize(), 2, GDT_Float64, nullptr);
+            rasterCorrector.calculateNewCoordinatesForRaster(raster, output, 1, 10, 100, NumericMethod::LEVENBERG_MARQUARD);
+            GDALClose(output);
+            return static_cast<size_t>(raster->GetRasterXSize()) * raster->GetRasterYSize();
+        });
+        GDALClose(raster);
+    }
+
+    ofstream file;
+    if (variablesMap.count("output") > 0)
+        file.open(variablesMap["output"].as<std::string>());
+    ostream &out = file.is_open() ? file : cout;
+
+    bool json = variablesMap["format"].as<std::string>() == "json";
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+
+    if (json)
+        out << "{\n  \"threads\": " << threads << ",\n  \"benchmarks\": [\n";
+    else
+        out << left << setw(40) << "benchmark" << right << setw(16) << "pixels/s" << setw(14) << "ns/pixel" << setw(14) << "pixels" << endl;
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        auto &r = results[i];
+        double perSecond = r.items / r.seconds;
+        double nsPerItem = r.seconds * 1e9 / r.items;
+        if (json)
+            out << "    {\"name\": \"" << r.name << "\", \"pixels\": " << r.items << ", \"seconds\": " << r.seconds
+                << ", \"pixels_per_second\": " << perSecond << ", \"ns_per_pixel\": " << nsPerItem << "}"
+                << (i + 1 < results.size() ? "," : "") << "\n";
+        else
+            out << left << setw(40) << r.name << right << fixed << setprecision(0) << setw(16) << perSecond
+                << setprecision(1) << setw(14) << nsPerItem << setw(14) << r.items << defaultfloat << endl;
+    }
+
+    if (json)
+        out << "  ]\n}\n";
+
+    return 0;
+}
@@ -1,15 +1,24 @@
 #include <ogr_spatialref.h>
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <tuple>
 #include <complex>
 #include <limits>
 #include <functional>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <chrono>
 #include <dlib/geometry/vector.h> 
 #include <dlib/matrix.h> 
 #include "correction.h"
 #include "georeference_utils.h"
+#include "output_encoding.h"
 #include "correction_utils.h"
 #include "geodetic_utils.h"
+#include "batched_solver.h"
+#include "parallax_problem.h"
 
 
 using namespace std;
@@ -17,167 +26,6 @@ using namespace std::placeholders;
 using namespace ksg;
 using namespace dlib;
 
-constexpr int PHI_E = 0;
-constexpr int LAMBDA_E = 1;
-constexpr int Q = 2;
-
-typedef dlib::vector<double, 3> TargetFunctionArg;
-typedef dlib::vector<double, 3> TargetFunctionResult;
-typedef matrix<double, 3, 3> TargetFunctionDerivative;
-typedef matrix<double, 3, 3> TargetFunctionHessian;
-
-
-static inline TargetFunctionArg createTargetFunctionArg(double phi_earth, double lambda_earth, double q)
-{
-    TargetFunctionArg ret;
-    ret(PHI_E) = phi_earth;
-    ret(LAMBDA_E) = lambda_earth;
-    ret(Q) = q;
-    return ret;
-}
-
-
-class ParallaxProblem {
-
-    double a;
-    double eSqr;
-    double h;
-    double phi_s; 
-    double lambda_s; 
-    double l;
-
-public:
-    ///
-    /// @param a Ellipsoid semi-major axis lenght
-    /// @param eSqr Ellipsoid flattering coefficient squared
-    /// @param h Object height above surface
-    /// @param phi_s Satellite vertical view angle in radians
-    /// @param lambda_s Satellite horizontal view angle in radians
-    /// @param l Satellite distance from center of ellipsoid
-    ParallaxProblem(double a, double eSqr, double h, double phi_s, double lambda_s, double l)
-    : a(a), eSqr(eSqr), h(h), phi_s(phi_s), lambda_s(lambda_s), l(l)
-    {}
-
-    inline double targetFunctionScalarValue(const TargetFunctionArg &arg) const {
-        return targetFunctionVectorValue(arg).length();
-    }
-
-    inline TargetFunctionResult targetFunctionVectorValue(const TargetFunctionArg &arg) const
-    {
-        TargetFunctionResult ret;
-        double n = N(arg(PHI_E), a, eSqr);
-        double cos_phi_e = cos(arg(PHI_E));
-        double cos_phi_s = cos(phi_s);
-        ret(0) = (n + h) * cos_phi_e * cos(arg(LAMBDA_E)) + cos_phi_s * cos(lambda_s) * arg(Q) - l;
-        ret(1) = (n + h) * cos_phi_e * sin(arg(LAMBDA_E)) - cos_phi_s * sin(lambda_s) * arg(Q);
-        ret(2) = (n * (1 - eSqr) + h) * sin(arg(PHI_E)) - sin(phi_s) * arg(Q);
-
-        return ret;
-    }
-
-    inline TargetFunctionDerivative targetFunctionJacobian(const TargetFunctionArg &arg) const
-    {
-        TargetFunctionDerivative ret;
-        double n = N(arg(PHI_E), a, eSqr);
-        double dndphi = dNdphi(arg(PHI_E), a, eSqr);
-        double cos_phi_s = cos(phi_s);
-        double cos_phi_e = cos(arg(PHI_E));
-        double sin_phi_e = sin(arg(PHI_E));
-        double sin_lambda_e = sin(arg(LAMBDA_E));
-        double cos_lambda_e = cos(arg(LAMBDA_E));
-
-        ret(0, Q) = cos_phi_s * cos(lambda_s);
-        ret(1, Q) = -cos_phi_s * sin(lambda_s);
-        ret(2, Q) = -sin(phi_s);
-
-        ret(0, LAMBDA_E) = -(n + h) * cos_phi_e * sin_lambda_e;
-        ret(1, LAMBDA_E) = (n + h) * cos_phi_e * cos_lambda_e;
-        ret(2, LAMBDA_E) = 0;
-
-        double tmp = (dndphi * cos_phi_e - (n + h) * sin_phi_e);
-
-        ret(0, PHI_E) = cos_lambda_e * tmp;
-        ret(1, PHI_E) = sin_lambda_e * tmp;
-        ret(2, PHI_E) = (1 - eSqr) * dndphi * sin_phi_e + (n * (1 - eSqr) + h) * cos_phi_e;
-
-        return ret;
-    }
-
-    inline TargetFunctionHessian targetFunctionHessian(const TargetFunctionArg &arg) const {
-        auto jacobi = targetFunctionJacobian(arg);
-        return trans(jacobi)*jacobi;
-    }
-
-    ///
-    /// @param value target function value
-    /// @param accuracy required accuracy
-    /// @return true if provided target function value satisfies required accuracy
-    static inline bool doesSatsifyRequiredAccuracy(const TargetFunctionResult value, double accuracy) {
-        return value.length() <= accuracy;
-    }
-
-};
-
-class ParallaxProblemSquared {
-    ParallaxProblem original;
-
-public:
-    ///
-    /// @param a Ellipsoid semi-major axis lenght
-    /// @param eSqr Ellipsoid flattering coefficient squared
-    /// @param h Object height above surface
-    /// @param phi_s Satellite vertical view angle in radians
-    /// @param lambda_s Satellite horizontal view angle in radians
-    /// @param l Satellite distance from center of ellipsoid
-    ParallaxProblemSquared(double a, double eSqr, double h, double phi_s, double lambda_s, double l)
-    : original(a,eSqr, h, phi_s, lambda_s, l)
-    {}
-
-    inline double targetFunctionScalarValue(const TargetFunctionArg &arg) const {
-        return targetFunctionVectorValue(arg).length();
-    }
-
-    inline TargetFunctionResult targetFunctionVectorValue(const TargetFunctionArg &arg) const
-    {
-        auto ret = original.targetFunctionVectorValue(arg);
-
-        for(auto& elem : ret) {
-            elem = elem * elem;
-        } 
-
-        return ret;
-    }
-
-    inline TargetFunctionDerivative targetFunctionJacobian(const TargetFunctionArg &arg) const
-    {
-        auto value = original.targetFunctionVectorValue(arg);
-        auto deriv = original.targetFunctionJacobian(arg);
-
-        for (int fun = 0; fun < 3; fun++)
-            for (int var = 0; var < 3; var++)
-            {
-                                      //    v Should be var, but does not work
-                deriv(fun, var) = 2 * value(fun) * deriv(fun, var);
-            }
-
-        return deriv;
-    }
-
-    inline TargetFunctionHessian targetFunctionHessian(const TargetFunctionArg &arg) const {
-        auto jacobi = targetFunctionJacobian(arg);
-        return trans(jacobi)*jacobi;
-    }
-
-    ///
-    /// @param value target function value
-    /// @param accuracy required accuracy
-    /// @return true if provided target function value satisfies required accuracy
-    static inline bool doesSatsifyRequiredAccuracy(const TargetFunctionResult value, double accuracy) {
-        return value.length() <= pow(accuracy, 2)/2;
-    }
-};
-
-
 class IterationsLimitException : std::exception
 {
 public:
@@ -188,24 +36,30 @@ public:
 
 
 template<class P>
-static inline TargetFunctionArg findTargetFunctionRootByLM(const TargetFunctionArg &start, const P& problem, double requiredAccuracy, int iterationsLimit)
+static inline TargetFunctionArg findTargetFunctionRootByLM(const TargetFunctionArg &start, const P& problem, double requiredAccuracy, int iterationsLimit, int &counter)
 {
     TargetFunctionArg current = start;
-    auto result = problem.targetFunctionVectorValue(current);
-    auto hessian = problem.targetFunctionHessian(current);
-    int counter = 0;
+    TargetFunctionResult result;
+    TargetFunctionDerivative jacobi;
+    problem.targetFunctionValueAndJacobian(current, result, jacobi);
+    TargetFunctionHessian hessian = trans(jacobi) * jacobi;
+    counter = 0;
     double damping = max(hessian);
-    const auto I = identity_matrix<double, 3>();
     while (!P::doesSatsifyRequiredAccuracy(result, requiredAccuracy))
     {
-        auto jacobi = problem.targetFunctionJacobian(current);
         TargetFunctionArg grad = (trans(jacobi) * result);
-        hessian = problem.targetFunctionHessian(current);
+        hessian = trans(jacobi) * jacobi;
         bool stepSucceed = false;
         do {
-            TargetFunctionArg step = inv(hessian + damping * I) * grad;
-            auto next = current - step;
-            auto nextResult = problem.targetFunctionVectorValue(next);
+            TargetFunctionHessian damped = hessian;
+            for (int i = 0; i < 3; i++)
+                damped(i, i) += damping;
+            TargetFunctionArg step = solveLinearSystem(damped, grad);
+            TargetFunctionArg next = current - step;
+            // Jacobian of accepted point is needed by next iteration, so it is evaluated together with value
+            TargetFunctionResult nextResult;
+            TargetFunctionDerivative nextJacobi;
+            problem.targetFunctionValueAndJacobian(next, nextResult, nextJacobi);
             stepSucceed = nextResult.length() < result.length();
             if(!stepSucceed) {
                 damping *= 2;
@@ -214,6 +68,7 @@ static inline TargetFunctionArg findTargetFunctionRootByLM(const TargetFunctionA
                 damping /= 2;
                 current = next;
                 result = nextResult;
+                jacobi = nextJacobi;
             }
             counter++;
             if (counter >= iterationsLimit)
@@ -229,21 +84,23 @@ static inline TargetFunctionArg findTargetFunctionRootByLM(const TargetFunctionA
 }
 
 template<class P>
-static inline TargetFunctionArg findTargetFunctionRootByNewton(const TargetFunctionArg &start, const P& problem, double requiredAccuracy, int iterationsLimit)
+static inline TargetFunctionArg findTargetFunctionRootByNewton(const TargetFunctionArg &start, const P& problem, double requiredAccuracy, int iterationsLimit, int &counter)
 {
     TargetFunctionArg current = start;
-    auto result = problem.targetFunctionVectorValue(current);
-    int counter = 0;
+    TargetFunctionResult result;
+    TargetFunctionDerivative jacobi;
+    problem.targetFunctionValueAndJacobian(current, result, jacobi);
+    counter = 0;
     double alpha = 1;
     while (!P::doesSatsifyRequiredAccuracy(result, requiredAccuracy))
     {
-        auto jacobi = problem.targetFunctionJacobian(current);
-        auto invJacobi = inv(jacobi);
-        TargetFunctionArg step = invJacobi * result;
+        TargetFunctionArg step = solveLinearSystem(jacobi, result);
         bool stepSucceed = false;
         do {
-            auto next = current - alpha * step;
-            auto nextResult = problem.targetFunctionVectorValue(next);
+            TargetFunctionArg next = current - alpha * step;
+            TargetFunctionResult nextResult;
+            TargetFunctionDerivative nextJacobi;
+            problem.targetFunctionValueAndJacobian(next, nextResult, nextJacobi);
             stepSucceed = nextResult.length() < result.length();
             if(!stepSucceed) {
                 alpha /= 2;
@@ -252,6 +109,7 @@ static inline TargetFunctionArg findTargetFunctionRootByNewton(const TargetFunct
                 alpha *= 2;
                 current = next;
                 result = nextResult;
+                jacobi = nextJacobi;
             }
             counter++;
             if (counter >= iterationsLimit)
@@ -266,25 +124,57 @@ static inline TargetFunctionArg findTargetFunctionRootByNewton(const TargetFunct
     return current;
 }
 
-using parallaxSolver = 
-    std::function<TargetFunctionArg (
-                            const TargetFunctionArg &start,
-                            double a, double eSqr, double h, double phi_s, double lambda_s, double l,
-                            double requiredAccuracy, int iterationsLimit
-    )>;
+///
+/// Safeguarded Newton method on height difference along line of sight. Bracket of solution is narrowed with every
+/// evaluation and step leaving it is replaced with bisection, so method cannot diverge.
+static inline TargetFunctionArg findLineOfSightRoot(const TargetFunctionArg &start, const LineOfSightProblem& problem, double requiredAccuracy, int iterationsLimit, int &counter)
+{
+    counter = 0;
+    double nearest, farthest;
+    if (!problem.bracket(nearest, farthest))
+        throw IterationsLimitException();
 
-template<class P>
-using numericMethod = 
-    std::function<TargetFunctionArg (const TargetFunctionArg &start, const P& problem, double requiredAccuracy, int iterationsLimit)>;
+    double q = std::min(std::max(start(Q), nearest), farthest);
+    double derivative, normal[3];
+    double difference = problem.heightDifference(q, derivative, normal);
 
+    // Height difference is distance from point at object height, so it is compared with accuracy directly
+    while (fabs(difference) > requiredAccuracy)
+    {
+        if (difference > 0)
+            nearest = q;
+        else
+            farthest = q;
 
+        double next = q - difference / derivative;
+        if (!(next > nearest && next < farthest))
+            next = (nearest + farthest) / 2;
+
+        q = next;
+        difference = problem.heightDifference(q, derivative, normal);
+
+        counter++;
+        if (counter >= iterationsLimit)
+        {
+            throw IterationsLimitException();
+        }
+    }
+
+    double phi_e, lambda_e;
+    problem.coordinates(q, normal, phi_e, lambda_e);
+    return createTargetFunctionArg(phi_e, lambda_e, q);
+}
+
+///
+/// Numeric method is selected once per call, problem form at compile time, so solvers are inlined for every combination.
 template<class P>
-static inline numericMethod<P> getNumericMethodImplememntation(NumericMethod method) {
+static inline TargetFunctionArg findTargetFunctionRoot(NumericMethod method, const TargetFunctionArg &start, const P& problem, double requiredAccuracy, int iterationsLimit, int &counter)
+{
     switch(method) {
         case NumericMethod::LEVENBERG_MARQUARD:
-            return findTargetFunctionRootByLM<P>;
+            return findTargetFunctionRootByLM(start, problem, requiredAccuracy, iterationsLimit, counter);
         case NumericMethod::NETWON:
-            return findTargetFunctionRootByNewton<P>;
+            return findTargetFunctionRootByNewton(start, problem, requiredAccuracy, iterationsLimit, counter);
         default:
             stringstream str;
             str << method;
@@ -292,45 +182,97 @@ static inline numericMethod<P> getNumericMethodImplememntation(NumericMethod met
     }
 }
 
+constexpr static inline bool isNoData(double v, double noData)
+{
+    return noData != noData ? (v != v) : (v == noData);
+}
 
-static inline parallaxSolver prepareParallaxSolver(NumericMethod method, bool squared) {
-    if(!squared) {
-        return [=](const TargetFunctionArg &start,
-                    double a, double eSqr, double h, double phi_s, double lambda_s, double l,
-                    double requiredAccuracy, int iterationsLimit) {
-                        ParallaxProblem p{a,eSqr,h,phi_s, lambda_s, l};
-                        auto nm = getNumericMethodImplememntation<ParallaxProblem>(method);
-                        return nm(start,p, requiredAccuracy, iterationsLimit);
-                    };
+///
+/// Writes window of coordinates into both output bands with single RasterIO call.
+/// @param coords interleaved buffer (x, y pairs) of width * height pixels
+static void saveCoordinatesInRaster(GDALDataset *output, int x, int y, int width, int height, double *coords)
+{
+    int bands[] = {1, 2};
+    GSpacing pixelSpace = 2 * sizeof(double);
+
+    if (output->RasterIO(GF_Write, x, y, width, height, coords, width, height, GDT_Float64, 2, bands,
+                         pixelSpace, pixelSpace * width, sizeof(double), nullptr) != CE_None)
+    {
+        cerr << "Error while writing block " << x << ", " << y << " (" << width << "x" << height << ") to output raster." << endl;
     }
-    else {
-        return [=](const TargetFunctionArg &start,
-            double a, double eSqr, double h, double phi_s, double lambda_s, double l,
-            double requiredAccuracy, int iterationsLimit) {
-                ParallaxProblemSquared p{a,eSqr,h,phi_s, lambda_s, l};
-                auto nm = getNumericMethodImplememntation<ParallaxProblemSquared>(method);
-                return nm(start,p, requiredAccuracy, iterationsLimit);
-            };
+}
+
+///
+/// Counterpart of saveCoordinatesInRaster for DISPLACEMENT_INT16 encoding.
+/// @param displacement interleaved buffer (dx, dy pairs) of width * height pixels
+static void saveDisplacementInRaster(GDALDataset *output, int x, int y, int width, int height, int16_t *displacement)
+{
+    int bands[] = {1, 2};
+    GSpacing pixelSpace = 2 * sizeof(int16_t);
+
+    if (output->RasterIO(GF_Write, x, y, width, height, displacement, width, height, GDT_Int16, 2, bands,
+                         pixelSpace, pixelSpace * width, sizeof(int16_t), nullptr) != CE_None)
+    {
+        cerr << "Error while writing block " << x << ", " << y << " (" << width << "x" << height << ") to output raster." << endl;
     }
 }
 
-constexpr static inline bool isNoData(double v, double noData)
+///
+/// Heights for which coordinates of block were solved: height of pixel if it was corrected, height of previous
+/// coordinates if they were kept, no data otherwise.
+/// @param previousHeights heights of previous coordinates, read only for UNCHANGED pixels
+/// @param integer if true, heights are rounded and those out of Int16 range are no data
+static void fillSolvedHeights(size_t count, const PixelStatus *statuses, const double *heights, const double *previousHeights,
+                              bool integer, double *solvedHeights)
 {
-    return noData != noData ? (v != v) : (v == noData);
+    for (size_t i = 0; i < count; i++)
+    {
+        double h = numeric_limits<double>::quiet_NaN();
+        if (statuses[i] == PixelStatus::CONVERGED || statuses[i] == PixelStatus::CACHED || statuses[i] == PixelStatus::INTERPOLATED)
+            h = heights[i];
+        else if (statuses[i] == PixelStatus::UNCHANGED)
+            h = previousHeights[i];
+
+        if (integer)
+            h = fabs(h) <= numeric_limits<int16_t>::max() ? round(h) : ksg::DISPLACEMENT_NO_DATA;
+        solvedHeights[i] = h;
+    }
 }
 
-static void saveCoordinatesInRaster(GDALDataset *output, int x, int y, double geoX, double geoY)
+///
+/// Writes window of solved heights into their band of output.
+static void saveSolvedHeightsInRaster(GDALDataset *output, int band, int x, int y, int width, int height, double *solvedHeights)
 {
-    double coords[] = {geoX, geoY};
-    int bands[] = {1, 2};
+    if (output->GetRasterBand(band)->RasterIO(GF_Write, x, y, width, height, solvedHeights, width, height, GDT_Float64,
+                                              0, 0, nullptr) != CE_None)
+    {
+        cerr << "Error while writing block " << x << ", " << y << " (" << width << "x" << height << ") to output raster." << endl;
+    }
+}
 
-    if (output->RasterIO(GF_Write, x, y, 1, 1, &coords, 1, 1, GDT_Float64, 2, bands,
-                         0, 0, 0, nullptr) != CE_None)
+///
+/// Writes window of diagnostics into its three bands with single RasterIO call.
+/// @param values interleaved buffer (iterations, residual, status triples) of width * height pixels
+static void saveDiagnosticsInRaster(GDALDataset *diagnostics, int x, int y, int width, int height, float *values)
+{
+    int bands[] = {1, 2, 3};
+    GSpacing pixelSpace = 3 * sizeof(float);
+
+    if (diagnostics->RasterIO(GF_Write, x, y, width, height, values, width, height, GDT_Float32, 3, bands,
+                              pixelSpace, pixelSpace * width, sizeof(float), nullptr) != CE_None)
     {
-        cerr << "Error while writing pixel " << x << ", " << y << " to output raster." << endl;
+        cerr << "Error while writing block " << x << ", " << y << " (" << width << "x" << height << ") to diagnostics raster." << endl;
     }
 }
 
+static inline double secondsSince(std::chrono::steady_clock::time_point &start)
+{
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - start).count();
+    start = now;
+    return seconds;
+}
+
 GEOSHeightCorrector::GEOSHeightCorrector(OGRSpatialReference &geosSrs)
     : geosSrs(geosSrs)
 {
@@ -349,6 +291,63 @@ GEOSHeightCorrector::GEOSHeightCorrector(OGRSpatialReference &geosSrs)
 
     transformation = OGRCreateCoordinateTransformation(&geosSrs, &elipsoidSrs);
     reverseTranformation = OGRCreateCoordinateTransformation(&elipsoidSrs, &geosSrs);
+
+    // Sweep axis is not a part of WKT, so it is taken from Proj description.
+    char *proj4 = nullptr;
+    bool sweepX = false;
+    if (geosSrs.exportToProj4(&proj4) == OGRERR_NONE && proj4 != nullptr)
+    {
+        sweepX = strstr(proj4, "+sweep=x") != nullptr;
+    }
+    CPLFree(proj4);
+
+    projection = GeosProjection(a, b, central_m, satelliteHeight, sweepX,
+                                geosSrs.GetProjParm("false_easting"), geosSrs.GetProjParm("false_northing"));
+
+    useNativeProjection = isProjectionConsistentWithProj();
+    if (!useNativeProjection)
+    {
+        cerr << "Analytic GEOS projection does not match PROJ, PROJ transformations will be used." << endl;
+    }
+}
+
+bool GEOSHeightCorrector::isProjectionConsistentWithProj()
+{
+    constexpr int steps = 8;
+    constexpr double angleTolerance = 1e-7;
+    constexpr double distanceTolerance = 1e-2;
+
+    // Grid of points covering view disc
+    double discRadius = 0.99 * satelliteHeight * asin(a / (a + satelliteHeight));
+    double falseEasting = geosSrs.GetProjParm("false_easting");
+    double falseNorthing = geosSrs.GetProjParm("false_northing");
+
+    for (int i = -steps; i <= steps; i++)
+        for (int j = -steps; j <= steps; j++)
+        {
+            double x = falseEasting + discRadius * i / steps;
+            double y = falseNorthing + discRadius * j / steps;
+
+            double lon = x, lat = y;
+            if (!transformation->Transform(1, &lon, &lat))
+                continue;
+
+            double nativeLon, nativeLat;
+            if (!projection.inverse(x, y, nativeLon, nativeLat) ||
+                fabs(remainder(nativeLon - lon, 360.0)) > angleTolerance || fabs(nativeLat - lat) > angleTolerance)
+                return false;
+
+            double geosX = lon, geosY = lat;
+            if (!reverseTranformation->Transform(1, &geosX, &geosY))
+                continue;
+
+            double nativeX, nativeY;
+            if (!projection.forward(lon, lat, nativeX, nativeY) ||
+                fabs(nativeX - geosX) > distanceTolerance || fabs(nativeY - geosY) > distanceTolerance)
+                return false;
+        }
+
+    return true;
 }
 
 GEOSHeightCorrector::~GEOSHeightCorrector()
@@ -357,29 +356,26 @@ GEOSHeightCorrector::~GEOSHeightCorrector()
     OGRCoordinateTransformation::DestroyCT(reverseTranformation);
 }
 
-std::pair<double, double> GEOSHeightCorrector::calculateNewCoordinates(
+GEOSHeightCorrector::PixelProblem GEOSHeightCorrector::preparePixelProblem(
     std::pair<double, double> geoCoords,
     std::pair<double, double> elipsCoords,
     double objectHeight,
-    double requiredAccuracy,
-    int iterationsLimit,
-    ksg::NumericMethod numericMethod,
-    bool useQuadraticForm
-)
+    ksg::InitialGuess initialGuess
+) const
 {
     elipsCoords.first -= central_m;
 
     elipsCoords.first *= M_PI / 180;
     elipsCoords.second *= M_PI / 180;
 
-    geoCoords.first /= satelliteHeight;
-    geoCoords.second /= satelliteHeight;
+    double phi_s, lambda_s;
+    projection.viewAngles(geoCoords.first, geoCoords.second, lambda_s, phi_s);
 
     double distanceFormSatellite;
 
-    if(geoCoords.second > numeric_limits<double>::epsilon()) {
+    if(phi_s > numeric_limits<double>::epsilon()) {
         double z = N(elipsCoords.second, a, eSqr) * (1 - eSqr) * sin(elipsCoords.second);
-        distanceFormSatellite = z / sin(geoCoords.second);
+        distanceFormSatellite = z / sin(phi_s);
     } else {
         distanceFormSatellite = satelliteHeight;
     }
@@ -388,24 +384,352 @@ std::pair<double, double> GEOSHeightCorrector::calculateNewCoordinates(
     double q = distanceFormSatellite - 2*objectHeight;
     q /= a;
 
-    auto startCoords = createTargetFunctionArg(elipsCoords.second, elipsCoords.first, q);
+    PixelProblem problem;
+    problem.h = objectHeight / a;
+    problem.phi_s = phi_s;
+    problem.lambda_s = lambda_s;
+    problem.phi_e = elipsCoords.second;
+    problem.lambda_e = elipsCoords.first;
+    problem.q = q;
 
-    try
-    {
-        auto solver = prepareParallaxSolver(numericMethod, useQuadraticForm);
-        auto finalCoords = solver(startCoords, 1, eSqr, objectHeight / a, geoCoords.second, geoCoords.first, 1 + satelliteHeight / a, requiredAccuracy / a, iterationsLimit);
-        double newX = finalCoords(LAMBDA_E), newY = finalCoords(PHI_E);
-        newX *= 180 / M_PI;
-        newY *= 180 / M_PI;
+    if (initialGuess == InitialGuess::INFLATED_ELLIPSOID)
+        intersectInflatedEllipsoid(problem);
 
-        newX += central_m;
+    return problem;
+}
 
-        return std::make_pair(newX, newY);
+bool GEOSHeightCorrector::intersectInflatedEllipsoid(PixelProblem &problem) const
+{
+    // Line of sight is parametrised by distance from satellite (q), same as in parallax problem.
+    double l = 1 + satelliteHeight / a;
+    double dx = -cos(problem.phi_s) * cos(problem.lambda_s);
+    double dy = cos(problem.phi_s) * sin(problem.lambda_s);
+    double dz = sin(problem.phi_s);
+
+    // Semi-axes of ellipsoid inflated by object height
+    double semiMajor = 1 + problem.h;
+    double semiMinor = sqrt(1 - eSqr) + problem.h;
+    double axesRatioSqr = pow(semiMajor / semiMinor, 2);
+
+    // (l + q*dx)^2 + (q*dy)^2 + (q*dz)^2 * axesRatioSqr = semiMajor^2
+    double qa = dx * dx + dy * dy + dz * dz * axesRatioSqr;
+    double qb = l * dx;
+    double qc = l * l - semiMajor * semiMajor;
+    double discriminant = qb * qb - qa * qc;
+
+    if (discriminant < 0)
+        return false;
+
+    // Nearer intersection is the visible one
+    double q = (-qb - sqrt(discriminant)) / qa;
+
+    double x = l + q * dx, y = q * dy, z = q * dz;
+
+    problem.q = q;
+    problem.lambda_e = atan2(y, x);
+    // Normal of inflated ellipsoid approximates geodetic latitude of intersection
+    problem.phi_e = atan2(z * axesRatioSqr, hypot(x, y));
+    return true;
+}
+
+std::pair<double, double> GEOSHeightCorrector::solutionToEllipsCoordinates(double phi_e, double lambda_e) const
+{
+    double newX = lambda_e, newY = phi_e;
+    newX *= 180 / M_PI;
+    newY *= 180 / M_PI;
+
+    // Solvers may end on any branch of longitude, depending on their start point
+    newX = ksg::wrapLongitude(newX + central_m);
+
+    return std::make_pair(newX, newY);
+}
+
+double GEOSHeightCorrector::residual(const PixelProblem &problem) const
+{
+    ParallaxProblem parallaxProblem(1, eSqr, problem.h, problem.phi_s, problem.lambda_s, 1 + satelliteHeight / a);
+    return parallaxProblem.targetFunctionScalarValue(createTargetFunctionArg(problem.phi_e, problem.lambda_e, problem.q)) * a;
+}
+
+bool GEOSHeightCorrector::solvePixelProblem(
+    PixelProblem &problem,
+    double requiredAccuracy,
+    int iterationsLimit,
+    ksg::NumericMethod numericMethod,
+    bool useQuadraticForm,
+    int &iterations
+) const
+{
+    auto startCoords = createTargetFunctionArg(problem.phi_e, problem.lambda_e, problem.q);
+
+    iterations = 0;
+
+    try
+    {
+        double l = 1 + satelliteHeight / a;
+        TargetFunctionArg finalCoords;
+        if (numericMethod == NumericMethod::LINE_OF_SIGHT)
+            finalCoords = findLineOfSightRoot(startCoords, LineOfSightProblem(eSqr, problem.h, problem.phi_s, problem.lambda_s, l), requiredAccuracy / a, iterationsLimit, iterations);
+        else if (useQuadraticForm)
+            finalCoords = findTargetFunctionRoot(numericMethod, startCoords, ParallaxProblemSquared(1, eSqr, problem.h, problem.phi_s, problem.lambda_s, l), requiredAccuracy / a, iterationsLimit, iterations);
+        else
+            finalCoords = findTargetFunctionRoot(numericMethod, startCoords, ParallaxProblem(1, eSqr, problem.h, problem.phi_s, problem.lambda_s, l), requiredAccuracy / a, iterationsLimit, iterations);
+        problem.phi_e = finalCoords(PHI_E);
+        problem.lambda_e = finalCoords(LAMBDA_E);
+        problem.q = finalCoords(Q);
+        return true;
     }
     catch (IterationsLimitException &ex)
     {
-        cerr << "Iterations limit for geos " << geoCoords.first << "," << geoCoords.second << " exceeded" << endl;
+        return false;
+    }
+}
+
+void GEOSHeightCorrector::solvePixelProblemsBatched(
+    size_t count,
+    PixelProblem *problems,
+    bool *converged,
+    int *iterations,
+    double requiredAccuracy,
+    int iterationsLimit,
+    ksg::NumericMethod numericMethod,
+    bool useQuadraticForm
+) const
+{
+    // Line of sight method branches between Newton steps and bisection, so lanes would not advance together
+    if (numericMethod == NumericMethod::LINE_OF_SIGHT)
+    {
+        for (size_t i = 0; i < count; i++)
+            converged[i] = solvePixelProblem(problems[i], requiredAccuracy, iterationsLimit, numericMethod, useQuadraticForm, iterations[i]);
+        return;
+    }
+
+    for (size_t first = 0; first < count; first += PARALLAX_BATCH_LANES)
+    {
+        ParallaxBatch batch;
+        batch.size = static_cast<int>(std::min<size_t>(PARALLAX_BATCH_LANES, count - first));
+
+        for (int lane = 0; lane < batch.size; lane++)
+        {
+            auto &problem = problems[first + lane];
+            batch.h[lane] = problem.h;
+            batch.phi_s[lane] = problem.phi_s;
+            batch.lambda_s[lane] = problem.lambda_s;
+            batch.phi_e[lane] = problem.phi_e;
+            batch.lambda_e[lane] = problem.lambda_e;
+            batch.q[lane] = problem.q;
+        }
+
+        solveParallaxBatch(batch, eSqr, 1 + satelliteHeight / a, requiredAccuracy / a, iterationsLimit, numericMethod, useQuadraticForm);
+
+        for (int lane = 0; lane < batch.size; lane++)
+        {
+            auto &problem = problems[first + lane];
+            problem.phi_e = batch.phi_e[lane];
+            problem.lambda_e = batch.lambda_e[lane];
+            problem.q = batch.q[lane];
+            converged[first + lane] = batch.converged[lane];
+            iterations[first + lane] = batch.iterations[lane];
+        }
+    }
+}
+
+std::pair<double, double> GEOSHeightCorrector::calculateNewCoordinates(
+    std::pair<double, double> geoCoords,
+    std::pair<double, double> elipsCoords,
+    double objectHeight,
+    double requiredAccuracy,
+    int iterationsLimit,
+    ksg::NumericMethod numericMethod,
+    bool useQuadraticForm,
+    ksg::InitialGuess initialGuess,
+    int *iterations,
+    double *residual
+)
+{
+    auto problem = preparePixelProblem(geoCoords, elipsCoords, objectHeight, initialGuess);
+
+    int counter = 0;
+    bool converged = solvePixelProblem(problem, requiredAccuracy, iterationsLimit, numericMethod, useQuadraticForm, counter);
+
+    if (iterations != nullptr)
+        *iterations = counter;
+
+    if (residual != nullptr)
+        *residual = converged ? this->residual(problem) : numeric_limits<double>::quiet_NaN();
+
+    if (!converged)
         return std::make_pair(numeric_limits<double>::quiet_NaN(), numeric_limits<double>::quiet_NaN());
+
+    return solutionToEllipsCoordinates(problem.phi_e, problem.lambda_e);
+}
+
+void GEOSHeightCorrector::calculateNewCoordinatesBatched(
+    size_t count,
+    const std::pair<double, double> *geoCoords,
+    const std::pair<double, double> *elipsCoords,
+    const double *objectHeights,
+    std::pair<double, double> *results,
+    double requiredAccuracy,
+    int iterationsLimit,
+    ksg::NumericMethod numericMethod,
+    bool useQuadraticForm,
+    ksg::InitialGuess initialGuess,
+    int *iterations,
+    double *residuals
+)
+{
+    std::vector<PixelProblem> problems(count);
+    std::vector<int> counters(count);
+    std::unique_ptr<bool[]> converged(new bool[count]);
+
+    for (size_t i = 0; i < count; i++)
+        problems[i] = preparePixelProblem(geoCoords[i], elipsCoords[i], objectHeights[i], initialGuess);
+
+    solvePixelProblemsBatched(count, problems.data(), converged.get(), counters.data(), requiredAccuracy, iterationsLimit, numericMethod, useQuadraticForm);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (iterations != nullptr)
+            iterations[i] = counters[i];
+
+        if (residuals != nullptr)
+            residuals[i] = converged[i] ? residual(problems[i]) : numeric_limits<double>::quiet_NaN();
+
+        if (converged[i])
+            results[i] = solutionToEllipsCoordinates(problems[i].phi_e, problems[i].lambda_e);
+        else
+            results[i] = std::make_pair(numeric_limits<double>::quiet_NaN(), numeric_limits<double>::quiet_NaN());
+    }
+}
+
+void GEOSHeightCorrector::calculateNewCoordinatesWarmStarted(
+    int width,
+    int height,
+    const std::pair<double, double> *geoCoords,
+    const std::pair<double, double> *elipsCoords,
+    const double *objectHeights,
+    std::pair<double, double> *results,
+    double requiredAccuracy,
+    int iterationsLimit,
+    ksg::NumericMethod numericMethod,
+    bool useQuadraticForm,
+    ksg::InitialGuess initialGuess,
+    int *iterations,
+    double *residuals
+)
+{
+    size_t count = static_cast<size_t>(width) * height;
+    bool useBatchedSolver = isBatchedSolverSupported();
+
+    // Cold start and solution of every object, solved objects are marked
+    std::vector<PixelProblem> coldStarts(count), solutions(count);
+    std::vector<char> solved(count, 0);
+    std::vector<int> counters(count, 0);
+
+    auto isValid = [&](size_t i) {
+        return !isnan(objectHeights[i]) && !isnan(elipsCoords[i].first) && !isnan(elipsCoords[i].second);
+    };
+
+    // Start point is neighbour solution moved by difference of initial guesses of both objects,
+    // which accounts for pixel step and height difference.
+    auto warmStart = [&](size_t i, size_t neighbour) {
+        PixelProblem problem = coldStarts[i];
+        problem.phi_e += solutions[neighbour].phi_e - coldStarts[neighbour].phi_e;
+        problem.lambda_e += solutions[neighbour].lambda_e - coldStarts[neighbour].lambda_e;
+        problem.q += solutions[neighbour].q - coldStarts[neighbour].q;
+        return problem;
+    };
+
+    auto solveFromColdStart = [&](size_t i) {
+        int counter = 0;
+        solutions[i] = coldStarts[i];
+        solved[i] = solvePixelProblem(solutions[i], requiredAccuracy, iterationsLimit, numericMethod, useQuadraticForm, counter);
+        counters[i] += counter;
+    };
+
+    std::vector<size_t> rowBatch;
+    std::vector<PixelProblem> rowProblems;
+    std::vector<int> rowCounters;
+    std::unique_ptr<bool[]> rowConverged(new bool[width]);
+
+    for (int y = 0; y < height; y++)
+    {
+        size_t row = static_cast<size_t>(y) * width;
+
+        for (int x = 0; x < width; x++)
+            if (isValid(row + x))
+                coldStarts[row + x] = preparePixelProblem(geoCoords[row + x], elipsCoords[row + x], objectHeights[row + x], initialGuess);
+
+        // Objects below solved ones do not depend on each other, so they are solved together.
+        rowBatch.clear();
+        rowProblems.clear();
+        if (y > 0)
+        {
+            for (int x = 0; x < width; x++)
+                if (isValid(row + x) && solved[row - width + x])
+                {
+                    rowBatch.push_back(row + x);
+                    rowProblems.push_back(warmStart(row + x, row - width + x));
+                }
+        }
+
+        rowCounters.assign(rowBatch.size(), 0);
+        if (useBatchedSolver)
+        {
+            solvePixelProblemsBatched(rowBatch.size(), rowProblems.data(), rowConverged.get(), rowCounters.data(),
+                                      requiredAccuracy, iterationsLimit, numericMethod, useQuadraticForm);
+        }
+        else
+        {
+            for (size_t b = 0; b < rowBatch.size(); b++)
+                rowConverged[b] = solvePixelProblem(rowProblems[b], requiredAccuracy, iterationsLimit, numericMethod, useQuadraticForm, rowCounters[b]);
+        }
+
+        for (size_t b = 0; b < rowBatch.size(); b++)
+        {
+            size_t i = rowBatch[b];
+            counters[i] = rowCounters[b];
+            solutions[i] = rowProblems[b];
+            solved[i] = rowConverged[b];
+            if (!solved[i])
+                solveFromColdStart(i);
+        }
+
+        // Remaining objects follow their left neighbour
+        for (int x = 0; x < width; x++)
+        {
+            size_t i = row + x;
+            if (!isValid(i) || (y > 0 && solved[i - width]))
+                continue;
+
+            if (x > 0 && solved[i - 1])
+            {
+                int counter = 0;
+                solutions[i] = warmStart(i, i - 1);
+                solved[i] = solvePixelProblem(solutions[i], requiredAccuracy, iterationsLimit, numericMethod, useQuadraticForm, counter);
+                counters[i] = counter;
+                if (!solved[i])
+                    solveFromColdStart(i);
+            }
+            else
+            {
+                solveFromColdStart(i);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (iterations != nullptr)
+            iterations[i] = counters[i];
+
+        if (residuals != nullptr)
+            residuals[i] = solved[i] ? residual(solutions[i]) : numeric_limits<double>::quiet_NaN();
+
+        if (solved[i])
+            results[i] = solutionToEllipsCoordinates(solutions[i].phi_e, solutions[i].lambda_e);
+        else
+            results[i] = std::make_pair(numeric_limits<double>::quiet_NaN(), numeric_limits<double>::quiet_NaN());
     }
 }
 
@@ -413,11 +737,11 @@ std::pair<double,double> GEOSHeightCorrector::transformToEllipsCoordinates(
     std::pair<double,double> geoCoords
 ) {
     auto elipsCoords = geoCoords;
-    if (!transformation->Transform(1, &elipsCoords.first, &elipsCoords.second))
-    {
-        cerr << "Failed to transform " << geoCoords.first << ", " << geoCoords.second << " from geos to elipsoid coords.\n";
+    bool transformed = useNativeProjection
+        ? projection.inverse(geoCoords.first, geoCoords.second, elipsCoords.first, elipsCoords.second)
+        : transformation->Transform(1, &elipsCoords.first, &elipsCoords.second);
+    if (!transformed)
         return std::make_pair(numeric_limits<double>::quiet_NaN(), numeric_limits<double>::quiet_NaN());
-    }
 
     // if(!elipsoidSrs.EPSGTreatsAsLatLong()) {
     //     swap(elipsCoords.first, elipsCoords.second);
@@ -433,70 +757,835 @@ std::pair<double,double> GEOSHeightCorrector::transformToGeosCoordinates(
     //     swap(elipsCoords.first, elipsCoords.second);
     // }
     auto geoCoords = elipsCoords;
-    if (!reverseTranformation->Transform(1, &geoCoords.first, &geoCoords.second))
-    {
-        cerr << "Failed to transform " << elipsCoords.first << ", " << elipsCoords.second << " from elipsoid to geos coords.\n";
+    bool transformed = useNativeProjection
+        ? projection.forward(elipsCoords.first, elipsCoords.second, geoCoords.first, geoCoords.second)
+        : reverseTranformation->Transform(1, &geoCoords.first, &geoCoords.second);
+    if (!transformed)
         return std::make_pair(numeric_limits<double>::quiet_NaN(), numeric_limits<double>::quiet_NaN());
-    }
 
     return geoCoords;
 }
 
 
+bool GEOSHeightCorrector::ellipsToGeos(std::pair<double, double> &coords, OGRCoordinateTransformation *reverseTransformation) const
+{
+    if (useNativeProjection)
+        return projection.forward(coords.first, coords.second, coords.first, coords.second);
+
+    return reverseTransformation->Transform(1, &coords.first, &coords.second);
+}
+
+bool GEOSHeightCorrector::observedGeosCoordinates(
+    double phi_e,
+    double lambda_e,
+    double objectHeight,
+    OGRCoordinateTransformation *reverseTransformation,
+    std::pair<double, double> &coords) const
+{
+    // Object position, normalised with semi-major axis like parallax problem
+    double h = objectHeight / a;
+    double n = N(phi_e, 1, eSqr);
+    double x = (n + h) * cos(phi_e) * cos(lambda_e);
+    double y = (n + h) * cos(phi_e) * sin(lambda_e);
+    double z = (n * (1 - eSqr) + h) * sin(phi_e);
+
+    if (useNativeProjection)
+    {
+        projection.forwardPoint(x, y, z, coords.first, coords.second);
+        return true;
+    }
+
+    // Object is observed where its line of sight meets ellipsoid surface
+    double l = 1 + satelliteHeight / a;
+    PixelProblem problem;
+    problem.h = 0;
+    problem.lambda_s = atan(y / (l - x));
+    problem.phi_s = atan(z / hypot(l - x, y));
+    if (!intersectInflatedEllipsoid(problem))
+        return false;
+
+    coords = solutionToEllipsCoordinates(problem.phi_e, problem.lambda_e);
+    return reverseTransformation->Transform(1, &coords.first, &coords.second);
+}
+
+bool GEOSHeightCorrector::correctWithCache(
+    DisplacementCache &cache,
+    int x, int y,
+    std::pair<double, double> geoCoords,
+    std::pair<double, double> elipsCoords,
+    double objectHeight,
+    double requiredAccuracy,
+    int iterationsLimit,
+    ksg::NumericMethod numericMethod,
+    bool useQuadraticForm,
+    ksg::InitialGuess initialGuess,
+    OGRCoordinateTransformation *reverseTransformation,
+    std::pair<double, double> &result)
+{
+    // Nodes are solved with quarter of required accuracy and interpolation may add at most half of it.
+    double maxInterpolationError = requiredAccuracy / 2;
+
+    double dx, dy;
+    auto status = cache.lookup(x, y, objectHeight, maxInterpolationError, dx, dy);
+
+    if (status == DisplacementCache::Lookup::UNFILLED)
+    {
+        int interval = cache.findInterval(objectHeight);
+
+        auto displacement = [&](double nodeHeight, double *d) {
+            auto corrected = calculateNewCoordinates(geoCoords, elipsCoords, nodeHeight, requiredAccuracy / 4, iterationsLimit,
+                                                     numericMethod, useQuadraticForm, initialGuess);
+            if (isnan(corrected.first) || isnan(corrected.second) || !ellipsToGeos(corrected, reverseTransformation))
+                corrected = std::make_pair(numeric_limits<double>::quiet_NaN(), numeric_limits<double>::quiet_NaN());
+            d[0] = corrected.first - geoCoords.first;
+            d[1] = corrected.second - geoCoords.second;
+        };
+
+        double lower[2], upper[2], middle[2];
+        double lowerHeight = cache.getNodeHeight(interval), upperHeight = cache.getNodeHeight(interval + 1);
+        displacement(lowerHeight, lower);
+        displacement(upperHeight, upper);
+        displacement((lowerHeight + upperHeight) / 2, middle);
+
+        double error = hypot(middle[0] - (lower[0] + upper[0]) / 2, middle[1] - (lower[1] + upper[1]) / 2);
+        cache.store(x, y, interval, lower, upper, error);
+
+        status = cache.lookup(x, y, objectHeight, maxInterpolationError, dx, dy);
+    }
+
+    if (status != DisplacementCache::Lookup::HIT)
+        return false;
+
+    result = std::make_pair(geoCoords.first + dx, geoCoords.second + dy);
+    return true;
+}
+
 void GEOSHeightCorrector::calculateNewCoordinatesForRaster(
     GDALDataset *input, GDALDataset *output,
     int inputBand, double requiredAccuracy, int iterationsLimit,
     ksg::NumericMethod numericMethod,
-    bool useQuadraticForm
+    bool useQuadraticForm,
+    ksg::InitialGuess initialGuess,
+    bool warmStart,
+    ksg::DisplacementCache *cache,
+    ksg::CorrectionStatistics *statistics,
+    GDALDataset *diagnostics,
+    const ksg::SparseLattice *lattice,
+    const ksg::PreviousCorrection *previous
 )
 {
+    auto runStart = std::chrono::steady_clock::now();
+
     int xSize = input->GetRasterXSize();
     int ySize = input->GetRasterYSize();
 
     Geotransform<> geo;
     input->GetGeoTransform(geo.geotransform);
 
+    auto band = input->GetRasterBand(inputBand);
+
     int hasNoData = 0;
-    double noData = input->GetRasterBand(inputBand)->GetNoDataValue(&hasNoData);
+    double noData = band->GetNoDataValue(&hasNoData);
+
+    int blockXSize, blockYSize;
+    band->GetBlockSize(&blockXSize, &blockYSize);
+
+    // Previous heights are heights of previous coordinates, recorded with them if previous output has them
+    GDALRasterBand *previousBand = nullptr;
+    double previousNoData = numeric_limits<double>::quiet_NaN();
+    if (previous != nullptr)
+    {
+        ksg::checkPreviousCorrection(input, *previous);
+        int previousSolvedHeightsBand = ksg::getSolvedHeightsBand(previous->coordinates);
+        previousBand = previousSolvedHeightsBand > 0 ? previous->coordinates->GetRasterBand(previousSolvedHeightsBand)
+                                                     : previous->heights->GetRasterBand(previous->heightBand);
+
+        int previousHasNoData = 0;
+        double value = previousBand->GetNoDataValue(&previousHasNoData);
+        if (previousHasNoData)
+            previousNoData = value;
+    }
+
+    // Batched solver is used if CPU provides required vector extensions, otherwise pixels are solved one by one.
+    bool useBatchedSolver = isBatchedSolverSupported();
 
-    for (int y = 0; y < ySize; y++)
-        for (int x = 0; x < xSize; x++)
+    int blocksPerRow = (xSize + blockXSize - 1) / blockXSize;
+    int blocksCount = blocksPerRow * ((ySize + blockYSize - 1) / blockYSize);
+
+    // Output created by createCoordinatesRaster records its encoding, other rasters receive absolute coordinates
+    auto encoding = ksg::getOutputEncoding(output);
+    double displacementScale = output->GetRasterBand(1)->GetScale();
+    int solvedHeightsBand = ksg::getSolvedHeightsBand(output);
+    size_t outOfRange = 0;
+
+    // Iterations and residuals are gathered only if someone reads them
+    bool collectDetails = statistics != nullptr || diagnostics != nullptr;
+    ksg::CorrectionStatistics runStatistics;
+
+    #pragma omp parallel
+    {
+        ksg::CorrectionStatistics threadStatistics;
+
+        // OGRCoordinateTransformation is not thread safe, every worker uses its own copy.
+        // It is required only if analytic projection could not be used.
+        OGRCoordinateTransformation *localTransformation = nullptr, *localReverseTransformation = nullptr;
+        if (!useNativeProjection)
         {
-            double h;
-            auto band = inputBand;
-            if (input->RasterIO(GF_Read, x, y, 1, 1, &h, 1, 1, GDT_Float64, 1, &band,
-                                0, 0, 0, nullptr) != CE_None)
+            #pragma omp critical(transformationClone)
             {
-                cerr << "Failed to fetch pixel " << x << "," << y << " from input raster." << endl;
-                saveCoordinatesInRaster(output, x, y, numeric_limits<double>::quiet_NaN(), numeric_limits<double>::quiet_NaN());
-                continue;
+                localTransformation = transformation->Clone();
+                localReverseTransformation = reverseTranformation->Clone();
             }
-            auto geoCoords = geo.calcGeoCoordsFromPix(x + 0.5, y + 0.5);
+        }
+
+        std::vector<double> heights(static_cast<size_t>(blockXSize) * blockYSize);
+        std::vector<double> coords(2 * heights.size());
+        std::vector<int16_t> displacement(encoding == ksg::OutputEncoding::DISPLACEMENT_INT16 ? coords.size() : 0);
+
+        // Per pixel outcome of block
+        std::vector<PixelStatus> statuses(heights.size());
+        std::vector<int> pixelIterations(heights.size());
+        std::vector<double> pixelResiduals(heights.size());
+        std::vector<float> diagnosticsValues(diagnostics != nullptr ? 3 * heights.size() : 0);
 
-            if (hasNoData && isNoData(h, noData))
+        // Heights of previous correction and flags of pixels which keep its coordinates
+        std::vector<double> previousHeights(previous != nullptr ? heights.size() : 0);
+        std::vector<uint8_t> unchanged(previousHeights.size());
+        std::vector<double> solvedHeights(solvedHeightsBand > 0 ? heights.size() : 0);
+
+        // Displacement is encoded outside of critical section, only writing is serialised
+        auto saveBlock = [&](int blockX, int blockY, int width, int height) {
+            if (solvedHeightsBand > 0)
+                fillSolvedHeights(static_cast<size_t>(width) * height, statuses.data(), heights.data(), previousHeights.data(),
+                                  encoding == ksg::OutputEncoding::DISPLACEMENT_INT16, solvedHeights.data());
+
+            if (encoding != ksg::OutputEncoding::DISPLACEMENT_INT16)
             {
-                saveCoordinatesInRaster(output, x, y, geoCoords.first, geoCoords.second);
-                continue;
+                #pragma omp critical(rasterIO)
+                {
+                    saveCoordinatesInRaster(output, blockX, blockY, width, height, coords.data());
+                    if (solvedHeightsBand > 0)
+                        saveSolvedHeightsInRaster(output, solvedHeightsBand, blockX, blockY, width, height, solvedHeights.data());
+                }
+                return;
+            }
+
+            size_t blockOutOfRange = ksg::encodeDisplacement(geo.geotransform, displacementScale, blockX, blockY, width, height,
+                                                             coords.data(), displacement.data());
+            #pragma omp critical(rasterIO)
+            {
+                saveDisplacementInRaster(output, blockX, blockY, width, height, displacement.data());
+                if (solvedHeightsBand > 0)
+                    saveSolvedHeightsInRaster(output, solvedHeightsBand, blockX, blockY, width, height, solvedHeights.data());
+                outOfRange += blockOutOfRange;
+            }
+        };
+
+        auto collectBlock = [&](int blockX, int blockY, int width, int height) {
+            size_t count = static_cast<size_t>(width) * height;
+            for (size_t i = 0; i < count; i++)
+            {
+                threadStatistics.count(statuses[i]);
+                if (statuses[i] == PixelStatus::CONVERGED)
+                {
+                    threadStatistics.iterationsHistogram[pixelIterations[i]]++;
+                    threadStatistics.maxResidual = std::max(threadStatistics.maxResidual, pixelResiduals[i]);
+                }
             }
 
-            auto elipsCoords = geoCoords;
-            if (!transformation->Transform(1, &elipsCoords.first, &elipsCoords.second))
+            if (diagnostics == nullptr)
+                return;
+
+            for (size_t i = 0; i < count; i++)
+            {
+                diagnosticsValues[3 * i] = pixelIterations[i];
+                diagnosticsValues[3 * i + 1] = pixelResiduals[i];
+                diagnosticsValues[3 * i + 2] = static_cast<float>(statuses[i]);
+            }
+            #pragma omp critical(rasterIO)
+            saveDiagnosticsInRaster(diagnostics, blockX, blockY, width, height, diagnosticsValues.data());
+        };
+
+        // Geos and ellipsoid coordinates of pixels centers
+        std::vector<double> geoX(heights.size()), geoY(heights.size()), lons(heights.size()), lats(heights.size());
+
+        // Pixels of block which require solving parallax problem
+        std::vector<size_t> pending;
+        std::vector<std::pair<double, double>> pendingGeoCoords, pendingElipsCoords, pendingResults;
+        std::vector<double> pendingHeights;
+        std::vector<int> pendingIterations;
+        std::vector<double> pendingResiduals;
+
+        // Whole block layout required by warm start
+        std::vector<std::pair<double, double>> gridGeoCoords, gridElipsCoords, gridResults;
+        std::vector<double> gridHeights, gridResiduals;
+        std::vector<int> gridIterations;
+        if (warmStart)
+        {
+            gridGeoCoords.resize(heights.size());
+            gridElipsCoords.resize(heights.size());
+            gridResults.resize(heights.size());
+            gridHeights.resize(heights.size());
+            gridIterations.resize(heights.size());
+            gridResiduals.resize(heights.size());
+        }
+
+        // Pixels near disc edge require much more iterations than those near center,
+        // so blocks are distributed dynamically.
+        #pragma omp for schedule(dynamic)
+        for (int block = 0; block < blocksCount; block++)
+        {
+            int blockX = (block % blocksPerRow) * blockXSize;
+            int blockY = (block / blocksPerRow) * blockYSize;
+            int width = std::min(blockXSize, xSize - blockX);
+            int height = std::min(blockYSize, ySize - blockY);
+            size_t count = static_cast<size_t>(width) * height;
+            auto stageStart = std::chrono::steady_clock::now();
+
+            std::fill(pixelIterations.begin(), pixelIterations.begin() + count, 0);
+            std::fill(pixelResiduals.begin(), pixelResiduals.begin() + count, numeric_limits<double>::quiet_NaN());
+
+            CPLErr readStatus;
+            #pragma omp critical(rasterIO)
+            readStatus = band->RasterIO(GF_Read, blockX, blockY, width, height, heights.data(), width, height, GDT_Float64,
+                                        0, 0, nullptr);
+
+            if (readStatus != CE_None)
             {
-                cerr << "Failed to transform pixel " << x << "," << y << " from geos to elipsoid coords." << endl;
-                saveCoordinatesInRaster(output, x, y, numeric_limits<double>::quiet_NaN(), numeric_limits<double>::quiet_NaN());
+                cerr << "Failed to fetch block " << blockX << "," << blockY << " from input raster." << endl;
+                std::fill(coords.begin(), coords.end(), numeric_limits<double>::quiet_NaN());
+                std::fill(statuses.begin(), statuses.begin() + count, PixelStatus::READ_FAILED);
+                saveBlock(blockX, blockY, width, height);
+                collectBlock(blockX, blockY, width, height);
                 continue;
             }
 
-            auto result = calculateNewCoordinates(geoCoords, elipsCoords, h, requiredAccuracy, iterationsLimit, numericMethod, useQuadraticForm);
+            // Previous coordinates are read straight into output buffer, pixels which changed overwrite them
+            size_t unchangedCount = 0;
+            if (previous != nullptr)
+            {
+                bool previousRead;
+                #pragma omp critical(rasterIO)
+                {
+                    previousRead = previousBand->RasterIO(GF_Read, blockX, blockY, width, height, previousHeights.data(), width, height,
+                                                          GDT_Float64, 0, 0, nullptr) == CE_None;
+                    try
+                    {
+                        if (previousRead)
+                            ksg::readCoordinates(previous->coordinates, blockX, blockY, width, height, coords.data());
+                    }
+                    catch (std::runtime_error &)
+                    {
+                        previousRead = false;
+                    }
+                }
+
+                if (previousRead)
+                    unchangedCount = ksg::findUnchangedPixels(count, heights.data(), previousHeights.data(), coords.data(),
+                                                              hasNoData ? noData : numeric_limits<double>::quiet_NaN(), previousNoData,
+                                                              previous->heightTolerance, unchanged.data());
+                else
+                    cerr << "Failed to fetch block " << blockX << "," << blockY << " from previous correction, it is corrected again." << endl;
+            }
+            threadStatistics.readSeconds += secondsSince(stageStart);
+
+            for (int by = 0; by < height; by++)
+                for (int bx = 0; bx < width; bx++)
+                {
+                    size_t i = static_cast<size_t>(by) * width + bx;
+                    std::tie(geoX[i], geoY[i]) = geo.calcGeoCoordsFromPix(blockX + bx + 0.5, blockY + by + 0.5);
+                }
 
-            if (isnan(result.first) || isnan(result.second))
+            // Block whose every pixel is unchanged or has no height is not transformed at all
+            bool transformRequired = unchangedCount == 0;
+            for (size_t i = 0; i < count && !transformRequired; i++)
+                transformRequired = !unchanged[i] && !isnan(heights[i]) && !(hasNoData && isNoData(heights[i], noData));
+
+            if (transformRequired && useNativeProjection)
+            {
+                projection.inverse(count, geoX.data(), geoY.data(), lons.data(), lats.data());
+            }
+            else if (transformRequired)
             {
-                cerr << "Failed to correct pixel" << x << "," << y << "." << endl;
+                for (size_t i = 0; i < count; i++)
+                {
+                    lons[i] = geoX[i];
+                    lats[i] = geoY[i];
+                    if (!localTransformation->Transform(1, &lons[i], &lats[i]))
+                        lons[i] = lats[i] = numeric_limits<double>::quiet_NaN();
+                }
+            }
+
+            threadStatistics.transformSeconds += secondsSince(stageStart);
+
+            pending.clear();
+            pendingGeoCoords.clear();
+            pendingElipsCoords.clear();
+            pendingHeights.clear();
+
+            for (int by = 0; by < height; by++)
+                for (int bx = 0; bx < width; bx++)
+                {
+                    int x = blockX + bx, y = blockY + by;
+                    size_t i = static_cast<size_t>(by) * width + bx;
+                    double h = heights[i];
+                    double *pixelCoords = &coords[2 * i];
+
+                    auto geoCoords = std::make_pair(geoX[i], geoY[i]);
+
+                    if (unchangedCount > 0 && unchanged[i])
+                    {
+                        statuses[i] = PixelStatus::UNCHANGED;
+                        continue;
+                    }
+
+                    // NaN height is no data even if band has no data value set
+                    if (isnan(h) || (hasNoData && isNoData(h, noData)))
+                    {
+                        pixelCoords[0] = geoCoords.first;
+                        pixelCoords[1] = geoCoords.second;
+                        statuses[i] = PixelStatus::NO_DATA;
+                        continue;
+                    }
+
+                    auto elipsCoords = std::make_pair(lons[i], lats[i]);
+                    if (isnan(elipsCoords.first) || isnan(elipsCoords.second))
+                    {
+                        pixelCoords[0] = pixelCoords[1] = numeric_limits<double>::quiet_NaN();
+                        statuses[i] = PixelStatus::OFF_DISC;
+                        continue;
+                    }
+
+                    std::pair<double, double> displacement;
+                    if (lattice != nullptr && lattice->interpolate(x, y, h, displacement))
+                    {
+                        pixelCoords[0] = geoCoords.first + displacement.first;
+                        pixelCoords[1] = geoCoords.second + displacement.second;
+                        statuses[i] = PixelStatus::INTERPOLATED;
+                        continue;
+                    }
+
+                    std::pair<double, double> cached;
+                    if (cache != nullptr &&
+                        correctWithCache(*cache, x, y, geoCoords, elipsCoords, h, requiredAccuracy, iterationsLimit, numericMethod,
+                                         useQuadraticForm, initialGuess, localReverseTransformation, cached))
+                    {
+                        pixelCoords[0] = cached.first;
+                        pixelCoords[1] = cached.second;
+                        statuses[i] = PixelStatus::CACHED;
+                        continue;
+                    }
+
+                    pending.push_back(i);
+                    pendingGeoCoords.push_back(geoCoords);
+                    pendingElipsCoords.push_back(elipsCoords);
+                    pendingHeights.push_back(h);
+                }
+
+            pendingResults.resize(pending.size());
+            pendingIterations.assign(pending.size(), 0);
+            pendingResiduals.assign(pending.size(), numeric_limits<double>::quiet_NaN());
+            int *iterationsOut = collectDetails ? pendingIterations.data() : nullptr;
+            double *residualsOut = collectDetails ? pendingResiduals.data() : nullptr;
+
+            if (warmStart)
+            {
+                // Pixels which do not require correction are skipped by solver thanks to NaN height
+                std::fill(gridHeights.begin(), gridHeights.begin() + count, numeric_limits<double>::quiet_NaN());
+                for (size_t p = 0; p < pending.size(); p++)
+                {
+                    gridGeoCoords[pending[p]] = pendingGeoCoords[p];
+                    gridElipsCoords[pending[p]] = pendingElipsCoords[p];
+                    gridHeights[pending[p]] = pendingHeights[p];
+                }
+
+                calculateNewCoordinatesWarmStarted(width, height, gridGeoCoords.data(), gridElipsCoords.data(), gridHeights.data(), gridResults.data(),
+                                                   requiredAccuracy, iterationsLimit, numericMethod, useQuadraticForm, initialGuess,
+                                                   collectDetails ? gridIterations.data() : nullptr, collectDetails ? gridResiduals.data() : nullptr);
+
+                for (size_t p = 0; p < pending.size(); p++)
+                {
+                    pendingResults[p] = gridResults[pending[p]];
+                    if (collectDetails)
+                    {
+                        pendingIterations[p] = gridIterations[pending[p]];
+                        pendingResiduals[p] = gridResiduals[pending[p]];
+                    }
+                }
+            }
+            else if (useBatchedSolver)
+            {
+                calculateNewCoordinatesBatched(pending.size(), pendingGeoCoords.data(), pendingElipsCoords.data(), pendingHeights.data(), pendingResults.data(),
+                                               requiredAccuracy, iterationsLimit, numericMethod, useQuadraticForm, initialGuess, iterationsOut, residualsOut);
             }
             else
             {
-                reverseTranformation->Transform(1, &result.first, &result.second);
+                for (size_t p = 0; p < pending.size(); p++)
+                    pendingResults[p] = calculateNewCoordinates(pendingGeoCoords[p], pendingElipsCoords[p], pendingHeights[p], requiredAccuracy, iterationsLimit, numericMethod, useQuadraticForm, initialGuess,
+                                                                iterationsOut != nullptr ? &iterationsOut[p] : nullptr, residualsOut != nullptr ? &residualsOut[p] : nullptr);
+            }
+
+            for (size_t p = 0; p < pending.size(); p++)
+            {
+                auto result = pendingResults[p];
+                size_t i = pending[p];
+
+                if (isnan(result.first) || isnan(result.second))
+                {
+                    statuses[i] = PixelStatus::ITERATIONS_LIMIT;
+                }
+                else if (ellipsToGeos(result, localReverseTransformation))
+                {
+                    statuses[i] = PixelStatus::CONVERGED;
+                }
+                else
+                {
+                    // Solution is not visible from satellite
+                    statuses[i] = PixelStatus::OFF_DISC;
+                    result.first = result.second = numeric_limits<double>::quiet_NaN();
+                }
+                coords[2 * i] = result.first;
+                coords[2 * i + 1] = result.second;
+                pixelIterations[i] = pendingIterations[p];
+                pixelResiduals[i] = pendingResiduals[p];
             }
-            saveCoordinatesInRaster(output, x, y, result.first, result.second);
+            threadStatistics.solveSeconds += secondsSince(stageStart);
+
+            saveBlock(blockX, blockY, width, height);
+            collectBlock(blockX, blockY, width, height);
+            threadStatistics.writeSeconds += secondsSince(stageStart);
+        }
+
+        if (!useNativeProjection)
+        {
+            OGRCoordinateTransformation::DestroyCT(localTransformation);
+            OGRCoordinateTransformation::DestroyCT(localReverseTransformation);
         }
-}
\ No newline at end of file
+
+        #pragma omp critical(statistics)
+        runStatistics += threadStatistics;
+    }
+
+    if (statistics != nullptr)
+    {
+        runStatistics.totalSeconds = secondsSince(runStart);
+        *statistics += runStatistics;
+    }
+
+    if (outOfRange > 0)
+        cerr << outOfRange << " pixels have displacement out of range of " << displacementScale << " m units, they are written as no data." << endl;
+}
+
+void GEOSHeightCorrector::buildLattice(
+    ksg::SparseLattice &lattice,
+    GDALDataset *raster,
+    double requiredAccuracy,
+    int iterationsLimit,
+    ksg::NumericMethod numericMethod,
+    bool useQuadraticForm,
+    ksg::InitialGuess initialGuess
+)
+{
+    Geotransform<> geo;
+    raster->GetGeoTransform(geo.geotransform);
+    lattice.build(0, 0, raster->GetRasterXSize(), raster->GetRasterYSize(), [&](long x, long y, const std::vector<double> &heights,
+                                                                              std::pair<double, double> *displacements) {
+        auto geoCoords = geo.calcGeoCoordsFromPix(x + 0.5, y + 0.5);
+        std::pair<double, double> elipsCoords;
+
+        // PROJ transformations are shared by nodes solved in parallel
+        if (useNativeProjection)
+        {
+            elipsCoords = transformToEllipsCoordinates(geoCoords);
+        }
+        else
+        {
+            #pragma omp critical(latticeTransformation)
+            elipsCoords = transformToEllipsCoordinates(geoCoords);
+        }
+
+        if (isnan(elipsCoords.first) || isnan(elipsCoords.second))
+            return false;
+
+        for (size_t hi = 0; hi < heights.size(); hi++)
+        {
+            auto corrected = calculateNewCoordinates(geoCoords, elipsCoords, heights[hi], requiredAccuracy / 2, iterationsLimit,
+                                                     numericMethod, useQuadraticForm, initialGuess);
+            if (isnan(corrected.first) || isnan(corrected.second))
+                return false;
+
+            bool transformed;
+            if (useNativeProjection)
+            {
+                transformed = ellipsToGeos(corrected, nullptr);
+            }
+            else
+            {
+                #pragma omp critical(latticeTransformation)
+                transformed = ellipsToGeos(corrected, reverseTranformation);
+            }
+
+            if (!transformed)
+                return false;
+            displacements[hi] = std::make_pair(corrected.first - geoCoords.first, corrected.second - geoCoords.second);
+        }
+
+        return true;
+    });
+}
+
+void GEOSHeightCorrector::calculateSourceCoordinatesForRaster(
+    GDALDataset *input,
+    GDALDataset *output,
+    int inputBand,
+    int iterationsLimit,
+    int firstRow,
+    int lastRow,
+    double maxHeight
+)
+{
+    int xSize = input->GetRasterXSize();
+    int ySize = input->GetRasterYSize();
+    if (lastRow < 0 || lastRow > ySize)
+        lastRow = ySize;
+
+    Geotransform<> geo;
+    input->GetGeoTransform(geo.geotransform);
+
+    double inverse[6];
+    if (!GDALInvGeoTransform(geo.geotransform, inverse))
+        throw runtime_error("Geotransform of input raster cannot be inverted");
+
+    auto band = input->GetRasterBand(inputBand);
+
+    int hasNoData = 0;
+    double noData = band->GetNoDataValue(&hasNoData);
+
+    // Object observed in pixel may be displaced anywhere, so whole height field is kept in memory
+    std::vector<double> heights(static_cast<size_t>(xSize) * ySize);
+    if (band->RasterIO(GF_Read, 0, 0, xSize, ySize, heights.data(), xSize, ySize, GDT_Float64, 0, 0, nullptr) != CE_None)
+        throw runtime_error("Cannot read heights from input raster");
+
+    double highest = 0;
+    for (auto &h : heights)
+    {
+        if (isnan(h) || (hasNoData && isNoData(h, noData)) || h < 0)
+            h = 0;
+        highest = std::max(highest, h);
+    }
+    if (maxHeight < 0)
+        maxHeight = highest;
+
+    double pixelSize = std::min(hypot(geo.geotransform[1], geo.geotransform[4]), hypot(geo.geotransform[2], geo.geotransform[5]));
+
+    // Height of pixel containing geos coordinates, surface outside of raster
+    auto heightAt = [&](const std::pair<double, double> &coords) {
+        double px = inverse[0] + coords.first * inverse[1] + coords.second * inverse[2];
+        double py = inverse[3] + coords.first * inverse[4] + coords.second * inverse[5];
+        if (!(px >= 0 && px < xSize && py >= 0 && py < ySize))
+            return 0.0;
+        return heights[static_cast<size_t>(py) * xSize + static_cast<size_t>(px)];
+    };
+
+    auto distance = [pixelSize](const std::pair<double, double> &p1, const std::pair<double, double> &p2) {
+        return hypot(p1.first - p2.first, p1.second - p2.second) / pixelSize;
+    };
+
+    #pragma omp parallel
+    {
+        // OGRCoordinateTransformation is not thread safe, every worker uses its own copy.
+        // It is required only if analytic projection could not be used.
+        OGRCoordinateTransformation *localTransformation = nullptr, *localReverseTransformation = nullptr;
+        if (!useNativeProjection)
+        {
+            #pragma omp critical(transformationClone)
+            {
+                localTransformation = transformation->Clone();
+                localReverseTransformation = reverseTranformation->Clone();
+            }
+        }
+
+        std::vector<double> geoX(xSize), geoY(xSize), lons(xSize), lats(xSize);
+        std::vector<double> coords(2 * static_cast<size_t>(xSize));
+
+        #pragma omp for schedule(dynamic)
+        for (int y = firstRow; y < lastRow; y++)
+        {
+            for (int x = 0; x < xSize; x++)
+                std::tie(geoX[x], geoY[x]) = geo.calcGeoCoordsFromPix(x + 0.5, y + 0.5);
+
+            if (useNativeProjection)
+            {
+                projection.inverse(xSize, geoX.data(), geoY.data(), lons.data(), lats.data());
+            }
+            else
+            {
+                for (int x = 0; x < xSize; x++)
+                {
+                    lons[x] = geoX[x];
+                    lats[x] = geoY[x];
+                    if (!localTransformation->Transform(1, &lons[x], &lats[x]))
+                        lons[x] = lats[x] = numeric_limits<double>::quiet_NaN();
+                }
+            }
+
+            for (int x = 0; x < xSize; x++)
+            {
+                double phi_e = lats[x] * M_PI / 180;
+                double lambda_e = (lons[x] - central_m) * M_PI / 180;
+                auto observedAt = [&](double objectHeight, std::pair<double, double> &observed) {
+                    return observedGeosCoordinates(phi_e, lambda_e, objectHeight, localReverseTransformation, observed);
+                };
+
+                // Vertical above pixel is searched for the highest t satisfying heightAt(observed(t)) >= t.
+                // Surface (t = 0) always satisfies it, top of height field bounds it from above.
+                std::pair<double, double> lowCoords, highCoords;
+                double low = 0, high = maxHeight;
+
+                if (isnan(phi_e) || isnan(lambda_e) || !observedAt(low, lowCoords))
+                {
+                    coords[2 * x] = coords[2 * x + 1] = numeric_limits<double>::quiet_NaN();
+                    continue;
+                }
+
+                if (high > 0 && observedAt(high, highCoords))
+                {
+                    if (heightAt(highCoords) >= high)
+                    {
+                        low = high;
+                        lowCoords = highCoords;
+                    }
+                    else
+                    {
+                        // March down with steps moving line of sight by half of pixel, so no pixel is skipped
+                        int steps = std::max(1, static_cast<int>(ceil(2 * distance(highCoords, lowCoords))));
+                        for (int step = 1; step < steps; step++)
+                        {
+                            double t = maxHeight * (steps - step) / steps;
+                            std::pair<double, double> observed;
+                            if (!observedAt(t, observed))
+                                continue;
+
+                            if (heightAt(observed) >= t)
+                            {
+                                low = t;
+                                lowCoords = observed;
+                                break;
+                            }
+                            high = t;
+                            highCoords = observed;
+                        }
+
+                        // Fixed point iteration on displacement raises lower bound towards height of object
+                        // observed there. If it leaves the bracket, interval is bisected instead.
+                        for (int iteration = 0; iteration < iterationsLimit && distance(highCoords, lowCoords) > 0.05; iteration++)
+                        {
+                            double next = heightAt(lowCoords);
+                            if (next == low)
+                                break;
+
+                            std::pair<double, double> observed;
+                            if (next < high && observedAt(next, observed) && heightAt(observed) >= next)
+                            {
+                                low = next;
+                                lowCoords = observed;
+                                continue;
+                            }
+
+                            double middle = (low + high) / 2;
+                            if (!observedAt(middle, observed))
+                                break;
+
+                            if (heightAt(observed) >= middle)
+                            {
+                                low = middle;
+                                lowCoords = observed;
+                            }
+                            else
+                            {
+                                high = middle;
+                                highCoords = observed;
+                            }
+                        }
+                    }
+                }
+
+                coords[2 * x] = lowCoords.first;
+                coords[2 * x + 1] = lowCoords.second;
+            }
+
+            #pragma omp critical(rasterIO)
+            saveCoordinatesInRaster(output, 0, y, xSize, 1, coords.data());
+        }
+
+        if (!useNativeProjection)
+        {
+            OGRCoordinateTransformation::DestroyCT(localTransformation);
+            OGRCoordinateTransformation::DestroyCT(localReverseTransformation);
+        }
+    }
+}
+
+std::vector<double> GEOSHeightCorrector::calculateRowsDisplacement(GDALDataset *raster, double objectHeight, int sampling)
+{
+    int xSize = raster->GetRasterXSize();
+    int ySize = raster->GetRasterYSize();
+
+    Geotransform<> geo;
+    raster->GetGeoTransform(geo.geotransform);
+
+    double inverse[6];
+    if (!GDALInvGeoTransform(geo.geotransform, inverse))
+        throw runtime_error("Geotransform of raster cannot be inverted");
+
+    std::vector<int> columns;
+    for (int x = 0; x < xSize; x += std::max(1, sampling))
+        columns.push_back(x);
+    if (columns.back() != xSize - 1)
+        columns.push_back(xSize - 1);
+
+    std::vector<double> displacement(ySize, 0);
+
+    #pragma omp parallel
+    {
+        OGRCoordinateTransformation *localTransformation = nullptr, *localReverseTransformation = nullptr;
+        if (!useNativeProjection)
+        {
+            #pragma omp critical(transformationClone)
+            {
+                localTransformation = transformation->Clone();
+                localReverseTransformation = reverseTranformation->Clone();
+            }
+        }
+
+        #pragma omp for schedule(dynamic)
+        for (int y = 0; y < ySize; y++)
+        {
+            for (int x : columns)
+            {
+                auto coords = geo.calcGeoCoordsFromPix(x + 0.5, y + 0.5);
+                bool transformed = useNativeProjection
+                    ? projection.inverse(coords.first, coords.second, coords.first, coords.second)
+                    : localTransformation->Transform(1, &coords.first, &coords.second);
+                if (!transformed || isnan(coords.first) || isnan(coords.second))
+                    continue;
+
+                std::pair<double, double> observed;
+                if (!observedGeosCoordinates(coords.second * M_PI / 180, (coords.first - central_m) * M_PI / 180, objectHeight, localReverseTransformation, observed))
+                    continue;
+
+                double row = inverse[3] + observed.first * inverse[4] + observed.second * inverse[5];
+                if (!isnan(row))
+                    displacement[y] = std::max(displacement[y], fabs(row - (y + 0.5)));
+            }
+        }
+
+        if (!useNativeProjection)
+        {
+            OGRCoordinateTransformation::DestroyCT(localTransformation);
+            OGRCoordinateTransformation::DestroyCT(localReverseTransformation);
+        }
+    }
+
+    return displacement;
+}
@@ -8,9 +8,15 @@
 #ifndef CORRECTION_H
 #define CORRECTION_H
 
+#include <vector>
 #include <ogr_spatialref.h>
 #include <gdal_priv.h>
 #include "correction_utils.h"
+#include "geos_projection.h"
+#include "displacement_cache.h"
+#include "sparse_lattice.h"
+#include "correction_statistics.h"
+#include "incremental_correction.h"
 
 class GEOSHeightCorrector
 {
@@ -22,11 +28,115 @@ private:
 
     OGRCoordinateTransformation *transformation, *reverseTranformation;
 
+    /// Analytic projection used instead of PROJ transformations, if both are consistent
+    ksg::GeosProjection projection;
+    bool useNativeProjection;
+
+    ///
+    /// Compares analytic projection with PROJ on grid of points covering view disc.
+    /// @return true if both are consistent
+    bool isProjectionConsistentWithProj();
+
+    ///
+    /// Parallax problem of single object, normalised with ellipsoid semi-major axis.
+    struct PixelProblem
+    {
+        double h, phi_s, lambda_s;
+        /// Start point for numeric method
+        double phi_e, lambda_e, q;
+    };
+
+    PixelProblem preparePixelProblem(
+        std::pair<double, double> geoCoords,
+        std::pair<double, double> ellipsCoords,
+        double objectHeight,
+        ksg::InitialGuess initialGuess) const;
+
+    ///
+    /// Replaces start point of problem with intersection of line of sight and ellipsoid inflated by object height.
+    /// @return false if line of sight misses inflated ellipsoid, problem is left unchanged then
+    bool intersectInflatedEllipsoid(PixelProblem &problem) const;
+
+    std::pair<double, double> solutionToEllipsCoordinates(double phi_e, double lambda_e) const;
+
+    ///
+    /// Length of target function of parallax problem at its current point [m].
+    double residual(const PixelProblem &problem) const;
+
+    ///
+    /// Solves problem from its start point, which is replaced with last point reached by numeric method.
+    /// @return true if required accuracy was satisfied within iterations limit
+    bool solvePixelProblem(
+        PixelProblem &problem,
+        double requiredAccuracy,
+        int iterationsLimit,
+        ksg::NumericMethod numericMethod,
+        bool useQuadraticForm,
+        int &iterations) const;
+
+    ///
+    /// Counterpart of solvePixelProblem which solves many problems at once with batched (SIMD) solver.
+    void solvePixelProblemsBatched(
+        size_t count,
+        PixelProblem *problems,
+        bool *converged,
+        int *iterations,
+        double requiredAccuracy,
+        int iterationsLimit,
+        ksg::NumericMethod numericMethod,
+        bool useQuadraticForm) const;
+
+    ///
+    /// Transforms ellipsoid coordinates into geos coordinates in place.
+    /// @param reverseTransformation transformation used if analytic projection is not available
+    bool ellipsToGeos(std::pair<double, double> &coords, OGRCoordinateTransformation *reverseTransformation) const;
+
+    ///
+    /// Geos coordinates at which object of given height above point of ellipsoid is observed.
+    /// It is closed-form counterpart of parallax problem.
+    /// @param phi_e geodetic latitude of point in radians
+    /// @param lambda_e longitude of point relative to central meridian in radians
+    /// @param reverseTransformation transformation used if analytic projection is not available
+    bool observedGeosCoordinates(double phi_e, double lambda_e, double objectHeight,
+                                 OGRCoordinateTransformation *reverseTransformation,
+                                 std::pair<double, double> &coords) const;
+
+    ///
+    /// Corrects pixel with displacement interpolated from cache. Interval containing object height
+    /// is filled first if required.
+    /// @param result corrected geos coordinates
+    /// @return false on cache miss
+    bool correctWithCache(
+        ksg::DisplacementCache &cache,
+        int x, int y,
+        std::pair<double, double> geoCoords,
+        std::pair<double, double> ellipsCoords,
+        double objectHeight,
+        double requiredAccuracy,
+        int iterationsLimit,
+        ksg::NumericMethod numericMethod,
+        bool useQuadraticForm,
+        ksg::InitialGuess initialGuess,
+        OGRCoordinateTransformation *reverseTransformation,
+        std::pair<double, double> &result);
+
 public:
     GEOSHeightCorrector(OGRSpatialReference &geoSrs);
 
     ~GEOSHeightCorrector();
 
+    ///
+    /// Corrects coordinates of every pixel of input and writes them into two bands of output, in encoding
+    /// recorded by ksg::createCoordinatesRaster (absolute coordinates if output has none).
+    /// Pixels which cannot be corrected are written as NaN and counted, instead of being reported one by one.
+    /// @param statistics if not null, counters of run are added to it
+    /// @param diagnostics if not null, raster created by ksg::createDiagnosticsRaster receiving iterations,
+    /// residual and status of every pixel
+    /// @param lattice if not null, lattice built with buildLattice for geometry of input, pixels which it covers
+    /// are interpolated instead of being solved
+    /// @param previous if not null, correction of previous heights whose coordinates are copied to pixels with
+    /// unchanged height, other pixels are corrected as usual
+    /// @throws std::runtime_error if previous correction has other geometry than input
     void calculateNewCoordinatesForRaster(
         GDALDataset *input,
         GDALDataset *output,
@@ -34,9 +144,57 @@ public:
         double requiredAccuracy,
         int iterationsLimit,
         ksg::NumericMethod numericMethod = ksg::NumericMethod::NETWON,
-        bool useQuadraticForm = false
+        bool useQuadraticForm = false,
+        ksg::InitialGuess initialGuess = ksg::InitialGuess::INFLATED_ELLIPSOID,
+        bool warmStart = false,
+        ksg::DisplacementCache *cache = nullptr,
+        ksg::CorrectionStatistics *statistics = nullptr,
+        GDALDataset *diagnostics = nullptr,
+        const ksg::SparseLattice *lattice = nullptr,
+        const ksg::PreviousCorrection *previous = nullptr
     );
 
+    ///
+    /// Builds lattice covering whole raster, whose displacements are differences between corrected and observed
+    /// geos coordinates. Nodes are solved with half of required accuracy, other half is left for interpolation.
+    void buildLattice(
+        ksg::SparseLattice &lattice,
+        GDALDataset *raster,
+        double requiredAccuracy,
+        int iterationsLimit,
+        ksg::NumericMethod numericMethod = ksg::NumericMethod::NETWON,
+        bool useQuadraticForm = false,
+        ksg::InitialGuess initialGuess = ksg::InitialGuess::INFLATED_ELLIPSOID
+    );
+
+    ///
+    /// Inverse of calculateNewCoordinatesForRaster. For every pixel it finds geos coordinates at which object
+    /// above pixel center is observed in input. Object is the highest intersection of vertical above pixel with
+    /// height field, so higher clouds cover lower ones. Pixels without height are treated as surface.
+    /// Coordinates are written into two bands of output, NaN for pixels outside of view disc.
+    /// @param iterationsLimit maximum number of refinement steps per pixel
+    /// @param firstRow, lastRow range of rows [firstRow, lastRow) written to output, negative lastRow means all rows
+    /// @param maxHeight height from which vertical is searched, negative means the highest height in input.
+    /// Rasters processed in parts should share it, so results do not depend on division.
+    void calculateSourceCoordinatesForRaster(
+        GDALDataset *input,
+        GDALDataset *output,
+        int inputBand,
+        int iterationsLimit,
+        int firstRow = 0,
+        int lastRow = -1,
+        double maxHeight = -1
+    );
+
+    ///
+    /// For every row of raster calculates maximal vertical distance [px] between pixel and position at which
+    /// object of given height above it is observed. It bounds rows from which parallax may move pixels into row.
+    /// @param sampling distance between checked pixels of row, last pixel is always checked
+    std::vector<double> calculateRowsDisplacement(GDALDataset *raster, double objectHeight, int sampling = 4);
+
+    ///
+    /// @param iterations if not null, receives number of iterations performed by numeric method
+    /// @param residual if not null, receives final residual of parallax problem [m], NaN if it was not solved
     std::pair<double, double> calculateNewCoordinates(
         std::pair<double, double> geoCoords,
         std::pair<double, double> ellipsCoords,
@@ -44,13 +202,66 @@ public:
         double requiredAccuracy,
         int iterationsLimit,
         ksg::NumericMethod numericMethod = ksg::NumericMethod::NETWON,
-        bool useQuadraticForm = false
+        bool useQuadraticForm = false,
+        ksg::InitialGuess initialGuess = ksg::InitialGuess::INFLATED_ELLIPSOID,
+        int *iterations = nullptr,
+        double *residual = nullptr
     );
 
+    ///
+    /// Counterpart of calculateNewCoordinates which solves many objects at once with batched (SIMD) solver.
+    /// Results of objects which could not be corrected are set to NaN.
+    /// @param iterations if not null, array of count elements receiving number of iterations performed for each object
+    /// @param residuals if not null, array of count elements receiving final residual of each object [m]
+    void calculateNewCoordinatesBatched(
+        size_t count,
+        const std::pair<double, double> *geoCoords,
+        const std::pair<double, double> *ellipsCoords,
+        const double *objectHeights,
+        std::pair<double, double> *results,
+        double requiredAccuracy,
+        int iterationsLimit,
+        ksg::NumericMethod numericMethod = ksg::NumericMethod::NETWON,
+        bool useQuadraticForm = false,
+        ksg::InitialGuess initialGuess = ksg::InitialGuess::INFLATED_ELLIPSOID,
+        int *iterations = nullptr,
+        double *residuals = nullptr
+    );
+
+    ///
+    /// Counterpart of calculateNewCoordinatesBatched for grid of width x height objects stored row by row.
+    /// Every object starts from solution of its upper or left neighbour, moved by difference of their initial guesses.
+    /// If numeric method fails from such start point, object is solved again from its own initial guess.
+    /// Objects with NaN height or ellipsoid coordinates are skipped, their results are set to NaN.
+    /// @param iterations if not null, array of width x height elements receiving number of iterations performed for each object
+    /// @param residuals if not null, array of width x height elements receiving final residual of each object [m]
+    void calculateNewCoordinatesWarmStarted(
+        int width,
+        int height,
+        const std::pair<double, double> *geoCoords,
+        const std::pair<double, double> *ellipsCoords,
+        const double *objectHeights,
+        std::pair<double, double> *results,
+        double requiredAccuracy,
+        int iterationsLimit,
+        ksg::NumericMethod numericMethod = ksg::NumericMethod::NETWON,
+        bool useQuadraticForm = false,
+        ksg::InitialGuess initialGuess = ksg::InitialGuess::INFLATED_ELLIPSOID,
+        int *iterations = nullptr,
+        double *residuals = nullptr
+    );
+
+    ///
+    /// Transformations between geos and ellipsoid coordinates return NaN coordinates for points outside of view disc.
     std::pair<double, double> transformToEllipsCoordinates(
         std::pair<double, double> geoCoords);
     std::pair<double, double> transformToGeosCoordinates(
         std::pair<double, double> ellipsCoords);
+
+    ///
+    /// @return true if transformations use analytic projection and may be called from many threads at once,
+    /// false if they use PROJ transformations, which are not thread safe
+    bool isTransformationThreadSafe() const { return useNativeProjection; }
 };
 
 #endif /* CORRECTION_H */
@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "correction_service.h"
+
+using namespace std;
+
+namespace ksg
+{
+    ServiceRequest ServiceRequest::parse(const string &line, const ServiceRequest &defaults)
+    {
+        ServiceRequest request = defaults;
+        request.item = BatchItem();
+
+        istringstream words(line);
+        string type;
+        words >> type;
+        if (type == "STATUS")
+        {
+            request.type = Type::STATUS;
+            return request;
+        }
+        if (type != "CORRECT")
+            throw logic_error("Unknown request: \"" + type + "\"");
+
+        request.type = Type::CORRECT;
+        string word;
+        while (words >> word)
+        {
+            auto separator = word.find('=');
+            if (separator == string::npos)
+                throw logic_error("Expected key=value, but was \"" + word + "\"");
+
+            string key = word.substr(0, separator);
+            istringstream value(word.substr(separator + 1));
+            if (key == "input")
+                value >> request.item.input;
+            else if (key == "output")
+                value >> request.item.output;
+            else if (key == "band")
+                value >> request.band;
+            else if (key == "method")
+                value >> request.method;
+            else if (key == "accuracy")
+                value >> request.accuracy;
+            else
+                throw logic_error("Unknown key: \"" + key + "\"");
+
+            if (value.fail())
+                throw logic_error("Bad value of " + key);
+        }
+
+        if (request.item.input.empty() || request.item.output.empty())
+            throw logic_error("Request requires input and output");
+
+        return request;
+    }
+
+    string ServiceRequest::format() const
+    {
+        if (type == Type::STATUS)
+            return "STATUS";
+
+        // Words are separated by whitespace, which is not escaped
+        for (auto path : {&item.input, &item.output})
+            if (any_of(path->begin(), path->end(), [](unsigned char c) { return isspace(c); }))
+                throw logic_error("Path of request cannot contain whitespace: \"" + *path + "\"");
+
+        ostringstream line;
+        line.precision(17);
+        line << "CORRECT input=" << item.input << " output=" << item.output << " band=" << band
+             << " method=" << method << " accuracy=" << accuracy;
+        return line.str();
+    }
+
+    string ServiceStatistics::format() const
+    {
+        size_t finished = completed + failed;
+        ostringstream line;
+        line << "queued=" << queued << " running=" << running << " completed=" << completed << " failed=" << failed
+             << " latency_mean=" << (finished > 0 ? totalLatency / finished : 0) << " latency_max=" << maxLatency
+             << " wait_mean=" << (finished > 0 ? totalWait / finished : 0);
+        return line.str();
+    }
+
+    static sockaddr_un socketAddress(const string &socketPath)
+    {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path))
+            throw runtime_error("Socket path is too long: " + socketPath);
+        strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+        return address;
+    }
+
+    /// Time in which client has to send its request [ms]
+    constexpr int REQUEST_TIMEOUT = 1000;
+
+    ///
+    /// @param timeout time in which whole line has to arrive [ms], negative to wait without limit
+    static bool readLine(int connection, string &line, int timeout = -1)
+    {
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout);
+        line.clear();
+        char c;
+        while (line.size() < 65536)
+        {
+            if (timeout >= 0)
+            {
+                auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+                pollfd descriptor{connection, POLLIN, 0};
+                if (remaining <= 0 || poll(&descriptor, 1, static_cast<int>(remaining)) <= 0)
+                    return false;
+            }
+
+            auto count = read(connection, &c, 1);
+            if (count <= 0)
+                return !line.empty();
+            if (c == '\n')
+                return true;
+            line += c;
+        }
+        return false;
+    }
+
+    static void writeLine(int connection, const string &line)
+    {
+        string message = line + "\n";
+        for (size_t sent = 0; sent < message.size();)
+        {
+            auto count = send(connection, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+            if (count <= 0)
+                return;
+            sent += count;
+        }
+    }
+
+    CorrectionService::CorrectionService(const string &socketPath, int workers, const ServiceRequest &defaults,
+                                         function<void(const ServiceRequest &)> task)
+        : socketPath(socketPath), workersCount(max(1, workers)), defaults(defaults), task(move(task))
+    {
+        auto address = socketAddress(socketPath);
+
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0)
+            throw runtime_error("Cannot create socket");
+
+        // Socket left by previous service is replaced, other files are not touched
+        struct stat existing;
+        if (stat(socketPath.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode))
+            unlink(socketPath.c_str());
+
+        if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0)
+        {
+            close(listener);
+            throw runtime_error("Cannot listen on " + socketPath + ": " + strerror(errno));
+        }
+    }
+
+    CorrectionService::~CorrectionService()
+    {
+        if (listener >= 0)
+        {
+            close(listener);
+            unlink(socketPath.c_str());
+        }
+    }
+
+    void CorrectionService::run()
+    {
+        vector<thread> workers;
+        for (int w = 0; w < workersCount; w++)
+            workers.emplace_back(&CorrectionService::work, this);
+
+        // Socket is polled with timeout, so stop requested from signal handler is noticed
+        while (!stopping)
+        {
+            pollfd descriptor{listener, POLLIN, 0};
+            if (poll(&descriptor, 1, 200) <= 0)
+                continue;
+
+            int connection = accept(listener, nullptr, nullptr);
+            if (connection >= 0)
+                serve(connection);
+        }
+
+        // Later clients are refused instead of waiting for answer that never comes
+        close(listener);
+        unlink(socketPath.c_str());
+        listener = -1;
+
+        {
+            lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        jobAvailable.notify_all();
+
+        for (auto &t : workers)
+            t.join();
+    }
+
+    void CorrectionService::serve(int connection)
+    {
+        auto received = chrono::steady_clock::now();
+
+        // Request is read on accepting thread, so client which does not send it is dropped soon
+        string line;
+        if (!readLine(connection, line, REQUEST_TIMEOUT))
+        {
+            close(connection);
+            return;
+        }
+
+        ServiceRequest request;
+        try
+        {
+            request = ServiceRequest::parse(line, defaults);
+        }
+        catch (exception &ex)
+        {
+            writeLine(connection, string("ERROR ") + ex.what());
+            close(connection);
+            return;
+        }
+
+        if (request.type == ServiceRequest::Type::STATUS)
+        {
+            writeLine(connection, getStatistics().format());
+            close(connection);
+            return;
+        }
+
+        {
+            lock_guard<std::mutex> lock(mutex);
+            queue.push_back(Job{connection, request, received});
+            statistics.queued = queue.size();
+        }
+        jobAvailable.notify_one();
+    }
+
+    void CorrectionService::work()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this]() { return finished || !queue.empty(); });
+                if (queue.empty())
+                    return;
+
+                job = queue.front();
+                queue.pop_front();
+                statistics.queued = queue.size();
+                statistics.running++;
+            }
+
+            auto started = chrono::steady_clock::now();
+            string answer;
+            bool succeeded = false;
+            try
+            {
+                task(job.request);
+                succeeded = true;
+            }
+            catch (exception &ex)
+            {
+                answer = string("ERROR ") + ex.what();
+            }
+            catch (...)
+            {
+                answer = "ERROR Unknown error";
+            }
+
+            auto now = chrono::steady_clock::now();
+            double seconds = chrono::duration<double>(now - started).count();
+            if (succeeded)
+                answer = "OK " + to_string(seconds);
+
+            {
+                lock_guard<std::mutex> lock(mutex);
+                statistics.running--;
+                (succeeded ? statistics.completed : statistics.failed)++;
+
+                double latency = chrono::duration<double>(now - job.received).count();
+                statistics.totalLatency += latency;
+                statistics.maxLatency = max(statistics.maxLatency, latency);
+                statistics.totalWait += chrono::duration<double>(started - job.received).count();
+            }
+
+            writeLine(job.connection, answer);
+            close(job.connection);
+        }
+    }
+
+    ServiceStatistics CorrectionService::getStatistics() const
+    {
+        lock_guard<std::mutex> lock(mutex);
+        return statistics;
+    }
+
+    string submitRequest(const string &socketPath, const string &line)
+    {
+        auto address = socketAddress(socketPath);
+
+        int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connection < 0)
+            throw runtime_error("Cannot create socket");
+
+        if (connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            close(connection);
+            throw runtime_error("Cannot connect to " + socketPath + ": " + strerror(errno));
+        }
+
+        writeLine(connection, line);
+        shutdown(connection, SHUT_WR);
+
+        string answer;
+        bool answered = readLine(connection, answer);
+        close(connection);
+
+        if (!answered)
+            throw runtime_error("Service closed connection without answer");
+        return answer;
+    }
+
+    string submitRequest(const string &socketPath, ServiceRequest request)
+    {
+        if (request.type == ServiceRequest::Type::CORRECT)
+        {
+            request.item.input = filesystem::absolute(request.item.input).string();
+            request.item.output = filesystem::absolute(request.item.output).string();
+        }
+        return submitRequest(socketPath, request.format());
+    }
+}
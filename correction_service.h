@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch_correction.h"
+#include "correction_utils.h"
+
+namespace ksg
+{
+    ///
+    /// Request of correction service. It is sent as single line of whitespace separated words:
+    ///
+    ///     CORRECT input=<path> output=<path> band=<n> method=<name> accuracy=<m>
+    ///     STATUS
+    ///
+    /// Words of CORRECT other than input and output are optional, service defaults are used for missing ones.
+    struct ServiceRequest
+    {
+        enum class Type {
+            CORRECT,
+            STATUS
+        };
+
+        Type type = Type::CORRECT;
+        BatchItem item;
+        int band = 1;
+        NumericMethod method = NumericMethod::LEVENBERG_MARQUARD;
+        double accuracy = 10;
+
+        ///
+        /// @param defaults request providing values of words missing in line
+        /// @throws std::logic_error if line is malformed
+        static ServiceRequest parse(const std::string &line, const ServiceRequest &defaults);
+
+        ///
+        /// @throws std::logic_error if path contains whitespace, which would split it into more words
+        std::string format() const;
+    };
+
+    ///
+    /// Counters of correction service. Latency is measured from receiving request to finishing its correction.
+    struct ServiceStatistics
+    {
+        size_t queued = 0;
+        size_t running = 0;
+        size_t completed = 0;
+        size_t failed = 0;
+        /// Sum and maximum of latencies of finished requests [s]
+        double totalLatency = 0, maxLatency = 0;
+        /// Sum of time spent by finished requests in queue [s]
+        double totalWait = 0;
+
+        std::string format() const;
+    };
+
+    ///
+    /// Service accepting correction requests over Unix domain socket. Requests are queued and corrected
+    /// by pool of worker threads; connection is answered when its request is finished, with line
+    /// "OK <seconds>" or "ERROR <message>". STATUS request is answered at once with counters. Connection
+    /// whose request line does not arrive within a second is closed without answer.
+    class CorrectionService
+    {
+    public:
+        ///
+        /// @param socketPath location of socket, socket left there by previous service is replaced
+        /// @param workers number of requests corrected at once
+        /// @param task corrects single request, exception fails only its request
+        CorrectionService(const std::string &socketPath, int workers, const ServiceRequest &defaults,
+                          std::function<void(const ServiceRequest &)> task);
+        ~CorrectionService();
+
+        CorrectionService(const CorrectionService &) = delete;
+        CorrectionService &operator=(const CorrectionService &) = delete;
+
+        ///
+        /// Accepts requests until stop is called, then closes socket and finishes queued ones.
+        void run();
+
+        ///
+        /// Stops accepting requests. Safe to call from other thread or signal handler.
+        void stop() { stopping = true; }
+
+        ServiceStatistics getStatistics() const;
+
+    private:
+        struct Job
+        {
+            int connection;
+            ServiceRequest request;
+            std::chrono::steady_clock::time_point received;
+        };
+
+        std::string socketPath;
+        int listener = -1;
+        int workersCount;
+        ServiceRequest defaults;
+        std::function<void(const ServiceRequest &)> task;
+        std::atomic<bool> stopping{false};
+
+        mutable std::mutex mutex;
+        std::condition_variable jobAvailable;
+        std::deque<Job> queue;
+        bool finished = false;
+        ServiceStatistics statistics;
+
+        void serve(int connection);
+        void work();
+    };
+
+    ///
+    /// Sends request line to service and waits for its answer.
+    /// @throws std::runtime_error if service cannot be reached
+    std::string submitRequest(const std::string &socketPath, const std::string &line);
+
+    ///
+    /// Sends request to service and waits for its answer. Paths are made absolute first, since service
+    /// opens them relative to its own working directory.
+    /// @throws std::logic_error if path contains whitespace
+    /// @throws std::runtime_error if service cannot be reached
+    std::string submitRequest(const std::string &socketPath, ServiceRequest request);
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "correction_statistics.h"
+
+using namespace std;
+
+namespace ksg
+{
+    void CorrectionStatistics::count(PixelStatus status)
+    {
+        pixels++;
+        switch (status)
+        {
+        case PixelStatus::NO_DATA:
+            noData++;
+            break;
+        case PixelStatus::CONVERGED:
+            converged++;
+            break;
+        case PixelStatus::CACHED:
+            cached++;
+            break;
+        case PixelStatus::OFF_DISC:
+            offDisc++;
+            break;
+        case PixelStatus::ITERATIONS_LIMIT:
+            iterationsLimit++;
+            break;
+        case PixelStatus::READ_FAILED:
+            readFailed++;
+            break;
+        case PixelStatus::INTERPOLATED:
+            interpolated++;
+            break;
+        case PixelStatus::UNCHANGED:
+            unchanged++;
+            break;
+        }
+    }
+
+    double CorrectionStatistics::solvedFraction() const
+    {
+        size_t corrected = converged + cached + iterationsLimit + interpolated;
+        return corrected > 0 ? static_cast<double>(converged + iterationsLimit + latticeNodes) / corrected : 0;
+    }
+
+    double CorrectionStatistics::resolvedFraction() const
+    {
+        size_t corrected = converged + cached + iterationsLimit + interpolated;
+        return corrected + unchanged > 0 ? static_cast<double>(corrected) / (corrected + unchanged) : 0;
+    }
+
+    CorrectionStatistics &CorrectionStatistics::operator+=(const CorrectionStatistics &other)
+    {
+        pixels += other.pixels;
+        noData += other.noData;
+        offDisc += other.offDisc;
+        converged += other.converged;
+        cached += other.cached;
+        iterationsLimit += other.iterationsLimit;
+        readFailed += other.readFailed;
+        interpolated += other.interpolated;
+        unchanged += other.unchanged;
+        latticeNodes += other.latticeNodes;
+
+        for (auto &bin : other.iterationsHistogram)
+            iterationsHistogram[bin.first] += bin.second;
+        maxResidual = max(maxResidual, other.maxResidual);
+
+        readSeconds += other.readSeconds;
+        transformSeconds += other.transformSeconds;
+        solveSeconds += other.solveSeconds;
+        writeSeconds += other.writeSeconds;
+        totalSeconds += other.totalSeconds;
+        return *this;
+    }
+
+    string CorrectionStatistics::toJson() const
+    {
+        ostringstream json;
+        json << "{\"pixels\": " << pixels
+             << ", \"no_data\": " << noData
+             << ", \"off_disc\": " << offDisc
+             << ", \"converged\": " << converged
+             << ", \"cached\": " << cached
+             << ", \"iterations_limit\": " << iterationsLimit
+             << ", \"read_failed\": " << readFailed
+             << ", \"interpolated\": " << interpolated
+             << ", \"lattice_nodes\": " << latticeNodes
+             << ", \"unchanged\": " << unchanged
+             << ", \"solved_fraction\": " << solvedFraction()
+             << ", \"resolved_fraction\": " << resolvedFraction()
+             << ", \"iterations_histogram\": {";
+
+        for (auto bin = iterationsHistogram.begin(); bin != iterationsHistogram.end(); ++bin)
+            json << (bin == iterationsHistogram.begin() ? "" : ", ") << "\"" << bin->first << "\": " << bin->second;
+
+        json << "}, \"max_residual\": " << maxResidual
+             << ", \"seconds\": {\"read\": " << readSeconds
+             << ", \"transform\": " << transformSeconds
+             << ", \"solve\": " << solveSeconds
+             << ", \"write\": " << writeSeconds
+             << ", \"total\": " << totalSeconds << "}}";
+        return json.str();
+    }
+
+    GDALDataset *createDiagnosticsRaster(const string &path, GDALDataset *input)
+    {
+        auto tifDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+        if (tifDriver == nullptr)
+            throw runtime_error("There is no GTiff driver");
+
+        auto diagnostics = tifDriver->Create(path.c_str(), input->GetRasterXSize(), input->GetRasterYSize(), 3, GDT_Float32, nullptr);
+        if (diagnostics == nullptr)
+            throw runtime_error("Cannot create " + path);
+
+        double geotransform[6];
+        input->GetGeoTransform(geotransform);
+        diagnostics->SetGeoTransform(geotransform);
+        diagnostics->SetProjection(input->GetProjectionRef());
+
+        diagnostics->GetRasterBand(1)->SetDescription("iterations");
+        diagnostics->GetRasterBand(2)->SetDescription("residual");
+        diagnostics->GetRasterBand(3)->SetDescription("status");
+        diagnostics->GetRasterBand(3)->SetMetadataItem("STATUS_CODES",
+            "0=NO_DATA 1=CONVERGED 2=CACHED 3=OFF_DISC 4=ITERATIONS_LIMIT 5=READ_FAILED 6=INTERPOLATED 7=UNCHANGED");
+
+        return diagnostics;
+    }
+}
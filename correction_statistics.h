@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <gdal_priv.h>
+
+namespace ksg
+{
+    ///
+    /// Outcome of correction of single pixel, stored in status band of diagnostics raster.
+    enum class PixelStatus : uint8_t {
+        /// Height is no data, pixel keeps its coordinates
+        NO_DATA = 0,
+        /// Numeric method satisfied required accuracy
+        CONVERGED = 1,
+        /// Displacement was interpolated from displacement cache
+        CACHED = 2,
+        /// Pixel center or its corrected position is outside of view disc
+        OFF_DISC = 3,
+        /// Numeric method exceeded iterations limit
+        ITERATIONS_LIMIT = 4,
+        /// Block of pixel could not be read
+        READ_FAILED = 5,
+        /// Displacement was interpolated from sparse lattice
+        INTERPOLATED = 6,
+        /// Height did not change, coordinates were copied from previous correction
+        UNCHANGED = 7
+    };
+
+    ///
+    /// Counters of single correction run, collected instead of reporting every pixel.
+    struct CorrectionStatistics
+    {
+        size_t pixels = 0;
+        size_t noData = 0;
+        size_t offDisc = 0;
+        size_t converged = 0;
+        size_t cached = 0;
+        size_t iterationsLimit = 0;
+        size_t readFailed = 0;
+        size_t interpolated = 0;
+        size_t unchanged = 0;
+        /// Number of solved nodes of sparse lattice built for run
+        size_t latticeNodes = 0;
+
+        /// Number of pixels solved by numeric method with given number of iterations
+        std::map<int, size_t> iterationsHistogram;
+        /// Largest residual of converged pixel [m]
+        double maxResidual = 0;
+
+        /// Time of stages, summed over threads [s]
+        double readSeconds = 0, transformSeconds = 0, solveSeconds = 0, writeSeconds = 0;
+        /// Wall time of whole run [s]
+        double totalSeconds = 0;
+
+        void count(PixelStatus status);
+
+        ///
+        /// @return ratio of pixels solved by numeric method, lattice nodes included, to pixels which required correction
+        double solvedFraction() const;
+
+        ///
+        /// @return ratio of pixels corrected in this run to pixels which required correction, unchanged ones included,
+        /// so 1 unless previous correction was reused
+        double resolvedFraction() const;
+
+        CorrectionStatistics &operator+=(const CorrectionStatistics &other);
+
+        std::string toJson() const;
+    };
+
+    ///
+    /// Creates three band Float32 GeoTIFF with geometry of input, for per pixel iterations count, residual [m]
+    /// and PixelStatus. Pixels without residual are NaN.
+    /// @throws std::runtime_error if raster cannot be created
+    GDALDataset *createDiagnosticsRaster(const std::string &path, GDALDataset *input);
+}
@@ -0,0 +1,343 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+
+#include <cpl_vsi.h>
+#include "correction_table.h"
+
+using namespace std;
+
+namespace ksg
+{
+    constexpr char TABLE_MAGIC[8] = {'K', 'S', 'G', 'C', 'T', 'A', 'B', 'L'};
+    constexpr uint32_t TABLE_VERSION = 1;
+    constexpr size_t TABLE_ALIGNMENT = 4096;
+    /// Size of text written at once by export
+    constexpr size_t EXPORT_BLOCK_SIZE = 4 << 20;
+
+    struct CorrectionTableHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t valueSize;
+        uint64_t imageWidth, imageHeight;
+        uint64_t firstColumn, firstLine;
+        uint64_t columns, lines;
+        uint64_t heightsCount;
+        uint64_t srsLength;
+        double geotransform[6];
+        double requiredAccuracy;
+        char numericMethod[32];
+        uint64_t bitmapOffset, dataOffset;
+    };
+
+    static runtime_error tableError(const string &message, const string &path)
+    {
+        return runtime_error(message + " " + path + ": " + strerror(errno));
+    }
+
+    static size_t align(size_t offset)
+    {
+        return (offset + TABLE_ALIGNMENT - 1) / TABLE_ALIGNMENT * TABLE_ALIGNMENT;
+    }
+
+    static size_t bitmapSize(const CorrectionTableInfo &info)
+    {
+        return (info.columns * info.lines + 63) / 64 * sizeof(uint64_t);
+    }
+
+    static size_t pixelSize(const CorrectionTableInfo &info)
+    {
+        return 2 * info.valueSize * info.heights.size();
+    }
+
+    char *formatTableLine(char *buffer, size_t line, size_t column, const pair<double, double> *coordinates, size_t heightsCount)
+    {
+        // Buffer is large enough, so results of to_chars are not checked
+        char *end = buffer + (2 + 2 * heightsCount) * TABLE_VALUE_MAX_CHARS;
+        char *position = to_chars(buffer, end, line).ptr;
+        *position++ = ' ';
+        position = to_chars(position, end, column).ptr;
+
+        for (size_t hi = 0; hi < heightsCount; hi++)
+        {
+            *position++ = ' ';
+            position = to_chars(position, end, coordinates[hi].second, chars_format::general, 6).ptr;
+            *position++ = ' ';
+            position = to_chars(position, end, coordinates[hi].first, chars_format::general, 6).ptr;
+        }
+
+        *position++ = '\n';
+        return position;
+    }
+
+    CorrectionTableWriter::CorrectionTableWriter(const string &path, const CorrectionTableInfo &info, bool resume)
+        : path(path), info(info)
+    {
+        if (info.columns == 0 || info.lines == 0 || info.heights.empty())
+            throw logic_error("Correction table has to contain at least one pixel and height");
+        if (info.valueSize != sizeof(float) && info.valueSize != sizeof(double))
+            throw logic_error("Correction table values have to be 4 or 8 bytes long");
+        if (info.numericMethod.size() >= sizeof(CorrectionTableHeader::numericMethod))
+            throw logic_error("Too long numeric method name: " + info.numericMethod);
+
+        CorrectionTableHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+        header.version = TABLE_VERSION;
+        header.valueSize = info.valueSize;
+        header.imageWidth = info.imageWidth;
+        header.imageHeight = info.imageHeight;
+        header.firstColumn = info.firstColumn;
+        header.firstLine = info.firstLine;
+        header.columns = info.columns;
+        header.lines = info.lines;
+        header.heightsCount = info.heights.size();
+        header.srsLength = info.srs.size();
+        copy(begin(info.geotransform), end(info.geotransform), header.geotransform);
+        header.requiredAccuracy = info.requiredAccuracy;
+        memcpy(header.numericMethod, info.numericMethod.data(), info.numericMethod.size());
+
+        size_t heightsOffset = sizeof(header);
+        size_t srsOffset = heightsOffset + info.heights.size() * sizeof(double);
+        header.bitmapOffset = align(srsOffset + info.srs.size());
+        header.dataOffset = align(header.bitmapOffset + bitmapSize(info));
+        mappingSize = header.dataOffset + info.columns * info.lines * pixelSize(info);
+
+        fd = open(path.c_str(), O_RDWR | O_CREAT | (resume ? 0 : O_TRUNC), 0644);
+        if (fd < 0)
+            throw tableError("Cannot create table", path);
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0)
+        {
+            close(fd);
+            throw tableError("Cannot read table", path);
+        }
+
+        // Resumed table keeps its pixels, it only has to be the same table
+        if (resume && fileStat.st_size > 0)
+        {
+            CorrectionTableHeader existing;
+            if (static_cast<size_t>(fileStat.st_size) != mappingSize || pread(fd, &existing, sizeof(existing), 0) != sizeof(existing) ||
+                memcmp(&existing, &header, sizeof(header)) != 0)
+            {
+                close(fd);
+                throw runtime_error("Cannot resume table with different geometry or settings " + path);
+            }
+        }
+        // New file is sparse and filled with zeros, so all pixels are invalid
+        else if (ftruncate(fd, mappingSize) != 0 ||
+            pwrite(fd, &header, sizeof(header), 0) != sizeof(header) ||
+            pwrite(fd, info.heights.data(), info.heights.size() * sizeof(double), heightsOffset) != static_cast<ssize_t>(info.heights.size() * sizeof(double)) ||
+            pwrite(fd, info.srs.data(), info.srs.size(), srsOffset) != static_cast<ssize_t>(info.srs.size()))
+        {
+            close(fd);
+            throw tableError("Cannot initialise table", path);
+        }
+
+        mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            close(fd);
+            throw tableError("Cannot map table", path);
+        }
+
+        bitmap = reinterpret_cast<uint64_t *>(static_cast<char *>(mapping) + header.bitmapOffset);
+        data = static_cast<char *>(mapping) + header.dataOffset;
+    }
+
+    CorrectionTableWriter::~CorrectionTableWriter()
+    {
+        msync(mapping, mappingSize, MS_SYNC);
+        munmap(mapping, mappingSize);
+        close(fd);
+    }
+
+    void CorrectionTableWriter::flush()
+    {
+        if (msync(mapping, mappingSize, MS_SYNC) != 0)
+            throw tableError("Cannot write table", path);
+    }
+
+    void CorrectionTableWriter::setPixel(size_t column, size_t line, const pair<double, double> *coordinates)
+    {
+        if (column < info.firstColumn || column >= info.firstColumn + info.columns ||
+            line < info.firstLine || line >= info.firstLine + info.lines)
+            throw logic_error("Pixel is out of scope of correction table");
+
+        size_t pixel = (line - info.firstLine) * info.columns + column - info.firstColumn;
+        char *values = data + pixel * pixelSize(info);
+        for (size_t hi = 0; hi < info.heights.size(); hi++)
+        {
+            if (info.valueSize == sizeof(float))
+            {
+                reinterpret_cast<float *>(values)[2 * hi] = coordinates[hi].second;
+                reinterpret_cast<float *>(values)[2 * hi + 1] = coordinates[hi].first;
+            }
+            else
+            {
+                reinterpret_cast<double *>(values)[2 * hi] = coordinates[hi].second;
+                reinterpret_cast<double *>(values)[2 * hi + 1] = coordinates[hi].first;
+            }
+        }
+
+        // Neighbouring pixels share word of bitmap
+        uint64_t &word = bitmap[pixel / 64];
+        uint64_t mask = uint64_t(1) << (pixel % 64);
+        #pragma omp atomic
+        word |= mask;
+    }
+
+    CorrectionTable::CorrectionTable(const string &path)
+    {
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw tableError("Cannot open table", path);
+
+        struct stat fileStat;
+        CorrectionTableHeader header;
+        if (fstat(fd, &fileStat) != 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            close(fd);
+            throw tableError("Cannot read table", path);
+        }
+
+        if (memcmp(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0 || header.version != TABLE_VERSION ||
+            (header.valueSize != sizeof(float) && header.valueSize != sizeof(double)) ||
+            header.numericMethod[sizeof(header.numericMethod) - 1] != '\0')
+        {
+            close(fd);
+            throw runtime_error("Not a correction table " + path);
+        }
+
+        info.valueSize = header.valueSize;
+        info.imageWidth = header.imageWidth;
+        info.imageHeight = header.imageHeight;
+        info.firstColumn = header.firstColumn;
+        info.firstLine = header.firstLine;
+        info.columns = header.columns;
+        info.lines = header.lines;
+        copy(begin(header.geotransform), end(header.geotransform), info.geotransform);
+        info.requiredAccuracy = header.requiredAccuracy;
+        info.numericMethod = header.numericMethod;
+
+        mappingSize = header.dataOffset + info.columns * info.lines * 2 * info.valueSize * header.heightsCount;
+        size_t srsOffset = sizeof(header) + header.heightsCount * sizeof(double);
+        if (static_cast<size_t>(fileStat.st_size) != mappingSize || srsOffset + header.srsLength > header.bitmapOffset ||
+            header.bitmapOffset + bitmapSize(info) > header.dataOffset)
+        {
+            close(fd);
+            throw runtime_error("Correction table is truncated or corrupted " + path);
+        }
+
+        mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            close(fd);
+            throw tableError("Cannot map table", path);
+        }
+
+        auto bytes = static_cast<const char *>(mapping);
+        auto heights = reinterpret_cast<const double *>(bytes + sizeof(header));
+        info.heights.assign(heights, heights + header.heightsCount);
+        info.srs.assign(bytes + srsOffset, header.srsLength);
+        bitmap = reinterpret_cast<const uint64_t *>(bytes + header.bitmapOffset);
+        data = bytes + header.dataOffset;
+    }
+
+    CorrectionTable::~CorrectionTable()
+    {
+        munmap(mapping, mappingSize);
+        close(fd);
+    }
+
+    pair<double, double> CorrectionTable::getCoordinates(size_t column, size_t line, size_t heightIndex) const
+    {
+        size_t index = pixelIndex(column, line) * 2 * info.heights.size() + 2 * heightIndex;
+        if (info.valueSize == sizeof(float))
+        {
+            auto values = reinterpret_cast<const float *>(data) + index;
+            return {values[1], values[0]};
+        }
+
+        auto values = reinterpret_cast<const double *>(data) + index;
+        return {values[1], values[0]};
+    }
+
+    void CorrectionTable::getCoordinates(size_t column, size_t line, pair<double, double> *coordinates) const
+    {
+        for (size_t hi = 0; hi < info.heights.size(); hi++)
+            coordinates[hi] = getCoordinates(column, line, hi);
+    }
+
+    bool isBinaryTable(const string &path)
+    {
+        char magic[sizeof(TABLE_MAGIC)] = {};
+        ifstream file(path, ios::binary);
+        file.read(magic, sizeof(magic));
+        return file && memcmp(magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) == 0;
+    }
+
+    void exportTableText(const CorrectionTable &table, const string &path, bool compress)
+    {
+        auto file = VSIFOpenL(((compress ? "/vsigzip/" : "") + path).c_str(), "wb");
+        if (file == nullptr)
+            throw tableError("Cannot create", path);
+
+        auto &info = table.getInfo();
+        size_t heightsCount = info.heights.size();
+        size_t lineLength = (2 + 2 * heightsCount) * TABLE_VALUE_MAX_CHARS;
+
+        string block;
+        block.reserve(EXPORT_BLOCK_SIZE + lineLength);
+        bool failed = false;
+
+        // Lines of table are formatted in parallel and appended to block in order
+        #pragma omp parallel for ordered schedule(dynamic)
+        for (size_t line = info.firstLine; line < info.firstLine + info.lines; line++)
+        {
+            vector<pair<double, double>> coordinates(heightsCount);
+            string text(info.columns * lineLength, '\0');
+            char *end = &text[0];
+
+            for (size_t column = info.firstColumn; column < info.firstColumn + info.columns; column++)
+            {
+                if (!table.isValid(column, line))
+                    continue;
+
+                table.getCoordinates(column, line, coordinates.data());
+                end = formatTableLine(end, line + 1, column + 1, coordinates.data(), heightsCount);
+            }
+
+            text.resize(end - text.data());
+
+            // After failed write the rest of table is not kept, export fails anyway
+            #pragma omp ordered
+            if (!failed)
+            {
+                block += text;
+                if (block.size() >= EXPORT_BLOCK_SIZE)
+                {
+                    failed = VSIFWriteL(block.data(), 1, block.size(), file) != block.size();
+                    block.clear();
+                }
+            }
+        }
+
+        if (!failed && !block.empty())
+            failed = VSIFWriteL(block.data(), 1, block.size(), file) != block.size();
+
+        if (VSIFCloseL(file) != 0 || failed)
+            throw tableError("Cannot write", path);
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ksg
+{
+    ///
+    /// Geometry of raster, scope of correction table and settings used to generate it.
+    struct CorrectionTableInfo
+    {
+        /// WKT of geos SRS
+        std::string srs;
+        double geotransform[6] = {0, 1, 0, 0, 0, 1};
+        size_t imageWidth = 0, imageHeight = 0;
+        /// 0 based raster column and line of the first pixel of table
+        size_t firstColumn = 0, firstLine = 0;
+        /// Size of table in pixels
+        size_t columns = 0, lines = 0;
+        /// Cloud heights [m]
+        std::vector<double> heights;
+        /// Required accuracy [m]
+        double requiredAccuracy = 0;
+        std::string numericMethod;
+        /// Size of stored coordinate: 4 (float) or 8 (double) bytes
+        size_t valueSize = sizeof(double);
+    };
+
+    /// Upper bound of length of single value in text table, together with separator
+    constexpr size_t TABLE_VALUE_MAX_CHARS = 32;
+
+    ///
+    /// Formats line of text table: 1 based line and column of pixel, followed by latitude and longitude for every height,
+    /// separated by spaces. Numbers are written as by std::ostream with default precision (six significant digits).
+    /// @param buffer has to hold (2 + 2 * heightsCount) * TABLE_VALUE_MAX_CHARS characters
+    /// @param coordinates (longitude, latitude) for every height [deg]
+    /// @return end of written line, which includes new line character
+    char *formatTableLine(char *buffer, size_t line, size_t column, const std::pair<double, double> *coordinates, size_t heightsCount);
+
+    ///
+    /// Creates binary correction table, memory mapped for writing.
+    ///
+    /// File starts with header, followed by heights [m] and SRS WKT. Validity bitmap (bit per pixel of table, in 64 bit
+    /// words) and dense array of coordinates start at page boundaries. Array keeps every pixel of table, in order of lines,
+    /// as interleaved (latitude, longitude) pairs for every height [deg]. Pixels which were not set are not valid.
+    class CorrectionTableWriter
+    {
+    public:
+        ///
+        /// @param path location of table, existing file is replaced
+        /// @param resume if true, existing table with the same header is opened with its pixels kept
+        /// @throws std::logic_error if info does not describe table
+        /// @throws std::runtime_error if file cannot be created or resumed table differs
+        CorrectionTableWriter(const std::string &path, const CorrectionTableInfo &info, bool resume = false);
+        ~CorrectionTableWriter();
+
+        CorrectionTableWriter(const CorrectionTableWriter &) = delete;
+        CorrectionTableWriter &operator=(const CorrectionTableWriter &) = delete;
+
+        ///
+        /// Stores coordinates of pixel and marks it valid. Safe to call from many threads for different pixels.
+        /// @param column, line 0 based raster position of pixel within scope of table
+        /// @param coordinates (longitude, latitude) for every height [deg]
+        void setPixel(size_t column, size_t line, const std::pair<double, double> *coordinates);
+
+        ///
+        /// Writes pixels set so far to file.
+        /// @throws std::runtime_error if mapping cannot be synchronised
+        void flush();
+
+    private:
+        std::string path;
+        int fd = -1;
+        void *mapping = nullptr;
+        size_t mappingSize = 0;
+
+        CorrectionTableInfo info;
+        uint64_t *bitmap = nullptr;
+        char *data = nullptr;
+    };
+
+    ///
+    /// Binary correction table, memory mapped for random access.
+    class CorrectionTable
+    {
+    public:
+        ///
+        /// @throws std::runtime_error if file cannot be mapped or it is not valid correction table
+        explicit CorrectionTable(const std::string &path);
+        ~CorrectionTable();
+
+        CorrectionTable(const CorrectionTable &) = delete;
+        CorrectionTable &operator=(const CorrectionTable &) = delete;
+
+        const CorrectionTableInfo &getInfo() const { return info; }
+
+        ///
+        /// @param column, line 0 based raster position of pixel within scope of table
+        /// @return true if coordinates of pixel were generated
+        bool isValid(size_t column, size_t line) const
+        {
+            size_t pixel = pixelIndex(column, line);
+            return (bitmap[pixel / 64] >> (pixel % 64)) & 1;
+        }
+
+        ///
+        /// @param column, line 0 based raster position of pixel within scope of table
+        /// @return (longitude, latitude) of pixel for height with given index [deg]
+        std::pair<double, double> getCoordinates(size_t column, size_t line, size_t heightIndex) const;
+
+        ///
+        /// Copies coordinates of pixel for all heights.
+        /// @param coordinates (longitude, latitude) for every height [deg]
+        void getCoordinates(size_t column, size_t line, std::pair<double, double> *coordinates) const;
+
+    private:
+        int fd = -1;
+        void *mapping = nullptr;
+        size_t mappingSize = 0;
+
+        CorrectionTableInfo info;
+        const uint64_t *bitmap = nullptr;
+        const char *data = nullptr;
+
+        inline size_t pixelIndex(size_t column, size_t line) const { return (line - info.firstLine) * info.columns + column - info.firstColumn; }
+    };
+
+    ///
+    /// @return true if file starts as binary correction table
+    bool isBinaryTable(const std::string &path);
+
+    ///
+    /// Exports binary table to text table, as generated by geostablegenerator. Lines are formatted in parallel
+    /// and written in large blocks. Invalid pixels are skipped.
+    /// @param compress if true, text is compressed with gzip while it is written
+    /// @throws std::runtime_error if file cannot be written
+    void exportTableText(const CorrectionTable &table, const std::string &path, bool compress);
+}
@@ -7,13 +7,16 @@ namespace ksg
 {
     enum class NumericMethod {
         NETWON,
-        LEVENBERG_MARQUARD
+        LEVENBERG_MARQUARD,
+        LINE_OF_SIGHT
     };
 
     constexpr const char* NM_NETWON_NAME = "NETWON";
     constexpr const char* NM_NETWON_DESC = "Netwon numeric method. I could be lighter in computation effort. However it fails to perform correction in subsatellite point.";
     constexpr const char* NM_LEVENBERG_MARQUARD_NAME = "LEVENBERG_MARQUARD";
     constexpr const char* NM_LEVENBERG_MARQUARD_DESC = "Levenberg-Marquard numeric method. This method is more roboust. It allows for correction near egde of view disc.";
+    constexpr const char* NM_LINE_OF_SIGHT_NAME = "LINE_OF_SIGHT";
+    constexpr const char* NM_LINE_OF_SIGHT_DESC = "Bracketed Newton method searching line of sight for point at object height. It has single unknown and works in subsatellite point. Squared target function does not apply to it.";
 
     inline static std::istream& operator>>(std::istream& in, NumericMethod& method) {
         std::string word;
@@ -23,6 +26,8 @@ namespace ksg
             method = NumericMethod::NETWON;
         } else if(word.compare(NM_LEVENBERG_MARQUARD_NAME) == 0) {
             method = NumericMethod::LEVENBERG_MARQUARD;
+        } else if(word.compare(NM_LINE_OF_SIGHT_NAME) == 0) {
+            method = NumericMethod::LINE_OF_SIGHT;
         } else {
             throw std::logic_error("Unknown numeric method: \""+word+"\"");
         }
@@ -37,6 +42,9 @@ namespace ksg
             case NumericMethod::LEVENBERG_MARQUARD:
                 out << NM_LEVENBERG_MARQUARD_NAME;
                 break;
+            case NumericMethod::LINE_OF_SIGHT:
+                out << NM_LINE_OF_SIGHT_NAME;
+                break;
             default:
                 out << "Unknown method";
                 break;
@@ -44,4 +52,188 @@ namespace ksg
 
         return out;
     }
+
+    enum class InitialGuess {
+        HEURISTIC,
+        INFLATED_ELLIPSOID
+    };
+
+    constexpr const char* IG_HEURISTIC_NAME = "HEURISTIC";
+    constexpr const char* IG_HEURISTIC_DESC = "Observed ellipsoid coordinates and distance from satellite shortened by twice object height.";
+    constexpr const char* IG_INFLATED_ELLIPSOID_NAME = "INFLATED_ELLIPSOID";
+    constexpr const char* IG_INFLATED_ELLIPSOID_DESC = "Intersection of line of sight with ellipsoid inflated by object height. Numeric method only refines it, so it requires much less iterations.";
+
+    inline static std::istream& operator>>(std::istream& in, InitialGuess& guess) {
+        std::string word;
+        in >> word;
+
+        if(word.compare(IG_HEURISTIC_NAME) == 0) {
+            guess = InitialGuess::HEURISTIC;
+        } else if(word.compare(IG_INFLATED_ELLIPSOID_NAME) == 0) {
+            guess = InitialGuess::INFLATED_ELLIPSOID;
+        } else {
+            throw std::logic_error("Unknown initial guess: \""+word+"\"");
+        }
+        return in;
+    }
+
+    inline static std::ostream& operator<<(std::ostream& out, const InitialGuess& guess) {
+        switch(guess) {
+            case InitialGuess::HEURISTIC:
+                out << IG_HEURISTIC_NAME;
+                break;
+            case InitialGuess::INFLATED_ELLIPSOID:
+                out << IG_INFLATED_ELLIPSOID_NAME;
+                break;
+            default:
+                out << "Unknown initial guess";
+                break;
+        }
+
+        return out;
+    }
+
+    enum class OutputEncoding {
+        FLOAT64,
+        FLOAT32,
+        DISPLACEMENT_INT16
+    };
+
+    constexpr const char* OE_FLOAT64_NAME = "FLOAT64";
+    constexpr const char* OE_FLOAT64_DESC = "Absolute geos coordinates as 64 bit floats.";
+    constexpr const char* OE_FLOAT32_NAME = "FLOAT32";
+    constexpr const char* OE_FLOAT32_DESC = "Absolute geos coordinates as 32 bit floats. Precision is about 0.5 m near edge of view disc.";
+    constexpr const char* OE_DISPLACEMENT_INT16_NAME = "DISPLACEMENT_INT16";
+    constexpr const char* OE_DISPLACEMENT_INT16_DESC = "Displacement from pixel center as 16 bit integers multiplied by scale stored in band metadata.";
+
+    inline static std::istream& operator>>(std::istream& in, OutputEncoding& encoding) {
+        std::string word;
+        in >> word;
+
+        if(word.compare(OE_FLOAT64_NAME) == 0) {
+            encoding = OutputEncoding::FLOAT64;
+        } else if(word.compare(OE_FLOAT32_NAME) == 0) {
+            encoding = OutputEncoding::FLOAT32;
+        } else if(word.compare(OE_DISPLACEMENT_INT16_NAME) == 0) {
+            encoding = OutputEncoding::DISPLACEMENT_INT16;
+        } else {
+            throw std::logic_error("Unknown output encoding: \""+word+"\"");
+        }
+        return in;
+    }
+
+    inline static std::ostream& operator<<(std::ostream& out, const OutputEncoding& encoding) {
+        switch(encoding) {
+            case OutputEncoding::FLOAT64:
+                out << OE_FLOAT64_NAME;
+                break;
+            case OutputEncoding::FLOAT32:
+                out << OE_FLOAT32_NAME;
+                break;
+            case OutputEncoding::DISPLACEMENT_INT16:
+                out << OE_DISPLACEMENT_INT16_NAME;
+                break;
+            default:
+                out << "Unknown output encoding";
+                break;
+        }
+
+        return out;
+    }
+
+    enum class Compression {
+        NONE,
+        DEFLATE,
+        ZSTD
+    };
+
+    constexpr const char* CO_NONE_NAME = "NONE";
+    constexpr const char* CO_NONE_DESC = "Striped, uncompressed GeoTIFF.";
+    constexpr const char* CO_DEFLATE_NAME = "DEFLATE";
+    constexpr const char* CO_DEFLATE_DESC = "Tiled GeoTIFF compressed with DEFLATE and predictor.";
+    constexpr const char* CO_ZSTD_NAME = "ZSTD";
+    constexpr const char* CO_ZSTD_DESC = "Tiled GeoTIFF compressed with ZSTD and predictor. Requires GDAL built with ZSTD.";
+
+    inline static std::istream& operator>>(std::istream& in, Compression& compression) {
+        std::string word;
+        in >> word;
+
+        if(word.compare(CO_NONE_NAME) == 0) {
+            compression = Compression::NONE;
+        } else if(word.compare(CO_DEFLATE_NAME) == 0) {
+            compression = Compression::DEFLATE;
+        } else if(word.compare(CO_ZSTD_NAME) == 0) {
+            compression = Compression::ZSTD;
+        } else {
+            throw std::logic_error("Unknown compression: \""+word+"\"");
+        }
+        return in;
+    }
+
+    inline static std::ostream& operator<<(std::ostream& out, const Compression& compression) {
+        switch(compression) {
+            case Compression::NONE:
+                out << CO_NONE_NAME;
+                break;
+            case Compression::DEFLATE:
+                out << CO_DEFLATE_NAME;
+                break;
+            case Compression::ZSTD:
+                out << CO_ZSTD_NAME;
+                break;
+            default:
+                out << "Unknown compression";
+                break;
+        }
+
+        return out;
+    }
+
+    enum class TableFormat {
+        TEXT,
+        BINARY_FLOAT64,
+        BINARY_FLOAT32
+    };
+
+    constexpr const char* TF_TEXT_NAME = "TEXT";
+    constexpr const char* TF_TEXT_DESC = "Text table, single line of latitudes and longitudes per pixel.";
+    constexpr const char* TF_BINARY_FLOAT64_NAME = "BINARY_FLOAT64";
+    constexpr const char* TF_BINARY_FLOAT64_DESC = "Binary, memory mappable table of 64 bit floats with validity bitmap.";
+    constexpr const char* TF_BINARY_FLOAT32_NAME = "BINARY_FLOAT32";
+    constexpr const char* TF_BINARY_FLOAT32_DESC = "Binary, memory mappable table of 32 bit floats with validity bitmap. It is half of size of BINARY_FLOAT64.";
+
+    inline static std::istream& operator>>(std::istream& in, TableFormat& format) {
+        std::string word;
+        in >> word;
+
+        if(word.compare(TF_TEXT_NAME) == 0) {
+            format = TableFormat::TEXT;
+        } else if(word.compare(TF_BINARY_FLOAT64_NAME) == 0) {
+            format = TableFormat::BINARY_FLOAT64;
+        } else if(word.compare(TF_BINARY_FLOAT32_NAME) == 0) {
+            format = TableFormat::BINARY_FLOAT32;
+        } else {
+            throw std::logic_error("Unknown table format: \""+word+"\"");
+        }
+        return in;
+    }
+
+    inline static std::ostream& operator<<(std::ostream& out, const TableFormat& format) {
+        switch(format) {
+            case TableFormat::TEXT:
+                out << TF_TEXT_NAME;
+                break;
+            case TableFormat::BINARY_FLOAT64:
+                out << TF_BINARY_FLOAT64_NAME;
+                break;
+            case TableFormat::BINARY_FLOAT32:
+                out << TF_BINARY_FLOAT32_NAME;
+                break;
+            default:
+                out << "Unknown table format";
+                break;
+        }
+
+        return out;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+
+#include "displacement_cache.h"
+
+using namespace std;
+
+namespace ksg
+{
+    constexpr char CACHE_MAGIC[8] = {'K', 'S', 'G', 'D', 'C', 'A', 'C', 'H'};
+    constexpr uint32_t CACHE_VERSION = 1;
+    constexpr size_t CACHE_ALIGNMENT = 4096;
+
+    struct DisplacementCacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t keyLength;
+        int32_t width, height;
+        int32_t heightsCount;
+        int32_t reserved;
+        double minHeight, heightStep;
+        uint64_t dataOffset;
+    };
+
+    static runtime_error cacheError(const string &message, const string &path)
+    {
+        return runtime_error(message + " " + path + ": " + strerror(errno));
+    }
+
+    DisplacementCache::DisplacementCache(const string &path, const string &key, int width, int height,
+                                         double minHeight, double maxHeight, double heightStep)
+        : width(width), height(height), minHeight(minHeight), heightStep(heightStep)
+    {
+        if (heightStep <= 0 || maxHeight <= minHeight)
+            throw logic_error("Invalid cache heights range");
+
+        heightsCount = static_cast<int>(floor((maxHeight - minHeight) / heightStep + 1e-9)) + 1;
+        if (heightsCount < 2)
+            throw logic_error("Cache heights range has to contain at least two heights");
+
+        size_t pixels = static_cast<size_t>(width) * height;
+        size_t dataOffset = (sizeof(DisplacementCacheHeader) + key.size() + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+        size_t nodesSize = 2 * sizeof(float) * pixels * heightsCount;
+        size_t errorsSize = sizeof(float) * pixels * (heightsCount - 1);
+        mappingSize = dataOffset + nodesSize + errorsSize;
+
+        fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            throw cacheError("Cannot open cache", path);
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0)
+        {
+            close(fd);
+            throw cacheError("Cannot stat cache", path);
+        }
+
+        DisplacementCacheHeader header;
+        if (static_cast<size_t>(fileStat.st_size) == mappingSize &&
+            pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+            memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+            header.version == CACHE_VERSION &&
+            header.keyLength == key.size() &&
+            header.width == width && header.height == height &&
+            header.heightsCount == heightsCount &&
+            header.minHeight == minHeight && header.heightStep == heightStep &&
+            header.dataOffset == dataOffset)
+        {
+            string storedKey(key.size(), '\0');
+            reused = pread(fd, &storedKey[0], key.size(), sizeof(header)) == static_cast<ssize_t>(key.size()) && storedKey == key;
+        }
+
+        if (!reused)
+        {
+            if (fileStat.st_size > 0)
+                cerr << "Cache " << path << " does not match raster or settings, it will be created again." << endl;
+
+            // Truncation to zero discards previous content, new file is sparse and filled with zeros
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+            header.version = CACHE_VERSION;
+            header.keyLength = key.size();
+            header.width = width;
+            header.height = height;
+            header.heightsCount = heightsCount;
+            header.minHeight = minHeight;
+            header.heightStep = heightStep;
+            header.dataOffset = dataOffset;
+
+            if (ftruncate(fd, 0) != 0 || ftruncate(fd, mappingSize) != 0 ||
+                pwrite(fd, &header, sizeof(header), 0) != sizeof(header) ||
+                pwrite(fd, key.data(), key.size(), sizeof(header)) != static_cast<ssize_t>(key.size()))
+            {
+                close(fd);
+                throw cacheError("Cannot initialise cache", path);
+            }
+        }
+
+        mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            close(fd);
+            throw cacheError("Cannot map cache", path);
+        }
+
+        nodes = reinterpret_cast<float *>(static_cast<char *>(mapping) + dataOffset);
+        errors = reinterpret_cast<float *>(static_cast<char *>(mapping) + dataOffset + nodesSize);
+    }
+
+    DisplacementCache::~DisplacementCache()
+    {
+        msync(mapping, mappingSize, MS_SYNC);
+        munmap(mapping, mappingSize);
+        close(fd);
+    }
+
+    string DisplacementCache::makeKey(const string &srsWkt, const double geotransform[6], double requiredAccuracy)
+    {
+        ostringstream key;
+        key.precision(17);
+        key << "srs=" << srsWkt << ";geotransform=";
+        for (int i = 0; i < 6; i++)
+            key << geotransform[i] << (i < 5 ? "," : "");
+        key << ";accuracy=" << requiredAccuracy;
+        return key.str();
+    }
+
+    bool DisplacementCache::setSymmetry(const ViewSymmetry &symmetry)
+    {
+        doubledAxisColumn = symmetry.isColumnMirrorExact() ? lround(2 * symmetry.getAxisColumn()) : -1;
+        doubledAxisLine = symmetry.isLineMirrorExact() ? lround(2 * symmetry.getAxisLine()) : -1;
+        return doubledAxisColumn >= 0 || doubledAxisLine >= 0;
+    }
+
+    void DisplacementCache::mirror(int &x, int &y, double &signX, double &signY) const
+    {
+        signX = signY = 1;
+
+        // Pixels whose mirror is out of raster keep their own entries
+        if (2 * x < doubledAxisColumn && doubledAxisColumn - x < width)
+        {
+            x = doubledAxisColumn - x;
+            signX = -1;
+        }
+        if (2 * y < doubledAxisLine && doubledAxisLine - y < height)
+        {
+            y = doubledAxisLine - y;
+            signY = -1;
+        }
+    }
+
+    unique_lock<mutex> DisplacementCache::lockEntry(int x, int y) const
+    {
+        if (doubledAxisColumn < 0 && doubledAxisLine < 0)
+            return unique_lock<mutex>();
+
+        // Adjacent intervals share node, so mutex is chosen by pixel only
+        return unique_lock<mutex>(entryMutexes[pixelIndex(x, y) % entryMutexes.size()]);
+    }
+
+    int DisplacementCache::findInterval(double objectHeight) const
+    {
+        double position = (objectHeight - minHeight) / heightStep;
+        if (!(position >= 0) || position > heightsCount - 1)
+            return -1;
+
+        return min(static_cast<int>(position), heightsCount - 2);
+    }
+
+    DisplacementCache::Lookup DisplacementCache::lookup(int x, int y, double objectHeight, double maxError, double &dx, double &dy) const
+    {
+        int interval = findInterval(objectHeight);
+        if (interval < 0)
+            return Lookup::MISS;
+
+        double signX, signY;
+        mirror(x, y, signX, signY);
+        auto lock = lockEntry(x, y);
+
+        float intervalError = error(x, y, interval);
+        if (intervalError == 0)
+            return Lookup::UNFILLED;
+        if (!(intervalError <= maxError))
+            return Lookup::MISS;
+
+        double t = (objectHeight - getNodeHeight(interval)) / heightStep;
+        const float *lower = node(x, y, interval);
+        const float *upper = node(x, y, interval + 1);
+        dx = signX * ((1 - t) * lower[0] + t * upper[0]);
+        dy = signY * ((1 - t) * lower[1] + t * upper[1]);
+        return Lookup::HIT;
+    }
+
+    void DisplacementCache::store(int x, int y, int interval, const double lower[2], const double upper[2], double intervalError)
+    {
+        // Mirrored pixels may fill the same entry from different threads, both with displacement within accuracy,
+        // entry lock keeps nodes and error of one of them together
+        double signX, signY;
+        mirror(x, y, signX, signY);
+        auto lock = lockEntry(x, y);
+
+        float *lowerNode = node(x, y, interval);
+        float *upperNode = node(x, y, interval + 1);
+        lowerNode[0] = signX * lower[0];
+        lowerNode[1] = signY * lower[1];
+        upperNode[0] = signX * upper[0];
+        upperNode[1] = signY * upper[1];
+
+        // Zero is reserved for intervals which were not filled yet
+        error(x, y, interval) = isnan(intervalError) ? numeric_limits<float>::infinity()
+                                                     : max(static_cast<float>(intervalError), numeric_limits<float>::min());
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+#include "view_symmetry.h"
+
+namespace ksg
+{
+    ///
+    /// Memory mapped, persistent cache of pixels displacements (in geos coordinates) on grid of object heights.
+    /// Displacement for height between grid nodes is linearly interpolated. Every interval between two nodes is
+    /// filled together with error of such interpolation, measured in its midpoint.
+    ///
+    /// Cache is valid only for single raster geometry and solver settings, described by key.
+    /// If existing file was created for different key or grid, it is discarded and created again.
+    class DisplacementCache
+    {
+    public:
+        enum class Lookup {
+            /// Displacement was interpolated from cache
+            HIT,
+            /// Interval containing height was not filled yet
+            UNFILLED,
+            /// Height is out of grid or interpolation error exceeds allowed one
+            MISS
+        };
+
+        ///
+        /// Opens existing cache file or creates new one.
+        /// @param path location of cache file
+        /// @param key description of raster geometry and solver settings
+        /// @param width raster width in pixels
+        /// @param height raster height in pixels
+        /// @param minHeight height of first grid node [m]
+        /// @param maxHeight height of last grid node [m]
+        /// @param heightStep distance between grid nodes [m]
+        DisplacementCache(const std::string &path, const std::string &key, int width, int height,
+                          double minHeight, double maxHeight, double heightStep);
+        ~DisplacementCache();
+
+        DisplacementCache(const DisplacementCache &) = delete;
+        DisplacementCache &operator=(const DisplacementCache &) = delete;
+
+        ///
+        /// @return key describing raster geometry and solver settings
+        static std::string makeKey(const std::string &srsWkt, const double geotransform[6], double requiredAccuracy);
+
+        ///
+        /// @return true if cache was loaded from existing file
+        bool isReused() const { return reused; }
+
+        ///
+        /// Shares entries of pixels mirrored about central meridian or equator, so only canonical quadrant of
+        /// cache is filled. Axes whose mirrored pixels do not land on pixel centers are not used.
+        /// Displacements are mirrored together with pixels, so content of cache does not depend on symmetry.
+        /// @return true if at least one axis is used
+        bool setSymmetry(const ViewSymmetry &symmetry);
+
+        int getHeightsCount() const { return heightsCount; }
+        double getNodeHeight(int node) const { return minHeight + node * heightStep; }
+
+        ///
+        /// @return index of interval containing objectHeight or -1 if it is out of grid
+        int findInterval(double objectHeight) const;
+
+        ///
+        /// @param maxError maximal allowed interpolation error [m]
+        /// @param dx, dy interpolated displacement, set only on HIT
+        Lookup lookup(int x, int y, double objectHeight, double maxError, double &dx, double &dy) const;
+
+        ///
+        /// Fills interval of pixel.
+        /// @param lower displacement (dx, dy) in lower node of interval
+        /// @param upper displacement (dx, dy) in upper node of interval
+        /// @param error interpolation error in the middle of interval, infinity if it could not be calculated
+        void store(int x, int y, int interval, const double lower[2], const double upper[2], double error);
+
+    private:
+        int fd = -1;
+        void *mapping = nullptr;
+        size_t mappingSize = 0;
+        bool reused = false;
+
+        int width, height;
+        int heightsCount;
+        double minHeight, heightStep;
+
+        /// Twice the 0 based column and line of axes of symmetry, negative if axis is not used
+        long doubledAxisColumn = -1, doubledAxisLine = -1;
+
+        /// Mirrored pixels of different blocks share entries, so with symmetry entries are guarded by striped mutexes
+        mutable std::array<std::mutex, 64> entryMutexes;
+
+        /// Displacements: node planes of interleaved (dx, dy) pairs
+        float *nodes = nullptr;
+        /// Interpolation errors: interval planes, zero marks interval which was not filled yet
+        float *errors = nullptr;
+
+        inline size_t pixelIndex(int x, int y) const { return static_cast<size_t>(y) * width + x; }
+
+        ///
+        /// Replaces pixel with its mirror in canonical quadrant.
+        /// @param signX, signY -1 for displacement component which changes sign, 1 otherwise
+        void mirror(int &x, int &y, double &signX, double &signY) const;
+
+        ///
+        /// Locks entry of mirrored pixel if entries are shared between pixels, otherwise pixel belongs to single thread.
+        std::unique_lock<std::mutex> lockEntry(int x, int y) const;
+        inline float *node(int x, int y, int node) const { return nodes + 2 * (static_cast<size_t>(node) * width * height + pixelIndex(x, y)); }
+        inline float &error(int x, int y, int interval) const { return errors[static_cast<size_t>(interval) * width * height + pixelIndex(x, y)]; }
+    };
+}
@@ -1,7 +1,12 @@
+#pragma once
 #include <cmath>
+#include <utility>
 
 namespace ksg
 {
+    /// Length of degree of great circle of WGS84 ellipsoid equator, used to measure errors of coordinates [m]
+    constexpr double DEGREE_LENGTH = 6378137 * M_PI / 180;
+
     constexpr static inline double N(double phi_earth, double a, double eSqr)
     {
         using namespace std;
@@ -11,7 +16,76 @@ namespace ksg
     constexpr static inline double dNdphi(double phi_earth, double a, double eSqr)
     {
         using namespace std;
-        return (a * eSqr * sin(phi_earth) * cos(phi_earth)) / pow(1 - eSqr * pow(sin(phi_earth), 2), 3 / 2);
+        return (a * eSqr * sin(phi_earth) * cos(phi_earth)) / pow(1 - eSqr * pow(sin(phi_earth), 2), 1.5);
+    }
+
+    ///
+    /// Longitude wrapped into [-180, 180) [deg]. Every corrected longitude uses this convention.
+    static inline double wrapLongitude(double longitude)
+    {
+        return longitude - 360 * std::floor((longitude + 180) / 360);
+    }
+
+    ///
+    /// Offset of point from origin along local parallel and meridian of origin [m].
+    /// @param origin, point (longitude, latitude) [deg]
+    static inline std::pair<double, double> localOffset(std::pair<double, double> origin, std::pair<double, double> point)
+    {
+        double eastLength = DEGREE_LENGTH * std::cos(origin.second * M_PI / 180);
+        return std::make_pair(wrapLongitude(point.first - origin.first) * eastLength, (point.second - origin.second) * DEGREE_LENGTH);
+    }
+
+    ///
+    /// Point at local offset from origin, inverse of localOffset.
+    /// @return (longitude, latitude) [deg], longitude wrapped like corrected ones
+    static inline std::pair<double, double> offsetPoint(std::pair<double, double> origin, std::pair<double, double> offset)
+    {
+        double eastLength = DEGREE_LENGTH * std::cos(origin.second * M_PI / 180);
+        return std::make_pair(wrapLongitude(origin.first + offset.first / eastLength), origin.second + offset.second / DEGREE_LENGTH);
+    }
+
+    ///
+    /// Geodetic height of cartesian point, with closed-form method of Vermeille.
+    /// Valid for points outside of evolute of ellipsoid, i.e. anywhere except hundreds of kilometres around its center.
+    /// @param normal if not null, receives unit normal of ellipsoid at foot of point
+    /// @return height above ellipsoid, in units of a
+    static inline double geodeticHeight(double x, double y, double z, double a, double eSqr, double *normal = nullptr)
+    {
+        using namespace std;
+        double eQuad = eSqr * eSqr;
+        double rho = sqrt(x * x + y * y);
+        double p = rho * rho / (a * a);
+        double q = (1 - eSqr) * z * z / (a * a);
+        double r = (p + q - eQuad) / 6;
+        double s = eQuad * p * q / (4 * r * r * r);
+        double t = cbrt(1 + s + sqrt(s * (2 + s)));
+        double u = r * (1 + t + 1 / t);
+        double v = sqrt(u * u + eQuad * q);
+        double w = eSqr * (u + v - q) / (2 * v);
+        double k = sqrt(u + v + w * w) - w;
+        double d = k * rho / (k + eSqr);
+        double dz = sqrt(d * d + z * z);
+
+        // Geodetic latitude is 2 * atan2(z, d + dz), so its cosine and sine are d / dz and z / dz
+        if (normal != nullptr)
+        {
+            double horizontal = rho > 0 ? d / (dz * rho) : 0;
+            normal[0] = x * horizontal;
+            normal[1] = y * horizontal;
+            normal[2] = z / dz;
+        }
+
+        return (k + eSqr - 1) / k * dz;
+    }
+
+    ///
+    /// Geodetic coordinates of cartesian point, see geodeticHeight.
+    static inline void geodeticCoordinates(double x, double y, double z, double a, double eSqr, double &phi_earth, double &lambda_earth, double &height)
+    {
+        double normal[3];
+        height = geodeticHeight(x, y, z, a, eSqr, normal);
+        phi_earth = std::atan2(normal[2], std::sqrt(normal[0] * normal[0] + normal[1] * normal[1]));
+        lambda_earth = std::atan2(y, x);
     }
 
 }
\ No newline at end of file
@@ -57,4 +57,23 @@ namespace ksg {
         return in;
     }
 
+    template<char SEP=','>
+    struct HeightsRange {
+        double min, max, step;
+    };
+
+    template<char SEP>
+    inline std::istream& operator>>(std::istream& in, HeightsRange<SEP>& range) {
+        std::tuple<double,double,double> packed;
+        ksg::TupleParser::parse_tuple_with_separator<SEP, double,double,double>(in, packed);
+        std::tie(range.min, range.max, range.step) = packed;
+        return in;
+    }
+
+    template<char SEP>
+    inline std::ostream& operator<<(std::ostream& out, const HeightsRange<SEP>& range) {
+        out << range.min << SEP << range.max << SEP << range.step;
+        return out;
+    }
+
 }
\ No newline at end of file
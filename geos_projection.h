@@ -0,0 +1,170 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace ksg
+{
+    ///
+    /// Closed-form geostationary projection on ellipsoid, equivalent of PROJ "geos" projection.
+    /// Ellipsoid coordinates are longitude and latitude in degrees, geos coordinates are expressed in metres.
+    /// Points which are not visible from satellite are mapped to NaN.
+    class GeosProjection
+    {
+        double a = 1;
+        double centralMeridian = 0;
+        double falseEasting = 0, falseNorthing = 0;
+        bool sweepX = false;
+
+        // Terms named after PROJ implementation, normalised with semi-major axis
+        double radiusP = 1, radiusP2 = 1, radiusPInv2 = 1;
+        double radiusG = 1, radiusG1 = 0, C = 0;
+
+        static inline double toRadians(double deg) { return deg * (M_PI / 180); }
+        static inline double toDegrees(double rad) { return rad * (180 / M_PI); }
+
+    public:
+        GeosProjection() = default;
+
+        ///
+        /// @param a Ellipsoid semi-major axis lenght
+        /// @param b Ellipsoid semi-minor axis lenght
+        /// @param centralMeridian Sub-satellite longitude in degrees
+        /// @param satelliteHeight Satellite height above ellipsoid
+        /// @param sweepX true if satellite sweeps along x axis (GOES), false if along y axis (Meteosat)
+        GeosProjection(double a, double b, double centralMeridian, double satelliteHeight, bool sweepX,
+                       double falseEasting = 0, double falseNorthing = 0)
+            : a(a), centralMeridian(centralMeridian), falseEasting(falseEasting), falseNorthing(falseNorthing), sweepX(sweepX)
+        {
+            radiusP2 = (b * b) / (a * a);
+            radiusP = std::sqrt(radiusP2);
+            radiusPInv2 = 1 / radiusP2;
+            radiusG1 = satelliteHeight / a;
+            radiusG = 1 + radiusG1;
+            C = radiusG * radiusG - 1;
+        }
+
+        bool isSweepX() const { return sweepX; }
+
+        ///
+        /// Transforms ellipsoid coordinates into geos coordinates.
+        /// @return false if point is not visible from satellite
+        inline bool forward(double lon, double lat, double &x, double &y) const
+        {
+            double lambda = toRadians(lon - centralMeridian);
+            double phi = std::atan(radiusP2 * std::tan(toRadians(lat)));
+
+            double r = radiusP / std::hypot(radiusP * std::cos(phi), std::sin(phi));
+            double vx = r * std::cos(lambda) * std::cos(phi);
+            double vy = r * std::sin(lambda) * std::cos(phi);
+            double vz = r * std::sin(phi);
+
+            double tmp = radiusG - vx;
+            bool visible = (tmp * vx - vy * vy - vz * vz * radiusPInv2) >= 0;
+
+            double angleX = sweepX ? std::atan(vy / std::hypot(vz, tmp)) : std::atan(vy / tmp);
+            double angleY = sweepX ? std::atan(vz / tmp) : std::atan(vz / std::hypot(vy, tmp));
+
+            constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+            x = visible ? a * radiusG1 * angleX + falseEasting : nan;
+            y = visible ? a * radiusG1 * angleY + falseNorthing : nan;
+            return visible;
+        }
+
+        ///
+        /// Transforms point of space into geos coordinates of its image. Visibility of point is not checked.
+        /// @param px, py, pz Cartesian coordinates normalised with semi-major axis, x axis points towards sub-satellite point
+        inline void forwardPoint(double px, double py, double pz, double &x, double &y) const
+        {
+            double tmp = radiusG - px;
+
+            double angleX = sweepX ? std::atan(py / std::hypot(pz, tmp)) : std::atan(py / tmp);
+            double angleY = sweepX ? std::atan(pz / tmp) : std::atan(pz / std::hypot(py, tmp));
+
+            x = a * radiusG1 * angleX + falseEasting;
+            y = a * radiusG1 * angleY + falseNorthing;
+        }
+
+        ///
+        /// Transforms geos coordinates into ellipsoid coordinates.
+        /// @return false if line of sight does not intersect ellipsoid
+        inline bool inverse(double x, double y, double &lon, double &lat) const
+        {
+            double angleX = (x - falseEasting) / (a * radiusG1);
+            double angleY = (y - falseNorthing) / (a * radiusG1);
+
+            double vx = -1, vy, vz;
+            if (sweepX)
+            {
+                vz = std::tan(angleY);
+                vy = std::tan(angleX) * std::hypot(1.0, vz);
+            }
+            else
+            {
+                vy = std::tan(angleX);
+                vz = std::tan(angleY) * std::hypot(1.0, vy);
+            }
+
+            double qa = vz / radiusP;
+            qa = vy * vy + qa * qa + vx * vx;
+            double qb = 2 * radiusG * vx;
+            double det = qb * qb - 4 * qa * C;
+            bool visible = det >= 0;
+
+            double k = (-qb - std::sqrt(visible ? det : 0)) / (2 * qa);
+            vx = radiusG + k * vx;
+            vy *= k;
+            vz *= k;
+
+            double lambda = std::atan2(vy, vx);
+            double phi = std::atan(radiusPInv2 * (vz * std::cos(lambda) / vx));
+
+            constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+            lon = visible ? std::remainder(toDegrees(lambda) + centralMeridian, 360.0) : nan;
+            lat = visible ? toDegrees(phi) : nan;
+            return visible;
+        }
+
+        ///
+        /// Converts geos coordinates into satellite view angles used by parallax problem.
+        /// Parallax problem uses y sweep convention, so for x sweep angles are recalculated from line of sight.
+        /// @param lambda_s Satellite horizontal view angle in radians
+        /// @param phi_s Satellite vertical view angle in radians
+        inline void viewAngles(double x, double y, double &lambda_s, double &phi_s) const
+        {
+            double angleX = (x - falseEasting) / (a * radiusG1);
+            double angleY = (y - falseNorthing) / (a * radiusG1);
+
+            if (sweepX)
+            {
+                double vz = std::tan(angleY);
+                double vy = std::tan(angleX) * std::hypot(1.0, vz);
+                lambda_s = std::atan(vy);
+                phi_s = std::atan(vz / std::hypot(1.0, vy));
+            }
+            else
+            {
+                lambda_s = angleX;
+                phi_s = angleY;
+            }
+        }
+
+        ///
+        /// Transforms arrays of ellipsoid coordinates into geos coordinates. Invisible points are set to NaN.
+        inline void forward(size_t count, const double *lon, const double *lat, double *x, double *y) const
+        {
+            #pragma omp simd
+            for (size_t i = 0; i < count; i++)
+                forward(lon[i], lat[i], x[i], y[i]);
+        }
+
+        ///
+        /// Transforms arrays of geos coordinates into ellipsoid coordinates. Invisible points are set to NaN.
+        inline void inverse(size_t count, const double *x, const double *y, double *lon, double *lat) const
+        {
+            #pragma omp simd
+            for (size_t i = 0; i < count; i++)
+                inverse(x[i], y[i], lon[i], lat[i]);
+        }
+    };
+}
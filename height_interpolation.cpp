@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "height_interpolation.h"
+#include "geodetic_utils.h"
+
+using namespace std;
+
+namespace ksg
+{
+    /// Number of intervals between anchors solved first
+    constexpr size_t INITIAL_INTERVALS = 4;
+
+    static double sign(double value)
+    {
+        return (value > 0) - (value < 0);
+    }
+
+    /// One sided, shape preserving derivative in end node
+    static double endSlope(double h0, double h1, double delta0, double delta1)
+    {
+        double slope = ((2 * h0 + h1) * delta0 - h0 * delta1) / (h0 + h1);
+        if (sign(slope) != sign(delta0))
+            return 0;
+        if (sign(delta0) != sign(delta1) && fabs(slope) > 3 * fabs(delta0))
+            return 3 * delta0;
+        return slope;
+    }
+
+    MonotoneCubic::MonotoneCubic(vector<double> x, vector<double> y)
+        : x(move(x)), y(move(y))
+    {
+        size_t n = this->x.size();
+        if (n < 2 || this->y.size() != n)
+            throw logic_error("Monotone cubic requires at least two nodes");
+
+        vector<double> h(n - 1), delta(n - 1);
+        for (size_t k = 0; k + 1 < n; k++)
+        {
+            h[k] = this->x[k + 1] - this->x[k];
+            delta[k] = (this->y[k + 1] - this->y[k]) / h[k];
+        }
+
+        slopes.resize(n);
+        if (n == 2)
+        {
+            slopes[0] = slopes[1] = delta[0];
+            return;
+        }
+
+        // Three point estimates, zero in local extrema
+        for (size_t k = 1; k + 1 < n; k++)
+            slopes[k] = delta[k - 1] * delta[k] <= 0 ? 0 : (h[k] * delta[k - 1] + h[k - 1] * delta[k]) / (h[k - 1] + h[k]);
+
+        slopes[0] = endSlope(h[0], h[1], delta[0], delta[1]);
+        slopes[n - 1] = endSlope(h[n - 2], h[n - 3], delta[n - 2], delta[n - 3]);
+
+        // Limit slopes so that interpolant stays monotone in every interval
+        for (size_t k = 0; k + 1 < n; k++)
+        {
+            if (delta[k] == 0)
+            {
+                slopes[k] = slopes[k + 1] = 0;
+                continue;
+            }
+
+            double alpha = slopes[k] / delta[k], beta = slopes[k + 1] / delta[k];
+            double radius = hypot(alpha, beta);
+            if (radius > 3)
+            {
+                slopes[k] = 3 * alpha / radius * delta[k];
+                slopes[k + 1] = 3 * beta / radius * delta[k];
+            }
+        }
+    }
+
+    double MonotoneCubic::operator()(double at) const
+    {
+        size_t k = upper_bound(x.begin(), x.end(), at) - x.begin();
+        k = min(max<size_t>(k, 1), x.size() - 1) - 1;
+
+        double h = x[k + 1] - x[k];
+        double t = (at - x[k]) / h;
+        double h00 = (1 + 2 * t) * (1 - t) * (1 - t), h10 = t * (1 - t) * (1 - t);
+        double h01 = t * t * (3 - 2 * t), h11 = t * t * (t - 1);
+        return h00 * y[k] + h10 * h * slopes[k] + h01 * y[k + 1] + h11 * h * slopes[k + 1];
+    }
+
+    size_t interpolateHeights(const vector<double> &heights, pair<double, double> observed, double maxError,
+                              const function<pair<double, double>(double)> &solve, pair<double, double> *coordinates)
+    {
+        size_t n = heights.size();
+        vector<bool> solved(n, false);
+        size_t solutions = 0;
+
+        // Solved heights are wrapped like interpolated ones, whatever convention solver uses
+        auto solveAt = [&](size_t i) {
+            coordinates[i] = solve(heights[i]);
+            coordinates[i].first = wrapLongitude(coordinates[i].first);
+            solved[i] = true;
+            solutions++;
+            return !isnan(coordinates[i].first) && !isnan(coordinates[i].second);
+        };
+
+        auto solveRest = [&]() {
+            for (size_t i = 0; i < n; i++)
+                if (!solved[i])
+                    solveAt(i);
+            return solutions;
+        };
+
+        if (n <= INITIAL_INTERVALS + 1)
+            return solveRest();
+
+        vector<size_t> anchors;
+        for (size_t k = 0; k <= INITIAL_INTERVALS; k++)
+            anchors.push_back(k * (n - 1) / INITIAL_INTERVALS);
+
+        for (auto anchor : anchors)
+            if (!solveAt(anchor))
+                return solveRest();
+
+        vector<bool> anchor(n, false);
+        for (auto a : anchors)
+            anchor[a] = true;
+
+        // Displacements of anchors, interpolated separately in longitude and latitude
+        auto fit = [&]() {
+            vector<double> x, longitudes, latitudes;
+            for (size_t i = 0; i < n; i++)
+                if (anchor[i])
+                {
+                    x.push_back(heights[i]);
+                    longitudes.push_back(wrapLongitude(coordinates[i].first - observed.first));
+                    latitudes.push_back(coordinates[i].second - observed.second);
+                }
+            return make_pair(MonotoneCubic(x, longitudes), MonotoneCubic(x, latitudes));
+        };
+
+        // Middles of intervals only check interpolation. Middle which disagrees becomes anchor, which changes
+        // interpolation of neighbouring intervals too, so all intervals are checked again until none fails.
+        double cosLatitude = cos(observed.second * M_PI / 180);
+        while (true)
+        {
+            auto spline = fit();
+            bool failed = false;
+
+            for (size_t first = 0, second = 1; second < n; second++)
+            {
+                if (!anchor[second])
+                    continue;
+
+                size_t middle = (first + second) / 2;
+                size_t length = second - first;
+                first = second;
+                if (length < 2)
+                    continue;
+
+                if (!solved[middle] && !solveAt(middle))
+                    return solveRest();
+
+                double longitude = spline.first(heights[middle]), latitude = spline.second(heights[middle]);
+                double error = DEGREE_LENGTH * hypot(wrapLongitude(coordinates[middle].first - observed.first - longitude) * cosLatitude,
+                                                     coordinates[middle].second - observed.second - latitude);
+                if (!(error <= maxError))
+                {
+                    anchor[middle] = true;
+                    failed = true;
+                }
+            }
+
+            if (!failed)
+            {
+                for (size_t i = 0; i < n; i++)
+                    if (!solved[i])
+                        coordinates[i] = make_pair(wrapLongitude(observed.first + spline.first(heights[i])),
+                                                   observed.second + spline.second(heights[i]));
+                break;
+            }
+        }
+
+        return solutions;
+    }
+}
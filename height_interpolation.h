@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace ksg
+{
+    ///
+    /// Monotone piecewise cubic Hermite interpolation (Fritsch-Carlson). Three point slopes are limited so that
+    /// interpolant does not overshoot data: it is monotone wherever data is, and keeps extrema at nodes.
+    class MonotoneCubic
+    {
+    public:
+        ///
+        /// @param x increasing nodes, at least two
+        /// @param y values in nodes
+        MonotoneCubic(std::vector<double> x, std::vector<double> y);
+
+        double operator()(double at) const;
+
+        ///
+        /// @return derivatives in nodes
+        const std::vector<double> &getSlopes() const { return slopes; }
+
+    private:
+        std::vector<double> x, y;
+        /// Derivatives in nodes
+        std::vector<double> slopes;
+    };
+
+    ///
+    /// Calculates corrected coordinates for every height of grid, solving only some heights (anchors) and
+    /// interpolating others. Displacements from observed coordinates are interpolated with MonotoneCubic in
+    /// both coordinates. Grid is divided into few intervals between anchors first. Middle grid height of every interval
+    /// is solved and compared with interpolation of anchors; where they differ by more than maxError, middle becomes
+    /// anchor and interval is split. New anchors change interpolation of neighbouring intervals, so all intervals are
+    /// checked again with the final interpolation, until none of them fails.
+    /// If any anchor cannot be solved, remaining heights are solved directly.
+    /// @param heights increasing grid of heights [m]
+    /// @param observed observed (longitude, latitude) [deg]
+    /// @param maxError maximal allowed interpolation error [m]
+    /// @param solve returns corrected (longitude, latitude) of object of given height [deg], NaN if it cannot be solved
+    /// @param coordinates receives corrected (longitude, latitude) for every height [deg], longitude wrapped into [-180, 180)
+    /// @return number of solved heights
+    size_t interpolateHeights(const std::vector<double> &heights, std::pair<double, double> observed, double maxError,
+                              const std::function<std::pair<double, double>(double)> &solve, std::pair<double, double> *coordinates);
+}
@@ -0,0 +1,228 @@
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <gdal_priv.h>
+#include <ogr_spatialref.h>
+#include <boost/program_options.hpp>
+#include "correction.h"
+#include "correction_utils.h"
+#include "image_correction.h"
+#include "memory_usage.h"
+
+using namespace std;
+
+static const string nmDesc = string() +
+        "Numeric method. Either:\n" +
+        ksg::NM_NETWON_NAME + "\n" +
+        ksg::NM_NETWON_DESC + "\n" +
+        ksg::NM_LEVENBERG_MARQUARD_NAME + "\n" +
+        ksg::NM_LEVENBERG_MARQUARD_DESC + "\n" +
+        ksg::NM_LINE_OF_SIGHT_NAME + "\n" +
+        ksg::NM_LINE_OF_SIGHT_DESC + "\n";
+
+static const string igDesc = string() +
+        "Initial guess for numeric method. Either:\n" +
+        ksg::IG_HEURISTIC_NAME + "\n" +
+        ksg::IG_HEURISTIC_DESC + "\n" +
+        ksg::IG_INFLATED_ELLIPSOID_NAME + "\n" +
+        ksg::IG_INFLATED_ELLIPSOID_DESC + "\n";
+
+static const string gaDesc = string() +
+        "Space or comma separated gridding algorithms of bands respectively. Bands not listed use average. Algorithms:\n" +
+        ksg::GA_AVERAGE_NAME + "\n" +
+        ksg::GA_AVERAGE_DESC + "\n" +
+        ksg::GA_NEAREST_NAME + "\n" +
+        ksg::GA_NEAREST_DESC + "\n" +
+        ksg::GA_MAXIMUM_NAME + "\n" +
+        ksg::GA_MAXIMUM_DESC + "\n";
+
+static const string cmDesc = string() +
+        "Correction mode. Either:\n" +
+        ksg::CM_FORWARD_NAME + "\n" +
+        ksg::CM_FORWARD_DESC + "\n" +
+        ksg::CM_INVERSE_NAME + "\n" +
+        ksg::CM_INVERSE_DESC + "\n";
+
+static const string rsDesc = string() +
+        "Resampling of inverse mode. Either:\n" +
+        ksg::RS_NEAREST_NAME + "\n" +
+        ksg::RS_NEAREST_DESC + "\n" +
+        ksg::RS_BILINEAR_NAME + "\n" +
+        ksg::RS_BILINEAR_DESC + "\n";
+
+boost::program_options::variables_map init(int argc, char ** argv)
+{
+    boost::program_options::options_description options("GEOS image correction options");
+    options.add_options()
+    ("help","Shows help message")
+    ("input", boost::program_options::value<std::string>(), "Location of image requiring correction.")
+    ("height", boost::program_options::value<std::string>(), "Location of image containing height information.")
+    ("output", boost::program_options::value<std::string>(), "Location of corrected image.")
+    ("height-band",boost::program_options::value<int>()->default_value(1),"Band with height information [m]. ")
+    ("mode", boost::program_options::value<ksg::CorrectionMode>()->default_value(ksg::CorrectionMode::FORWARD), cmDesc.c_str())
+    ("algorithms", boost::program_options::value<std::vector<std::string>>()->multitoken(), gaDesc.c_str())
+    ("z-buffer-tolerance", boost::program_options::value<double>()->default_value(500), "Pixels moved into the same cell are combined only if they are lower than the highest one by at most this value [m]. Displacements of coarse height raster are interpolated only between pixels whose heights differ by at most this value.")
+    ("fill-distance", boost::program_options::value<int>()->default_value(2), "Maximal distance of filling cells left empty after correction with neighbouring values [px]. 0 disables filling.")
+    ("resampling", boost::program_options::value<ksg::Resampling>()->default_value(ksg::Resampling::BILINEAR), rsDesc.c_str())
+    ("requierd-accuracy",boost::program_options::value<double>()->default_value(10),"Required accuracy [m].")
+    (
+        "numeric-method",
+        boost::program_options::value<ksg::NumericMethod>()->default_value(ksg::NumericMethod::LEVENBERG_MARQUARD),
+        nmDesc.c_str()
+    )
+    ("use-squared-target", "Use squared targed function.")
+    (
+        "initial-guess",
+        boost::program_options::value<ksg::InitialGuess>()->default_value(ksg::InitialGuess::INFLATED_ELLIPSOID),
+        igDesc.c_str()
+    )
+    ("iterations-limit",boost::program_options::value<int>()->default_value(100),"Maximum number of iteration per pixel.")
+    ("warm-start", "Start numeric method from solution of neighbouring pixel.")
+    ("memory-limit",boost::program_options::value<int>()->default_value(0),"Memory limit [MiB]. Image is processed in strips of rows fitting into it, one eighth of it is given to GDAL block cache. 0 means the whole image is processed at once.")
+    ("threads",boost::program_options::value<int>()->default_value(0),"Number of worker threads. 0 means all available cores.");
+
+    auto ret = boost::program_options::variables_map();
+
+    auto style = boost::program_options::command_line_style::unix_style;
+    style = (decltype(style))(style ^ boost::program_options::command_line_style::allow_short);
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options, style), ret);
+    boost::program_options::notify(ret);
+
+    if(argc <= 1 || ret.count("help") >=1)
+    {
+        std::cout << options << std::endl;
+        exit(1);
+    }
+
+    return ret;
+}
+
+void CopyGeoMetadata(GDALDataset* dest, GDALDataset* source)
+{
+    double geo[6];
+    source->GetGeoTransform(geo);
+    dest->SetGeoTransform(geo);
+    dest->SetProjection(source->GetProjectionRef());
+}
+
+std::vector<ksg::GriddingAlgorithm> ParseAlgorithms(const boost::program_options::variables_map &variablesMap)
+{
+    std::vector<ksg::GriddingAlgorithm> algorithms;
+    if(variablesMap.count("algorithms") == 0)
+        return algorithms;
+
+    for(auto word : variablesMap["algorithms"].as<std::vector<std::string>>())
+    {
+        std::replace(word.begin(), word.end(), ',', ' ');
+        std::istringstream in(word);
+        ksg::GriddingAlgorithm algorithm;
+        while(in >> std::ws && !in.eof())
+        {
+            in >> algorithm;
+            algorithms.push_back(algorithm);
+        }
+    }
+    return algorithms;
+}
+
+int main(int argc, char** argv) {
+    auto variablesMap = init(argc,argv);
+    GDALAllRegister();
+
+#ifdef _OPENMP
+    if(variablesMap["threads"].as<int>() > 0)
+        omp_set_num_threads(variablesMap["threads"].as<int>());
+#endif
+
+    int ret = 0;
+
+    // Block cache takes part of memory limit, so finished strips leave it early
+    size_t memoryLimit = static_cast<size_t>(std::max(0, variablesMap["memory-limit"].as<int>())) << 20;
+    if(memoryLimit > 0)
+        GDALSetCacheMax64(memoryLimit / 8);
+
+    GDALDataset *image = nullptr, *heights = nullptr, *output = nullptr;
+
+    try
+    {
+        ksg::ImageCorrectionSettings settings;
+        settings.mode = variablesMap["mode"].as<ksg::CorrectionMode>();
+        settings.algorithms = ParseAlgorithms(variablesMap);
+        settings.zBufferTolerance = variablesMap["z-buffer-tolerance"].as<double>();
+        settings.fillDistance = variablesMap["fill-distance"].as<int>();
+        settings.resampling = variablesMap["resampling"].as<ksg::Resampling>();
+        settings.requiredAccuracy = variablesMap["requierd-accuracy"].as<double>();
+        settings.iterationsLimit = variablesMap["iterations-limit"].as<int>();
+        settings.numericMethod = variablesMap["numeric-method"].as<ksg::NumericMethod>();
+        settings.useQuadraticForm = variablesMap.count("use-squared-target") > 0;
+        settings.initialGuess = variablesMap["initial-guess"].as<ksg::InitialGuess>();
+        settings.warmStart = variablesMap.count("warm-start") > 0;
+        settings.memoryLimit = memoryLimit;
+
+        auto imagePath = variablesMap["input"].as<std::string>();
+        image = (GDALDataset*)GDALOpen(imagePath.c_str(), GA_ReadOnly);
+        if(image == nullptr)
+            throw runtime_error("Cannot open "+imagePath);
+
+        auto heightPath = variablesMap["height"].as<std::string>();
+        heights = (GDALDataset*)GDALOpen(heightPath.c_str(), GA_ReadOnly);
+        if(heights == nullptr)
+            throw runtime_error("Cannot open "+heightPath);
+
+        auto tifDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+        if(tifDriver == nullptr)
+            throw runtime_error("There is no GTiff driver");
+
+        OGRSpatialReference srs;
+        auto srs_c = image->GetProjectionRef();
+        srs.importFromWkt(&srs_c);
+
+        auto projectionName = srs.GetAttrValue("PROJECTION");
+        if(projectionName == nullptr || string(projectionName) != "Geostationary_Satellite")
+            throw runtime_error("Height correction requires Geostationary_Satellite projection.");
+
+        int heightBand = variablesMap["height-band"].as<int>();
+        if(heights->GetRasterBand(heightBand) == nullptr)
+            throw runtime_error("There is no band " + to_string(heightBand) + " in "+heightPath);
+
+        auto outputPath = variablesMap["output"].as<std::string>();
+        output = tifDriver->Create(outputPath.c_str(), image->GetRasterXSize(), image->GetRasterYSize(), image->GetRasterCount(), GDT_Float64, nullptr);
+        if(output == nullptr)
+            throw runtime_error("Cannot create "+outputPath);
+        CopyGeoMetadata(output, image);
+
+        auto corrector = GEOSHeightCorrector(srs);
+
+        // Height raster on different grid is warped onto image grid strip by strip
+        ksg::ImageCorrector imageCorrector(corrector, image, heights, heightBand);
+        imageCorrector.correct(output, settings);
+
+        if(memoryLimit > 0)
+        {
+            size_t peak = ksg::peakMemoryUsage();
+            cerr << "Image corrected in " << imageCorrector.getStripsCount() << " strips, peak memory usage " << (peak >> 20) << " MiB." << endl;
+            if(peak > memoryLimit)
+                cerr << "Warning: peak memory usage exceeded limit of " << (memoryLimit >> 20) << " MiB." << endl;
+        }
+    }
+    catch(exception &ex)
+    {
+        cerr << "Error: "<< ex.what() << endl;
+        ret = -1;
+    }
+
+    for(auto dataset : {image, heights, output})
+        if(dataset != nullptr)
+            GDALClose(dataset);
+
+    return ret == 0 ? 0 : 2;
+}
@@ -0,0 +1,930 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <stdexcept>
+
+#include <gdalwarper.h>
+#include "image_correction.h"
+#include "memory_usage.h"
+
+using namespace std;
+
+namespace ksg
+{
+    constexpr static inline bool isNoData(double v, double noData)
+    {
+        return v != v || (noData == noData && v == noData);
+    }
+
+    ForwardSplat::ForwardSplat(int width, int height, vector<double> pixelX, vector<double> pixelY,
+                               vector<double> heights, double zBufferTolerance)
+        : width(width), height(height), pixelX(move(pixelX)), pixelY(move(pixelY)), heights(move(heights)),
+          zBufferTolerance(zBufferTolerance)
+    {
+        size_t count = static_cast<size_t>(width) * height;
+        if (this->pixelX.size() != count || this->pixelY.size() != count || this->heights.size() != count)
+            throw logic_error("Pixels positions do not match raster dimensions");
+
+        // Pixels without height show surface
+        for (auto &h : this->heights)
+            if (isnan(h))
+                h = 0;
+
+        // Counting sort by row; pixel may reach cell centers of row above, so rows from -1 are kept
+        rowStart.assign(height + 3, 0);
+        auto rowOf = [this](size_t i) {
+            double row = floor(this->pixelY[i]);
+            return row >= -1 && row <= this->height ? static_cast<int>(row) : numeric_limits<int>::min();
+        };
+
+        for (size_t i = 0; i < count; i++)
+        {
+            int row = rowOf(i);
+            if (row != numeric_limits<int>::min() && !isnan(this->pixelX[i]))
+                rowStart[row + 2]++;
+        }
+        for (int r = 1; r < height + 3; r++)
+            rowStart[r] += rowStart[r - 1];
+
+        sorted.resize(rowStart.back());
+        vector<size_t> next(rowStart.begin(), rowStart.end() - 1);
+        for (size_t i = 0; i < count; i++)
+        {
+            int row = rowOf(i);
+            if (row != numeric_limits<int>::min() && !isnan(this->pixelX[i]))
+                sorted[next[row + 1]++] = i;
+        }
+    }
+
+    void ForwardSplat::grid(const double *values, double noData, GriddingAlgorithm algorithm, double *output,
+                            int firstRow, int lastRow) const
+    {
+        if (lastRow < 0 || lastRow > height)
+            lastRow = height;
+
+        #pragma omp parallel
+        {
+            vector<size_t> candidates;
+
+            #pragma omp for schedule(dynamic, 16)
+            for (int r = firstRow; r < lastRow; r++)
+            {
+                // Cell centers of row r are reached only from rows r - 1, r and r + 1
+                candidates.clear();
+                for (size_t k = rowStart[r]; k < rowStart[r + 3]; k++)
+                    if (!isNoData(values[sorted[k]], noData))
+                        candidates.push_back(sorted[k]);
+
+                sort(candidates.begin(), candidates.end(), [this](size_t i, size_t j) {
+                    return pixelX[i] < pixelX[j] || (pixelX[i] == pixelX[j] && i < j);
+                });
+
+                double cy = r + 0.5;
+                size_t begin = 0, end = 0;
+                for (int c = 0; c < width; c++)
+                {
+                    double cx = c + 0.5;
+                    while (end < candidates.size() && pixelX[candidates[end]] <= cx + 1)
+                        end++;
+                    while (begin < end && pixelX[candidates[begin]] < cx - 1)
+                        begin++;
+
+                    auto distanceSqr = [&](size_t i) {
+                        return (pixelX[i] - cx) * (pixelX[i] - cx) + (pixelY[i] - cy) * (pixelY[i] - cy);
+                    };
+
+                    double top = -numeric_limits<double>::infinity();
+                    for (size_t k = begin; k < end; k++)
+                        if (distanceSqr(candidates[k]) <= 1)
+                            top = max(top, heights[candidates[k]]);
+
+                    double &cell = output[static_cast<size_t>(r) * width + c];
+                    cell = noData;
+                    if (isinf(top))
+                        continue;
+
+                    double sum = 0, nearest = numeric_limits<double>::infinity();
+                    size_t contributors = 0;
+                    for (size_t k = begin; k < end; k++)
+                    {
+                        size_t i = candidates[k];
+                        double d = distanceSqr(i);
+                        if (d > 1 || heights[i] < top - zBufferTolerance)
+                            continue;
+
+                        switch (algorithm)
+                        {
+                        case GriddingAlgorithm::AVERAGE:
+                            sum += values[i];
+                            contributors++;
+                            break;
+                        case GriddingAlgorithm::NEAREST:
+                            if (d < nearest)
+                            {
+                                nearest = d;
+                                cell = values[i];
+                            }
+                            break;
+                        case GriddingAlgorithm::MAXIMUM:
+                            cell = contributors++ == 0 ? values[i] : max(cell, values[i]);
+                            break;
+                        }
+                    }
+
+                    if (algorithm == GriddingAlgorithm::AVERAGE)
+                        cell = sum / contributors;
+                }
+            }
+        }
+    }
+
+    void ForwardSplat::fillGaps(const double *values, double noData, GriddingAlgorithm algorithm, int distance, double *output,
+                                int firstRow, int lastRow) const
+    {
+        if (lastRow < 0 || lastRow > height)
+            lastRow = height;
+
+        size_t begin = static_cast<size_t>(firstRow) * width, end = static_cast<size_t>(lastRow) * width;
+        vector<double> previous(end - begin);
+
+        // Orthogonal neighbours first, so nearest prefers them over diagonal ones
+        constexpr int neighbours[8][2] = {{0, -1}, {-1, 0}, {1, 0}, {0, 1}, {-1, -1}, {1, -1}, {-1, 1}, {1, 1}};
+
+        for (int pass = 0; pass < distance; pass++)
+        {
+            copy(output + begin, output + end, previous.begin());
+            size_t filled = 0;
+
+            #pragma omp parallel for schedule(dynamic, 16) reduction(+ : filled)
+            for (int r = firstRow; r < lastRow; r++)
+                for (int c = 0; c < width; c++)
+                {
+                    size_t i = static_cast<size_t>(r) * width + c;
+                    if (!isNoData(previous[i - begin], noData) || isnan(pixelX[i]) || isNoData(values[i], noData))
+                        continue;
+
+                    double sum = 0, value = noData;
+                    int contributors = 0;
+                    for (auto &n : neighbours)
+                    {
+                        int x = c + n[0], y = r + n[1];
+                        if (x < 0 || y < firstRow || x >= width || y >= lastRow)
+                            continue;
+
+                        double v = previous[static_cast<size_t>(y) * width + x - begin];
+                        if (isNoData(v, noData))
+                            continue;
+
+                        if (algorithm == GriddingAlgorithm::NEAREST && contributors > 0)
+                            continue;
+
+                        sum += v;
+                        value = contributors++ == 0 ? v : max(value, v);
+                    }
+
+                    if (contributors == 0)
+                        continue;
+
+                    output[i] = algorithm == GriddingAlgorithm::AVERAGE ? sum / contributors : value;
+                    filled++;
+                }
+
+            if (filled == 0)
+                break;
+        }
+    }
+
+    static bool hasSameGrid(GDALDataset *a, GDALDataset *b)
+    {
+        double aGeo[6], bGeo[6];
+        a->GetGeoTransform(aGeo);
+        b->GetGeoTransform(bGeo);
+
+        if (a->GetRasterXSize() != b->GetRasterXSize() || a->GetRasterYSize() != b->GetRasterYSize())
+            return false;
+
+        // Sub-millimetre differences come from text representation of geotransforms
+        for (int i = 0; i < 6; i++)
+            if (fabs(aGeo[i] - bGeo[i]) > 1e-3)
+                return false;
+
+        return true;
+    }
+
+    ///
+    /// @return true if heights are on north up grid of the same projection as image, with larger pixels
+    static bool isCoarserGrid(GDALDataset *image, GDALDataset *heights)
+    {
+        double imageGeo[6], heightsGeo[6];
+        image->GetGeoTransform(imageGeo);
+        heights->GetGeoTransform(heightsGeo);
+
+        if (strcmp(image->GetProjectionRef(), heights->GetProjectionRef()) != 0 ||
+            imageGeo[2] != 0 || imageGeo[4] != 0 || heightsGeo[2] != 0 || heightsGeo[4] != 0)
+            return false;
+
+        double ratioX = fabs(heightsGeo[1] / imageGeo[1]), ratioY = fabs(heightsGeo[5] / imageGeo[5]);
+        return ratioX >= 1 - 1e-9 && ratioY >= 1 - 1e-9 && ratioX * ratioY > 1 + 1e-6;
+    }
+
+    ///
+    /// Creates in-memory raster covering columns [firstColumn, firstColumn + columns) and rows [firstRow, firstRow + rows) of raster.
+    static GDALDataset *createWindow(GDALDataset *raster, int firstColumn, int firstRow, int columns, int rows, int bands)
+    {
+        auto memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+        if (memDriver == nullptr)
+            throw runtime_error("There is no MEM driver");
+
+        auto window = memDriver->Create("", columns, rows, bands, GDT_Float64, nullptr);
+        if (window == nullptr)
+            throw runtime_error("Cannot create in-memory raster");
+
+        double geotransform[6];
+        raster->GetGeoTransform(geotransform);
+        geotransform[0] += firstColumn * geotransform[1] + firstRow * geotransform[2];
+        geotransform[3] += firstColumn * geotransform[4] + firstRow * geotransform[5];
+        window->SetGeoTransform(geotransform);
+        window->SetProjection(raster->GetProjectionRef());
+        return window;
+    }
+
+    ///
+    /// Creates in-memory raster covering rows [firstRow, firstRow + rows) of image.
+    static GDALDataset *createWindow(GDALDataset *image, int firstRow, int rows, int bands)
+    {
+        return createWindow(image, 0, firstRow, image->GetRasterXSize(), rows, bands);
+    }
+
+    ///
+    /// Warps height band onto window with nearest neighbour, as gdalwarp did in the wrapping script.
+    /// Only part of height raster covering window is read.
+    static CPLErr warpHeights(GDALDataset *heights, int heightBand, GDALDataset *image, GDALDataset *window)
+    {
+        void *transformer = GDALCreateGenImgProjTransformer(heights, heights->GetProjectionRef(), window, image->GetProjectionRef(), FALSE, 0, 1);
+        if (transformer == nullptr)
+            return CE_Failure;
+
+        auto options = GDALCreateWarpOptions();
+        options->hSrcDS = heights;
+        options->hDstDS = window;
+        options->eResampleAlg = GRA_NearestNeighbour;
+        options->nBandCount = 1;
+        options->panSrcBands = static_cast<int *>(CPLMalloc(sizeof(int)));
+        options->panSrcBands[0] = heightBand;
+        options->panDstBands = static_cast<int *>(CPLMalloc(sizeof(int)));
+        options->panDstBands[0] = 1;
+
+        int hasNoData = 0;
+        double noData = heights->GetRasterBand(heightBand)->GetNoDataValue(&hasNoData);
+        if (hasNoData)
+        {
+            options->padfSrcNoDataReal = static_cast<double *>(CPLMalloc(sizeof(double)));
+            options->padfSrcNoDataReal[0] = noData;
+        }
+
+        // Pixels not covered by height raster get no data
+        options->padfDstNoDataReal = static_cast<double *>(CPLMalloc(sizeof(double)));
+        options->padfDstNoDataReal[0] = numeric_limits<double>::quiet_NaN();
+        options->papszWarpOptions = CSLSetNameValue(options->papszWarpOptions, "INIT_DEST", "NO_DATA");
+
+        options->pfnTransformer = GDALGenImgProjTransform;
+        options->pTransformerArg = transformer;
+
+        GDALWarpOperation operation;
+        auto status = operation.Initialize(options);
+        if (status == CE_None)
+            status = operation.ChunkAndWarpImage(0, 0, window->GetRasterXSize(), window->GetRasterYSize());
+
+        GDALDestroyGenImgProjTransformer(transformer);
+        GDALDestroyWarpOptions(options);
+        return status;
+    }
+
+    ImageCorrector::ImageCorrector(GEOSHeightCorrector &corrector, GDALDataset *image, GDALDataset *heights, int heightBand)
+        : corrector(corrector), image(image), heights(heights), heightBand(heightBand)
+    {
+        width = image->GetRasterXSize();
+        height = image->GetRasterYSize();
+
+        image->GetGeoTransform(geotransform);
+        if (!GDALInvGeoTransform(geotransform, inverseGeotransform))
+            throw runtime_error("Geotransform of image cannot be inverted");
+
+        if (heights->GetRasterBand(heightBand) == nullptr)
+            throw runtime_error("There is no band " + to_string(heightBand) + " in height raster");
+
+        sameGrid = hasSameGrid(image, heights);
+        coarseGrid = !sameGrid && isCoarserGrid(image, heights);
+
+        heights->GetGeoTransform(heightsGeotransform);
+        if (coarseGrid && !GDALInvGeoTransform(heightsGeotransform, heightsInverseGeotransform))
+            throw runtime_error("Geotransform of height raster cannot be inverted");
+
+        if (coarseGrid)
+            cerr << "Height raster is " << fabs(heightsGeotransform[1] * heightsGeotransform[5] / (geotransform[1] * geotransform[5]))
+                 << " times coarser than image, forward mode solves its grid and upsamples displacements." << endl;
+        else if (!sameGrid)
+            cerr << "Height raster does not match image grid, it will be warped." << endl;
+    }
+
+    GDALDataset *ImageCorrector::readHeights(int firstRow, int rows) const
+    {
+        auto window = createWindow(image, firstRow, rows, 1);
+        auto band = window->GetRasterBand(1);
+        band->SetNoDataValue(numeric_limits<double>::quiet_NaN());
+
+        vector<double> values(static_cast<size_t>(width) * rows);
+        CPLErr status;
+        if (sameGrid)
+        {
+            auto source = heights->GetRasterBand(heightBand);
+            status = source->RasterIO(GF_Read, 0, firstRow, width, rows, values.data(), width, rows, GDT_Float64, 0, 0, nullptr);
+
+            int hasNoData = 0;
+            double noData = source->GetNoDataValue(&hasNoData);
+            for (auto &h : values)
+                if (hasNoData && isNoData(h, noData))
+                    h = numeric_limits<double>::quiet_NaN();
+
+            if (status == CE_None)
+                status = band->RasterIO(GF_Write, 0, 0, width, rows, values.data(), width, rows, GDT_Float64, 0, 0, nullptr);
+        }
+        else
+        {
+            status = warpHeights(heights, heightBand, image, window);
+        }
+
+        if (status != CE_None)
+        {
+            GDALClose(window);
+            throw runtime_error("Cannot read heights of rows " + to_string(firstRow) + "-" + to_string(firstRow + rows));
+        }
+
+        return window;
+    }
+
+    double ImageCorrector::findMaxHeight() const
+    {
+        int chunk = max(1, (1 << 20) / width);
+        vector<double> values;
+        double maxHeight = 0;
+
+        // Coarse height raster is not warped, the highest of all its heights bounds heights of image
+        if (coarseGrid)
+        {
+            auto source = heights->GetRasterBand(heightBand);
+            int hasNoData = 0;
+            double noData = source->GetNoDataValue(&hasNoData);
+            int heightsWidth = heights->GetRasterXSize(), heightsHeight = heights->GetRasterYSize();
+            chunk = max(1, (1 << 20) / heightsWidth);
+
+            for (int firstRow = 0; firstRow < heightsHeight; firstRow += chunk)
+            {
+                int rows = min(chunk, heightsHeight - firstRow);
+                values.resize(static_cast<size_t>(heightsWidth) * rows);
+                if (source->RasterIO(GF_Read, 0, firstRow, heightsWidth, rows, values.data(), heightsWidth, rows, GDT_Float64, 0, 0, nullptr) != CE_None)
+                    throw runtime_error("Cannot read heights");
+
+                for (auto h : values)
+                    if (h > maxHeight && !(hasNoData && isNoData(h, noData)))
+                        maxHeight = h;
+            }
+
+            return maxHeight;
+        }
+
+        for (int firstRow = 0; firstRow < height; firstRow += chunk)
+        {
+            int rows = min(chunk, height - firstRow);
+            auto window = readHeights(firstRow, rows);
+            values.resize(static_cast<size_t>(width) * rows);
+            auto status = window->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, width, rows, values.data(), width, rows, GDT_Float64, 0, 0, nullptr);
+            GDALClose(window);
+            if (status != CE_None)
+                throw runtime_error("Cannot read heights");
+
+            for (auto h : values)
+                if (h > maxHeight)
+                    maxHeight = h;
+        }
+
+        return maxHeight;
+    }
+
+    pair<int, int> ImageCorrector::window(int firstRow, int lastRow, int margin) const
+    {
+        if (rowsDisplacement.empty())
+            return make_pair(0, height);
+
+        double first = firstRow, last = lastRow;
+        for (int r = firstRow; r < lastRow; r++)
+        {
+            first = min(first, r - rowsDisplacement[r]);
+            last = max(last, r + 1 + rowsDisplacement[r]);
+        }
+
+        return make_pair(max(0, static_cast<int>(floor(first)) - margin), min(height, static_cast<int>(ceil(last)) + margin));
+    }
+
+    int ImageCorrector::stripEnd(int firstRow, int extension, int margin, int windowRows) const
+    {
+        auto windowHeight = [&](int lastRow) {
+            auto rows = window(max(0, firstRow - extension), min(height, lastRow + extension), margin);
+            return rows.second - rows.first;
+        };
+
+        if (windowHeight(firstRow + 1) > windowRows)
+            throw runtime_error("Memory limit is too low, at least " + to_string(windowHeight(firstRow + 1)) + " rows of image are required at once");
+
+        // Window grows with strip, so the highest fitting strip is found by bisection
+        int low = firstRow + 1, high = height;
+        while (low < high)
+        {
+            int middle = (low + high + 1) / 2;
+            if (windowHeight(middle) <= windowRows)
+                low = middle;
+            else
+                high = middle - 1;
+        }
+        return low;
+    }
+
+    void ImageCorrector::readRows(int band, int firstRow, int lastRow, vector<double> &values, double &noData) const
+    {
+        auto imageBand = image->GetRasterBand(band);
+
+        // No data value is replaced with NaN if band has none
+        int hasNoData = 0;
+        noData = imageBand->GetNoDataValue(&hasNoData);
+        if (!hasNoData)
+            noData = numeric_limits<double>::quiet_NaN();
+
+        int rows = lastRow - firstRow;
+        values.resize(static_cast<size_t>(width) * rows);
+        if (imageBand->RasterIO(GF_Read, 0, firstRow, width, rows, values.data(), width, rows, GDT_Float64, 0, 0, nullptr) != CE_None)
+            throw runtime_error("Cannot read band " + to_string(band) + " of image");
+    }
+
+    void ImageCorrector::writeRows(GDALDataset *output, int band, int firstRow, int lastRow, const double *values, double noData) const
+    {
+        auto outputBand = output->GetRasterBand(band);
+        outputBand->SetNoDataValue(noData);
+
+        int rows = lastRow - firstRow;
+        if (outputBand->RasterIO(GF_Write, 0, firstRow, width, rows, const_cast<double *>(values), width, rows, GDT_Float64, 0, 0, nullptr) != CE_None)
+            throw runtime_error("Cannot write band " + to_string(band) + " of corrected image");
+    }
+
+    void ImageCorrector::correct(GDALDataset *output, const ImageCorrectionSettings &settings)
+    {
+        stripsCount = 0;
+        rowsDisplacement.clear();
+        maxHeight = -1;
+
+        int windowRows = height;
+        if (settings.memoryLimit > 0)
+        {
+            // Pixels move at most as far as the highest object does
+            maxHeight = findMaxHeight();
+            rowsDisplacement = corrector.calculateRowsDisplacement(image, maxHeight);
+
+            // Bytes required per pixel of window: corrected positions, heights and their copies gridded in forward mode,
+            // heights and source positions in inverse mode; in both modes band values and output
+            size_t pixelBytes = settings.mode == CorrectionMode::FORWARD ? 15 * sizeof(double) : 9 * sizeof(double);
+            size_t used = currentMemoryUsage() + static_cast<size_t>(GDALGetCacheMax64());
+            size_t available = settings.memoryLimit > used ? settings.memoryLimit - used : 0;
+            windowRows = static_cast<int>(min<size_t>(height, available / (pixelBytes * width)));
+        }
+
+        if (settings.mode == CorrectionMode::INVERSE)
+            correctInverse(output, settings, windowRows);
+        else
+            correctForward(output, settings, windowRows);
+
+        rowsDisplacement.clear();
+    }
+
+    void ImageCorrector::correctForward(GDALDataset *output, const ImageCorrectionSettings &settings, int windowRows)
+    {
+        // Splatted pixel reaches cells within one pixel, filled cells are reached from distance of fillDistance
+        int fillDistance = max(0, settings.fillDistance);
+        constexpr int margin = 2;
+
+        cacheFirst = cacheLast = 0;
+        vector<double> values, gridded;
+
+        for (int firstRow = 0; firstRow < height; stripsCount++)
+        {
+            // Grid of strip is expanded by fill distance on both sides
+            int lastRow = rowsDisplacement.empty() ? height : stripEnd(firstRow, fillDistance, margin, windowRows);
+
+            int gridFirst = max(0, firstRow - fillDistance), gridLast = min(height, lastRow + fillDistance);
+            auto rows = window(gridFirst, gridLast, margin);
+
+            updateCache(rows.first, rows.second, settings);
+
+            // Positions are shifted into window, cache is no longer needed after the last strip
+            int windowHeight = rows.second - rows.first;
+            bool last = lastRow == height;
+            vector<double> pixelY = last ? move(cachedY) : cachedY;
+            for (auto &y : pixelY)
+                y -= rows.first;
+
+            ForwardSplat splat(width, windowHeight, last ? move(cachedX) : cachedX, move(pixelY),
+                               last ? move(cachedHeights) : cachedHeights, settings.zBufferTolerance);
+
+            for (int b = 1; b <= image->GetRasterCount(); b++)
+            {
+                double noData;
+                readRows(b, rows.first, rows.second, values, noData);
+                gridded.resize(values.size());
+
+                auto algorithm = static_cast<size_t>(b) <= settings.algorithms.size() ? settings.algorithms[b - 1] : GriddingAlgorithm::AVERAGE;
+
+                splat.grid(values.data(), noData, algorithm, gridded.data(), gridFirst - rows.first, gridLast - rows.first);
+                if (fillDistance > 0)
+                    splat.fillGaps(values.data(), noData, algorithm, fillDistance, gridded.data(), gridFirst - rows.first, gridLast - rows.first);
+
+                writeRows(output, b, firstRow, lastRow, gridded.data() + static_cast<size_t>(firstRow - rows.first) * width, noData);
+            }
+
+            // Finished strip leaves memory at once
+            output->FlushCache();
+            firstRow = lastRow;
+        }
+
+        cachedX.clear();
+        cachedY.clear();
+        cachedHeights.clear();
+        cacheFirst = cacheLast = 0;
+    }
+
+    void ImageCorrector::updateCache(int firstRow, int lastRow, const ImageCorrectionSettings &settings)
+    {
+        size_t rowOffset = static_cast<size_t>(width);
+
+        if (cacheFirst >= cacheLast || lastRow <= cacheFirst || firstRow >= cacheLast)
+        {
+            cachedX.clear();
+            cachedY.clear();
+            cachedHeights.clear();
+            cacheFirst = cacheLast = firstRow;
+        }
+        else
+        {
+            if (firstRow > cacheFirst)
+            {
+                size_t dropped = (firstRow - cacheFirst) * rowOffset;
+                for (auto cached : {&cachedX, &cachedY, &cachedHeights})
+                    cached->erase(cached->begin(), cached->begin() + dropped);
+            }
+            else if (firstRow < cacheFirst)
+            {
+                vector<double> pixelX, pixelY, objectHeights;
+                calculatePositions(firstRow, cacheFirst, settings, pixelX, pixelY, objectHeights);
+                cachedX.insert(cachedX.begin(), pixelX.begin(), pixelX.end());
+                cachedY.insert(cachedY.begin(), pixelY.begin(), pixelY.end());
+                cachedHeights.insert(cachedHeights.begin(), objectHeights.begin(), objectHeights.end());
+            }
+            cacheFirst = firstRow;
+
+            if (lastRow < cacheLast)
+            {
+                size_t kept = (lastRow - cacheFirst) * rowOffset;
+                for (auto cached : {&cachedX, &cachedY, &cachedHeights})
+                    cached->resize(kept);
+                cacheLast = lastRow;
+            }
+        }
+
+        if (lastRow > cacheLast)
+        {
+            vector<double> pixelX, pixelY, objectHeights;
+            calculatePositions(cacheLast, lastRow, settings, pixelX, pixelY, objectHeights);
+            cachedX.insert(cachedX.end(), pixelX.begin(), pixelX.end());
+            cachedY.insert(cachedY.end(), pixelY.begin(), pixelY.end());
+            cachedHeights.insert(cachedHeights.end(), objectHeights.begin(), objectHeights.end());
+            cacheLast = lastRow;
+        }
+    }
+
+    void ImageCorrector::calculatePositions(int firstRow, int lastRow, const ImageCorrectionSettings &settings,
+                                            vector<double> &pixelX, vector<double> &pixelY, vector<double> &objectHeights)
+    {
+        if (coarseGrid)
+        {
+            upsamplePositions(firstRow, lastRow, settings, pixelX, pixelY, objectHeights);
+            return;
+        }
+
+        int rows = lastRow - firstRow;
+        size_t count = static_cast<size_t>(width) * rows;
+        pixelX.resize(count);
+        pixelY.resize(count);
+        objectHeights.resize(count);
+
+        auto heightsWindow = readHeights(firstRow, rows);
+        GDALDataset *coordinates = nullptr;
+        try
+        {
+            coordinates = createWindow(image, firstRow, rows, 2);
+            corrector.calculateNewCoordinatesForRaster(
+                heightsWindow, coordinates, 1,
+                settings.requiredAccuracy,
+                settings.iterationsLimit,
+                settings.numericMethod,
+                settings.useQuadraticForm,
+                settings.initialGuess,
+                settings.warmStart
+            );
+
+            if (coordinates->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, width, rows, pixelX.data(), width, rows, GDT_Float64, 0, 0, nullptr) != CE_None ||
+                coordinates->GetRasterBand(2)->RasterIO(GF_Read, 0, 0, width, rows, pixelY.data(), width, rows, GDT_Float64, 0, 0, nullptr) != CE_None ||
+                heightsWindow->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, width, rows, objectHeights.data(), width, rows, GDT_Float64, 0, 0, nullptr) != CE_None)
+                throw runtime_error("Cannot read corrected coordinates");
+        }
+        catch (...)
+        {
+            GDALClose(heightsWindow);
+            if (coordinates != nullptr)
+                GDALClose(coordinates);
+            throw;
+        }
+        GDALClose(heightsWindow);
+        GDALClose(coordinates);
+
+        // Geos coordinates are converted into pixel coordinates of image
+        for (size_t i = 0; i < count; i++)
+        {
+            double x = pixelX[i], y = pixelY[i];
+            pixelX[i] = inverseGeotransform[0] + x * inverseGeotransform[1] + y * inverseGeotransform[2];
+            pixelY[i] = inverseGeotransform[3] + x * inverseGeotransform[4] + y * inverseGeotransform[5];
+        }
+    }
+
+    void ImageCorrector::upsamplePositions(int firstRow, int lastRow, const ImageCorrectionSettings &settings,
+                                           vector<double> &pixelX, vector<double> &pixelY, vector<double> &objectHeights)
+    {
+        int rows = lastRow - firstRow;
+        size_t count = static_cast<size_t>(width) * rows;
+        pixelX.resize(count);
+        pixelY.resize(count);
+        objectHeights.resize(count);
+
+        // Image pixel centers in pixel coordinates of height raster, grids are north up
+        vector<double> column(width), line(rows);
+        for (int c = 0; c < width; c++)
+            column[c] = heightsInverseGeotransform[0] + (geotransform[0] + (c + 0.5) * geotransform[1]) * heightsInverseGeotransform[1];
+        for (int r = 0; r < rows; r++)
+            line[r] = heightsInverseGeotransform[3] + (geotransform[3] + (firstRow + r + 0.5) * geotransform[5]) * heightsInverseGeotransform[5];
+
+        // Window of height raster with neighbours used by interpolation
+        auto range = [](const vector<double> &positions, int size) {
+            auto bounds = minmax_element(positions.begin(), positions.end());
+            return make_pair(max(0, static_cast<int>(floor(*bounds.first - 0.5))), min(size, static_cast<int>(floor(*bounds.second + 0.5)) + 1));
+        };
+        auto columns = range(column, heights->GetRasterXSize());
+        auto lines = range(line, heights->GetRasterYSize());
+        int coarseWidth = max(0, columns.second - columns.first), coarseHeight = max(0, lines.second - lines.first);
+        size_t coarseCount = static_cast<size_t>(coarseWidth) * coarseHeight;
+
+        vector<double> coarseHeights(coarseCount), displacementX(coarseCount), displacementY(coarseCount);
+        if (coarseCount > 0)
+        {
+            auto source = heights->GetRasterBand(heightBand);
+            if (source->RasterIO(GF_Read, columns.first, lines.first, coarseWidth, coarseHeight, coarseHeights.data(),
+                                 coarseWidth, coarseHeight, GDT_Float64, 0, 0, nullptr) != CE_None)
+                throw runtime_error("Cannot read heights of rows " + to_string(firstRow) + "-" + to_string(lastRow));
+
+            int hasNoData = 0;
+            double noData = source->GetNoDataValue(&hasNoData);
+            for (auto &h : coarseHeights)
+                if (hasNoData && isNoData(h, noData))
+                    h = numeric_limits<double>::quiet_NaN();
+
+            GDALDataset *heightsWindow = nullptr, *coordinates = nullptr;
+            try
+            {
+                heightsWindow = createWindow(heights, columns.first, lines.first, coarseWidth, coarseHeight, 1);
+                auto band = heightsWindow->GetRasterBand(1);
+                band->SetNoDataValue(numeric_limits<double>::quiet_NaN());
+                if (band->RasterIO(GF_Write, 0, 0, coarseWidth, coarseHeight, coarseHeights.data(), coarseWidth, coarseHeight, GDT_Float64, 0, 0, nullptr) != CE_None)
+                    throw runtime_error("Cannot write heights window");
+
+                coordinates = createWindow(heights, columns.first, lines.first, coarseWidth, coarseHeight, 2);
+                corrector.calculateNewCoordinatesForRaster(
+                    heightsWindow, coordinates, 1,
+                    settings.requiredAccuracy,
+                    settings.iterationsLimit,
+                    settings.numericMethod,
+                    settings.useQuadraticForm,
+                    settings.initialGuess,
+                    settings.warmStart
+                );
+
+                if (coordinates->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, coarseWidth, coarseHeight, displacementX.data(), coarseWidth, coarseHeight, GDT_Float64, 0, 0, nullptr) != CE_None ||
+                    coordinates->GetRasterBand(2)->RasterIO(GF_Read, 0, 0, coarseWidth, coarseHeight, displacementY.data(), coarseWidth, coarseHeight, GDT_Float64, 0, 0, nullptr) != CE_None)
+                    throw runtime_error("Cannot read corrected coordinates");
+            }
+            catch (...)
+            {
+                if (heightsWindow != nullptr)
+                    GDALClose(heightsWindow);
+                if (coordinates != nullptr)
+                    GDALClose(coordinates);
+                throw;
+            }
+            GDALClose(heightsWindow);
+            GDALClose(coordinates);
+
+            // Corrected coordinates are turned into displacements from coarse pixel centers
+            for (int r = 0; r < coarseHeight; r++)
+                for (int c = 0; c < coarseWidth; c++)
+                {
+                    size_t i = static_cast<size_t>(r) * coarseWidth + c;
+                    displacementX[i] -= heightsGeotransform[0] + (columns.first + c + 0.5) * heightsGeotransform[1];
+                    displacementY[i] -= heightsGeotransform[3] + (lines.first + r + 0.5) * heightsGeotransform[5];
+                }
+        }
+
+        vector<double> pixelColumn(count), pixelLine(count);
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < width; c++)
+            {
+                size_t i = static_cast<size_t>(r) * width + c;
+                pixelColumn[i] = column[c] - columns.first;
+                pixelLine[i] = line[r] - lines.first;
+            }
+
+        upsampleDisplacements(coarseWidth, coarseHeight, coarseHeights.data(), displacementX.data(), displacementY.data(),
+                              pixelColumn.data(), pixelLine.data(), count, settings.zBufferTolerance,
+                              objectHeights.data(), pixelX.data(), pixelY.data());
+
+        // Displacements are converted into pixel coordinates of image
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < width; c++)
+            {
+                size_t i = static_cast<size_t>(r) * width + c;
+                double x = geotransform[0] + (c + 0.5) * geotransform[1] + pixelX[i];
+                double y = geotransform[3] + (firstRow + r + 0.5) * geotransform[5] + pixelY[i];
+                pixelX[i] = inverseGeotransform[0] + x * inverseGeotransform[1] + y * inverseGeotransform[2];
+                pixelY[i] = inverseGeotransform[3] + x * inverseGeotransform[4] + y * inverseGeotransform[5];
+            }
+    }
+
+    void upsampleDisplacements(int coarseWidth, int coarseHeight, const double *coarseHeights, const double *displacementX,
+                               const double *displacementY, const double *column, const double *line, size_t count,
+                               double tolerance, double *heights, double *outputX, double *outputY)
+    {
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; i++)
+        {
+            double u = column[i], v = line[i];
+            heights[i] = numeric_limits<double>::quiet_NaN();
+            outputX[i] = outputY[i] = 0;
+            if (!(u >= 0 && u < coarseWidth && v >= 0 && v < coarseHeight))
+                continue;
+
+            size_t own = static_cast<size_t>(v) * coarseWidth + static_cast<size_t>(u);
+            double h = coarseHeights[own];
+            heights[i] = h;
+            outputX[i] = displacementX[own];
+            outputY[i] = displacementY[own];
+            if (!(h > 0) || isnan(outputX[i]) || isnan(outputY[i]))
+                continue;
+
+            // Displacement per metre of height of neighbours in the same layer, own pixel is always one of them
+            double x0 = floor(u - 0.5), y0 = floor(v - 0.5);
+            double fx = u - 0.5 - x0, fy = v - 0.5 - y0;
+
+            double sumX = 0, sumY = 0, weights = 0;
+            for (int dy = 0; dy <= 1; dy++)
+                for (int dx = 0; dx <= 1; dx++)
+                {
+                    double x = x0 + dx, y = y0 + dy;
+                    if (!(x >= 0 && x < coarseWidth && y >= 0 && y < coarseHeight))
+                        continue;
+
+                    size_t k = static_cast<size_t>(y) * coarseWidth + static_cast<size_t>(x);
+                    double hk = coarseHeights[k];
+                    if (!(hk > 0) || !(fabs(hk - h) <= tolerance) || isnan(displacementX[k]) || isnan(displacementY[k]))
+                        continue;
+
+                    double weight = (dx ? fx : 1 - fx) * (dy ? fy : 1 - fy);
+                    sumX += weight * displacementX[k] / hk;
+                    sumY += weight * displacementY[k] / hk;
+                    weights += weight;
+                }
+
+            if (weights > 0)
+            {
+                outputX[i] = h * sumX / weights;
+                outputY[i] = h * sumY / weights;
+            }
+        }
+    }
+
+    void ImageCorrector::correctInverse(GDALDataset *output, const ImageCorrectionSettings &settings, int windowRows)
+    {
+        // Bilinear resampling reaches pixel next to source position
+        constexpr int margin = 2;
+
+        vector<double> pixelX, pixelY, values, warped;
+
+        for (int firstRow = 0; firstRow < height; stripsCount++)
+        {
+            int lastRow = rowsDisplacement.empty() ? height : stripEnd(firstRow, 0, margin, windowRows);
+            auto rows = window(firstRow, lastRow, margin);
+            int windowHeight = rows.second - rows.first;
+            size_t count = static_cast<size_t>(width) * (lastRow - firstRow);
+
+            auto heightsWindow = readHeights(rows.first, windowHeight);
+            GDALDataset *sources = nullptr;
+            try
+            {
+                sources = createWindow(image, rows.first, windowHeight, 2);
+                corrector.calculateSourceCoordinatesForRaster(heightsWindow, sources, 1, settings.iterationsLimit,
+                                                              firstRow - rows.first, lastRow - rows.first, maxHeight);
+
+                pixelX.resize(count);
+                pixelY.resize(count);
+                if (sources->GetRasterBand(1)->RasterIO(GF_Read, 0, firstRow - rows.first, width, lastRow - firstRow, pixelX.data(), width, lastRow - firstRow, GDT_Float64, 0, 0, nullptr) != CE_None ||
+                    sources->GetRasterBand(2)->RasterIO(GF_Read, 0, firstRow - rows.first, width, lastRow - firstRow, pixelY.data(), width, lastRow - firstRow, GDT_Float64, 0, 0, nullptr) != CE_None)
+                    throw runtime_error("Cannot read source coordinates");
+            }
+            catch (...)
+            {
+                GDALClose(heightsWindow);
+                if (sources != nullptr)
+                    GDALClose(sources);
+                throw;
+            }
+            GDALClose(heightsWindow);
+            GDALClose(sources);
+
+            // Source positions in pixel coordinates of window
+            for (size_t i = 0; i < count; i++)
+            {
+                double x = pixelX[i], y = pixelY[i];
+                pixelX[i] = inverseGeotransform[0] + x * inverseGeotransform[1] + y * inverseGeotransform[2];
+                pixelY[i] = inverseGeotransform[3] + x * inverseGeotransform[4] + y * inverseGeotransform[5] - rows.first;
+            }
+
+            warped.resize(count);
+            for (int b = 1; b <= image->GetRasterCount(); b++)
+            {
+                double noData;
+                readRows(b, rows.first, rows.second, values, noData);
+                resampleBand(width, windowHeight, values.data(), noData, pixelX.data(), pixelY.data(), count, settings.resampling, warped.data());
+                writeRows(output, b, firstRow, lastRow, warped.data(), noData);
+            }
+
+            output->FlushCache();
+            firstRow = lastRow;
+        }
+    }
+
+    void resampleBand(int width, int height, const double *values, double noData, const double *pixelX, const double *pixelY,
+                      size_t count, Resampling resampling, double *output)
+    {
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < count; i++)
+        {
+            double px = pixelX[i], py = pixelY[i];
+            output[i] = noData;
+
+            if (resampling == Resampling::NEAREST)
+            {
+                if (px >= 0 && px < width && py >= 0 && py < height)
+                    output[i] = values[static_cast<size_t>(py) * width + static_cast<size_t>(px)];
+                continue;
+            }
+
+            // Weights of pixels without data are skipped and remaining ones normalised
+            double u = px - 0.5, v = py - 0.5;
+            double x0 = floor(u), y0 = floor(v);
+            double fx = u - x0, fy = v - y0;
+
+            double sum = 0, weights = 0;
+            for (int dy = 0; dy <= 1; dy++)
+                for (int dx = 0; dx <= 1; dx++)
+                {
+                    double x = x0 + dx, y = y0 + dy;
+                    if (!(x >= 0 && x < width && y >= 0 && y < height))
+                        continue;
+
+                    double value = values[static_cast<size_t>(y) * width + static_cast<size_t>(x)];
+                    if (isNoData(value, noData))
+                        continue;
+
+                    double weight = (dx ? fx : 1 - fx) * (dy ? fy : 1 - fy);
+                    sum += weight * value;
+                    weights += weight;
+                }
+
+            if (weights > 0)
+                output[i] = sum / weights;
+        }
+    }
+}
@@ -0,0 +1,308 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gdal_priv.h>
+#include "correction.h"
+
+namespace ksg
+{
+    enum class GriddingAlgorithm {
+        AVERAGE,
+        NEAREST,
+        MAXIMUM
+    };
+
+    constexpr const char* GA_AVERAGE_NAME = "average";
+    constexpr const char* GA_AVERAGE_DESC = "Average of values moved into cell.";
+    constexpr const char* GA_NEAREST_NAME = "nearest";
+    constexpr const char* GA_NEAREST_DESC = "Value moved nearest to cell center. Suggested for bands with quantified data.";
+    constexpr const char* GA_MAXIMUM_NAME = "maximum";
+    constexpr const char* GA_MAXIMUM_DESC = "Maximum of values moved into cell.";
+
+    inline static std::istream& operator>>(std::istream& in, GriddingAlgorithm& algorithm) {
+        std::string word;
+        in >> word;
+
+        if(word.compare(GA_AVERAGE_NAME) == 0) {
+            algorithm = GriddingAlgorithm::AVERAGE;
+        } else if(word.compare(GA_NEAREST_NAME) == 0) {
+            algorithm = GriddingAlgorithm::NEAREST;
+        } else if(word.compare(GA_MAXIMUM_NAME) == 0 || word.compare("max") == 0) {
+            algorithm = GriddingAlgorithm::MAXIMUM;
+        } else {
+            throw std::logic_error("Unknown gridding algorithm: \""+word+"\"");
+        }
+        return in;
+    }
+
+    inline static std::ostream& operator<<(std::ostream& out, const GriddingAlgorithm& algorithm) {
+        switch(algorithm) {
+            case GriddingAlgorithm::AVERAGE:
+                out << GA_AVERAGE_NAME;
+                break;
+            case GriddingAlgorithm::NEAREST:
+                out << GA_NEAREST_NAME;
+                break;
+            case GriddingAlgorithm::MAXIMUM:
+                out << GA_MAXIMUM_NAME;
+                break;
+            default:
+                out << "Unknown algorithm";
+                break;
+        }
+
+        return out;
+    }
+
+    enum class Resampling {
+        NEAREST,
+        BILINEAR
+    };
+
+    constexpr const char* RS_NEAREST_NAME = "nearest";
+    constexpr const char* RS_NEAREST_DESC = "Value of pixel containing source position. Suggested for bands with quantified data.";
+    constexpr const char* RS_BILINEAR_NAME = "bilinear";
+    constexpr const char* RS_BILINEAR_DESC = "Bilinear interpolation of four pixels surrounding source position.";
+
+    inline static std::istream& operator>>(std::istream& in, Resampling& resampling) {
+        std::string word;
+        in >> word;
+
+        if(word.compare(RS_NEAREST_NAME) == 0) {
+            resampling = Resampling::NEAREST;
+        } else if(word.compare(RS_BILINEAR_NAME) == 0) {
+            resampling = Resampling::BILINEAR;
+        } else {
+            throw std::logic_error("Unknown resampling: \""+word+"\"");
+        }
+        return in;
+    }
+
+    inline static std::ostream& operator<<(std::ostream& out, const Resampling& resampling) {
+        switch(resampling) {
+            case Resampling::NEAREST:
+                out << RS_NEAREST_NAME;
+                break;
+            case Resampling::BILINEAR:
+                out << RS_BILINEAR_NAME;
+                break;
+            default:
+                out << "Unknown resampling";
+                break;
+        }
+
+        return out;
+    }
+
+    enum class CorrectionMode {
+        FORWARD,
+        INVERSE
+    };
+
+    constexpr const char* CM_FORWARD_NAME = "forward";
+    constexpr const char* CM_FORWARD_DESC = "Pixels are moved to corrected positions and gridded with selected algorithms.";
+    constexpr const char* CM_INVERSE_NAME = "inverse";
+    constexpr const char* CM_INVERSE_DESC = "Every output pixel is resampled from position at which object above it is observed. It leaves no gaps and does not require numeric method.";
+
+    inline static std::istream& operator>>(std::istream& in, CorrectionMode& mode) {
+        std::string word;
+        in >> word;
+
+        if(word.compare(CM_FORWARD_NAME) == 0) {
+            mode = CorrectionMode::FORWARD;
+        } else if(word.compare(CM_INVERSE_NAME) == 0) {
+            mode = CorrectionMode::INVERSE;
+        } else {
+            throw std::logic_error("Unknown correction mode: \""+word+"\"");
+        }
+        return in;
+    }
+
+    inline static std::ostream& operator<<(std::ostream& out, const CorrectionMode& mode) {
+        switch(mode) {
+            case CorrectionMode::FORWARD:
+                out << CM_FORWARD_NAME;
+                break;
+            case CorrectionMode::INVERSE:
+                out << CM_INVERSE_NAME;
+                break;
+            default:
+                out << "Unknown mode";
+                break;
+        }
+
+        return out;
+    }
+
+    ///
+    /// Moves pixels of raster to their corrected positions and grids them back onto the same raster.
+    /// Every moved pixel contributes to cells whose centers are not further than one pixel from it,
+    /// like gdal_grid with both radii equal to pixel size.
+    ///
+    /// Pixels act as z-buffer: only pixels not lower than the highest one contributing to cell
+    /// (less its tolerance) are used, so higher clouds cover lower clouds and surface.
+    class ForwardSplat
+    {
+    public:
+        ///
+        /// @param width, height raster dimensions in pixels
+        /// @param pixelX, pixelY corrected positions of pixels centers in pixel coordinates, NaN if pixel could not be corrected
+        /// @param heights object heights of pixels [m], NaN for pixels showing surface
+        /// @param zBufferTolerance height difference [m] within which pixels covering each other are combined
+        ForwardSplat(int width, int height, std::vector<double> pixelX, std::vector<double> pixelY,
+                     std::vector<double> heights, double zBufferTolerance);
+
+        ///
+        /// Grids single band.
+        /// @param values band values, in raster layout
+        /// @param noData value marking missing data in values and output, may be NaN
+        /// @param output gridded band, cells without any contributing pixel are set to noData
+        /// @param firstRow, lastRow range of rows [firstRow, lastRow) to grid, negative lastRow means all rows
+        void grid(const double *values, double noData, GriddingAlgorithm algorithm, double *output,
+                  int firstRow = 0, int lastRow = -1) const;
+
+        ///
+        /// Fills cells left empty by grid with values of neighbouring cells, growing up to distance pixels.
+        /// Only cells whose own pixel has corrected position and value are filled,
+        /// so edges of view disc and regions without data are preserved.
+        /// @param values band values used for grid
+        /// @param firstRow, lastRow range of rows [firstRow, lastRow) to fill, rows outside of it are treated as empty
+        void fillGaps(const double *values, double noData, GriddingAlgorithm algorithm, int distance, double *output,
+                      int firstRow = 0, int lastRow = -1) const;
+
+    private:
+        int width, height;
+        std::vector<double> pixelX, pixelY, heights;
+        double zBufferTolerance;
+
+        /// Pixels sorted by row of their corrected position. Row r (from -1 to height) occupies
+        /// sorted[rowStart[r + 1]] up to sorted[rowStart[r + 2]].
+        std::vector<size_t> rowStart;
+        std::vector<size_t> sorted;
+    };
+
+    ///
+    /// Resamples single band at given positions.
+    /// @param width, height band dimensions in pixels
+    /// @param pixelX, pixelY positions in pixel coordinates of band, one per output cell; NaN for cells without source
+    /// @param noData value marking missing data in values and output, may be NaN
+    void resampleBand(int width, int height, const double *values, double noData, const double *pixelX, const double *pixelY,
+                      size_t count, Resampling resampling, double *output);
+
+    ///
+    /// Upsamples displacements solved on coarse grid of height raster onto image pixels. Pixel takes height of coarse
+    /// pixel containing it. Its displacement per metre of height is bilinearly interpolated from coarse pixels around it
+    /// which lie in the same layer (their height differs by at most tolerance) and multiplied by its height, so
+    /// displacement follows height and cloud edges are not smeared. Pixels without positive height keep displacement
+    /// of their coarse pixel, pixels outside of coarse grid get no height and no displacement.
+    /// @param coarseWidth, coarseHeight dimensions of coarse grid
+    /// @param coarseHeights heights of coarse pixels [m], NaN for pixels without height
+    /// @param displacementX, displacementY displacements of coarse pixels, NaN if pixel could not be corrected
+    /// @param column, line positions of image pixel centers in pixel coordinates of coarse grid
+    /// @param heights receives height of every image pixel [m]
+    /// @param outputX, outputY receive displacement of every image pixel
+    void upsampleDisplacements(int coarseWidth, int coarseHeight, const double *coarseHeights, const double *displacementX,
+                               const double *displacementY, const double *column, const double *line, size_t count,
+                               double tolerance, double *heights, double *outputX, double *outputY);
+
+    ///
+    /// Settings of image correction. Numeric method settings are used by forward mode only.
+    struct ImageCorrectionSettings
+    {
+        CorrectionMode mode = CorrectionMode::FORWARD;
+
+        /// Gridding algorithm of every band, average is used for bands not listed
+        std::vector<GriddingAlgorithm> algorithms;
+        /// Height difference [m] of pixels in the same layer, used by z-buffer and by upsampling of coarse height raster
+        double zBufferTolerance = 500;
+        /// Maximal size of filled gaps [px], 0 disables filling
+        int fillDistance = 2;
+
+        Resampling resampling = Resampling::BILINEAR;
+
+        double requiredAccuracy = 10;
+        int iterationsLimit = 100;
+        NumericMethod numericMethod = NumericMethod::LEVENBERG_MARQUARD;
+        bool useQuadraticForm = false;
+        InitialGuess initialGuess = InitialGuess::INFLATED_ELLIPSOID;
+        bool warmStart = false;
+
+        /// Memory available for correction [B]. 0 means the whole image is processed at once.
+        size_t memoryLimit = 0;
+    };
+
+    ///
+    /// Corrects all bands of image, strip of rows after strip. Every strip requires only window of rows around it,
+    /// widened by the largest displacement of objects as high as the highest one in height raster.
+    /// Windows of consecutive strips overlap, so in forward mode corrected coordinates are kept for rows shared with next window.
+    class ImageCorrector
+    {
+    public:
+        ///
+        /// @param image raster requiring correction
+        /// @param heights raster with heights [m]. If it is coarser north up grid of the same projection, forward mode solves
+        /// displacements on its grid and upsamples them (see upsampleDisplacements). Otherwise, if its grid differs from
+        /// image, it is warped onto image grid with nearest neighbour.
+        ImageCorrector(GEOSHeightCorrector &corrector, GDALDataset *image, GDALDataset *heights, int heightBand);
+
+        ///
+        /// Strips are as high as memory limit allows and are written to output as soon as they are finished.
+        /// @param output raster on the same grid as image with the same number of bands
+        void correct(GDALDataset *output, const ImageCorrectionSettings &settings);
+
+        /// Number of strips used by last correction
+        int getStripsCount() const { return stripsCount; }
+
+    private:
+        GEOSHeightCorrector &corrector;
+        GDALDataset *image, *heights;
+        int heightBand;
+        bool sameGrid, coarseGrid;
+        int width, height;
+        double geotransform[6], inverseGeotransform[6];
+        double heightsGeotransform[6], heightsInverseGeotransform[6];
+
+        /// Vertical displacement bound of every row [px] and the highest height, empty if image is processed at once
+        std::vector<double> rowsDisplacement;
+        double maxHeight = -1;
+        int stripsCount = 0;
+
+        /// Corrected positions in pixel coordinates and heights of image rows [cacheFirst, cacheLast)
+        std::vector<double> cachedX, cachedY, cachedHeights;
+        int cacheFirst = 0, cacheLast = 0;
+
+        ///
+        /// Reads heights of image rows [firstRow, firstRow + rows) into in-memory raster covering them.
+        /// Pixels without height are set to NaN.
+        GDALDataset *readHeights(int firstRow, int rows) const;
+        double findMaxHeight() const;
+
+        ///
+        /// Rows [first, last) of image which may be moved by parallax within margin pixels of rows [firstRow, lastRow).
+        std::pair<int, int> window(int firstRow, int lastRow, int margin) const;
+
+        ///
+        /// Finds end of the highest strip starting at firstRow whose window fits in given number of rows.
+        /// @param extension number of rows by which strip is expanded before its window is found
+        int stripEnd(int firstRow, int extension, int margin, int windowRows) const;
+
+        void correctForward(GDALDataset *output, const ImageCorrectionSettings &settings, int windowRows);
+        void correctInverse(GDALDataset *output, const ImageCorrectionSettings &settings, int windowRows);
+
+        ///
+        /// Keeps corrected positions of rows [firstRow, lastRow) in cache, calculating missing ones.
+        void updateCache(int firstRow, int lastRow, const ImageCorrectionSettings &settings);
+        void calculatePositions(int firstRow, int lastRow, const ImageCorrectionSettings &settings,
+                                std::vector<double> &pixelX, std::vector<double> &pixelY, std::vector<double> &objectHeights);
+
+        ///
+        /// Calculates positions of rows [firstRow, lastRow) from displacements solved on coarse grid of height raster.
+        void upsamplePositions(int firstRow, int lastRow, const ImageCorrectionSettings &settings,
+                               std::vector<double> &pixelX, std::vector<double> &pixelY, std::vector<double> &objectHeights);
+
+        void readRows(int band, int firstRow, int lastRow, std::vector<double> &values, double &noData) const;
+        void writeRows(GDALDataset *output, int band, int firstRow, int lastRow, const double *values, double noData) const;
+    };
+}
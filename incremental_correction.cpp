@@ -0,0 +1,62 @@
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "incremental_correction.h"
+#include "output_encoding.h"
+
+using namespace std;
+
+namespace ksg
+{
+    static bool isNoData(double v, double noData)
+    {
+        return isnan(v) || v == noData;
+    }
+
+    static void checkGeometry(GDALDataset *input, GDALDataset *raster, const string &name)
+    {
+        if (raster == nullptr)
+            throw runtime_error("There is no " + name + " of previous correction");
+
+        if (raster->GetRasterXSize() != input->GetRasterXSize() || raster->GetRasterYSize() != input->GetRasterYSize())
+            throw runtime_error("Size of " + name + " of previous correction differs from input");
+
+        double inputGeotransform[6], geotransform[6];
+        input->GetGeoTransform(inputGeotransform);
+        raster->GetGeoTransform(geotransform);
+        for (int i = 0; i < 6; i++)
+            if (geotransform[i] != inputGeotransform[i])
+                throw runtime_error("Geotransform of " + name + " of previous correction differs from input");
+    }
+
+    void checkPreviousCorrection(GDALDataset *input, const PreviousCorrection &previous)
+    {
+        checkGeometry(input, previous.coordinates, "coordinates");
+        if (previous.coordinates->GetRasterCount() < 2)
+            throw runtime_error("Coordinates of previous correction have to have two bands");
+
+        if (getSolvedHeightsBand(previous.coordinates) > 0)
+            return;
+
+        if (previous.heights == nullptr)
+            throw runtime_error("Coordinates of previous correction do not record their heights, previous heights are required");
+        checkGeometry(input, previous.heights, "heights");
+        if (previous.heightBand < 1 || previous.heightBand > previous.heights->GetRasterCount())
+            throw runtime_error("Heights of previous correction have no band " + to_string(previous.heightBand));
+    }
+
+    size_t findUnchangedPixels(size_t count, const double *heights, const double *previousHeights, const double *previousCoords,
+                               double noData, double previousNoData, double tolerance, uint8_t *unchanged)
+    {
+        size_t found = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            unchanged[i] = !isNoData(heights[i], noData) && !isNoData(previousHeights[i], previousNoData) &&
+                           fabs(heights[i] - previousHeights[i]) <= tolerance &&
+                           !isnan(previousCoords[2 * i]) && !isnan(previousCoords[2 * i + 1]);
+            found += unchanged[i];
+        }
+        return found;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <gdal_priv.h>
+
+namespace ksg
+{
+    ///
+    /// Correction of previous slot of the same geometry, e.g. previous rapid scan. Corrected coordinates depend
+    /// only on pixel and its height, so pixels whose height did not change keep coordinates of previous output
+    /// instead of being solved again. Previous output should be corrected with the same settings and encoding.
+    ///
+    /// Heights are compared with heights for which previous coordinates were solved. Those are recorded in solved
+    /// heights band of previous output (see OutputFormat::solvedHeights) if it has one; so in chain of slots,
+    /// where copied coordinates are copied again, height which changes slowly is still solved again once
+    /// it differs by more than tolerance from the height of its coordinates. Otherwise they are heights of
+    /// previous slot, which is right only if previous output was fully corrected from them.
+    struct PreviousCorrection
+    {
+        /// Heights of previous slot, not used if coordinates have solved heights band
+        GDALDataset *heights = nullptr;
+        int heightBand = 1;
+        /// Coordinates corrected for previous heights, in any encoding of createCoordinatesRaster
+        GDALDataset *coordinates = nullptr;
+        /// Largest change of height for which coordinates are kept [m]
+        double heightTolerance = 0;
+    };
+
+    ///
+    /// @throws std::runtime_error if rasters of previous correction differ from input in size or geotransform,
+    /// or there are neither solved heights nor previous heights
+    void checkPreviousCorrection(GDALDataset *input, const PreviousCorrection &previous);
+
+    ///
+    /// Marks pixels whose height differs from height of previous coordinates by at most tolerance. Pixels whose
+    /// height is no data in any slot, or whose previous coordinates are NaN, are changed: the former are not
+    /// solved anyway, the latter could have been lost by encoding.
+    /// @param previousHeights heights for which previous coordinates were solved
+    /// @param noData, previousNoData no data values of heights, NaN if raster has none
+    /// @param previousCoords interleaved buffer (x, y pairs) of previous coordinates of count pixels
+    /// @param unchanged receives 1 for unchanged pixels, 0 for others
+    /// @return number of unchanged pixels
+    size_t findUnchangedPixels(size_t count, const double *heights, const double *previousHeights, const double *previousCoords,
+                               double noData, double previousNoData, double tolerance, uint8_t *unchanged);
+}
@@ -6,14 +6,32 @@
  */
 
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <gdal_priv.h>
 #include <ogr_spatialref.h>
 #include <boost/program_options.hpp>
 #include "correction.h"
 #include "correction_utils.h"
+#include "georeference_utils.h"
+#include "displacement_cache.h"
+#include "output_encoding.h"
+#include "correction_statistics.h"
+#include "incremental_correction.h"
+#include "batch_correction.h"
+#include "correction_service.h"
+#include <csignal>
 
 using namespace std;
 
@@ -22,7 +40,34 @@ static const string nmDesc = string() +
         ksg::NM_NETWON_NAME + "\n" +
         ksg::NM_NETWON_DESC + "\n" +
         ksg::NM_LEVENBERG_MARQUARD_NAME + "\n" +
-        ksg::NM_LEVENBERG_MARQUARD_DESC + "\n";
+        ksg::NM_LEVENBERG_MARQUARD_DESC + "\n" +
+        ksg::NM_LINE_OF_SIGHT_NAME + "\n" +
+        ksg::NM_LINE_OF_SIGHT_DESC + "\n";
+
+static const string oeDesc = string() +
+        "Encoding of corrected coordinates. Either:\n" +
+        ksg::OE_FLOAT64_NAME + "\n" +
+        ksg::OE_FLOAT64_DESC + "\n" +
+        ksg::OE_FLOAT32_NAME + "\n" +
+        ksg::OE_FLOAT32_DESC + "\n" +
+        ksg::OE_DISPLACEMENT_INT16_NAME + "\n" +
+        ksg::OE_DISPLACEMENT_INT16_DESC + "\n";
+
+static const string coDesc = string() +
+        "Compression of output. Either:\n" +
+        ksg::CO_NONE_NAME + "\n" +
+        ksg::CO_NONE_DESC + "\n" +
+        ksg::CO_DEFLATE_NAME + "\n" +
+        ksg::CO_DEFLATE_DESC + "\n" +
+        ksg::CO_ZSTD_NAME + "\n" +
+        ksg::CO_ZSTD_DESC + "\n";
+
+static const string igDesc = string() +
+        "Initial guess for numeric method. Either:\n" +
+        ksg::IG_HEURISTIC_NAME + "\n" +
+        ksg::IG_HEURISTIC_DESC + "\n" +
+        ksg::IG_INFLATED_ELLIPSOID_NAME + "\n" +
+        ksg::IG_INFLATED_ELLIPSOID_DESC + "\n";
 
 boost::program_options::variables_map init(int argc, char ** argv)
 {
@@ -39,7 +84,42 @@ boost::program_options::variables_map init(int argc, char ** argv)
         nmDesc.c_str()
     )
     ("use-squared-target", "Use squared targed function.")
-    ("iterations-limit",boost::program_options::value<int>()->default_value(100),"Maximum number of iteration per pixel.");
+    (
+        "initial-guess",
+        boost::program_options::value<ksg::InitialGuess>()->default_value(ksg::InitialGuess::INFLATED_ELLIPSOID),
+        igDesc.c_str()
+    )
+    ("iterations-limit",boost::program_options::value<int>()->default_value(100),"Maximum number of iteration per pixel.")
+    ("warm-start", "Start numeric method from solution of neighbouring pixel.")
+    ("cache", boost::program_options::value<std::string>(), "Location of displacement cache. It is created if missing and reused by following corrections of rasters with the same geometry.")
+    ("cache-heights", boost::program_options::value<ksg::HeightsRange<>>()->default_value({0.0, 20.0, 1.0}), "Heights grid of displacement cache and sparse lattice. Should contain following comma separated values min, max, step. All numbers should be expressed in km.")
+    ("use-symmetry", "Share displacement cache entries of pixels mirrored about equator and central meridian, so only quadrant of view disc is solved. Applies to --cache.")
+    ("sparse-lattice", "Solve displacements only on sparse lattice of pixels and bicubically interpolate others. Lattice is refined in quadtree where interpolation error exceeds half of required accuracy, other half is left for solutions. It is built once per raster geometry.")
+    ("lattice-cell-size", boost::program_options::value<size_t>()->default_value(32), "Size of the largest cells of --sparse-lattice in pixels, power of 2.")
+    (
+        "output-encoding",
+        boost::program_options::value<ksg::OutputEncoding>()->default_value(ksg::OutputEncoding::FLOAT64),
+        oeDesc.c_str()
+    )
+    (
+        "compression",
+        boost::program_options::value<ksg::Compression>()->default_value(ksg::Compression::NONE),
+        coDesc.c_str()
+    )
+    ("displacement-scale", boost::program_options::value<double>()->default_value(0), "Size of DISPLACEMENT_INT16 unit [m]. 0 means half of required accuracy.")
+    ("diagnostics", boost::program_options::value<std::string>(), "Location of raster with iterations count, residual [m] and status of every pixel. Single raster mode only.")
+    ("previous-output", boost::program_options::value<std::string>(), "Location of coordinates of previous slot corrected with the same options. Pixels whose height differs at most by --height-tolerance from height of their previous coordinates copy them instead of being solved again. Output then records heights of its coordinates for the next slot. It has to differ from --output. Single raster mode only.")
+    ("previous-input", boost::program_options::value<std::string>(), "Location of heights of previous slot. Required only if --previous-output does not record heights of its coordinates, i.e. it was not corrected incrementally.")
+    ("height-tolerance", boost::program_options::value<double>()->default_value(0), "Largest difference [m] between height of pixel and height of its previous coordinates which keeps them.")
+    ("threads",boost::program_options::value<int>()->default_value(0),"Number of worker threads. 0 means all available cores.")
+    ("batch-manifest", boost::program_options::value<std::string>(), "Location of manifest of batch mode. Every line contains input and output location separated with whitespace. Lines starting with # are skipped.")
+    ("batch-glob", boost::program_options::value<std::string>(), "Pattern of inputs of batch mode, e.g. \"data/h_*.tif\". Outputs are written to --batch-output-dir under the same names.")
+    ("batch-output-dir", boost::program_options::value<std::string>()->default_value("."), "Directory of outputs of inputs found with --batch-glob.")
+    ("batch-workers", boost::program_options::value<int>()->default_value(1), "Number of rasters corrected at once in batch mode. Threads are divided between them.")
+    ("serve", boost::program_options::value<std::string>(), "Runs correction service listening on given Unix domain socket. Options of this command are defaults of requests.")
+    ("service-workers", boost::program_options::value<int>()->default_value(1), "Number of requests corrected at once by service. Threads are divided between them.")
+    ("submit", boost::program_options::value<std::string>(), "Submits correction of --input to service listening on given socket and waits for it.")
+    ("service-status", boost::program_options::value<std::string>(), "Prints queue and latency counters of service listening on given socket.");
 
     auto ret = boost::program_options::variables_map();
 
@@ -57,80 +137,369 @@ boost::program_options::variables_map init(int argc, char ** argv)
     return ret;
 }
 
-void CopyGeoMetadata(GDALDataset* dest, GDALDataset* source)
+///
+/// Output layout selected by options. Displacement scale defaults to half of required accuracy, so rounding
+/// to the unit costs at most quarter of it. Int16 then covers displacements up to 16384 times required accuracy.
+ksg::OutputFormat OutputFormatFromOptions(const boost::program_options::variables_map &variablesMap, double requiredAccuracy)
 {
-    double geo[6];
-    source->GetGeoTransform(geo);
-    dest->SetGeoTransform(geo);
-    dest->SetProjection(source->GetProjectionRef());
+    ksg::OutputFormat format;
+    format.encoding = variablesMap["output-encoding"].as<ksg::OutputEncoding>();
+    format.compression = variablesMap["compression"].as<ksg::Compression>();
+    format.displacementScale = variablesMap["displacement-scale"].as<double>();
+    if(format.displacementScale <= 0)
+        format.displacementScale = requiredAccuracy / 2;
+    format.threads = variablesMap["threads"].as<int>();
+    return format;
 }
 
+///
+/// Corrects single raster with corrector shared by rasters of the same geometry.
+/// @param statistics counters of run are added to it, if not null
+/// @param diagnosticsPath location of diagnostics raster, none is written if empty
+/// @param previousOutputPath coordinates of previous slot reused for unchanged pixels, none are reused if empty
+/// @param previousInputPath heights of previous slot, required if previous output does not record its heights
+void CorrectRaster(const std::string &inputPath, const std::string &outputPath, int heightBand, ksg::NumericMethod numericMethod, double requiredAccuracy,
+                   const boost::program_options::variables_map &variablesMap, ksg::CorrectorPool &pool,
+                   ksg::CorrectionStatistics *statistics = nullptr, const std::string &diagnosticsPath = "",
+                   const std::string &previousInputPath = "", const std::string &previousOutputPath = "")
+{
+    GDALDataset *input = nullptr, *output = nullptr, *diagnostics = nullptr;
+    ksg::PreviousCorrection previous;
+    bool usePrevious = !previousOutputPath.empty();
+    if(!previousInputPath.empty() && !usePrevious)
+        throw runtime_error("Previous input requires previous output");
 
-
-int main(int argc, char** argv) {
-    auto variablesMap = init(argc,argv);
-    GDALAllRegister();
-    
-    int ret = 0;
-    
-    GDALDataset *input = nullptr, *output = nullptr;
-    
     try
     {
-        auto inputPath = variablesMap["input"].as<std::string>();
-
         input = (GDALDataset*)GDALOpen(inputPath.c_str(), GA_ReadOnly);
         if(input == nullptr)
             throw runtime_error("Cannot open "+inputPath);
-        
-        auto tifDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
-        if(tifDriver == nullptr)
-            throw runtime_error("There is no GTiff driver");
-        
-        GDALDataType type = GDT_Float64;
-        OGRSpatialReference srs;
-        auto srs_c = input->GetProjectionRef();
-        srs.importFromWkt(&srs_c);
-        
-        auto projectionName = string(srs.GetAttrValue("PROJECTION"));
-        
-        if(projectionName != "Geostationary_Satellite")
-            throw runtime_error("Height correction requires Geostationary_Satellite projection.");
-        
-
-        auto outputPath = variablesMap["output"].as<std::string>();   
-        
-        output = tifDriver->Create(outputPath.c_str(),input->GetRasterXSize(), input->GetRasterYSize(),2, type, nullptr);
-        
-        CopyGeoMetadata(output,input);
-        
-        auto corrector = GEOSHeightCorrector(srs);
-        
-        corrector.calculateNewCoordinatesForRaster(
+
+        // Previous output is read while output is written, so it cannot be overwritten
+        if(usePrevious)
+        {
+            if(previousOutputPath == outputPath)
+                throw runtime_error("Previous output has to differ from output");
+
+            if(!previousInputPath.empty())
+            {
+                previous.heights = (GDALDataset*)GDALOpen(previousInputPath.c_str(), GA_ReadOnly);
+                if(previous.heights == nullptr)
+                    throw runtime_error("Cannot open "+previousInputPath);
+            }
+            previous.coordinates = (GDALDataset*)GDALOpen(previousOutputPath.c_str(), GA_ReadOnly);
+            if(previous.coordinates == nullptr)
+                throw runtime_error("Cannot open "+previousOutputPath);
+            previous.heightBand = heightBand;
+            previous.heightTolerance = variablesMap["height-tolerance"].as<double>();
+            ksg::checkPreviousCorrection(input, previous);
+        }
+
+        // Projection is checked when corrector of geometry is created
+        auto entry = pool.get(input);
+
+        // Heights of coordinates copied again by following slots are recorded, so they do not drift away from them
+        auto format = OutputFormatFromOptions(variablesMap, requiredAccuracy);
+        format.solvedHeights = usePrevious;
+        output = ksg::createCoordinatesRaster(outputPath, input, format);
+        if(!diagnosticsPath.empty())
+            diagnostics = ksg::createDiagnosticsRaster(diagnosticsPath, input);
+
+        // Cache is filled in place, so rasters sharing it are corrected one at a time
+        // Cache is valid for single accuracy, requests with other one are solved directly
+        std::unique_lock<std::mutex> cacheLock;
+        bool useCache = variablesMap.count("cache") > 0 && requiredAccuracy == variablesMap["requierd-accuracy"].as<double>();
+        if(useCache)
+        {
+            cacheLock = std::unique_lock<std::mutex>(entry->mutex);
+            if(!entry->cache)
+            {
+                double geotransform[6];
+                input->GetGeoTransform(geotransform);
+                auto heights = variablesMap["cache-heights"].as<ksg::HeightsRange<>>();
+                auto key = ksg::DisplacementCache::makeKey(input->GetProjectionRef(), geotransform, requiredAccuracy);
+
+                // Every further geometry of batch gets cache file of its own
+                auto cachePath = variablesMap["cache"].as<std::string>();
+                if(entry->index > 0)
+                    cachePath += "." + to_string(entry->index);
+
+                entry->cache.reset(new ksg::DisplacementCache(
+                    cachePath, key,
+                    input->GetRasterXSize(), input->GetRasterYSize(),
+                    heights.min * 1000, heights.max * 1000, heights.step * 1000
+                ));
+
+                if(variablesMap.count("use-symmetry") > 0)
+                {
+                    OGRSpatialReference srs;
+                    auto wkt = input->GetProjectionRef();
+                    srs.importFromWkt(&wkt);
+                    ksg::ViewSymmetry symmetry(geotransform, srs.GetProjParm("false_easting", 0), srs.GetProjParm("false_northing", 0));
+                    if(!entry->cache->setSymmetry(symmetry))
+                        cerr << "Pixels of " << inputPath << " are not mirrored onto pixel centers, symmetry is not used." << endl;
+                }
+            }
+        }
+
+        // Lattice is built by first raster of geometry and only read afterwards
+        // It is valid for single accuracy too
+        const ksg::SparseLattice *lattice = nullptr;
+        if(variablesMap.count("sparse-lattice") > 0 && requiredAccuracy == variablesMap["requierd-accuracy"].as<double>())
+        {
+            std::unique_lock<std::mutex> latticeLock;
+            if(!cacheLock)
+                latticeLock = std::unique_lock<std::mutex>(entry->mutex);
+
+            if(!entry->lattice)
+            {
+                auto range = variablesMap["cache-heights"].as<ksg::HeightsRange<>>();
+                std::vector<double> heights;
+                for(double h = range.min; h <= range.max; h += range.step)
+                    heights.push_back(h * 1000);
+
+                std::unique_ptr<ksg::SparseLattice> built(new ksg::SparseLattice(heights, requiredAccuracy / 2, variablesMap["lattice-cell-size"].as<size_t>()));
+                entry->corrector->buildLattice(*built, input, requiredAccuracy, variablesMap["iterations-limit"].as<int>(), numericMethod,
+                                               variablesMap.count("use-squared-target") > 0, variablesMap["initial-guess"].as<ksg::InitialGuess>());
+                entry->lattice = std::move(built);
+                if(statistics != nullptr)
+                    statistics->latticeNodes += entry->lattice->getNodesCount();
+            }
+            lattice = entry->lattice.get();
+        }
+
+        entry->corrector->calculateNewCoordinatesForRaster(
             input,output,
-            variablesMap["height-band"].as<int>(),
-            variablesMap["requierd-accuracy"].as<double>(),
+            heightBand,
+            requiredAccuracy,
             variablesMap["iterations-limit"].as<int>(),
-            variablesMap["numeric-method"].as<ksg::NumericMethod>(),
-            variablesMap.count("use-squared-target") > 0
+            numericMethod,
+            variablesMap.count("use-squared-target") > 0,
+            variablesMap["initial-guess"].as<ksg::InitialGuess>(),
+            variablesMap.count("warm-start") > 0,
+            useCache ? entry->cache.get() : nullptr,
+            statistics,
+            diagnostics,
+            lattice,
+            usePrevious ? &previous : nullptr
         );
-        
     }
-    catch(exception &ex)
+    catch(...)
     {
-        cerr << "Error: "<< ex.what() << endl;
-        ret = -1;
+        for(auto dataset : {input, output, diagnostics, previous.heights, previous.coordinates})
+            if(dataset != nullptr)
+                GDALClose(dataset);
+        throw;
     }
-    
-    if(input != nullptr)
+
+    GDALClose(input);
+    GDALClose(output);
+    for(auto dataset : {diagnostics, previous.heights, previous.coordinates})
+        if(dataset != nullptr)
+            GDALClose(dataset);
+}
+
+///
+/// Corrects all rasters of manifest or glob pattern. Failure of raster is reported and does not stop others.
+/// @return number of failed rasters
+int CorrectBatch(const boost::program_options::variables_map &variablesMap)
+{
+    std::vector<ksg::BatchItem> items;
+    if(variablesMap.count("batch-manifest") > 0)
     {
-        GDALClose(input);
+        auto manifestPath = variablesMap["batch-manifest"].as<std::string>();
+        std::ifstream manifest(manifestPath);
+        if(!manifest)
+            throw runtime_error("Cannot open "+manifestPath);
+        items = ksg::readManifest(manifest);
     }
-    
-    if(output != nullptr)
+    else
+    {
+        items = ksg::expandGlob(variablesMap["batch-glob"].as<std::string>(), variablesMap["batch-output-dir"].as<std::string>());
+    }
+
+    if(items.empty())
+        throw runtime_error("There are no rasters to correct");
+
+    int workers = std::max(1, variablesMap["batch-workers"].as<int>());
+    int threads = variablesMap["threads"].as<int>();
+#ifdef _OPENMP
+    if(threads <= 0)
+        threads = omp_get_num_procs();
+#endif
+    int threadsPerWorker = std::max(1, threads / workers);
+
+    ksg::CorrectorPool pool;
+    ksg::CorrectionStatistics statistics;
+    std::mutex statisticsMutex;
+    auto start = std::chrono::steady_clock::now();
+
+    auto results = ksg::runBatch(items, workers,
+        [&](const ksg::BatchItem &item) {
+#ifdef _OPENMP
+            // Worker threads do not inherit number of threads set by main thread
+            omp_set_num_threads(threadsPerWorker);
+#endif
+            ksg::CorrectionStatistics itemStatistics;
+            CorrectRaster(item.input, item.output, variablesMap["height-band"].as<int>(), variablesMap["numeric-method"].as<ksg::NumericMethod>(),
+                          variablesMap["requierd-accuracy"].as<double>(), variablesMap, pool, &itemStatistics);
+
+            std::lock_guard<std::mutex> lock(statisticsMutex);
+            statistics += itemStatistics;
+        },
+        [](const ksg::BatchResult &result) {
+            if(result.succeeded)
+                cout << result.item.input << " -> " << result.item.output << ": " << std::fixed << std::setprecision(2) << result.seconds << " s" << endl;
+            else
+                cerr << "Error: " << result.item.input << ": " << result.error << " (after " << std::fixed << std::setprecision(2) << result.seconds << " s)" << endl;
+        }
+    );
+
+    int failed = std::count_if(results.begin(), results.end(), [](const ksg::BatchResult &result) { return !result.succeeded; });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    cout << "Corrected " << results.size() - failed << " of " << results.size() << " rasters in " << std::fixed << std::setprecision(2) << seconds << " s"
+         << " with " << pool.size() << " corrector" << (pool.size() == 1 ? "" : "s") << "." << endl;
+    cout << statistics.toJson() << endl;
+
+    return failed;
+}
+
+///
+/// Request with values of options of this command.
+ksg::ServiceRequest RequestFromOptions(const boost::program_options::variables_map &variablesMap)
+{
+    ksg::ServiceRequest request;
+    if(variablesMap.count("input") > 0)
+        request.item.input = variablesMap["input"].as<std::string>();
+    if(variablesMap.count("output") > 0)
+        request.item.output = variablesMap["output"].as<std::string>();
+    request.band = variablesMap["height-band"].as<int>();
+    request.method = variablesMap["numeric-method"].as<ksg::NumericMethod>();
+    request.accuracy = variablesMap["requierd-accuracy"].as<double>();
+    return request;
+}
+
+static ksg::CorrectionService *runningService = nullptr;
+
+void StopService(int)
+{
+    if(runningService != nullptr)
+        runningService->stop();
+}
+
+///
+/// Keeps correctors and caches of met geometries between requests, until SIGINT or SIGTERM.
+void Serve(const boost::program_options::variables_map &variablesMap)
+{
+    int workers = std::max(1, variablesMap["service-workers"].as<int>());
+    int threads = variablesMap["threads"].as<int>();
+#ifdef _OPENMP
+    if(threads <= 0)
+        threads = omp_get_num_procs();
+#endif
+    int threadsPerWorker = std::max(1, threads / workers);
+
+    ksg::CorrectorPool pool;
+    ksg::CorrectionService service(variablesMap["serve"].as<std::string>(), workers, RequestFromOptions(variablesMap),
+        [&](const ksg::ServiceRequest &request) {
+#ifdef _OPENMP
+            omp_set_num_threads(threadsPerWorker);
+#endif
+            CorrectRaster(request.item.input, request.item.output, request.band, request.method, request.accuracy, variablesMap, pool);
+        });
+
+    runningService = &service;
+    signal(SIGINT, StopService);
+    signal(SIGTERM, StopService);
+
+    cout << "Listening on " << variablesMap["serve"].as<std::string>() << endl;
+    service.run();
+    runningService = nullptr;
+
+    cout << service.getStatistics().format() << endl;
+}
+
+///
+/// Sends single request to service.
+/// @return 0 if request succeeded
+int Submit(const std::string &socketPath, const ksg::ServiceRequest &request)
+{
+    auto answer = ksg::submitRequest(socketPath, request);
+    if(answer.compare(0, 6, "ERROR ") == 0)
     {
-        GDALClose(output);
+        cerr << "Error: " << answer.substr(6) << endl;
+        return 2;
     }
+
+    cout << answer << endl;
     return 0;
 }
 
+int main(int argc, char** argv) {
+    auto variablesMap = init(argc,argv);
+    GDALAllRegister();
+
+#ifdef _OPENMP
+    if(variablesMap["threads"].as<int>() > 0)
+        omp_set_num_threads(variablesMap["threads"].as<int>());
+#endif
+
+    if(variablesMap.count("serve") > 0 || variablesMap.count("submit") > 0 || variablesMap.count("service-status") > 0)
+    {
+        try
+        {
+            if(variablesMap.count("serve") > 0)
+            {
+                Serve(variablesMap);
+                return 0;
+            }
+
+            ksg::ServiceRequest request = RequestFromOptions(variablesMap);
+            if(variablesMap.count("service-status") > 0)
+            {
+                request.type = ksg::ServiceRequest::Type::STATUS;
+                return Submit(variablesMap["service-status"].as<std::string>(), request);
+            }
+
+            if(request.item.input.empty() || request.item.output.empty())
+                throw runtime_error("Submitted request requires --input and --output");
+            return Submit(variablesMap["submit"].as<std::string>(), request);
+        }
+        catch(exception &ex)
+        {
+            cerr << "Error: "<< ex.what() << endl;
+            return 2;
+        }
+    }
+
+    if(variablesMap.count("batch-manifest") > 0 || variablesMap.count("batch-glob") > 0)
+    {
+        try
+        {
+            return CorrectBatch(variablesMap) == 0 ? 0 : 2;
+        }
+        catch(exception &ex)
+        {
+            cerr << "Error: "<< ex.what() << endl;
+            return 2;
+        }
+    }
+
+    try
+    {
+        ksg::CorrectorPool pool;
+        ksg::CorrectionStatistics statistics;
+        CorrectRaster(variablesMap["input"].as<std::string>(), variablesMap["output"].as<std::string>(), variablesMap["height-band"].as<int>(),
+                      variablesMap["numeric-method"].as<ksg::NumericMethod>(), variablesMap["requierd-accuracy"].as<double>(), variablesMap, pool,
+                      &statistics, variablesMap.count("diagnostics") > 0 ? variablesMap["diagnostics"].as<std::string>() : "",
+                      variablesMap.count("previous-input") > 0 ? variablesMap["previous-input"].as<std::string>() : "",
+                      variablesMap.count("previous-output") > 0 ? variablesMap["previous-output"].as<std::string>() : "");
+        cout << statistics.toJson() << endl;
+    }
+    catch(exception &ex)
+    {
+        cerr << "Error: "<< ex.what() << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <fstream>
+#include <limits>
+#include <string>
+
+namespace ksg
+{
+    ///
+    /// Reads memory usage of current process from /proc/self/status.
+    /// @param field either "VmRSS:" for resident set size or "VmHWM:" for its peak
+    /// @return size in bytes, 0 if it is not available
+    inline size_t readMemoryUsage(const std::string &field)
+    {
+        std::ifstream status("/proc/self/status");
+        std::string key;
+        while (status >> key)
+        {
+            if (key == field)
+            {
+                size_t kilobytes = 0;
+                status >> kilobytes;
+                return kilobytes * 1024;
+            }
+            status.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        return 0;
+    }
+
+    inline size_t currentMemoryUsage() { return readMemoryUsage("VmRSS:"); }
+    inline size_t peakMemoryUsage() { return readMemoryUsage("VmHWM:"); }
+}
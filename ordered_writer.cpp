@@ -0,0 +1,45 @@
+#include <utility>
+
+#include "ordered_writer.h"
+
+using namespace std;
+
+namespace ksg
+{
+    OrderedWriter::OrderedWriter(ostream &out, size_t first)
+        : out(out), next(first)
+    {
+    }
+
+    void OrderedWriter::submit(size_t index, string buffer)
+    {
+        lock_guard<std::mutex> lock(mutex);
+
+        if (index != next)
+        {
+            pending.emplace(index, std::move(buffer));
+            return;
+        }
+
+        out << buffer;
+        next++;
+
+        for (auto it = pending.begin(); it != pending.end() && it->first == next; it = pending.erase(it))
+        {
+            out << it->second;
+            next++;
+        }
+    }
+
+    size_t OrderedWriter::getNext() const
+    {
+        lock_guard<std::mutex> lock(mutex);
+        return next;
+    }
+
+    size_t OrderedWriter::getWaiting() const
+    {
+        lock_guard<std::mutex> lock(mutex);
+        return pending.size();
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace ksg
+{
+    ///
+    /// Writes buffers produced out of order by parallel workers into stream in order of their indices.
+    /// Buffer is written as soon as all preceding ones are, so only buffers waiting for slower workers are kept.
+    /// Safe to use from many threads.
+    class OrderedWriter
+    {
+        std::ostream &out;
+        size_t next;
+        std::map<size_t, std::string> pending;
+        mutable std::mutex mutex;
+
+    public:
+        ///
+        /// @param first index of the first buffer
+        OrderedWriter(std::ostream &out, size_t first = 0);
+
+        ///
+        /// Queues buffer and writes every buffer which does not wait for preceding one anymore.
+        /// Every index should be submitted exactly once. Exceptions of stream are propagated to caller.
+        void submit(size_t index, std::string buffer);
+
+        ///
+        /// Index of the first buffer which is not written yet.
+        size_t getNext() const;
+
+        ///
+        /// Number of buffers waiting for preceding ones.
+        size_t getWaiting() const;
+    };
+}
@@ -0,0 +1,168 @@
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <cpl_string.h>
+#include "output_encoding.h"
+
+using namespace std;
+
+namespace ksg
+{
+    static pair<double, double> pixelCenter(const double *geotransform, int x, int y)
+    {
+        return make_pair(geotransform[0] + geotransform[1] * (x + 0.5) + geotransform[2] * (y + 0.5),
+                         geotransform[3] + geotransform[4] * (x + 0.5) + geotransform[5] * (y + 0.5));
+    }
+
+    GDALDataset *createCoordinatesRaster(const string &path, GDALDataset *input, const OutputFormat &format)
+    {
+        auto tifDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+        if (tifDriver == nullptr)
+            throw runtime_error("There is no GTiff driver");
+
+        GDALDataType type = GDT_Float64;
+        if (format.encoding == OutputEncoding::FLOAT32)
+            type = GDT_Float32;
+        else if (format.encoding == OutputEncoding::DISPLACEMENT_INT16)
+            type = GDT_Int16;
+
+        if (format.encoding == OutputEncoding::DISPLACEMENT_INT16 && !(format.displacementScale > 0))
+            throw runtime_error("Displacement scale should be positive");
+
+        char **options = nullptr;
+        if (format.compression != Compression::NONE)
+        {
+            ostringstream name;
+            name << format.compression;
+
+            auto creationOptions = tifDriver->GetMetadataItem(GDAL_DMD_CREATIONOPTIONLIST);
+            if (creationOptions == nullptr || string(creationOptions).find(name.str()) == string::npos)
+                throw runtime_error("GTiff driver does not support " + name.str() + " compression");
+
+            // Horizontal differencing for integers, floating point predictor for floats
+            options = CSLSetNameValue(options, "TILED", "YES");
+            options = CSLSetNameValue(options, "BLOCKXSIZE", "256");
+            options = CSLSetNameValue(options, "BLOCKYSIZE", "256");
+            options = CSLSetNameValue(options, "COMPRESS", name.str().c_str());
+            options = CSLSetNameValue(options, "PREDICTOR", type == GDT_Int16 ? "2" : "3");
+            options = CSLSetNameValue(options, "NUM_THREADS", format.threads > 0 ? to_string(format.threads).c_str() : "ALL_CPUS");
+        }
+
+        auto output = tifDriver->Create(path.c_str(), input->GetRasterXSize(), input->GetRasterYSize(), format.solvedHeights ? 3 : 2,
+                                        type, options);
+        CSLDestroy(options);
+        if (output == nullptr)
+            throw runtime_error("Cannot create " + path);
+
+        double geotransform[6];
+        input->GetGeoTransform(geotransform);
+        output->SetGeoTransform(geotransform);
+        output->SetProjection(input->GetProjectionRef());
+
+        ostringstream encoding;
+        encoding << format.encoding;
+        output->SetMetadataItem(COORDINATES_ENCODING_ITEM, encoding.str().c_str());
+
+        if (format.encoding == OutputEncoding::DISPLACEMENT_INT16)
+        {
+            for (int b = 1; b <= 2; b++)
+            {
+                auto band = output->GetRasterBand(b);
+                band->SetScale(format.displacementScale);
+                band->SetOffset(0);
+                band->SetNoDataValue(DISPLACEMENT_NO_DATA);
+                band->SetDescription(b == 1 ? "dx" : "dy");
+            }
+        }
+
+        if (format.solvedHeights)
+        {
+            output->SetMetadataItem(SOLVED_HEIGHTS_BAND_ITEM, "3");
+            auto band = output->GetRasterBand(3);
+            band->SetDescription("solved_height");
+            band->SetNoDataValue(type == GDT_Int16 ? DISPLACEMENT_NO_DATA : numeric_limits<double>::quiet_NaN());
+        }
+
+        return output;
+    }
+
+    int getSolvedHeightsBand(GDALDataset *raster)
+    {
+        auto item = raster->GetMetadataItem(SOLVED_HEIGHTS_BAND_ITEM);
+        int band = item != nullptr ? atoi(item) : 0;
+        return band > 2 && band <= raster->GetRasterCount() ? band : 0;
+    }
+
+    OutputEncoding getOutputEncoding(GDALDataset *raster)
+    {
+        auto name = raster->GetMetadataItem(COORDINATES_ENCODING_ITEM);
+        if (name == nullptr)
+            return OutputEncoding::FLOAT64;
+
+        OutputEncoding encoding;
+        istringstream in(name);
+        in >> encoding;
+        return encoding;
+    }
+
+    size_t encodeDisplacement(const double *geotransform, double scale, int x, int y, int width, int height,
+                              const double *coords, int16_t *displacement)
+    {
+        size_t outOfRange = 0;
+        for (int wy = 0; wy < height; wy++)
+            for (int wx = 0; wx < width; wx++)
+            {
+                size_t i = 2 * (static_cast<size_t>(wy) * width + wx);
+                auto center = pixelCenter(geotransform, x + wx, y + wy);
+
+                double dx = round((coords[i] - center.first) / scale);
+                double dy = round((coords[i + 1] - center.second) / scale);
+
+                // NaN fails both comparisons, so it is not counted as out of range
+                bool valid = fabs(dx) <= numeric_limits<int16_t>::max() && fabs(dy) <= numeric_limits<int16_t>::max();
+                if (!valid && !isnan(dx) && !isnan(dy))
+                    outOfRange++;
+
+                displacement[i] = valid ? static_cast<int16_t>(dx) : DISPLACEMENT_NO_DATA;
+                displacement[i + 1] = valid ? static_cast<int16_t>(dy) : DISPLACEMENT_NO_DATA;
+            }
+        return outOfRange;
+    }
+
+    void readCoordinates(GDALDataset *raster, int x, int y, int width, int height, double *coords)
+    {
+        int bands[] = {1, 2};
+        GSpacing pixelSpace = 2 * sizeof(double);
+
+        if (raster->RasterIO(GF_Read, x, y, width, height, coords, width, height, GDT_Float64, 2, bands,
+                             pixelSpace, pixelSpace * width, sizeof(double), nullptr) != CE_None)
+            throw runtime_error("Cannot read coordinates raster");
+
+        if (getOutputEncoding(raster) != OutputEncoding::DISPLACEMENT_INT16)
+            return;
+
+        double geotransform[6];
+        raster->GetGeoTransform(geotransform);
+        double scale[] = {raster->GetRasterBand(1)->GetScale(), raster->GetRasterBand(2)->GetScale()};
+
+        for (int wy = 0; wy < height; wy++)
+            for (int wx = 0; wx < width; wx++)
+            {
+                size_t i = 2 * (static_cast<size_t>(wy) * width + wx);
+                auto center = pixelCenter(geotransform, x + wx, y + wy);
+
+                if (coords[i] == DISPLACEMENT_NO_DATA || coords[i + 1] == DISPLACEMENT_NO_DATA)
+                {
+                    coords[i] = coords[i + 1] = numeric_limits<double>::quiet_NaN();
+                    continue;
+                }
+
+                coords[i] = center.first + coords[i] * scale[0];
+                coords[i + 1] = center.second + coords[i + 1] * scale[1];
+            }
+    }
+}
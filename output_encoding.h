@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <gdal_priv.h>
+#include "correction_utils.h"
+
+namespace ksg
+{
+    /// Value of DISPLACEMENT_INT16 pixels which could not be corrected or whose displacement does not fit in Int16
+    constexpr int16_t DISPLACEMENT_NO_DATA = -32768;
+
+    /// Dataset metadata item holding name of OutputEncoding
+    constexpr const char* COORDINATES_ENCODING_ITEM = "COORDINATES_ENCODING";
+
+    /// Dataset metadata item holding index of optional band with height for which coordinates of pixel were solved [m]
+    constexpr const char* SOLVED_HEIGHTS_BAND_ITEM = "SOLVED_HEIGHTS_BAND";
+
+    ///
+    /// Layout of raster with corrected coordinates.
+    struct OutputFormat
+    {
+        OutputEncoding encoding = OutputEncoding::FLOAT64;
+        Compression compression = Compression::NONE;
+        /// Size of DISPLACEMENT_INT16 unit [m]. Absolute coordinates are rebuilt with error up to half of it.
+        double displacementScale = 5;
+        /// Threads compressing output, 0 means all available cores
+        int threads = 0;
+        /// Adds third band with height for which coordinates of pixel were solved, so following incremental
+        /// correction compares heights with it. DISPLACEMENT_INT16 rounds it to whole metres.
+        bool solvedHeights = false;
+    };
+
+    ///
+    /// Creates two band GeoTIFF for corrected coordinates of input, with the same size, geotransform and projection.
+    /// Encoding is recorded in dataset metadata, DISPLACEMENT_INT16 bands additionally carry scale and no data value,
+    /// so absolute coordinate is pixel center plus value multiplied by scale.
+    /// @throws std::runtime_error if raster cannot be created or GDAL does not support compression
+    GDALDataset *createCoordinatesRaster(const std::string &path, GDALDataset *input, const OutputFormat &format);
+
+    ///
+    /// Encoding of raster with corrected coordinates. Rasters without encoding in metadata hold FLOAT64 coordinates.
+    OutputEncoding getOutputEncoding(GDALDataset *raster);
+
+    ///
+    /// @return index of band with solved heights, 0 if raster has none
+    int getSolvedHeightsBand(GDALDataset *raster);
+
+    ///
+    /// Converts window of corrected coordinates into displacement from pixels centers in units of scale.
+    /// NaN coordinates and displacements out of Int16 range are replaced with DISPLACEMENT_NO_DATA.
+    /// @param geotransform geotransform of raster
+    /// @param coords interleaved buffer (x, y pairs) of width * height pixels
+    /// @param displacement interleaved buffer (dx, dy pairs) of width * height pixels
+    /// @return number of pixels whose displacement is out of range
+    size_t encodeDisplacement(const double *geotransform, double scale, int x, int y, int width, int height,
+                              const double *coords, int16_t *displacement);
+
+    ///
+    /// Reads window of raster with corrected coordinates of any encoding as absolute geos coordinates.
+    /// @param coords interleaved buffer (x, y pairs) of width * height pixels, NaN for pixels without coordinates
+    /// @throws std::runtime_error if raster cannot be read
+    void readCoordinates(GDALDataset *raster, int x, int y, int width, int height, double *coords);
+}
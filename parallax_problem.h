@@ -0,0 +1,291 @@
+#pragma once
+#include <cmath>
+#include <dlib/geometry/vector.h>
+#include <dlib/matrix.h>
+
+#include "geodetic_utils.h"
+
+namespace ksg
+{
+    constexpr int PHI_E = 0;
+    constexpr int LAMBDA_E = 1;
+    constexpr int Q = 2;
+
+    typedef dlib::vector<double, 3> TargetFunctionArg;
+    typedef dlib::vector<double, 3> TargetFunctionResult;
+    typedef dlib::matrix<double, 3, 3> TargetFunctionDerivative;
+    typedef dlib::matrix<double, 3, 3> TargetFunctionHessian;
+
+    static inline TargetFunctionArg createTargetFunctionArg(double phi_earth, double lambda_earth, double q)
+    {
+        TargetFunctionArg ret;
+        ret(PHI_E) = phi_earth;
+        ret(LAMBDA_E) = lambda_earth;
+        ret(Q) = q;
+        return ret;
+    }
+
+    ///
+    /// Solves 3x3 system m * x = v with Cramer's rule.
+    static inline TargetFunctionArg solveLinearSystem(const dlib::matrix<double, 3, 3> &m, const TargetFunctionArg &v)
+    {
+        double c0 = m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1);
+        double c1 = m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2);
+        double c2 = m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0);
+        double invDet = 1 / (m(0, 0) * c0 + m(0, 1) * c1 + m(0, 2) * c2);
+
+        TargetFunctionArg ret;
+        ret(0) = (v(0) * c0 + m(0, 1) * (v(2) * m(1, 2) - v(1) * m(2, 2)) + m(0, 2) * (v(1) * m(2, 1) - v(2) * m(1, 1))) * invDet;
+        ret(1) = (m(0, 0) * (v(1) * m(2, 2) - v(2) * m(1, 2)) + v(0) * c1 + m(0, 2) * (v(2) * m(1, 0) - v(1) * m(2, 0))) * invDet;
+        ret(2) = (m(0, 0) * (v(2) * m(1, 1) - v(1) * m(2, 1)) + m(0, 1) * (v(1) * m(2, 0) - v(2) * m(1, 0)) + v(0) * c2) * invDet;
+        return ret;
+    }
+
+    ///
+    /// Point of ellipsoid inflated by object height, lying on line of sight of satellite. Target function is
+    /// difference between both in cartesian coordinates, its root is found by numeric method.
+    class ParallaxProblem {
+
+        double a;
+        double eSqr;
+        double h;
+        double phi_s; 
+        double lambda_s; 
+        double l;
+
+        // Trigonometric functions of satellite view angles, constant for pixel
+        double cos_phi_s;
+        double sin_phi_s;
+        double cos_lambda_s;
+        double sin_lambda_s;
+
+    public:
+        ///
+        /// @param a Ellipsoid semi-major axis lenght
+        /// @param eSqr Ellipsoid flattering coefficient squared
+        /// @param h Object height above surface
+        /// @param phi_s Satellite vertical view angle in radians
+        /// @param lambda_s Satellite horizontal view angle in radians
+        /// @param l Satellite distance from center of ellipsoid
+        ParallaxProblem(double a, double eSqr, double h, double phi_s, double lambda_s, double l)
+        : a(a), eSqr(eSqr), h(h), phi_s(phi_s), lambda_s(lambda_s), l(l),
+          cos_phi_s(std::cos(phi_s)), sin_phi_s(std::sin(phi_s)), cos_lambda_s(std::cos(lambda_s)), sin_lambda_s(std::sin(lambda_s))
+        {}
+
+        inline double targetFunctionScalarValue(const TargetFunctionArg &arg) const {
+            return targetFunctionVectorValue(arg).length();
+        }
+
+        inline TargetFunctionResult targetFunctionVectorValue(const TargetFunctionArg &arg) const
+        {
+            TargetFunctionResult ret;
+            double sin_phi_e = std::sin(arg(PHI_E));
+            double cos_phi_e = std::cos(arg(PHI_E));
+            double n = a / std::sqrt(1 - eSqr * sin_phi_e * sin_phi_e);
+            ret(0) = (n + h) * cos_phi_e * std::cos(arg(LAMBDA_E)) + cos_phi_s * cos_lambda_s * arg(Q) - l;
+            ret(1) = (n + h) * cos_phi_e * std::sin(arg(LAMBDA_E)) - cos_phi_s * sin_lambda_s * arg(Q);
+            ret(2) = (n * (1 - eSqr) + h) * sin_phi_e - sin_phi_s * arg(Q);
+
+            return ret;
+        }
+
+        ///
+        /// Evaluates target function and its Jacobian in single pass, sharing N and trigonometric functions of arg.
+        inline void targetFunctionValueAndJacobian(const TargetFunctionArg &arg, TargetFunctionResult &value, TargetFunctionDerivative &jacobian) const
+        {
+            double sin_phi_e = std::sin(arg(PHI_E));
+            double cos_phi_e = std::cos(arg(PHI_E));
+            double sin_lambda_e = std::sin(arg(LAMBDA_E));
+            double cos_lambda_e = std::cos(arg(LAMBDA_E));
+
+            double w = 1 - eSqr * sin_phi_e * sin_phi_e;
+            double sqrt_w = std::sqrt(w);
+            double n = a / sqrt_w;
+            double dndphi = a * eSqr * sin_phi_e * cos_phi_e / (w * sqrt_w);
+
+            value(0) = (n + h) * cos_phi_e * cos_lambda_e + cos_phi_s * cos_lambda_s * arg(Q) - l;
+            value(1) = (n + h) * cos_phi_e * sin_lambda_e - cos_phi_s * sin_lambda_s * arg(Q);
+            value(2) = (n * (1 - eSqr) + h) * sin_phi_e - sin_phi_s * arg(Q);
+
+            jacobian(0, Q) = cos_phi_s * cos_lambda_s;
+            jacobian(1, Q) = -cos_phi_s * sin_lambda_s;
+            jacobian(2, Q) = -sin_phi_s;
+
+            jacobian(0, LAMBDA_E) = -(n + h) * cos_phi_e * sin_lambda_e;
+            jacobian(1, LAMBDA_E) = (n + h) * cos_phi_e * cos_lambda_e;
+            jacobian(2, LAMBDA_E) = 0;
+
+            double tmp = (dndphi * cos_phi_e - (n + h) * sin_phi_e);
+
+            jacobian(0, PHI_E) = cos_lambda_e * tmp;
+            jacobian(1, PHI_E) = sin_lambda_e * tmp;
+            jacobian(2, PHI_E) = (1 - eSqr) * dndphi * sin_phi_e + (n * (1 - eSqr) + h) * cos_phi_e;
+        }
+
+        inline TargetFunctionDerivative targetFunctionJacobian(const TargetFunctionArg &arg) const
+        {
+            TargetFunctionResult value;
+            TargetFunctionDerivative ret;
+            targetFunctionValueAndJacobian(arg, value, ret);
+            return ret;
+        }
+
+        inline TargetFunctionHessian targetFunctionHessian(const TargetFunctionArg &arg) const {
+            auto jacobi = targetFunctionJacobian(arg);
+            return dlib::trans(jacobi)*jacobi;
+        }
+
+        ///
+        /// @param value target function value
+        /// @param accuracy required accuracy
+        /// @return true if provided target function value satisfies required accuracy
+        static inline bool doesSatsifyRequiredAccuracy(const TargetFunctionResult value, double accuracy) {
+            return value.length() <= accuracy;
+        }
+
+    };
+
+    ///
+    /// Variant of ParallaxProblem with squared components of target function.
+    class ParallaxProblemSquared {
+        ParallaxProblem original;
+
+    public:
+        ///
+        /// @param a Ellipsoid semi-major axis lenght
+        /// @param eSqr Ellipsoid flattering coefficient squared
+        /// @param h Object height above surface
+        /// @param phi_s Satellite vertical view angle in radians
+        /// @param lambda_s Satellite horizontal view angle in radians
+        /// @param l Satellite distance from center of ellipsoid
+        ParallaxProblemSquared(double a, double eSqr, double h, double phi_s, double lambda_s, double l)
+        : original(a,eSqr, h, phi_s, lambda_s, l)
+        {}
+
+        inline double targetFunctionScalarValue(const TargetFunctionArg &arg) const {
+            return targetFunctionVectorValue(arg).length();
+        }
+
+        inline TargetFunctionResult targetFunctionVectorValue(const TargetFunctionArg &arg) const
+        {
+            auto ret = original.targetFunctionVectorValue(arg);
+
+            for(auto& elem : ret) {
+                elem = elem * elem;
+            } 
+
+            return ret;
+        }
+
+        ///
+        /// Evaluates target function and its Jacobian in single pass, sharing N and trigonometric functions of arg.
+        inline void targetFunctionValueAndJacobian(const TargetFunctionArg &arg, TargetFunctionResult &value, TargetFunctionDerivative &jacobian) const
+        {
+            original.targetFunctionValueAndJacobian(arg, value, jacobian);
+
+            // Chain rule: derivative of f^2 is 2 * f * f'
+            for (int fun = 0; fun < 3; fun++)
+            {
+                for (int var = 0; var < 3; var++)
+                    jacobian(fun, var) = 2 * value(fun) * jacobian(fun, var);
+                value(fun) = value(fun) * value(fun);
+            }
+        }
+
+        inline TargetFunctionDerivative targetFunctionJacobian(const TargetFunctionArg &arg) const
+        {
+            TargetFunctionResult value;
+            TargetFunctionDerivative ret;
+            targetFunctionValueAndJacobian(arg, value, ret);
+            return ret;
+        }
+
+        inline TargetFunctionHessian targetFunctionHessian(const TargetFunctionArg &arg) const {
+            auto jacobi = targetFunctionJacobian(arg);
+            return dlib::trans(jacobi)*jacobi;
+        }
+
+        ///
+        /// @param value target function value
+        /// @param accuracy required accuracy
+        /// @return true if provided target function value satisfies required accuracy
+        static inline bool doesSatsifyRequiredAccuracy(const TargetFunctionResult value, double accuracy) {
+            return value.length() <= std::pow(accuracy, 2)/2;
+        }
+    };
+
+    ///
+    /// Line of sight of satellite parametrised by distance from satellite (q), same as in ParallaxProblem.
+    /// Object lies at the point of line whose geodetic height equals object height, so problem has single unknown.
+    class LineOfSightProblem {
+
+        double eSqr;
+        double h;
+        double l;
+
+        // Direction of line of sight
+        double dx;
+        double dy;
+        double dz;
+
+    public:
+        ///
+        /// @param eSqr Ellipsoid flattering coefficient squared, semi-major axis is 1
+        /// @param h Object height above surface
+        /// @param phi_s Satellite vertical view angle in radians
+        /// @param lambda_s Satellite horizontal view angle in radians
+        /// @param l Satellite distance from center of ellipsoid
+        LineOfSightProblem(double eSqr, double h, double phi_s, double lambda_s, double l)
+        : eSqr(eSqr), h(h), l(l),
+          dx(-std::cos(phi_s) * std::cos(lambda_s)), dy(std::cos(phi_s) * std::sin(lambda_s)), dz(std::sin(phi_s))
+        {}
+
+        ///
+        /// Difference between geodetic height of point q of line and object height.
+        /// @param derivative derivative of difference with respect to q, projection of line direction on ellipsoid normal
+        /// @param normal unit normal of ellipsoid at foot of point
+        inline double heightDifference(double q, double &derivative, double *normal) const
+        {
+            double height = geodeticHeight(l + q * dx, q * dy, q * dz, 1, eSqr, normal);
+            derivative = normal[0] * dx + normal[1] * dy + normal[2] * dz;
+            return height - h;
+        }
+
+        ///
+        /// Geodetic coordinates of point q of line, from normal found by heightDifference.
+        inline void coordinates(double q, const double *normal, double &phi_e, double &lambda_e) const
+        {
+            phi_e = std::atan2(normal[2], std::sqrt(normal[0] * normal[0] + normal[1] * normal[1]));
+            lambda_e = std::atan2(q * dy, l + q * dx);
+        }
+
+        ///
+        /// Finds range of q containing the visible solution. Point at distance r from center has geodetic height
+        /// between r - 1 and r - sqrt(1 - eSqr), so it is bounded with spheres inflated by object height.
+        /// @param nearest q of non-negative height difference
+        /// @param farthest q of non-positive height difference
+        /// @return false if line of sight does not reach object height
+        inline bool bracket(double &nearest, double &farthest) const
+        {
+            // |(l + q*dx, q*dy, q*dz)|^2 = radius^2, direction is unit vector
+            auto intersectSphere = [&](double radius, double &q) {
+                double discriminant = l * l * dx * dx - (l * l - radius * radius);
+                if (discriminant < 0)
+                    return false;
+                q = -l * dx - std::sqrt(discriminant);
+                return true;
+            };
+
+            if (!intersectSphere(1 + h, nearest))
+                return false;
+
+            if (intersectSphere(std::sqrt(1 - eSqr) + h, farthest))
+                return true;
+
+            // Line grazes object height surface, point nearest to center is the lowest one
+            farthest = -l * dx;
+            double derivative, normal[3];
+            return heightDifference(farthest, derivative, normal) <= 0;
+        }
+    };
+}
@@ -0,0 +1,378 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "sparse_lattice.h"
+#include "height_interpolation.h"
+
+using namespace std;
+
+namespace ksg
+{
+    /// Offset of node coordinates in key, nodes of stencils may lie before first pixel of raster
+    constexpr long KEY_OFFSET = 1L << 30;
+
+    /// Positions in cell (in quarters of its size) which are solved to check interpolation. Error of Catmull-Rom
+    /// interpolation of cubic terms vanishes in the center of cell, so all quarters are checked too.
+    constexpr long CHECKS[5][2] = {{2, 2}, {1, 1}, {3, 1}, {1, 3}, {3, 3}};
+
+    /// Catmull-Rom weights of nodes -1, 0, 1, 2 for position t in [0, 1] between nodes 0 and 1
+    static void catmullRomWeights(double t, double w[4])
+    {
+        double t2 = t * t, t3 = t2 * t;
+        w[0] = (-t3 + 2 * t2 - t) / 2;
+        w[1] = (3 * t3 - 5 * t2 + 2) / 2;
+        w[2] = (-3 * t3 + 4 * t2 + t) / 2;
+        w[3] = (t3 - t2) / 2;
+    }
+
+    /// Cubic Hermite interpolant at position t in [0, 1] of interval of given length
+    static double hermite(double y0, double y1, double slope0, double slope1, double length, double t)
+    {
+        double h00 = (1 + 2 * t) * (1 - t) * (1 - t), h10 = t * (1 - t) * (1 - t);
+        double h01 = t * t * (3 - 2 * t), h11 = t * t * (t - 1);
+        return h00 * y0 + h10 * length * slope0 + h01 * y1 + h11 * length * slope1;
+    }
+
+    SparseLattice::SparseLattice(vector<double> heights, double maxError, size_t cellSize, bool betweenHeights)
+        : heights(move(heights)), maxError(maxError), cellSize(cellSize), betweenHeights(betweenHeights)
+    {
+        if (cellSize < MIN_CELL_SIZE || (cellSize & (cellSize - 1)) != 0)
+            throw logic_error("Size of lattice cell should be power of 2 not lower than " + to_string(MIN_CELL_SIZE));
+        if (this->heights.empty())
+            throw logic_error("Lattice requires at least one height");
+
+        solvedHeights = this->heights;
+        if (betweenHeights)
+            for (size_t hi = 0; hi + 1 < this->heights.size(); hi++)
+                solvedHeights.push_back((this->heights[hi] + this->heights[hi + 1]) / 2);
+        nodeSlots = solvedHeights.size() + (betweenHeights ? this->heights.size() : 0);
+    }
+
+    uint64_t SparseLattice::nodeKey(long column, long line)
+    {
+        return (static_cast<uint64_t>(line + KEY_OFFSET) << 32) | static_cast<uint64_t>(column + KEY_OFFSET);
+    }
+
+    const float *SparseLattice::node(long column, long line) const
+    {
+        auto found = nodeIndex.find(nodeKey(column, line));
+        if (found == nodeIndex.end())
+            return nullptr;
+
+        const float *node = &values[2 * nodeSlots * found->second];
+        return isnan(node[0]) ? nullptr : node;
+    }
+
+    void SparseLattice::build(size_t firstColumn, size_t firstLine, size_t columns, size_t lines, const Solver &solve)
+    {
+        this->firstColumn = firstColumn;
+        this->firstLine = firstLine;
+        this->columns = columns;
+        this->lines = lines;
+        cells.clear();
+        stencils.clear();
+        nodeIndex.clear();
+        values.clear();
+        solvedNodes = 0;
+        built = true;
+
+        if (columns == 0 || lines == 0)
+            return;
+
+        topColumns = max<size_t>(1, (columns - 1 + cellSize - 1) / cellSize);
+        topLines = max<size_t>(1, (lines - 1 + cellSize - 1) / cellSize);
+        long lastColumn = firstColumn + columns - 1, lastLine = firstLine + lines - 1;
+
+        struct Pending
+        {
+            uint32_t cell;
+            long x0, y0;
+            long size;
+        };
+
+        vector<Pending> pending;
+        // Checked pixels of pending cells are solved in midpoints between heights too
+        vector<uint64_t> checkKeys;
+        cells.resize(topColumns * topLines);
+        for (size_t j = 0; j < topLines; j++)
+            for (size_t i = 0; i < topColumns; i++)
+                pending.push_back({static_cast<uint32_t>(j * topColumns + i), static_cast<long>(firstColumn + i * cellSize),
+                                   static_cast<long>(firstLine + j * cellSize), static_cast<long>(cellSize)});
+
+        size_t valuesPerNode = 2 * nodeSlots;
+        size_t slopesSlot = solvedHeights.size();
+
+        // Cells of the same size are refined together, so nodes shared by neighbouring cells are solved once
+        while (!pending.empty())
+        {
+            vector<uint64_t> keys;
+            checkKeys.clear();
+            for (auto &p : pending)
+            {
+                for (long j = -1; j <= 2; j++)
+                    for (long i = -1; i <= 2; i++)
+                        keys.push_back(nodeKey(p.x0 + i * p.size, p.y0 + j * p.size));
+                for (auto &check : CHECKS)
+                    checkKeys.push_back(nodeKey(p.x0 + check[0] * p.size / 4, p.y0 + check[1] * p.size / 4));
+            }
+            keys.insert(keys.end(), checkKeys.begin(), checkKeys.end());
+            sort(checkKeys.begin(), checkKeys.end());
+
+            sort(keys.begin(), keys.end());
+            keys.erase(unique(keys.begin(), keys.end()), keys.end());
+            keys.erase(remove_if(keys.begin(), keys.end(), [&](uint64_t key) { return nodeIndex.count(key) > 0; }), keys.end());
+
+            size_t firstNode = values.size() / valuesPerNode;
+            values.resize(values.size() + keys.size() * valuesPerNode, numeric_limits<float>::quiet_NaN());
+
+            #pragma omp parallel
+            {
+                vector<pair<double, double>> solved(solvedHeights.size());
+                vector<double> dx(heights.size()), dy(heights.size());
+
+                #pragma omp for schedule(dynamic)
+                for (size_t k = 0; k < keys.size(); k++)
+                {
+                    long column = static_cast<long>(keys[k] & 0xffffffff) - KEY_OFFSET;
+                    long line = static_cast<long>(keys[k] >> 32) - KEY_OFFSET;
+                    bool checked = solvedHeights.size() > heights.size() && binary_search(checkKeys.begin(), checkKeys.end(), keys[k]);
+                    auto &nodeHeights = checked ? solvedHeights : heights;
+                    bool valid = solve(column, line, nodeHeights, solved.data());
+
+                    float *node = &values[(firstNode + k) * valuesPerNode];
+                    for (size_t hi = 0; hi < nodeHeights.size(); hi++)
+                    {
+                        valid = valid && !isnan(solved[hi].first) && !isnan(solved[hi].second);
+                        node[2 * hi] = solved[hi].first;
+                        node[2 * hi + 1] = solved[hi].second;
+                    }
+
+                    // Node which cannot be solved is marked with NaN in its first value
+                    if (!valid)
+                    {
+                        node[0] = numeric_limits<float>::quiet_NaN();
+                        continue;
+                    }
+                    solvedNodes++;
+
+                    // Slopes of node in height are found once and interpolated across cells like displacements
+                    if (!betweenHeights || heights.size() < 2)
+                        continue;
+
+                    for (size_t hi = 0; hi < heights.size(); hi++)
+                    {
+                        dx[hi] = node[2 * hi];
+                        dy[hi] = node[2 * hi + 1];
+                    }
+                    MonotoneCubic xSpline(heights, dx), ySpline(heights, dy);
+                    for (size_t hi = 0; hi < heights.size(); hi++)
+                    {
+                        node[2 * (slopesSlot + hi)] = xSpline.getSlopes()[hi];
+                        node[2 * (slopesSlot + hi) + 1] = ySpline.getSlopes()[hi];
+                    }
+                }
+            }
+
+            for (size_t k = 0; k < keys.size(); k++)
+                nodeIndex.emplace(keys[k], firstNode + k);
+
+            // Cell is interpolated if all nodes of its stencil were solved and checked pixels agree with them
+            vector<uint32_t> stencil(16 * pending.size());
+            vector<char> accepted(pending.size()), unsolvable(pending.size());
+
+            #pragma omp parallel
+            {
+                vector<pair<double, double>> interpolated(heights.size()), slopes(heights.size());
+
+                #pragma omp for schedule(dynamic, 16)
+                for (size_t c = 0; c < pending.size(); c++)
+                {
+                    auto &p = pending[c];
+                    unsolvable[c] = !node(p.x0, p.y0) && !node(p.x0 + p.size, p.y0) && !node(p.x0, p.y0 + p.size) &&
+                                    !node(p.x0 + p.size, p.y0 + p.size);
+
+                    bool valid = true;
+                    for (long j = -1; j <= 2 && valid; j++)
+                        for (long i = -1; i <= 2 && valid; i++)
+                        {
+                            long column = p.x0 + i * p.size, line = p.y0 + j * p.size;
+                            valid = node(column, line) != nullptr;
+                            if (valid)
+                                stencil[16 * c + 4 * (j + 1) + i + 1] = nodeIndex.at(nodeKey(column, line));
+                        }
+
+                    double error = 0;
+                    for (auto &check : CHECKS)
+                    {
+                        const float *solved = valid ? node(p.x0 + check[0] * p.size / 4, p.y0 + check[1] * p.size / 4) : nullptr;
+                        valid = solved != nullptr;
+                        if (!valid)
+                            break;
+
+                        interpolateStencil(&stencil[16 * c], check[0] / 4.0, check[1] / 4.0, 0, heights.size(), interpolated.data());
+                        for (size_t hi = 0; hi < heights.size(); hi++)
+                            error = max(error, hypot(interpolated[hi].first - solved[2 * hi], interpolated[hi].second - solved[2 * hi + 1]));
+
+                        // Interpolation in height is checked in midpoints, where its error is the largest
+                        if (solvedHeights.size() == heights.size())
+                            continue;
+
+                        interpolateStencil(&stencil[16 * c], check[0] / 4.0, check[1] / 4.0, slopesSlot, heights.size(), slopes.data());
+                        for (size_t hi = 0; hi + 1 < heights.size(); hi++)
+                        {
+                            double length = heights[hi + 1] - heights[hi];
+                            const float *midpoint = &solved[2 * (heights.size() + hi)];
+                            double x = hermite(interpolated[hi].first, interpolated[hi + 1].first, slopes[hi].first, slopes[hi + 1].first, length, 0.5);
+                            double y = hermite(interpolated[hi].second, interpolated[hi + 1].second, slopes[hi].second, slopes[hi + 1].second, length, 0.5);
+                            error = max(error, hypot(x - midpoint[0], y - midpoint[1]));
+                        }
+                    }
+                    accepted[c] = valid && error <= maxError;
+                }
+            }
+
+            vector<Pending> next;
+            for (size_t c = 0; c < pending.size(); c++)
+            {
+                auto &p = pending[c];
+                if (accepted[c])
+                {
+                    cells[p.cell].state = CellState::INTERPOLATED;
+                    cells[p.cell].stencil = stencils.size();
+                    stencils.insert(stencils.end(), stencil.begin() + 16 * c, stencil.begin() + 16 * (c + 1));
+                    continue;
+                }
+
+                // Cell without any solved corner lies outside of view disc, its pixels cannot be solved anyway
+                if (p.size <= static_cast<long>(MIN_CELL_SIZE) || unsolvable[c])
+                    continue;
+
+                long half = p.size / 2;
+                cells[p.cell].state = CellState::DIVIDED;
+                cells[p.cell].children = cells.size();
+                cells.resize(cells.size() + 4);
+
+                // Children which do not contain any pixel of scope are never looked up
+                for (long j = 0; j < 2; j++)
+                    for (long i = 0; i < 2; i++)
+                        if (p.x0 + i * half <= lastColumn && p.y0 + j * half <= lastLine)
+                            next.push_back({static_cast<uint32_t>(cells[p.cell].children + 2 * j + i), p.x0 + i * half, p.y0 + j * half, half});
+            }
+
+            pending = move(next);
+        }
+    }
+
+    const SparseLattice::Cell *SparseLattice::findCell(size_t column, size_t line, long &x0, long &y0, size_t &size) const
+    {
+        if (column < firstColumn || column >= firstColumn + columns || line < firstLine || line >= firstLine + lines)
+            return nullptr;
+
+        size_t i = min((column - firstColumn) / cellSize, topColumns - 1);
+        size_t j = min((line - firstLine) / cellSize, topLines - 1);
+        const Cell *cell = &cells[j * topColumns + i];
+        x0 = firstColumn + i * cellSize;
+        y0 = firstLine + j * cellSize;
+        size = cellSize;
+
+        while (cell->state == CellState::DIVIDED)
+        {
+            size /= 2;
+            long ci = static_cast<long>(column) - x0 >= static_cast<long>(size) ? 1 : 0;
+            long cj = static_cast<long>(line) - y0 >= static_cast<long>(size) ? 1 : 0;
+            x0 += ci * size;
+            y0 += cj * size;
+            cell = &cells[cell->children + 2 * cj + ci];
+        }
+
+        return cell;
+    }
+
+    void SparseLattice::interpolateStencil(const uint32_t *stencil, double tx, double ty, size_t first, size_t count,
+                                           pair<double, double> *displacements) const
+    {
+        double wx[4], wy[4];
+        catmullRomWeights(tx, wx);
+        catmullRomWeights(ty, wy);
+
+        size_t valuesPerNode = 2 * nodeSlots;
+        for (size_t hi = 0; hi < count; hi++)
+            displacements[hi] = make_pair(0.0, 0.0);
+
+        for (int j = 0; j < 4; j++)
+            for (int i = 0; i < 4; i++)
+            {
+                double w = wx[i] * wy[j];
+                const float *node = &values[stencil[4 * j + i] * valuesPerNode + 2 * first];
+                for (size_t hi = 0; hi < count; hi++)
+                {
+                    displacements[hi].first += w * node[2 * hi];
+                    displacements[hi].second += w * node[2 * hi + 1];
+                }
+            }
+    }
+
+    bool SparseLattice::pixelDisplacements(size_t column, size_t line, size_t first, size_t count, pair<double, double> *displacements) const
+    {
+        long x0, y0;
+        size_t size;
+        const Cell *cell = findCell(column, line, x0, y0, size);
+        if (cell == nullptr)
+            return false;
+
+        if (cell->state == CellState::INTERPOLATED)
+        {
+            interpolateStencil(&stencils[cell->stencil], static_cast<double>(column - x0) / size, static_cast<double>(line - y0) / size,
+                               first, count, displacements);
+            return true;
+        }
+
+        // Pixels which are nodes of failed cells were solved anyway
+        const float *solved = node(column, line);
+        if (solved == nullptr)
+            return false;
+
+        for (size_t hi = 0; hi < count; hi++)
+            displacements[hi] = make_pair(solved[2 * (first + hi)], solved[2 * (first + hi) + 1]);
+        return true;
+    }
+
+    bool SparseLattice::interpolate(size_t column, size_t line, pair<double, double> *displacements) const
+    {
+        return pixelDisplacements(column, line, 0, heights.size(), displacements);
+    }
+
+    bool SparseLattice::interpolate(size_t column, size_t line, double objectHeight, pair<double, double> &displacement) const
+    {
+        if (!(objectHeight >= heights.front() && objectHeight <= heights.back()))
+            return false;
+
+        if (heights.size() == 1)
+            return pixelDisplacements(column, line, 0, 1, &displacement);
+        if (!betweenHeights)
+            return false;
+
+        // Interpolation in height was checked only in interpolated cells
+        long x0, y0;
+        size_t size;
+        const Cell *cell = findCell(column, line, x0, y0, size);
+        if (cell == nullptr || cell->state != CellState::INTERPOLATED)
+            return false;
+
+        size_t upper = upper_bound(heights.begin(), heights.end(), objectHeight) - heights.begin();
+        size_t lower = min(upper, heights.size() - 1) - 1;
+
+        pair<double, double> nodes[2], slopes[2];
+        double tx = static_cast<double>(column - x0) / size, ty = static_cast<double>(line - y0) / size;
+        interpolateStencil(&stencils[cell->stencil], tx, ty, lower, 2, nodes);
+        interpolateStencil(&stencils[cell->stencil], tx, ty, solvedHeights.size() + lower, 2, slopes);
+
+        double length = heights[lower + 1] - heights[lower];
+        double t = (objectHeight - heights[lower]) / length;
+        displacement = make_pair(hermite(nodes[0].first, nodes[1].first, slopes[0].first, slopes[1].first, length, t),
+                                 hermite(nodes[0].second, nodes[1].second, slopes[0].second, slopes[1].second, length, t));
+        return true;
+    }
+}
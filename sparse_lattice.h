@@ -0,0 +1,138 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ksg
+{
+    ///
+    /// Displacements of pixels for every height of grid, solved only on sparse lattice of pixels and bicubically
+    /// (Catmull-Rom) interpolated between them. Away from edge of view disc displacement changes very smoothly
+    /// across raster, so coarse lattice is enough there.
+    ///
+    /// Scope is covered with square cells whose corners are lattice nodes. Cell is interpolated from 4 x 4 nodes
+    /// around it, spaced by its size. Its center and four quarter points are solved and compared with interpolation;
+    /// if they differ by more than allowed error, or any node cannot be solved, cell is divided into four (quadtree). Cells of
+    /// minimal size which still fail, and cells outside of view disc, are left to be solved directly.
+    ///
+    /// Displacement between grid heights is interpolated with monotone cubic, whose slopes are found for every node once and
+    /// interpolated across cell like displacements. Checked pixels are solved in midpoints between grid heights too, so
+    /// interpolation in height shares allowed error with interpolation across raster.
+    ///
+    /// Displacements are any pair of components measured in metres, e.g. in geos coordinates.
+    class SparseLattice
+    {
+    public:
+        ///
+        /// Solves lattice node. Called from many threads at once.
+        /// @param column, line 0 based pixel, may lie outside of raster
+        /// @param heights heights to solve [m], grid heights possibly followed by midpoints between them
+        /// @param displacements receives displacement for every height [m]
+        /// @return false if any height of pixel cannot be solved
+        using Solver = std::function<bool(long column, long line, const std::vector<double> &heights, std::pair<double, double> *displacements)>;
+
+        /// Smallest cell which may be divided further
+        static constexpr size_t MIN_CELL_SIZE = 4;
+
+        ///
+        /// @param heights increasing heights grid [m]
+        /// @param maxError maximal allowed interpolation error [m], nodes should be solved with the rest of required accuracy
+        /// @param cellSize size of largest cells in pixels, power of 2 not lower than MIN_CELL_SIZE
+        /// @param betweenHeights whether displacement is interpolated between grid heights too, lattice without it
+        /// solves only grid heights
+        /// @throws std::logic_error if cell size is not valid
+        SparseLattice(std::vector<double> heights, double maxError, size_t cellSize = 32, bool betweenHeights = true);
+
+        ///
+        /// Solves lattice covering scope, refining it where required. Nodes are solved in parallel.
+        /// @param firstColumn, firstLine, columns, lines 0 based scope of raster
+        void build(size_t firstColumn, size_t firstLine, size_t columns, size_t lines, const Solver &solve);
+
+        bool isBuilt() const { return built; }
+
+        const std::vector<double> &getHeights() const { return heights; }
+
+        ///
+        /// @return number of solved lattice nodes
+        size_t getNodesCount() const { return solvedNodes; }
+
+        ///
+        /// @param displacements receives displacement for every height of grid [m]
+        /// @return false if pixel is out of scope or has to be solved directly
+        bool interpolate(size_t column, size_t line, std::pair<double, double> *displacements) const;
+
+        ///
+        /// Displacement for object height between grid heights is interpolated with monotone cubic in height.
+        /// @return false if pixel is out of scope or is not in interpolated cell, height is out of grid or lattice
+        /// does not interpolate between heights
+        bool interpolate(size_t column, size_t line, double objectHeight, std::pair<double, double> &displacement) const;
+
+    private:
+        enum class CellState : uint8_t {
+            /// Cell is interpolated from its stencil
+            INTERPOLATED,
+            /// Cell is divided into four cells
+            DIVIDED,
+            /// Pixels of cell have to be solved directly
+            DIRECT
+        };
+
+        struct Cell
+        {
+            CellState state = CellState::DIRECT;
+            /// Index of first of four children of divided cell, ordered row by row
+            uint32_t children = 0;
+            /// Index of first of 16 stencil nodes of interpolated cell in stencils
+            uint32_t stencil = 0;
+        };
+
+        std::vector<double> heights;
+        double maxError;
+        size_t cellSize;
+        bool betweenHeights;
+        bool built = false;
+
+        /// Grid heights followed by midpoints between them if lattice interpolates between heights
+        std::vector<double> solvedHeights;
+        /// Number of displacements stored for every node: solved heights, followed by slopes in grid heights
+        /// if lattice interpolates between heights
+        size_t nodeSlots = 0;
+
+        size_t firstColumn = 0, firstLine = 0, columns = 0, lines = 0;
+        size_t topColumns = 0, topLines = 0;
+
+        /// Top cells row by row, followed by children of divided cells
+        std::vector<Cell> cells;
+        /// Indexes of nodes of stencils of interpolated cells, row by row
+        std::vector<uint32_t> stencils;
+
+        /// Index of node in values by its pixel
+        std::unordered_map<uint64_t, uint32_t> nodeIndex;
+        /// Interleaved displacements of nodes for every slot, midpoints are solved only for checked pixels
+        std::vector<float> values;
+        std::atomic<size_t> solvedNodes{0};
+
+        static uint64_t nodeKey(long column, long line);
+        const float *node(long column, long line) const;
+
+        ///
+        /// Finds cell containing pixel.
+        /// @param x0, y0, size receive origin and size of cell
+        /// @return nullptr if pixel is out of scope
+        const Cell *findCell(size_t column, size_t line, long &x0, long &y0, size_t &size) const;
+
+        ///
+        /// Displacements of slots [first, first + count) of pixel, interpolated or taken from its node.
+        bool pixelDisplacements(size_t column, size_t line, size_t first, size_t count, std::pair<double, double> *displacements) const;
+
+        ///
+        /// Interpolates slots [first, first + count) from 16 stencil nodes, row by row.
+        /// @param tx, ty position of pixel in cell, from 0 to 1
+        void interpolateStencil(const uint32_t *stencil, double tx, double ty, size_t first, size_t count,
+                                std::pair<double, double> *displacements) const;
+    };
+}
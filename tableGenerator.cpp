@@ -1,10 +1,26 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <filesystem>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <boost/program_options.hpp>
 #include "correction.h"
 #include "georeference_utils.h"
 #include "correction_utils.h"
+#include "geodetic_utils.h"
+#include "ordered_writer.h"
+#include "correction_table.h"
+#include "view_symmetry.h"
+#include "height_interpolation.h"
+#include "sparse_lattice.h"
+#include "table_shards.h"
 
 using namespace std;
 
@@ -23,34 +39,30 @@ inline std::istream &operator>>(std::istream &in, Range<SEP> &range)
     return in;
 }
 
-template <char SEP = ','>
-struct HeightsRange
-{
-    double min, max, step;
-};
-
-template <char SEP>
-inline std::istream &operator>>(std::istream &in, HeightsRange<SEP> &range)
-{
-    std::tuple<double, double, double> packed;
-    ksg::TupleParser::parse_tuple_with_separator<SEP, double, double, double>(in, packed);
-    std::tie(range.min, range.max, range.step) = packed;
-    return in;
-}
-
-template <char SEP>
-inline std::ostream &operator<<(std::ostream &out, const HeightsRange<SEP> &range)
-{
-    out << range.min << SEP << range.max << SEP << range.step;
-    return out;
-}
-
 static const string nmDesc = string() +
         "Numeric method. Either:\n" +
         ksg::NM_NETWON_NAME + "\n" +
         ksg::NM_NETWON_DESC + "\n" +
         ksg::NM_LEVENBERG_MARQUARD_NAME + "\n" +
-        ksg::NM_LEVENBERG_MARQUARD_DESC + "\n";
+        ksg::NM_LEVENBERG_MARQUARD_DESC + "\n" +
+        ksg::NM_LINE_OF_SIGHT_NAME + "\n" +
+        ksg::NM_LINE_OF_SIGHT_DESC + "\n";
+
+static const string igDesc = string() +
+        "Initial guess for numeric method. Either:\n" +
+        ksg::IG_HEURISTIC_NAME + "\n" +
+        ksg::IG_HEURISTIC_DESC + "\n" +
+        ksg::IG_INFLATED_ELLIPSOID_NAME + "\n" +
+        ksg::IG_INFLATED_ELLIPSOID_DESC + "\n";
+
+static const string tfDesc = string() +
+        "Format of result table. Either:\n" +
+        ksg::TF_TEXT_NAME + "\n" +
+        ksg::TF_TEXT_DESC + "\n" +
+        ksg::TF_BINARY_FLOAT64_NAME + "\n" +
+        ksg::TF_BINARY_FLOAT64_DESC + "\n" +
+        ksg::TF_BINARY_FLOAT32_NAME + "\n" +
+        ksg::TF_BINARY_FLOAT32_DESC + "\n";
 
 boost::program_options::variables_map init(int argc, char **argv)
 {
@@ -62,8 +74,16 @@ boost::program_options::variables_map init(int argc, char **argv)
     ("image-dimensions", boost::program_options::value<ksg::ImageDimmensions<>>(), "Comma separated image dimmensions: width and height in pixels. See GDAL Raster Model.")
     ("columns-scope", boost::program_options::value<Range<>>(), "Comma separated, 1 based, inclusive scope for rasters columns. If specified, generation of table will be limited to those columns.")
     ("lines-scope", boost::program_options::value<Range<>>(), "Comma separated, 1 based, inclusive scope for rasters lines. If specified, generation of table will be limited to those lines.")
-    ("heights-range", boost::program_options::value<HeightsRange<>>()->default_value({0.5, 20.0, 0.5}), "Range and of cloud heights. Should contain following comma separated values min, max, step. All numbers should be expressed in km.")
+    ("heights-range", boost::program_options::value<ksg::HeightsRange<>>()->default_value({0.5, 20.0, 0.5}), "Range and of cloud heights. Should contain following comma separated values min, max, step. All numbers should be expressed in km.")
     ("output", boost::program_options::value<std::string>(), "Location of result table")
+    (
+        "table-format",
+        boost::program_options::value<ksg::TableFormat>()->default_value(ksg::TableFormat::TEXT),
+        tfDesc.c_str()
+    )
+    ("export-text", boost::program_options::value<std::string>(), "Binary table which is exported to text table at --output. No table is generated.")
+    ("gzip", "Compresses text table exported with --export-text with gzip.")
+    ("merge", boost::program_options::value<std::vector<std::string>>()->multitoken(), "Tables of shards generated with --shard, which are merged into table at --output in order of their lines. No table is generated.")
     ("requierd-accuracy", boost::program_options::value<double>()->default_value(10), "Required accuracy [m].")
     (
         "numeric-method", 
@@ -71,7 +91,20 @@ boost::program_options::variables_map init(int argc, char **argv)
         nmDesc.c_str()
     )
     ("use-squared-target", "Use squared targed function.")
-    ("iterations-limit", boost::program_options::value<int>()->default_value(100), "Maximum number of iteration per pixel.");
+    (
+        "initial-guess",
+        boost::program_options::value<ksg::InitialGuess>()->default_value(ksg::InitialGuess::INFLATED_ELLIPSOID),
+        igDesc.c_str()
+    )
+    ("iterations-limit", boost::program_options::value<int>()->default_value(100), "Maximum number of iteration per pixel.")
+    ("adaptive-heights", "Solve only some heights of pixel and interpolate others with monotone cubic spline. Heights are added where interpolation error exceeds half of required accuracy, other half is left for solutions.")
+    ("sparse-lattice", "Solve only sparse lattice of pixels and bicubically interpolate others. Lattice is refined in quadtree where interpolation error exceeds half of required accuracy, other half is left for solutions.")
+    ("lattice-cell-size", boost::program_options::value<size_t>()->default_value(32), "Size of the largest cells of --sparse-lattice in pixels, power of 2.")
+    ("use-symmetry", "Solve only quadrant of view disc and mirror it about equator and central meridian. Pixels mirrored between pixel centers are interpolated within required accuracy.")
+    ("shard", boost::program_options::value<ksg::TableShard>(), "Generate only i-th of N shards of lines scope, written as i/N. Shards are balanced by number of pixels on view disc. Implies --checkpoint.")
+    ("checkpoint", "Record finished lines in manifest (--output followed by .manifest). Interrupted generation is resumed by running the same command again.")
+    ("checkpoint-lines", boost::program_options::value<size_t>()->default_value(64), "Number of lines between checkpoints.")
+    ("threads", boost::program_options::value<int>()->default_value(0), "Number of worker threads. 0 means all available cores.");
 
     auto ret = boost::program_options::variables_map();
 
@@ -101,6 +134,29 @@ int main(int argc, char **argv)
 {
     auto variablesMap = init(argc, argv);
 
+#ifdef _OPENMP
+    if (variablesMap["threads"].as<int>() > 0)
+        omp_set_num_threads(variablesMap["threads"].as<int>());
+#endif
+
+    if (variablesMap.count("export-text") > 0)
+    {
+        check_required_option(variablesMap, "output");
+        ksg::CorrectionTable table(variablesMap["export-text"].as<std::string>());
+        ksg::exportTableText(table, variablesMap["output"].as<std::string>(), variablesMap.count("gzip") > 0);
+        return 0;
+    }
+
+    if (variablesMap.count("gzip") > 0)
+        throw logic_error("--gzip applies only to --export-text");
+
+    if (variablesMap.count("merge") > 0)
+    {
+        check_required_option(variablesMap, "output");
+        ksg::mergeTableShards(variablesMap["merge"].as<std::vector<std::string>>(), variablesMap["output"].as<std::string>());
+        return 0;
+    }
+
     check_required_option(variablesMap, "projection-description");
     auto srs = variablesMap["projection-description"].as<ksg::ProjSRS>();
 
@@ -142,7 +198,7 @@ int main(int argc, char **argv)
         endY = dims.y - 1;
     }
 
-    auto heightRange = variablesMap["heights-range"].as<HeightsRange<>>();
+    auto heightRange = variablesMap["heights-range"].as<ksg::HeightsRange<>>();
 
     auto requiredAccuracy = variablesMap["requierd-accuracy"].as<double>();
 
@@ -152,12 +208,18 @@ int main(int argc, char **argv)
 
     auto useQuadraticForm = variablesMap.count("use-squared-target") > 0;
 
-    check_required_option(variablesMap, "output");
-    auto outputName = variablesMap["output"].as<std::string>();
+    auto initialGuess = variablesMap["initial-guess"].as<ksg::InitialGuess>();
+
+    auto tableFormat = variablesMap["table-format"].as<ksg::TableFormat>();
 
-    std::ofstream output(outputName);
+    auto useSymmetry = variablesMap.count("use-symmetry") > 0;
 
-    output.exceptions(std::ios::failbit | std::ios::badbit);
+    auto adaptiveHeights = variablesMap.count("adaptive-heights") > 0;
+
+    auto sparseLattice = variablesMap.count("sparse-lattice") > 0;
+
+    check_required_option(variablesMap, "output");
+    auto outputName = variablesMap["output"].as<std::string>();
 
     GEOSHeightCorrector corrector(srs.srs);
 
@@ -167,42 +229,324 @@ int main(int argc, char **argv)
         heights.push_back(h * 1000);    
     }
 
-    for (size_t y = startY; y <= endY; y++)
+    // Observed ellipsoid coordinates of pixel center, NaN outside of view disc
+    auto observe = [&](const std::pair<double, double> &geosCoords) {
+        if (corrector.isTransformationThreadSafe())
+            return corrector.transformToEllipsCoordinates(geosCoords);
+
+        std::pair<double, double> ellipsCoords;
+
+        // PROJ transformation of corrector is not thread safe
+        #pragma omp critical(transformation)
+        ellipsCoords = corrector.transformToEllipsCoordinates(geosCoords);
+
+        return ellipsCoords;
+    };
+
+    size_t width = endX - startX + 1;
+
+    if (variablesMap.count("shard") > 0)
     {
-        for (size_t x = startX; x <= endX; x++)
+        // Cost of line is estimated from sample of its pixels, since pixels outside of view disc are not solved
+        auto shard = variablesMap["shard"].as<ksg::TableShard>();
+        size_t step = std::max<size_t>(1, width / 256);
+        std::vector<double> lineCosts(endY - startY + 1);
+
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t line = 0; line < lineCosts.size(); line++)
+            for (size_t x = startX; x <= endX; x += step)
+            {
+                auto ellipsCoords = observe(geo.calcGeoCoordsFromPix(x + 0.5, startY + line + 0.5));
+                if (!isnan(ellipsCoords.first) && !isnan(ellipsCoords.second))
+                    lineCosts[line]++;
+            }
+
+        auto lines = ksg::balanceShard(lineCosts, shard);
+        endY = startY + lines.second - 1;
+        startY += lines.first;
+        std::cerr << "Shard " << shard.index << "/" << shard.count << " contains lines " << startY + 1 << " - " << endY + 1 << ".\n";
+    }
+
+    // Finished lines are recorded in manifest, generation is resumed after the last of them
+    std::unique_ptr<ksg::TableManifest> manifest;
+    size_t resumeY = startY;
+
+    if (variablesMap.count("checkpoint") > 0 || variablesMap.count("shard") > 0)
+    {
+        char *wkt = nullptr;
+        srs.srs.exportToWkt(&wkt);
+        std::ostringstream description;
+        description.precision(17);
+        description << wkt << " geotransform";
+        CPLFree(wkt);
+        for (auto value : geo.geotransform)
+            description << " " << value;
+        description << " image " << dims.x << " " << dims.y << " columns " << startX + 1 << " " << endX + 1 << " heights";
+        for (auto h : heights)
+            description << " " << h;
+        description << " accuracy " << requiredAccuracy << " method " << numericMethod << " squared " << useQuadraticForm
+                    << " guess " << initialGuess << " iterations " << iterationLimit << " format " << tableFormat
+                    << " adaptive " << adaptiveHeights << " symmetry " << useSymmetry << " lattice " << sparseLattice;
+        if (sparseLattice)
+            description << " " << variablesMap["lattice-cell-size"].as<size_t>();
+
+        manifest = std::make_unique<ksg::TableManifest>(outputName + ".manifest", description.str(), startY, endY - startY + 1);
+        resumeY = manifest->getNextLine();
+
+        if (manifest->isComplete())
         {
+            std::cerr << "Table " << outputName << " is already complete.\n";
+            return 0;
+        }
+
+        if (manifest->isResumed())
+        {
+            if (!std::filesystem::exists(outputName))
+                throw runtime_error("Table " + outputName + " of resumed generation is missing, remove its manifest to generate it again");
+            std::cerr << "Generation is resumed from line " << resumeY + 1 << ".\n";
+        }
+    }
+
+    // Lines are divided into segments, so narrow scopes are spread between threads too.
+    // Segments are numbered in order of table, which is restored by writer.
+    const size_t segmentWidth = 64;
+    size_t segmentsPerLine = (width + segmentWidth - 1) / segmentWidth;
+
+    std::ofstream output;
+    std::unique_ptr<ksg::OrderedWriter> writer;
+    std::unique_ptr<ksg::CorrectionTableWriter> binaryTable;
+
+    if (tableFormat == ksg::TableFormat::TEXT)
+    {
+        output.exceptions(std::ios::failbit | std::ios::badbit);
+        if (manifest && manifest->isResumed())
+        {
+            // Text written after the last checkpoint is dropped
+            std::filesystem::resize_file(outputName, manifest->getOutputSize());
+            output.open(outputName, std::ios::app);
+        }
+        else
+        {
+            output.open(outputName);
+        }
+        writer = std::make_unique<ksg::OrderedWriter>(output, (resumeY - startY) * segmentsPerLine);
+    }
+    else
+    {
+        ksg::CorrectionTableInfo info;
+        char *wkt = nullptr;
+        srs.srs.exportToWkt(&wkt);
+        info.srs = wkt;
+        CPLFree(wkt);
+        std::copy(std::begin(geo.geotransform), std::end(geo.geotransform), info.geotransform);
+        info.imageWidth = dims.x;
+        info.imageHeight = dims.y;
+        info.firstColumn = startX;
+        info.firstLine = startY;
+        info.columns = width;
+        info.lines = endY - startY + 1;
+        info.heights = heights;
+        info.requiredAccuracy = requiredAccuracy;
+        std::ostringstream method;
+        method << numericMethod;
+        info.numericMethod = method.str();
+        info.valueSize = tableFormat == ksg::TableFormat::BINARY_FLOAT32 ? sizeof(float) : sizeof(double);
+        binaryTable = std::make_unique<ksg::CorrectionTableWriter>(outputName, info, manifest && manifest->isResumed());
+    }
+
+    std::atomic<size_t> solutions(0), requested(0), solvedPixels(0);
+
+    auto solve = [&](const std::pair<double, double> &geosCoords, const std::pair<double, double> &ellipsCoords, double accuracy,
+                     std::vector<std::pair<double,double>> &results) {
+        solvedPixels++;
+        requested += heights.size();
+
+        if (adaptiveHeights) {
+            solutions += ksg::interpolateHeights(heights, ellipsCoords, accuracy / 2, [&](double height) {
+                return corrector.calculateNewCoordinates(geosCoords, ellipsCoords, height, accuracy / 2, iterationLimit, numericMethod, useQuadraticForm, initialGuess);
+            }, results.data());
+            return;
+        }
+
+        for(size_t hi = 0; hi < heights.size(); hi++) {
+            results[hi] = corrector.calculateNewCoordinates(geosCoords, ellipsCoords, heights[hi], accuracy, iterationLimit, numericMethod, useQuadraticForm, initialGuess);
+        }
+        solutions += heights.size();
+    };
+
+    std::unique_ptr<ksg::QuadrantTable> quadrant;
+    double interpolationError = 0;
+    double quadrantAccuracy = requiredAccuracy;
+
+    if (useSymmetry)
+    {
+        ksg::ViewSymmetry symmetry(geo.geotransform, srs.srs.GetProjParm("false_easting", 0), srs.srs.GetProjParm("false_northing", 0));
+        quadrant = std::make_unique<ksg::QuadrantTable>(symmetry, dims.x, dims.y, startX, resumeY, width, endY - resumeY + 1, heights.size());
+
+        // Interpolated pixels share required accuracy between solution and interpolation
+        if (!symmetry.isColumnMirrorExact() || !symmetry.isLineMirrorExact())
+        {
+            quadrantAccuracy = requiredAccuracy / 2;
+            interpolationError = requiredAccuracy / 2;
+        }
+    }
+
+    // Lattice covers pixels which are solved: quadrant if symmetry is used, whole scope otherwise.
+    // Its displacements are local east and north offsets [m], which change across raster as smoothly as geos ones.
+    std::unique_ptr<ksg::SparseLattice> lattice;
+
+    auto interpolate = [&](size_t x, size_t y, const std::pair<double, double> &ellipsCoords, std::vector<std::pair<double,double>> &results) {
+        if (!lattice || !lattice->interpolate(x, y, results.data()))
+            return false;
+
+        // Longitudes are wrapped like those of directly solved pixels
+        for (auto &offset : results)
+            offset = ksg::offsetPoint(ellipsCoords, offset);
+        return true;
+    };
+
+    if (sparseLattice)
+    {
+        double latticeAccuracy = quadrant ? quadrantAccuracy : requiredAccuracy;
+        // Table is written for grid heights only
+        lattice = std::make_unique<ksg::SparseLattice>(heights, latticeAccuracy / 2, variablesMap["lattice-cell-size"].as<size_t>(), false);
+
+        auto solveNode = [&](long x, long y, const std::vector<double> &, std::pair<double, double> *offsets) {
             auto geosCoords = geo.calcGeoCoordsFromPix(x + 0.5, y + 0.5);
-            auto ellipsCoords = corrector.transformToEllipsCoordinates(geosCoords);
+            auto ellipsCoords = observe(geosCoords);
+            if (isnan(ellipsCoords.first) || isnan(ellipsCoords.second))
+                return false;
+
+            std::vector<std::pair<double,double>> results(heights.size());
+            solve(geosCoords, ellipsCoords, latticeAccuracy / 2, results);
+
+            for (size_t hi = 0; hi < heights.size(); hi++)
+                offsets[hi] = ksg::localOffset(ellipsCoords, results[hi]);
+            return true;
+        };
+
+        if (quadrant)
+            lattice->build(quadrant->getFirstColumn(), quadrant->getFirstLine(), quadrant->getColumns(), quadrant->getLines(), solveNode);
+        else
+            lattice->build(startX, resumeY, width, endY - resumeY + 1, solveNode);
+    }
 
-            if(isnan(ellipsCoords.first) || isnan(ellipsCoords.second)) {
-                std::cerr << "Pixel " << x + 1 <<", " << y + 1 << " is out of scope - skipping.\n";
-                continue;
-            }
-            
-            std::vector<std::pair<double,double>> results;
-            results.resize(heights.size());
-
-            #pragma omp parallel for shared(results) 
-            for(size_t hi = 0; hi < heights.size(); hi++) {
-                auto h = heights[hi];
-                results[hi] = corrector.calculateNewCoordinates(geosCoords, ellipsCoords, h, requiredAccuracy, iterationLimit, numericMethod, useQuadraticForm);
+    if (quadrant)
+    {
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t line = 0; line < quadrant->getLines(); line++)
+        {
+            size_t y = quadrant->getFirstLine() + line;
+            std::vector<std::pair<double,double>> results(heights.size());
+
+            for (size_t x = quadrant->getFirstColumn(); x < quadrant->getFirstColumn() + quadrant->getColumns(); x++)
+            {
+                auto geosCoords = geo.calcGeoCoordsFromPix(x + 0.5, y + 0.5);
+                auto ellipsCoords = observe(geosCoords);
+                if(isnan(ellipsCoords.first) || isnan(ellipsCoords.second))
+                    continue;
+
+                if (!interpolate(x, y, ellipsCoords, results))
+                    solve(geosCoords, ellipsCoords, quadrantAccuracy, results);
+                quadrant->setPixel(x, y, ellipsCoords, results.data());
             }
+        }
+    }
 
-            if(std::all_of(results.begin(), results.end(), [](auto pair)  { return isnan(pair.first) && isnan(pair.second); } )) {
-                std::cerr << "Failed to generate table for pixel " << x + 1 <<", " << y + 1 << ".\n";
-                continue;
-            }
+    std::atomic<size_t> outOfScope(0), failed(0), mirrored(0);
+    std::exception_ptr error;
 
-            output << y + 1 << " " << x + 1;
+    // Lines are generated in chunks between checkpoints, all of them at once without manifest
+    size_t checkpointLines = manifest ? std::max<size_t>(1, variablesMap["checkpoint-lines"].as<size_t>()) : endY - startY + 1;
 
-            for(size_t hi = 0; hi < results.size(); hi++) {
-                auto res = results[hi];
-                output << " " << res.second << " " << res.first;
+    for (size_t chunkY = resumeY; chunkY <= endY; chunkY += checkpointLines)
+    {
+        size_t chunkEndY = std::min(chunkY + checkpointLines - 1, endY);
+        size_t firstSegment = (chunkY - startY) * segmentsPerLine;
+        size_t lastSegment = (chunkEndY - startY + 1) * segmentsPerLine;
+
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t segment = firstSegment; segment < lastSegment; segment++)
+        {
+            size_t y = startY + segment / segmentsPerLine;
+            size_t firstX = startX + (segment % segmentsPerLine) * segmentWidth;
+            size_t lastX = std::min(firstX + segmentWidth - 1, endX);
+
+            std::string lines;
+            std::vector<std::pair<double,double>> results(heights.size());
+            std::vector<char> line(writer ? (2 + 2 * heights.size()) * ksg::TABLE_VALUE_MAX_CHARS : 0);
+
+            for (size_t x = firstX; x <= lastX; x++)
+            {
+                auto geosCoords = geo.calcGeoCoordsFromPix(x + 0.5, y + 0.5);
+                auto ellipsCoords = observe(geosCoords);
+
+                if(isnan(ellipsCoords.first) || isnan(ellipsCoords.second)) {
+                    outOfScope++;
+                    continue;
+                }
+
+                if(quadrant && quadrant->getPixel(x, y, ellipsCoords, interpolationError, results.data())) {
+                    mirrored++;
+                } else if(!interpolate(x, y, ellipsCoords, results)) {
+                    solve(geosCoords, ellipsCoords, requiredAccuracy, results);
+                }
+
+                if(std::all_of(results.begin(), results.end(), [](auto pair)  { return isnan(pair.first) && isnan(pair.second); } )) {
+                    failed++;
+                    continue;
+                }
+
+                // Pixels of binary table are written directly into its mapping
+                if (binaryTable) {
+                    binaryTable->setPixel(x, y, results.data());
+                    continue;
+                }
+
+                lines.append(line.data(), ksg::formatTableLine(line.data(), y + 1, x + 1, results.data(), results.size()));
+            }
+
+            // Exception cannot leave parallel region, it is rethrown after it
+            try
+            {
+                if (writer)
+                    writer->submit(segment, std::move(lines));
+            }
+            catch (...)
+            {
+                #pragma omp critical(error)
+                if (!error)
+                    error = std::current_exception();
             }
+        }
+
+        if (error)
+            std::rethrow_exception(error);
 
-            output << "\n";
+        if (manifest)
+        {
+            if (binaryTable)
+                binaryTable->flush();
+            else
+                output.flush();
+            manifest->checkpoint(chunkEndY, writer ? static_cast<uint64_t>(output.tellp()) : 0);
         }
     }
 
+    if (outOfScope > 0)
+        std::cerr << outOfScope << " pixels are out of scope - skipped.\n";
+    if (failed > 0)
+        std::cerr << "Failed to generate table for " << failed << " pixels.\n";
+    if (adaptiveHeights)
+        std::cerr << solutions << " of " << requested << " heights were solved, others were interpolated.\n";
+    if (lattice)
+    {
+        size_t onDisc = width * (endY - resumeY + 1) - outOfScope;
+        std::cerr << solvedPixels << " pixels were solved for " << onDisc << " pixels of scope (" << 100.0 * solvedPixels / std::max<size_t>(onDisc, 1)
+                  << " %), sparse lattice has " << lattice->getNodesCount() << " nodes.\n";
+    }
+    if (quadrant)
+        std::cerr << mirrored << " pixels were taken from symmetric quadrant of " << quadrant->getColumns() * quadrant->getLines() << " pixels.\n";
+
     return 0;
 }
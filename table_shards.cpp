@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+#include "table_shards.h"
+#include "correction_table.h"
+#include "program_options_ext.h"
+
+using namespace std;
+
+namespace ksg
+{
+    constexpr char MANIFEST_MAGIC[] = "KSG table manifest 1";
+
+    istream &operator>>(istream &in, TableShard &shard)
+    {
+        tuple<size_t, size_t> packed;
+        TupleParser::parse_tuple_with_separator<'/', size_t, size_t>(in, packed);
+        tie(shard.index, shard.count) = packed;
+
+        if (shard.index < 1 || shard.index > shard.count)
+            throw logic_error("Shard has to be written as index/count, with index from 1 to count");
+        return in;
+    }
+
+    pair<size_t, size_t> balanceShard(const vector<double> &lineCosts, const TableShard &shard)
+    {
+        size_t lines = lineCosts.size();
+        if (shard.count > lines)
+            throw logic_error("There are more shards than lines of scope");
+
+        double total = 0;
+        for (auto cost : lineCosts)
+            total += cost;
+
+        // Boundary k is the first line whose middle of cost lies in shard k, lines are equal if nothing costs
+        vector<size_t> boundaries(shard.count + 1, lines);
+        boundaries[0] = 0;
+        double cumulative = 0;
+        size_t k = 1;
+        for (size_t line = 0; line < lines && k < shard.count; line++)
+        {
+            double middle = total > 0 ? (cumulative + lineCosts[line] / 2) / total : (line + 0.5) / lines;
+            while (k < shard.count && middle * shard.count >= k)
+                boundaries[k++] = line;
+            cumulative += lineCosts[line];
+        }
+
+        // Every shard keeps at least one line
+        for (k = 1; k < shard.count; k++)
+            boundaries[k] = max(boundaries[k], boundaries[k - 1] + 1);
+        for (k = shard.count - 1; k > 0; k--)
+            boundaries[k] = min(boundaries[k], boundaries[k + 1] - 1);
+
+        return {boundaries[shard.index - 1], boundaries[shard.index]};
+    }
+
+    TableManifest::TableManifest(const string &path, const string &description, size_t firstLine, size_t lines)
+        : path(path), description(description), firstLine(firstLine), lines(lines), nextLine(firstLine)
+    {
+        if (description.find('\n') != string::npos)
+            throw logic_error("Description of table has to be single line");
+
+        if (read() && (this->description != description || this->firstLine != firstLine || this->lines != lines))
+            throw runtime_error("Manifest " + path + " describes different table, remove it to generate table again");
+
+        this->description = description;
+        this->firstLine = firstLine;
+        this->lines = lines;
+
+        // Manifest is written again, without incomplete checkpoint, and replaces the old one at once
+        string temporary = path + ".tmp";
+        {
+            ofstream file(temporary, ios::trunc);
+            file << MANIFEST_MAGIC << "\n" << description << "\n" << "lines " << firstLine + 1 << " " << firstLine + lines << "\n";
+            if (isResumed())
+                file << "done " << nextLine << " " << outputSize << "\n";
+            file.flush();
+            if (!file)
+                throw runtime_error("Cannot write manifest " + temporary);
+        }
+
+        if (rename(temporary.c_str(), path.c_str()) != 0)
+            throw runtime_error("Cannot replace manifest " + path);
+    }
+
+    TableManifest::TableManifest(const string &path)
+        : path(path)
+    {
+        if (!read())
+            throw runtime_error("Cannot read manifest " + path);
+    }
+
+    bool TableManifest::read()
+    {
+        ifstream file(path);
+        if (!file)
+            return false;
+
+        string magic, scope;
+        if (!getline(file, magic) || magic != MANIFEST_MAGIC || !getline(file, description) || !getline(file, scope))
+            throw runtime_error("Not a table manifest " + path);
+
+        istringstream scopeStream(scope);
+        string keyword;
+        size_t first, last;
+        if (!(scopeStream >> keyword >> first >> last) || keyword != "lines" || first < 1 || last < first)
+            throw runtime_error("Not a table manifest " + path);
+
+        firstLine = first - 1;
+        lines = last - first + 1;
+        nextLine = firstLine;
+        outputSize = 0;
+
+        // Checkpoint is valid only when its line is complete
+        string checkpoint;
+        while (getline(file, checkpoint) && !file.eof())
+        {
+            istringstream checkpointStream(checkpoint);
+            size_t lastLine;
+            uint64_t size;
+            if (!(checkpointStream >> keyword >> lastLine >> size) || keyword != "done" || lastLine > firstLine + lines)
+                break;
+
+            nextLine = max(nextLine, lastLine);
+            outputSize = size;
+        }
+
+        return true;
+    }
+
+    void TableManifest::checkpoint(size_t lastLine, uint64_t outputSize)
+    {
+        ofstream file(path, ios::app);
+        file << "done " << lastLine + 1 << " " << outputSize << "\n";
+        file.flush();
+        if (!file)
+            throw runtime_error("Cannot write manifest " + path);
+
+        nextLine = lastLine + 1;
+        this->outputSize = outputSize;
+    }
+
+    static void mergeBinaryShards(const vector<string> &shards, const string &output)
+    {
+        vector<unique_ptr<CorrectionTable>> tables;
+        for (auto &shard : shards)
+            tables.push_back(make_unique<CorrectionTable>(shard));
+
+        sort(tables.begin(), tables.end(), [](auto &a, auto &b) { return a->getInfo().firstLine < b->getInfo().firstLine; });
+
+        auto info = tables.front()->getInfo();
+        for (size_t i = 1; i < tables.size(); i++)
+        {
+            auto &shard = tables[i]->getInfo();
+            if (shard.srs != info.srs || !equal(begin(shard.geotransform), end(shard.geotransform), begin(info.geotransform)) ||
+                shard.imageWidth != info.imageWidth || shard.imageHeight != info.imageHeight ||
+                shard.firstColumn != info.firstColumn || shard.columns != info.columns || shard.heights != info.heights ||
+                shard.requiredAccuracy != info.requiredAccuracy || shard.numericMethod != info.numericMethod ||
+                shard.valueSize != info.valueSize)
+                throw runtime_error("Shards differ in geometry, columns scope or generation settings");
+
+            if (shard.firstLine != info.firstLine + info.lines)
+                throw runtime_error("Lines of shards do not follow each other, line " + to_string(info.firstLine + info.lines + 1) +
+                                    " is " + (shard.firstLine < info.firstLine + info.lines ? "repeated" : "missing"));
+            info.lines += shard.lines;
+        }
+
+        CorrectionTableWriter writer(output, info);
+        vector<pair<size_t, const CorrectionTable *>> lines;
+        for (auto &table : tables)
+            for (size_t line = table->getInfo().firstLine; line < table->getInfo().firstLine + table->getInfo().lines; line++)
+                lines.emplace_back(line, table.get());
+
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            auto [line, table] = lines[i];
+            vector<pair<double, double>> coordinates(info.heights.size());
+            for (size_t column = info.firstColumn; column < info.firstColumn + info.columns; column++)
+                if (table->isValid(column, line))
+                {
+                    table->getCoordinates(column, line, coordinates.data());
+                    writer.setPixel(column, line, coordinates.data());
+                }
+        }
+
+        writer.flush();
+    }
+
+    ///
+    /// @return 1 based table lines of the first and the last pixel of text table, zeros if table is empty
+    static pair<size_t, size_t> textTableLines(const string &path)
+    {
+        ifstream file(path, ios::binary);
+        if (!file)
+            throw runtime_error("Cannot open table " + path);
+
+        size_t first = 0, last = 0;
+        file >> first;
+        if (!file)
+            return {0, 0};
+
+        // The last pixel starts after the last but one new line character
+        file.seekg(0, ios::end);
+        streamoff end = file.tellg(), position = end - 1;
+        char character = 0;
+        while (position > 0)
+        {
+            file.seekg(position - 1);
+            file.get(character);
+            if (character == '\n')
+                break;
+            position--;
+        }
+
+        file.clear();
+        file.seekg(position);
+        file >> last;
+        if (!file)
+            throw runtime_error("Not a text correction table " + path);
+        return {first, last};
+    }
+
+    static void mergeTextShards(const vector<string> &shards, const string &output)
+    {
+        // 0 based range [first, end) of lines of shard, scoped if it is known from manifest
+        struct TextShard
+        {
+            size_t first, end;
+            bool scoped;
+            string path;
+        };
+
+        vector<TextShard> tables;
+        for (auto &shard : shards)
+        {
+            auto lines = textTableLines(shard);
+            string manifestPath = shard + ".manifest";
+            if (filesystem::exists(manifestPath))
+            {
+                TableManifest manifest(manifestPath);
+                TextShard table = {manifest.getFirstLine(), manifest.getFirstLine() + manifest.getLines(), true, shard};
+                if (lines.first > 0 && (lines.first - 1 < table.first || lines.second > table.end))
+                    throw runtime_error("Shard " + shard + " has lines out of scope of its manifest");
+                tables.push_back(table);
+            }
+            else if (lines.first > 0)
+            {
+                tables.push_back({lines.first - 1, lines.second, false, shard});
+            }
+        }
+
+        sort(tables.begin(), tables.end(), [](auto &a, auto &b) { return a.first < b.first || (a.first == b.first && a.end < b.end); });
+        for (size_t i = 1; i < tables.size(); i++)
+        {
+            auto &previous = tables[i - 1], &next = tables[i];
+            if (next.first < previous.end)
+                throw runtime_error("Lines of shards " + previous.path + " and " + next.path + " overlap");
+            if (previous.scoped && next.scoped && next.first > previous.end)
+                throw runtime_error("Lines of shards do not follow each other, line " + to_string(previous.end + 1) + " is missing");
+        }
+
+        ofstream out(output, ios::binary | ios::trunc);
+        for (auto &table : tables)
+        {
+            // Inserting empty stream would mark output as failed
+            if (filesystem::file_size(table.path) == 0)
+                continue;
+
+            ifstream in(table.path, ios::binary);
+            out << in.rdbuf();
+        }
+
+        out.flush();
+        if (!out)
+            throw runtime_error("Cannot write table " + output);
+    }
+
+    void mergeTableShards(const vector<string> &shards, const string &output)
+    {
+        if (shards.empty())
+            throw runtime_error("There are no shards to merge");
+
+        // Output is truncated before shards are read, while binary shards are still mapped
+        for (auto &shard : shards)
+            if (filesystem::exists(output) && filesystem::exists(shard) && filesystem::equivalent(shard, output))
+                throw runtime_error("Output " + output + " is one of merged shards");
+
+        for (auto &shard : shards)
+        {
+            string manifest = shard + ".manifest";
+            if (filesystem::exists(manifest) && !TableManifest(manifest).isComplete())
+                throw runtime_error("Generation of shard " + shard + " is not finished");
+        }
+
+        bool binary = isBinaryTable(shards.front());
+        for (auto &shard : shards)
+            if (isBinaryTable(shard) != binary)
+                throw runtime_error("Shard " + shard + " is " + (binary ? "text" : "binary") + " table, unlike " + shards.front());
+
+        if (binary)
+            mergeBinaryShards(shards, output);
+        else
+            mergeTextShards(shards, output);
+    }
+}
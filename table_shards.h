@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ksg
+{
+    ///
+    /// Part of table generated by one of several processes, e.g. "3/8" is the third of eight shards.
+    struct TableShard
+    {
+        /// 1 based index of shard
+        size_t index = 1;
+        size_t count = 1;
+    };
+
+    ///
+    /// Reads shard written as "index/count".
+    /// @throws std::logic_error if index is not between 1 and count
+    std::istream &operator>>(std::istream &in, TableShard &shard);
+
+    ///
+    /// Splits lines into contiguous ranges of about the same cost, e.g. number of pixels on view disc.
+    /// Line belongs to shard which contains middle of its cost, so every line is in exactly one shard.
+    /// @param lineCosts estimated cost of every line
+    /// @return 0 based, non-empty range [first, last) of lines of shard
+    /// @throws std::logic_error if there are more shards than lines
+    std::pair<size_t, size_t> balanceShard(const std::vector<double> &lineCosts, const TableShard &shard);
+
+    ///
+    /// Manifest of table generation, which records lines already written to table, so generation interrupted
+    /// by crash or preemption is resumed where it stopped.
+    ///
+    /// Manifest is text file with description of table (generation settings, which have to be the same when
+    /// generation is resumed) and scope of lines, followed by a line for every checkpoint with its last finished
+    /// line and size of text table written so far. Checkpoints are appended and flushed, so the manifest stays
+    /// valid whenever generation stops; incomplete last line is ignored.
+    class TableManifest
+    {
+    public:
+        ///
+        /// Opens manifest of generation, resuming it if manifest exists.
+        /// @param description settings of generation, single line of text
+        /// @param firstLine, lines 0 based scope of lines of table
+        /// @throws std::runtime_error if existing manifest describes different table or it cannot be written
+        TableManifest(const std::string &path, const std::string &description, size_t firstLine, size_t lines);
+
+        ///
+        /// Reads existing manifest.
+        /// @throws std::runtime_error if file is not a manifest
+        explicit TableManifest(const std::string &path);
+
+        ///
+        /// @return 0 based first line which is not finished yet
+        size_t getNextLine() const { return nextLine; }
+
+        ///
+        /// @return size of text table with finished lines [B]
+        uint64_t getOutputSize() const { return outputSize; }
+
+        ///
+        /// @return 0 based first line and number of lines of scope of table
+        size_t getFirstLine() const { return firstLine; }
+        size_t getLines() const { return lines; }
+
+        bool isComplete() const { return nextLine == firstLine + lines; }
+
+        bool isResumed() const { return nextLine > firstLine; }
+
+        ///
+        /// Records that lines up to lastLine are written. Table has to be flushed before.
+        /// @param lastLine 0 based, inclusive
+        /// @param outputSize size of text table [B]
+        /// @throws std::runtime_error if manifest cannot be written
+        void checkpoint(size_t lastLine, uint64_t outputSize);
+
+    private:
+        std::string path;
+        std::string description;
+        size_t firstLine = 0, lines = 0;
+        size_t nextLine = 0;
+        uint64_t outputSize = 0;
+
+        /// @return false if file does not exist
+        bool read();
+    };
+
+    ///
+    /// Assembles tables of shards into one table. Shards are ordered by their lines, which must not overlap,
+    /// and all of them have to be either binary or text tables.
+    /// Binary tables have to share geometry, columns scope and generation settings, and their lines have to follow
+    /// each other; merged table has the same format. Text tables are concatenated.
+    /// If shard has manifest (path followed by ".manifest"), it has to be complete. Scopes of lines of text
+    /// tables are known only from their manifests, so text shards with manifests have to follow each other too;
+    /// text table without manifest covers only lines of its pixels.
+    /// @throws std::runtime_error if shards cannot be merged, read or written, or output is one of them
+    void mergeTableShards(const std::vector<std::string> &shards, const std::string &output);
+}
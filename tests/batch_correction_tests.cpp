@@ -0,0 +1,126 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <gdal_priv.h>
+#include "batch_correction.h"
+#include "fixtures.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+BOOST_AUTO_TEST_SUITE(batch_correction_suite)
+
+BOOST_AUTO_TEST_CASE(manifest_test)
+{
+  istringstream manifest("# slots of a day\n"
+                         "h_1200.tif  out/c_1200.tif\n"
+                         "\n"
+                         "\th_1215.tif\tout/c_1215.tif\n");
+
+  auto items = readManifest(manifest);
+  BOOST_TEST_REQUIRE(items.size() == 2u);
+  BOOST_TEST(items[0].input == "h_1200.tif");
+  BOOST_TEST(items[0].output == "out/c_1200.tif");
+  BOOST_TEST(items[1].input == "h_1215.tif");
+  BOOST_TEST(items[1].output == "out/c_1215.tif");
+
+  istringstream missingOutput("h_1200.tif out/c_1200.tif\nh_1215.tif\n");
+  BOOST_CHECK_THROW(readManifest(missingOutput), logic_error);
+
+  istringstream extraWord("h_1200.tif out/c_1200.tif out/d_1200.tif\n");
+  BOOST_CHECK_THROW(readManifest(extraWord), logic_error);
+}
+
+BOOST_DATA_TEST_CASE(run_batch_test, data::make({1, 3}), workers)
+{
+  vector<BatchItem> items;
+  for (int i = 0; i < 8; i++)
+    items.push_back({"h_" + to_string(i) + ".tif", "c_" + to_string(i) + ".tif"});
+
+  atomic<int> running(0), maxRunning(0);
+  int reported = 0;
+
+  auto results = runBatch(items, workers,
+    [&](const BatchItem &item) {
+      int now = ++running;
+      for (int seen = maxRunning; now > seen && !maxRunning.compare_exchange_weak(seen, now);)
+        ;
+      this_thread::sleep_for(chrono::milliseconds(10));
+      running--;
+
+      if (item.input == "h_2.tif")
+        throw runtime_error("Cannot open " + item.input);
+    },
+    [&](const BatchResult &) { reported++; });
+
+  // Failing item does not stop others
+  BOOST_TEST(reported == 8);
+  BOOST_TEST_REQUIRE(results.size() == items.size());
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    BOOST_TEST(results[i].item.input == items[i].input);
+    BOOST_TEST(results[i].succeeded == (i != 2));
+    BOOST_TEST(results[i].seconds > 0);
+  }
+  BOOST_TEST(results[2].error == "Cannot open h_2.tif");
+
+  BOOST_TEST(maxRunning <= workers);
+}
+
+BOOST_FIXTURE_TEST_CASE(corrector_pool_test, PixelFixture)
+{
+  GDALAllRegister();
+  auto memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+
+  char *wkt = nullptr;
+  srs.exportToWkt(&wkt);
+
+  auto createRaster = [&](double shift, int size = 16) {
+    auto raster = memDriver->Create("", size, size, 1, GDT_Float64, nullptr);
+    double gt[6];
+    copy(begin(geotransform.geotransform), end(geotransform.geotransform), gt);
+    gt[0] += shift;
+    raster->SetGeoTransform(gt);
+    raster->SetProjection(wkt);
+    return raster;
+  };
+
+  auto first = createRaster(0), second = createRaster(0), shifted = createRaster(3000), larger = createRaster(0, 32);
+  CPLFree(wkt);
+
+  CorrectorPool pool;
+  auto entry = pool.get(first);
+  BOOST_TEST(pool.get(second) == entry);
+  BOOST_TEST(pool.size() == 1u);
+
+  auto other = pool.get(shifted);
+  BOOST_TEST(other != entry);
+  BOOST_TEST(other->index == 1u);
+  BOOST_TEST(pool.size() == 2u);
+
+  // Cache and lattice of entry cannot be shared by raster of other size
+  BOOST_TEST(pool.get(larger) != entry);
+  BOOST_TEST(pool.size() == 3u);
+
+  // Raster outside of geostationary projection gets no corrector
+  auto latLon = memDriver->Create("", 16, 16, 1, GDT_Float64, nullptr);
+  OGRSpatialReference wgs84;
+  wgs84.importFromProj4("+proj=longlat +datum=WGS84 +no_defs");
+  wgs84.exportToWkt(&wkt);
+  latLon->SetProjection(wkt);
+  CPLFree(wkt);
+  BOOST_CHECK_THROW(pool.get(latLon), runtime_error);
+  BOOST_TEST(pool.size() == 3u);
+
+  for (auto raster : {first, second, shifted, larger, latLon})
+    GDALClose(raster);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
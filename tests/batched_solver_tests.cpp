@@ -0,0 +1,80 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <vector>
+#include <cmath>
+
+#include "fixtures.h"
+#include "cloud_simulation.h"
+#include "test_utils.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+static vector<GeoPosition> positions = {
+    {18.4239, 33.9253}, // Cape Town
+    {3.6947, 40.4177},  // Madrit
+    {47.9142, 15.7839}, // Brasília
+    {18.6453, 54.3475}, // Gdańsk
+    {18.9333, 69.6667}, // Tromsø
+    {-12.0, -8.0},      // Equatorial Atlantic
+    {-45.0, -55.0},     // South Atlantic
+    {0.0, 0.0}          // Subsatellite point
+};
+
+static vector<double> requiredAccuracies = {10, 1};
+static vector<NumericMethod> numericMethods = {NumericMethod::NETWON, NumericMethod::LEVENBERG_MARQUARD, NumericMethod::LINE_OF_SIGHT};
+static vector<bool> quadraticForms = {false, true};
+
+BOOST_FIXTURE_TEST_SUITE(batched_solver_suite, Fixture)
+
+BOOST_DATA_TEST_CASE(
+    batched_solver_test,
+    data::xrange(1000.0, 20000.0, 3000.0) *
+    data::make(requiredAccuracies) *
+    data::make(numericMethods) *
+    data::make(quadraticForms),
+    cloudHeight, requiredAccuracy, numericMethod, quadraticForm)
+{
+  vector<pair<double, double>> orginalGeos, geos, ellips, results(positions.size());
+  vector<double> heights;
+
+  for (auto position : positions)
+  {
+    orginalGeos.push_back(corrector.transformToGeosCoordinates(make_pair(position.lon, position.lat)));
+
+    auto cloudXYZ = calculateCloudPosition(position.lat * M_PI / 180.0, position.lon * M_PI / 180.0, cloudHeight, a, eSqr, central_m);
+    geos.push_back(calculateGEOSCorrdsFromXYZ(cloudXYZ, a, satelliteHeight));
+    ellips.push_back(corrector.transformToEllipsCoordinates(geos.back()));
+    heights.push_back(cloudHeight);
+  }
+
+  corrector.calculateNewCoordinatesBatched(positions.size(), geos.data(), ellips.data(), heights.data(), results.data(), requiredAccuracy, 1000, numericMethod, quadraticForm);
+
+  for (size_t i = 0; i < positions.size(); i++)
+  {
+    // Newton method is known to fail in subsatellite point
+    if (numericMethod == NumericMethod::NETWON && positions[i].lon == 0.0 && positions[i].lat == 0.0)
+      continue;
+
+    BOOST_TEST_CONTEXT(positions[i])
+    {
+      BOOST_TEST((!isnan(results[i].first) && !isnan(results[i].second)));
+
+      auto corrected = corrector.transformToGeosCoordinates(results[i]);
+      auto res = sqrt(pow(orginalGeos[i].first - corrected.first, 2) + pow(orginalGeos[i].second - corrected.second, 2));
+      BOOST_TEST(res <= requiredAccuracy);
+
+      auto scalar = corrector.calculateNewCoordinates(geos[i], ellips[i], cloudHeight, requiredAccuracy, 1000, numericMethod, quadraticForm);
+      if (!isnan(scalar.first) && !isnan(scalar.second))
+      {
+        scalar = corrector.transformToGeosCoordinates(scalar);
+        auto diff = sqrt(pow(scalar.first - corrected.first, 2) + pow(scalar.second - corrected.second, 2));
+        BOOST_TEST(diff <= requiredAccuracy);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
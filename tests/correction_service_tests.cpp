@@ -0,0 +1,143 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "correction_service.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+BOOST_AUTO_TEST_SUITE(correction_service_suite)
+
+BOOST_AUTO_TEST_CASE(request_parse_test)
+{
+  ServiceRequest defaults;
+  defaults.band = 2;
+  defaults.method = NumericMethod::NETWON;
+  defaults.accuracy = 5;
+
+  auto request = ServiceRequest::parse("CORRECT input=h.tif output=c.tif", defaults);
+  BOOST_TEST((request.type == ServiceRequest::Type::CORRECT));
+  BOOST_TEST(request.item.input == "h.tif");
+  BOOST_TEST(request.item.output == "c.tif");
+  BOOST_TEST(request.band == 2);
+  BOOST_TEST((request.method == NumericMethod::NETWON));
+  BOOST_TEST(request.accuracy == 5);
+
+  request.band = 3;
+  request.method = NumericMethod::LEVENBERG_MARQUARD;
+  request.accuracy = 0.125;
+  auto parsed = ServiceRequest::parse(request.format(), defaults);
+  BOOST_TEST(parsed.item.input == "h.tif");
+  BOOST_TEST(parsed.item.output == "c.tif");
+  BOOST_TEST(parsed.band == 3);
+  BOOST_TEST((parsed.method == NumericMethod::LEVENBERG_MARQUARD));
+  BOOST_TEST(parsed.accuracy == 0.125);
+
+  BOOST_TEST((ServiceRequest::parse("STATUS", defaults).type == ServiceRequest::Type::STATUS));
+}
+
+BOOST_DATA_TEST_CASE(request_malformed_test,
+  data::make({"", "REMOVE input=h.tif", "CORRECT input=h.tif", "CORRECT input=h.tif output=c.tif band",
+              "CORRECT input=h.tif output=c.tif band=x", "CORRECT input=h.tif output=c.tif colour=red"}),
+  line)
+{
+  BOOST_CHECK_THROW(ServiceRequest::parse(line, ServiceRequest()), logic_error);
+}
+
+BOOST_AUTO_TEST_CASE(service_test)
+{
+  string socketPath = "/tmp/correction_service_test_" + to_string(getpid()) + ".sock";
+
+  ServiceRequest defaults;
+  defaults.accuracy = 7;
+  CorrectionService service(socketPath, 2, defaults, [](const ServiceRequest &request) {
+    this_thread::sleep_for(chrono::milliseconds(10));
+    if (request.item.input == "missing.tif")
+      throw runtime_error("Cannot open missing.tif");
+    if (request.accuracy != 7)
+      throw runtime_error("Default accuracy not applied");
+  });
+  thread serving(&CorrectionService::run, &service);
+
+  BOOST_TEST(submitRequest(socketPath, "CORRECT input=h.tif output=c.tif").compare(0, 3, "OK ") == 0);
+  BOOST_TEST(submitRequest(socketPath, "CORRECT input=missing.tif output=c.tif") == "ERROR Cannot open missing.tif");
+  BOOST_TEST(submitRequest(socketPath, "CORRECT output=c.tif").compare(0, 6, "ERROR ") == 0);
+
+  // Malformed request is refused before queueing, so it is not counted
+  auto status = submitRequest(socketPath, "STATUS");
+  BOOST_TEST(status.find("queued=0 running=0 completed=1 failed=1 ") == 0u);
+
+  service.stop();
+  serving.join();
+
+  auto statistics = service.getStatistics();
+  BOOST_TEST(statistics.completed == 1u);
+  BOOST_TEST(statistics.failed == 1u);
+  BOOST_TEST(statistics.maxLatency >= 0.01);
+  BOOST_TEST(statistics.totalLatency >= statistics.maxLatency);
+
+  BOOST_CHECK_THROW(submitRequest(socketPath, "STATUS"), runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(service_relative_path_test)
+{
+  string socketPath = "/tmp/correction_service_relative_test_" + to_string(getpid()) + ".sock";
+  CorrectionService service(socketPath, 1, ServiceRequest(), [](const ServiceRequest &request) {
+    if (request.item.input != (filesystem::current_path() / "data/h.tif").string() || request.item.output != "/tmp/c.tif")
+      throw runtime_error("Unexpected paths " + request.item.input + " " + request.item.output);
+  });
+  thread serving(&CorrectionService::run, &service);
+
+  // Service opens paths relative to its own working directory, so client sends them absolute
+  ServiceRequest request;
+  request.item.input = "data/h.tif";
+  request.item.output = "/tmp/c.tif";
+  BOOST_TEST(submitRequest(socketPath, request).compare(0, 3, "OK ") == 0);
+
+  request.item.input = "data/h 1.tif";
+  BOOST_CHECK_THROW(submitRequest(socketPath, request), logic_error);
+
+  service.stop();
+  serving.join();
+}
+
+BOOST_AUTO_TEST_CASE(service_silent_client_test)
+{
+  string socketPath = "/tmp/correction_service_silent_test_" + to_string(getpid()) + ".sock";
+  CorrectionService service(socketPath, 1, ServiceRequest(), [](const ServiceRequest &) {});
+  thread serving(&CorrectionService::run, &service);
+
+  // Client which connects and sends nothing is dropped, later clients are answered
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+  int silent = socket(AF_UNIX, SOCK_STREAM, 0);
+  BOOST_TEST(connect(silent, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0);
+  this_thread::sleep_for(chrono::milliseconds(100));
+
+  auto started = chrono::steady_clock::now();
+  BOOST_TEST(submitRequest(socketPath, "CORRECT input=h.tif output=c.tif").compare(0, 3, "OK ") == 0);
+  BOOST_TEST(chrono::duration<double>(chrono::steady_clock::now() - started).count() < 5);
+
+  char c;
+  BOOST_TEST(read(silent, &c, 1) == 0);
+  close(silent);
+
+  service.stop();
+  serving.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,140 @@
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <gdal_priv.h>
+#include "correction_statistics.h"
+#include "fixtures.h"
+
+using namespace std;
+using namespace ksg;
+
+BOOST_AUTO_TEST_SUITE(correction_statistics_suite)
+
+BOOST_AUTO_TEST_CASE(merge_statistics_test)
+{
+  CorrectionStatistics first, second;
+  first.count(PixelStatus::CONVERGED);
+  first.count(PixelStatus::NO_DATA);
+  first.iterationsHistogram[3] = 1;
+  first.maxResidual = 0.5;
+  second.count(PixelStatus::CONVERGED);
+  second.count(PixelStatus::OFF_DISC);
+  second.count(PixelStatus::ITERATIONS_LIMIT);
+  second.iterationsHistogram[3] = 1;
+  second.iterationsHistogram[4] = 2;
+  second.maxResidual = 0.25;
+  second.solveSeconds = 1.5;
+
+  first += second;
+  BOOST_TEST(first.pixels == 5u);
+  BOOST_TEST(first.converged == 2u);
+  BOOST_TEST(first.noData == 1u);
+  BOOST_TEST(first.offDisc == 1u);
+  BOOST_TEST(first.iterationsLimit == 1u);
+  BOOST_TEST(first.iterationsHistogram[3] == 2u);
+  BOOST_TEST(first.iterationsHistogram[4] == 2u);
+  BOOST_TEST(first.maxResidual == 0.5);
+  BOOST_TEST(first.solveSeconds == 1.5);
+
+  auto json = first.toJson();
+  BOOST_TEST(json.find("\"pixels\": 5") != string::npos);
+  BOOST_TEST(json.find("\"iterations_histogram\": {\"3\": 2, \"4\": 2}") != string::npos);
+}
+
+BOOST_FIXTURE_TEST_CASE(diagnostics_test, PixelFixture)
+{
+  // Window crossing western edge of view disc, so some pixels are off disc
+  const int width = 64, height = 32;
+  const double noData = -1;
+  vector<double> values;
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      values.push_back(x % 7 == 0 ? noData : (x * 397 + y * 113) % 20000);
+  auto heights = createHeightsRaster(width, height, 0, 1800, values);
+  heights->GetRasterBand(1)->SetNoDataValue(noData);
+
+  auto memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+  auto output = memDriver->Create("", width, height, 2, GDT_Float64, nullptr);
+  auto diagnostics = memDriver->Create("", width, height, 3, GDT_Float32, nullptr);
+
+  CorrectionStatistics statistics;
+  corrector.calculateNewCoordinatesForRaster(heights, output, 1, 1, 100, NumericMethod::LEVENBERG_MARQUARD, false,
+                                             InitialGuess::HEURISTIC, false, nullptr, &statistics, diagnostics);
+
+  BOOST_TEST(statistics.pixels == static_cast<size_t>(width * height));
+  BOOST_TEST(statistics.pixels == statistics.noData + statistics.offDisc + statistics.converged + statistics.cached
+                                  + statistics.iterationsLimit + statistics.readFailed);
+  BOOST_TEST(statistics.noData > 0u);
+  BOOST_TEST(statistics.offDisc > 0u);
+  BOOST_TEST(statistics.converged > 0u);
+  BOOST_TEST(statistics.maxResidual <= 1);
+
+  size_t histogramTotal = 0;
+  for (auto &bin : statistics.iterationsHistogram)
+    histogramTotal += bin.second;
+  BOOST_TEST(histogramTotal == statistics.converged);
+
+  vector<float> iterations(width * height), residuals(width * height), statuses(width * height);
+  diagnostics->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, width, height, iterations.data(), width, height, GDT_Float32, 0, 0, nullptr);
+  diagnostics->GetRasterBand(2)->RasterIO(GF_Read, 0, 0, width, height, residuals.data(), width, height, GDT_Float32, 0, 0, nullptr);
+  diagnostics->GetRasterBand(3)->RasterIO(GF_Read, 0, 0, width, height, statuses.data(), width, height, GDT_Float32, 0, 0, nullptr);
+
+  size_t converged = 0, offDisc = 0, noDataPixels = 0;
+  for (size_t i = 0; i < statuses.size(); i++)
+  {
+    auto status = static_cast<PixelStatus>(statuses[i]);
+    if (status == PixelStatus::CONVERGED)
+    {
+      converged++;
+      BOOST_TEST(residuals[i] <= 1);
+    }
+    else
+    {
+      BOOST_TEST(isnan(residuals[i]));
+    }
+    offDisc += status == PixelStatus::OFF_DISC;
+    noDataPixels += status == PixelStatus::NO_DATA;
+  }
+  BOOST_TEST(converged == statistics.converged);
+  BOOST_TEST(offDisc == statistics.offDisc);
+  BOOST_TEST(noDataPixels == statistics.noData);
+
+  GDALClose(diagnostics);
+  GDALClose(output);
+  GDALClose(heights);
+}
+
+BOOST_FIXTURE_TEST_CASE(nan_height_test, PixelFixture)
+{
+  const int width = 8, height = 8;
+
+  // Band without no data value, whose NaN heights are no data anyway
+  vector<double> values(width * height, 5000);
+  for (size_t i = 0; i < values.size(); i += 3)
+    values[i] = numeric_limits<double>::quiet_NaN();
+  auto heights = createHeightsRaster(width, height, 0, 0, values);
+
+  auto output = GetGDALDriverManager()->GetDriverByName("MEM")->Create("", width, height, 2, GDT_Float64, nullptr);
+  CorrectionStatistics statistics;
+  corrector.calculateNewCoordinatesForRaster(heights, output, 1, 1, 100, NumericMethod::LEVENBERG_MARQUARD, false,
+                                             InitialGuess::HEURISTIC, false, nullptr, &statistics);
+  BOOST_TEST(statistics.noData == (values.size() + 2) / 3);
+
+  vector<double> x(width * height), y(width * height);
+  output->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, width, height, x.data(), width, height, GDT_Float64, 0, 0, nullptr);
+  output->GetRasterBand(2)->RasterIO(GF_Read, 0, 0, width, height, y.data(), width, height, GDT_Float64, 0, 0, nullptr);
+  for (size_t i = 0; i < values.size(); i += 3)
+  {
+    auto center = geotransform.calcGeoCoordsFromPix(i % width + 0.5, i / width + 0.5);
+    BOOST_TEST(x[i] == center.first);
+    BOOST_TEST(y[i] == center.second);
+  }
+
+  GDALClose(output);
+  GDALClose(heights);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
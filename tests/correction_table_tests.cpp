@@ -0,0 +1,177 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "correction_table.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+struct TableFixture
+{
+  string path, textPath;
+  CorrectionTableInfo info;
+
+  TableFixture()
+      : path((filesystem::temp_directory_path() / "ksg_correction_table_test.bin").string()),
+        textPath((filesystem::temp_directory_path() / "ksg_correction_table_test.txt").string())
+  {
+    info.srs = "GEOS";
+    info.imageWidth = 3712;
+    info.imageHeight = 3712;
+    info.firstColumn = 100;
+    info.firstLine = 200;
+    info.columns = 70;
+    info.lines = 5;
+    info.heights = {500, 1000, 1500};
+    info.requiredAccuracy = 10;
+    info.numericMethod = "LEVENBERG_MARQUARD";
+  }
+
+  ~TableFixture()
+  {
+    filesystem::remove(path);
+    filesystem::remove(textPath);
+  }
+
+  /// Coordinates of pixel, with NaN for the last height of some pixels
+  static vector<pair<double, double>> coordinates(size_t column, size_t line)
+  {
+    vector<pair<double, double>> result;
+    for (int hi = 0; hi < 3; hi++)
+      result.push_back({column == 130 && hi == 2 ? NAN : -12.3456789 + column * 0.0173 + hi * 1e-5,
+                        line * 0.11 - 23.75 + hi * 1234.5678});
+    return result;
+  }
+};
+
+BOOST_AUTO_TEST_SUITE(correction_table_suite)
+
+BOOST_AUTO_TEST_CASE(format_table_line_test)
+{
+  vector<pair<double, double>> coordinates = {{79.5734123, -4.91278}, {-0.0, 1e-7}, {123456789.0, -1.5e300},
+                                              {NAN, -NAN}, {numeric_limits<double>::infinity(), 0.1}};
+
+  ostringstream expected;
+  expected << 3712 << " " << 1;
+  for (auto &c : coordinates)
+    expected << " " << c.second << " " << c.first;
+  expected << "\n";
+
+  vector<char> buffer((2 + 2 * coordinates.size()) * TABLE_VALUE_MAX_CHARS);
+  auto end = formatTableLine(buffer.data(), 3712, 1, coordinates.data(), coordinates.size());
+  BOOST_TEST(string(buffer.data(), end) == expected.str());
+}
+
+BOOST_DATA_TEST_CASE_F(TableFixture, binary_table_test, data::make(vector<size_t>{sizeof(float), sizeof(double)}), valueSize)
+{
+  info.valueSize = valueSize;
+  {
+    CorrectionTableWriter writer(path, info);
+
+    #pragma omp parallel for
+    for (size_t line = 200; line < 205; line++)
+      for (size_t column = 100; column < 170; column++)
+        if ((column + line) % 3 != 0)
+          writer.setPixel(column, line, coordinates(column, line).data());
+
+    BOOST_CHECK_THROW(writer.setPixel(170, 200, coordinates(170, 200).data()), logic_error);
+  }
+
+  CorrectionTable table(path);
+  auto &stored = table.getInfo();
+  BOOST_TEST(stored.srs == info.srs);
+  BOOST_TEST(stored.heights == info.heights);
+  BOOST_TEST(stored.numericMethod == info.numericMethod);
+  BOOST_TEST(stored.firstColumn == info.firstColumn);
+  BOOST_TEST(stored.lines == info.lines);
+  BOOST_TEST(stored.valueSize == valueSize);
+
+  // Text of stored values, as generator writes it
+  ostringstream expected;
+  for (size_t line = 200; line < 205; line++)
+    for (size_t column = 100; column < 170; column++)
+    {
+      BOOST_TEST(table.isValid(column, line) == ((column + line) % 3 != 0));
+      if (!table.isValid(column, line))
+        continue;
+
+      auto values = coordinates(column, line);
+      expected << line + 1 << " " << column + 1;
+      for (size_t hi = 0; hi < values.size(); hi++)
+      {
+        auto value = table.getCoordinates(column, line, hi);
+        double tolerance = valueSize == sizeof(float) ? 1e-3 : 0;
+        if (isnan(values[hi].first))
+          BOOST_TEST(isnan(value.first));
+        else
+          BOOST_TEST(fabs(value.first - values[hi].first) <= tolerance);
+        BOOST_TEST(fabs(value.second - values[hi].second) <= tolerance);
+        expected << " " << value.second << " " << value.first;
+      }
+      expected << "\n";
+    }
+
+  exportTableText(table, textPath, false);
+  ifstream text(textPath);
+  BOOST_TEST(string(istreambuf_iterator<char>(text), istreambuf_iterator<char>()) == expected.str());
+
+  // Device which refuses every write
+  if (ifstream("/dev/full"))
+    BOOST_CHECK_THROW(exportTableText(table, "/dev/full", false), runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(invalid_table_test, TableFixture)
+{
+  ofstream(path) << "not a table";
+  BOOST_CHECK_THROW(CorrectionTable table(path), runtime_error);
+
+  {
+    CorrectionTableWriter writer(path, info);
+  }
+  filesystem::resize_file(path, filesystem::file_size(path) - 1);
+  BOOST_CHECK_THROW(CorrectionTable table(path), runtime_error);
+
+  info.heights.clear();
+  BOOST_CHECK_THROW(CorrectionTableWriter writer(path, info), logic_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(resume_table_test, TableFixture)
+{
+  {
+    CorrectionTableWriter writer(path, info);
+    writer.setPixel(100, 200, coordinates(100, 200).data());
+  }
+
+  // Resumed table keeps pixels written before
+  {
+    CorrectionTableWriter writer(path, info, true);
+    writer.setPixel(101, 200, coordinates(101, 200).data());
+    writer.flush();
+  }
+
+  {
+    CorrectionTable table(path);
+    BOOST_TEST(isBinaryTable(path));
+    BOOST_TEST(table.isValid(100, 200));
+    BOOST_TEST(table.isValid(101, 200));
+    BOOST_TEST(!table.isValid(102, 200));
+  }
+
+  info.requiredAccuracy = 5;
+  BOOST_CHECK_THROW(CorrectionTableWriter writer(path, info, true), runtime_error);
+
+  ofstream(path) << "not a table";
+  BOOST_TEST(!isBinaryTable(path));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
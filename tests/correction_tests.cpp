@@ -22,7 +22,7 @@ static vector<GeoPosition> positions = {
 
 static vector<int> iterations = {100, 1000};
 static vector<double> requiredAccuracies = {10, 1};
-static vector<NumericMethod> numericMethods = {NumericMethod::NETWON, NumericMethod::LEVENBERG_MARQUARD};
+static vector<NumericMethod> numericMethods = {NumericMethod::NETWON, NumericMethod::LEVENBERG_MARQUARD, NumericMethod::LINE_OF_SIGHT};
 static vector<bool> quadraticForms = {false, true};
 
 
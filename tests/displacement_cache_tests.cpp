@@ -0,0 +1,190 @@
+#include <boost/test/unit_test.hpp>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "displacement_cache.h"
+
+using namespace std;
+using namespace ksg;
+
+struct CacheFixture
+{
+  string path;
+  double geotransform[6] = {5.5702484773397446e+06, -3.0004031658172607e+03, 0.0, -5.5702484773397446e+06, 0.0, 3.0004031658172607e+03};
+
+  CacheFixture()
+      : path((filesystem::temp_directory_path() / "ksg_displacement_cache_test.cache").string())
+  {
+    filesystem::remove(path);
+  }
+
+  ~CacheFixture()
+  {
+    filesystem::remove(path);
+  }
+
+  string key(double requiredAccuracy = 10)
+  {
+    return DisplacementCache::makeKey("GEOS", geotransform, requiredAccuracy);
+  }
+};
+
+BOOST_FIXTURE_TEST_SUITE(displacement_cache_suite, CacheFixture)
+
+BOOST_AUTO_TEST_CASE(displacement_cache_interpolation_test)
+{
+  DisplacementCache cache(path, key(), 16, 8, 0, 20000, 1000);
+
+  BOOST_TEST(!cache.isReused());
+  BOOST_TEST(cache.getHeightsCount() == 21);
+  BOOST_TEST(cache.findInterval(-1) == -1);
+  BOOST_TEST(cache.findInterval(20001) == -1);
+  BOOST_TEST(cache.findInterval(20000) == 19);
+  BOOST_TEST(cache.findInterval(5500) == 5);
+
+  double dx = 0, dy = 0;
+  BOOST_TEST((cache.lookup(3, 2, 5500, 5, dx, dy) == DisplacementCache::Lookup::UNFILLED));
+  BOOST_TEST((cache.lookup(3, 2, 25000, 5, dx, dy) == DisplacementCache::Lookup::MISS));
+
+  double lower[] = {100, -200}, upper[] = {120, -240};
+  cache.store(3, 2, 5, lower, upper, 0.5);
+
+  BOOST_TEST((cache.lookup(3, 2, 5250, 5, dx, dy) == DisplacementCache::Lookup::HIT));
+  BOOST_TEST(dx == 105, boost::test_tools::tolerance(1e-9));
+  BOOST_TEST(dy == -210, boost::test_tools::tolerance(1e-9));
+
+  // Interval exceeding allowed interpolation error
+  BOOST_TEST((cache.lookup(3, 2, 5250, 0.1, dx, dy) == DisplacementCache::Lookup::MISS));
+
+  // Exact interpolation is still distinguishable from unfilled interval
+  cache.store(4, 2, 5, lower, upper, 0);
+  BOOST_TEST((cache.lookup(4, 2, 5000, 0.1, dx, dy) == DisplacementCache::Lookup::HIT));
+
+  // Interval which could not be solved
+  cache.store(5, 2, 5, lower, upper, numeric_limits<double>::quiet_NaN());
+  BOOST_TEST((cache.lookup(5, 2, 5000, 1e9, dx, dy) == DisplacementCache::Lookup::MISS));
+
+  // Neighbouring pixel and interval are not affected
+  BOOST_TEST((cache.lookup(3, 3, 5500, 5, dx, dy) == DisplacementCache::Lookup::UNFILLED));
+  BOOST_TEST((cache.lookup(3, 2, 6500, 5, dx, dy) == DisplacementCache::Lookup::UNFILLED));
+}
+
+BOOST_AUTO_TEST_CASE(displacement_cache_persistence_test)
+{
+  double lower[] = {100, -200}, upper[] = {120, -240};
+  double dx = 0, dy = 0;
+
+  {
+    DisplacementCache cache(path, key(), 16, 8, 0, 20000, 1000);
+    cache.store(7, 1, 12, lower, upper, 0.5);
+  }
+
+  {
+    DisplacementCache cache(path, key(), 16, 8, 0, 20000, 1000);
+    BOOST_TEST(cache.isReused());
+    BOOST_TEST((cache.lookup(7, 1, 12000, 5, dx, dy) == DisplacementCache::Lookup::HIT));
+    BOOST_TEST(dx == 100, boost::test_tools::tolerance(1e-9));
+  }
+
+  // Different settings discard cache content
+  {
+    DisplacementCache cache(path, key(1), 16, 8, 0, 20000, 1000);
+    BOOST_TEST(!cache.isReused());
+    BOOST_TEST((cache.lookup(7, 1, 12000, 5, dx, dy) == DisplacementCache::Lookup::UNFILLED));
+  }
+
+  {
+    DisplacementCache cache(path, key(1), 16, 8, 0, 20000, 500);
+    BOOST_TEST(!cache.isReused());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(displacement_cache_symmetry_test)
+{
+  DisplacementCache cache(path, key(), 16, 8, 0, 20000, 1000);
+
+  // Axes pass between columns 7 and 8 and between lines 3 and 4
+  double symmetricGeotransform[6] = {8000, -1000, 0, -4000, 0, 1000};
+  BOOST_TEST(cache.setSymmetry(ViewSymmetry(symmetricGeotransform)));
+
+  double lower[] = {100, -200}, upper[] = {120, -240};
+  double dx = 0, dy = 0;
+  cache.store(3, 1, 5, lower, upper, 0.5);
+
+  BOOST_TEST((cache.lookup(3, 1, 5250, 5, dx, dy) == DisplacementCache::Lookup::HIT));
+  BOOST_TEST(dx == 105, boost::test_tools::tolerance(1e-9));
+  BOOST_TEST(dy == -210, boost::test_tools::tolerance(1e-9));
+
+  // Mirrors share entry, with displacement mirrored
+  BOOST_TEST((cache.lookup(12, 1, 5250, 5, dx, dy) == DisplacementCache::Lookup::HIT));
+  BOOST_TEST(dx == -105, boost::test_tools::tolerance(1e-9));
+  BOOST_TEST(dy == -210, boost::test_tools::tolerance(1e-9));
+  BOOST_TEST((cache.lookup(12, 6, 5250, 5, dx, dy) == DisplacementCache::Lookup::HIT));
+  BOOST_TEST(dx == -105, boost::test_tools::tolerance(1e-9));
+  BOOST_TEST(dy == 210, boost::test_tools::tolerance(1e-9));
+
+  BOOST_TEST((cache.lookup(4, 1, 5250, 5, dx, dy) == DisplacementCache::Lookup::UNFILLED));
+
+  // Grid which is not mirrored onto pixel centers
+  double shiftedGeotransform[6] = {8300, -1000, 0, -4300, 0, 1000};
+  BOOST_TEST(!cache.setSymmetry(ViewSymmetry(shiftedGeotransform)));
+  BOOST_TEST((cache.lookup(12, 1, 5250, 5, dx, dy) == DisplacementCache::Lookup::UNFILLED));
+}
+
+BOOST_AUTO_TEST_CASE(displacement_cache_concurrent_symmetry_test)
+{
+  DisplacementCache cache(path, key(), 16, 8, 0, 20000, 1000);
+  double symmetricGeotransform[6] = {8000, -1000, 0, -4000, 0, 1000};
+  BOOST_TEST(cache.setSymmetry(ViewSymmetry(symmetricGeotransform)));
+
+  // Western and eastern blocks fill mirrored pixels at once, every entry has to come from single writer
+  auto fill = [&cache](int firstColumn, double sign, int seed) {
+    for (int round = 0; round < 200; round++)
+      for (int y = 0; y < 8; y++)
+        for (int x = firstColumn; x < firstColumn + 8; x++)
+          for (int interval = 0; interval < 20; interval++)
+          {
+            // Displacement is mirrored with pixel about both axes
+            double value = seed * 1000 + round;
+            double lower[] = {sign * value, (y < 4 ? -1 : 1) * value}, upper[] = {lower[0], lower[1]};
+            cache.store(x, y, interval, lower, upper, value);
+          }
+  };
+  auto check = [&cache]() {
+    size_t torn = 0;
+    for (int round = 0; round < 200; round++)
+      for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 16; x++)
+          for (int interval = 0; interval < 20; interval++)
+          {
+            double dx, dy;
+            double height = 1000 * interval + 500;
+            if (cache.lookup(x, y, height, 1e9, dx, dy) == DisplacementCache::Lookup::HIT && fabs(dx) != fabs(dy))
+              torn++;
+          }
+    return torn;
+  };
+
+  size_t torn = 0;
+  thread western(fill, 0, 1, 1), eastern(fill, 8, -1, 2);
+  thread reader([&]() { torn = check(); });
+  western.join();
+  eastern.join();
+  reader.join();
+  BOOST_TEST(torn == 0u);
+
+  // Every entry holds nodes of one writer, consistent with its error
+  for (int y = 0; y < 8; y++)
+    for (int x = 0; x < 16; x++)
+    {
+      double dx, dy;
+      BOOST_TEST((cache.lookup(x, y, 5500, 1e9, dx, dy) == DisplacementCache::Lookup::HIT));
+      BOOST_TEST(fabs(dx) == fabs(dy));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
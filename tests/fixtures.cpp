@@ -1,5 +1,7 @@
 #include "fixtures.h"
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <iterator>
 
 namespace ksg
 {
@@ -28,4 +30,26 @@ namespace ksg
     {
     }
 
+    GDALDataset *PixelFixture::createHeightsRaster(int width, int height, int originX, int originY, const std::vector<double> &values)
+    {
+        GDALAllRegister();
+        double gt[6];
+        std::copy(std::begin(geotransform.geotransform), std::end(geotransform.geotransform), gt);
+        gt[0] += originX * gt[1];
+        gt[3] += originY * gt[5];
+
+        char *wkt = nullptr;
+        srs.exportToWkt(&wkt);
+
+        auto raster = GetGDALDriverManager()->GetDriverByName("MEM")->Create("", width, height, 1, GDT_Float64, nullptr);
+        raster->SetGeoTransform(gt);
+        raster->SetProjection(wkt);
+        CPLFree(wkt);
+
+        if (!values.empty())
+            BOOST_TEST(raster->GetRasterBand(1)->RasterIO(GF_Write, 0, 0, width, height, const_cast<double *>(values.data()), width, height,
+                                                          GDT_Float64, 0, 0, nullptr) == CE_None);
+        return raster;
+    }
+
 }
\ No newline at end of file
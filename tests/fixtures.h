@@ -1,5 +1,8 @@
+#include <vector>
+
 #include <correction.h>
 #include <georeference_utils.h>
+#include <gdal_priv.h>
 #include <ogr_spatialref.h>
 
 namespace ksg
@@ -23,5 +26,11 @@ namespace ksg
         ksg::Geotransform<> geotransform;
 
         PixelFixture();
+
+        ///
+        /// Creates in memory heights raster, window of full disc of fixture.
+        /// @param originX, originY pixel of full disc which is the first pixel of window
+        /// @param values heights of pixels row by row, written if not empty
+        GDALDataset *createHeightsRaster(int width, int height, int originX, int originY, const std::vector<double> &values = {});
     };
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <vector>
+#include <string>
+#include <cmath>
+
+#include <ogr_spatialref.h>
+#include "geos_projection.h"
+#include "test_utils.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+static vector<string> projections = {
+    "+proj=geos +lon_0=0 +h=35785831 +x_0=0 +y_0=0 +datum=WGS84 +units=m +no_defs",
+    "+proj=geos +lon_0=9.5 +h=35785831 +x_0=1500 +y_0=-2500 +datum=WGS84 +units=m +no_defs",
+    "+proj=geos +lon_0=-75.2 +h=35786023 +x_0=0 +y_0=0 +sweep=x +ellps=GRS80 +units=m +no_defs"};
+
+static vector<GeoPosition> offsets = {
+    {0.0, 0.0},
+    {18.6453, 54.3475},
+    {-35.0, -20.0},
+    {60.0, 10.0},
+    {-10.0, 75.0},
+    {70.0, -45.0},
+    {95.0, 0.0}};
+
+struct ProjectionFixture
+{
+  OGRSpatialReference geosSrs, elipsoidSrs;
+
+  GeosProjection init(const string &proj)
+  {
+    BOOST_TEST(geosSrs.importFromProj4(proj.c_str()) == OGRERR_NONE);
+
+    char *elips = nullptr;
+    geosSrs.GetAttrNode("GEOGCS")->exportToWkt(&elips);
+    elipsoidSrs.importFromWkt(elips);
+    CPLFree(elips);
+
+    return GeosProjection(geosSrs.GetSemiMajor(), geosSrs.GetSemiMinor(), geosSrs.GetProjParm("central_meridian"),
+                          geosSrs.GetProjParm("satellite_height", 35785831), proj.find("+sweep=x") != string::npos,
+                          geosSrs.GetProjParm("false_easting"), geosSrs.GetProjParm("false_northing"));
+  }
+};
+
+BOOST_FIXTURE_TEST_SUITE(geos_projection_suite, ProjectionFixture)
+
+BOOST_DATA_TEST_CASE(
+    geos_projection_test,
+    data::make(projections) *
+    data::make(offsets),
+    proj, offset)
+{
+  auto projection = init(proj);
+  auto transformation = OGRCreateCoordinateTransformation(&geosSrs, &elipsoidSrs);
+  auto reverseTransformation = OGRCreateCoordinateTransformation(&elipsoidSrs, &geosSrs);
+
+  double lon = geosSrs.GetProjParm("central_meridian") + offset.lon, lat = offset.lat;
+
+  double x, y;
+  bool visible = projection.forward(lon, lat, x, y);
+
+  double projX = lon, projY = lat;
+  BOOST_TEST(visible == (bool)reverseTransformation->Transform(1, &projX, &projY));
+
+  if (visible)
+  {
+    BOOST_TEST(fabs(x - projX) <= 1e-3);
+    BOOST_TEST(fabs(y - projY) <= 1e-3);
+
+    double newLon, newLat;
+    BOOST_TEST(projection.inverse(x, y, newLon, newLat));
+
+    double projLon = x, projLat = y;
+    BOOST_TEST(transformation->Transform(1, &projLon, &projLat));
+    BOOST_TEST(fabs(remainder(newLon - projLon, 360.0)) <= 1e-9);
+    BOOST_TEST(fabs(newLat - projLat) <= 1e-9);
+    BOOST_TEST(fabs(remainder(newLon - lon, 360.0)) <= 1e-9);
+    BOOST_TEST(fabs(newLat - lat) <= 1e-9);
+
+    // View angles use y sweep convention regardless of projection
+    GeosProjection ySweep(geosSrs.GetSemiMajor(), geosSrs.GetSemiMinor(), geosSrs.GetProjParm("central_meridian"),
+                          geosSrs.GetProjParm("satellite_height", 35785831), false);
+    double ySweepX, ySweepY, lambda_s, phi_s;
+    ySweep.forward(lon, lat, ySweepX, ySweepY);
+    projection.viewAngles(x, y, lambda_s, phi_s);
+
+    double satelliteHeight = geosSrs.GetProjParm("satellite_height", 35785831);
+    BOOST_TEST(fabs(lambda_s * satelliteHeight - ySweepX) <= 1e-3);
+    BOOST_TEST(fabs(phi_s * satelliteHeight - ySweepY) <= 1e-3);
+  }
+  else
+  {
+    double newLon, newLat;
+    BOOST_TEST(!projection.inverse(x, y, newLon, newLat));
+    BOOST_TEST((isnan(x) && isnan(y)));
+  }
+
+  OGRCoordinateTransformation::DestroyCT(transformation);
+  OGRCoordinateTransformation::DestroyCT(reverseTransformation);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,130 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <vector>
+#include <cmath>
+#include <limits>
+
+#include "height_interpolation.h"
+#include "geodetic_utils.h"
+#include "fixtures.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+/// Pixels of fixture raster: center of disc, mid latitudes and near edge of view disc
+static vector<double> columns = {1856, 2300, 1200, 3500};
+static vector<double> lines = {1856, 700, 2900, 1856};
+
+BOOST_AUTO_TEST_SUITE(height_interpolation_suite)
+
+BOOST_AUTO_TEST_CASE(monotone_cubic_test)
+{
+  // Cubic reproduces linear data
+  MonotoneCubic linear({0, 1, 3, 4}, {1, 3, 7, 9});
+  for (double x = 0; x <= 4; x += 0.25)
+    BOOST_TEST(linear(x) == 1 + 2 * x, boost::test_tools::tolerance(1e-12));
+
+  // Step-like data is not overshot and stays monotone
+  MonotoneCubic step({0, 1, 2, 3, 4}, {0, 0, 0.1, 1, 1});
+  double previous = step(0);
+  for (double x = 0; x <= 4; x += 0.05)
+  {
+    BOOST_TEST(step(x) >= previous - 1e-12);
+    BOOST_TEST(step(x) >= -1e-12);
+    BOOST_TEST(step(x) <= 1 + 1e-12);
+    previous = step(x);
+  }
+
+  BOOST_TEST(step(2) == 0.1, boost::test_tools::tolerance(1e-12));
+  BOOST_CHECK_THROW(MonotoneCubic({0}, {0}), logic_error);
+}
+
+BOOST_DATA_TEST_CASE_F(PixelFixture, interpolate_heights_test, data::make(columns) ^ data::make(lines), column, line)
+{
+  const double accuracy = 2;
+
+  // Fine grid of 100 m
+  vector<double> heights;
+  for (double h = 500; h <= 20000; h += 100)
+    heights.push_back(h);
+
+  auto geos = geotransform.calcGeoCoordsFromPix(column + 0.5, line + 0.5);
+  auto ellips = corrector.transformToEllipsCoordinates(geos);
+
+  vector<pair<double, double>> coordinates(heights.size());
+  size_t solutions = interpolateHeights(heights, ellips, accuracy / 2, [&](double height) {
+    return corrector.calculateNewCoordinates(geos, ellips, height, accuracy / 2, 100, NumericMethod::LEVENBERG_MARQUARD);
+  }, coordinates.data());
+
+  BOOST_TEST(solutions * 5 < heights.size());
+
+  for (size_t hi = 0; hi < heights.size(); hi++)
+  {
+    auto expected = corrector.calculateNewCoordinates(geos, ellips, heights[hi], accuracy / 2, 100, NumericMethod::LEVENBERG_MARQUARD);
+    double dLongitude = (coordinates[hi].first - expected.first) * cos(expected.second * M_PI / 180);
+    double dLatitude = coordinates[hi].second - expected.second;
+    BOOST_TEST(DEGREE_LENGTH * hypot(dLongitude, dLatitude) <= accuracy);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(interpolate_heights_step_test)
+{
+  vector<double> heights;
+  for (double h = 0; h <= 20000; h += 100)
+    heights.push_back(h);
+
+  // Sharp step needs anchors added late, which change interpolation of intervals checked before
+  auto displacement = [](double height) { return make_pair(10 + 1e-7 * height, 20 + 0.01 * tanh((height - 7000) / 800)); };
+  vector<pair<double, double>> coordinates(heights.size());
+  // Only middles of intervals are checked, so heights between them get the rest of accuracy
+  size_t solutions = interpolateHeights(heights, {10, 20}, 0.5, displacement, coordinates.data());
+  BOOST_TEST(solutions < heights.size() / 2);
+
+  for (size_t hi = 0; hi < heights.size(); hi++)
+  {
+    auto expected = displacement(heights[hi]);
+    double error = DEGREE_LENGTH * hypot((coordinates[hi].first - expected.first) * cos(20 * M_PI / 180),
+                                                 coordinates[hi].second - expected.second);
+    BOOST_TEST(error <= 1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(interpolate_heights_antimeridian_test)
+{
+  vector<double> heights;
+  for (double h = 0; h <= 20000; h += 500)
+    heights.push_back(h);
+
+  // Solver which does not wrap longitudes, so coordinates cross antimeridian at 190 degrees
+  auto displacement = [](double height) { return make_pair(189.99 + 1e-6 * height, 20 + 1e-7 * height); };
+  vector<pair<double, double>> coordinates(heights.size());
+  size_t solutions = interpolateHeights(heights, {190, 20}, 0.5, displacement, coordinates.data());
+  BOOST_TEST(solutions < heights.size());
+
+  for (size_t hi = 0; hi < heights.size(); hi++)
+  {
+    BOOST_TEST(coordinates[hi].first >= -180);
+    BOOST_TEST(coordinates[hi].first < 180);
+    BOOST_TEST(coordinates[hi].first == displacement(heights[hi]).first - 360, boost::test_tools::tolerance(1e-9));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(interpolate_heights_failure_test)
+{
+  vector<double> heights = {0, 1000, 2000, 3000, 4000, 5000, 6000, 7000, 8000};
+  vector<pair<double, double>> coordinates(heights.size());
+
+  // Heights which cannot be solved are not interpolated
+  const double nan = numeric_limits<double>::quiet_NaN();
+  size_t solutions = interpolateHeights(heights, {10, 20}, 1, [&](double height) {
+    return height > 5500 ? make_pair(nan, nan) : make_pair(10 + height * 1e-6, 20 + height * 1e-6);
+  }, coordinates.data());
+
+  BOOST_TEST(solutions == heights.size());
+  BOOST_TEST(isnan(coordinates.back().first));
+  BOOST_TEST(coordinates[3].first == 10.003, boost::test_tools::tolerance(1e-12));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
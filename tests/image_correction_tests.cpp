@@ -0,0 +1,475 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <vector>
+#include <cmath>
+
+#include <gdal_priv.h>
+#include "image_correction.h"
+#include "memory_usage.h"
+#include "fixtures.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+static vector<GriddingAlgorithm> algorithms = {GriddingAlgorithm::AVERAGE, GriddingAlgorithm::NEAREST, GriddingAlgorithm::MAXIMUM};
+
+///
+/// Small raster whose pixels are moved by given offset [px]
+struct SplatFixture
+{
+  static constexpr int width = 8, height = 6;
+  static constexpr double noData = -1;
+
+  vector<double> pixelX, pixelY, heights, values;
+
+  SplatFixture()
+  {
+    for (int y = 0; y < height; y++)
+      for (int x = 0; x < width; x++)
+      {
+        pixelX.push_back(x + 0.5);
+        pixelY.push_back(y + 0.5);
+        heights.push_back(NAN);
+        values.push_back(10 * y + x);
+      }
+  }
+
+  size_t index(int x, int y) const { return static_cast<size_t>(y) * width + x; }
+
+  void move(int x, int y, double dx, double dy, double h)
+  {
+    pixelX[index(x, y)] += dx;
+    pixelY[index(x, y)] += dy;
+    heights[index(x, y)] = h;
+  }
+
+  vector<double> grid(GriddingAlgorithm algorithm, int fillDistance = 0, double zBufferTolerance = 500)
+  {
+    ForwardSplat splat(width, height, pixelX, pixelY, heights, zBufferTolerance);
+    vector<double> output(values.size());
+    splat.grid(values.data(), noData, algorithm, output.data());
+    if (fillDistance > 0)
+      splat.fillGaps(values.data(), noData, algorithm, fillDistance, output.data());
+    return output;
+  }
+};
+
+BOOST_FIXTURE_TEST_SUITE(image_correction_suite, SplatFixture)
+
+BOOST_AUTO_TEST_CASE(forward_splat_identity_test)
+{
+  auto nearest = grid(GriddingAlgorithm::NEAREST);
+  auto average = grid(GriddingAlgorithm::AVERAGE);
+  auto maximum = grid(GriddingAlgorithm::MAXIMUM);
+
+  BOOST_TEST(nearest == values, boost::test_tools::per_element());
+
+  // Orthogonal neighbours lie exactly on search radius
+  BOOST_TEST(average[index(3, 2)] == (22 + 24 + 13 + 33 + 23) / 5.0, boost::test_tools::tolerance(1e-12));
+  BOOST_TEST(average[index(0, 0)] == (0 + 1 + 10) / 3.0, boost::test_tools::tolerance(1e-12));
+  BOOST_TEST(maximum[index(3, 2)] == values[index(3, 3)]);
+}
+
+BOOST_AUTO_TEST_CASE(forward_splat_shift_test)
+{
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      move(x, y, 2, 0, 5000);
+
+  auto nearest = grid(GriddingAlgorithm::NEAREST);
+  for (int y = 0; y < height; y++)
+  {
+    BOOST_TEST(nearest[index(0, y)] == noData);
+    BOOST_TEST(nearest[index(1, y)] == values[index(0, y)]);
+    for (int x = 2; x < width; x++)
+      BOOST_TEST(nearest[index(x, y)] == values[index(x - 2, y)]);
+  }
+
+  // Column reached by no pixel is filled from its neighbour
+  auto filled = grid(GriddingAlgorithm::NEAREST, 1);
+  for (int y = 0; y < height; y++)
+    BOOST_TEST(filled[index(0, y)] == nearest[index(1, y)]);
+}
+
+BOOST_DATA_TEST_CASE(forward_splat_z_buffer_test, data::make(algorithms), algorithm)
+{
+  // Cloud moved onto surface pixel covers it, regardless of its value
+  move(3, 2, 0.9, 0, 8000);
+  values[index(3, 2)] = 0;
+  values[index(4, 2)] = 100;
+
+  auto output = grid(algorithm);
+  BOOST_TEST(output[index(4, 2)] == 0);
+
+  // Clouds of similar height are combined
+  move(4, 2, 0, 0, 7800);
+  output = grid(algorithm);
+  switch (algorithm)
+  {
+  case GriddingAlgorithm::AVERAGE:
+    BOOST_TEST(output[index(4, 2)] == 50);
+    break;
+  case GriddingAlgorithm::NEAREST:
+  case GriddingAlgorithm::MAXIMUM:
+    BOOST_TEST(output[index(4, 2)] == 100);
+    break;
+  }
+
+  output = grid(algorithm, 0, 100);
+  BOOST_TEST(output[index(4, 2)] == 0);
+}
+
+BOOST_DATA_TEST_CASE(forward_splat_fill_test, data::make(algorithms), algorithm)
+{
+  // Three columns of clouds moved out of raster leave gap in the middle one
+  for (int y = 0; y < height; y++)
+    for (int x = 2; x <= 4; x++)
+      move(x, y, 0, 100, 10000);
+
+  // Pixel without value and pixel outside of view disc
+  values[index(3, 1)] = noData;
+  pixelX[index(3, 4)] = pixelY[index(3, 4)] = NAN;
+
+  auto gaps = grid(algorithm);
+  auto output = grid(algorithm, 1);
+
+  for (int y = 0; y < height; y++)
+  {
+    BOOST_TEST(gaps[index(3, y)] == noData);
+    BOOST_TEST(gaps[index(2, y)] != noData);
+    BOOST_TEST(gaps[index(4, y)] != noData);
+
+    if (y == 1 || y == 4)
+      BOOST_TEST(output[index(3, y)] == noData);
+    else
+      BOOST_TEST(output[index(3, y)] != noData);
+  }
+
+  if (algorithm == GriddingAlgorithm::NEAREST)
+    BOOST_TEST(output[index(3, 2)] == gaps[index(2, 2)]);
+  if (algorithm == GriddingAlgorithm::AVERAGE)
+    BOOST_TEST(output[index(3, 2)] == (gaps[index(2, 2)] + gaps[index(4, 2)] + gaps[index(2, 1)] + gaps[index(4, 1)] + gaps[index(2, 3)] + gaps[index(4, 3)]) / 6, boost::test_tools::tolerance(1e-12));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+///
+/// Height raster of stratiform cloud deck with gaps and single high tower, near north edge of view disc
+struct InverseWarpFixture : public PixelFixture
+{
+  static constexpr int width = 48, height = 48;
+  static constexpr int originX = 1464, originY = 3400;
+  static constexpr int towerX = 20, towerY = 30;
+  static constexpr double towerHeight = 14000;
+
+  GDALDataset *heights = nullptr, *sources = nullptr;
+
+  InverseWarpFixture()
+  {
+    GDALAllRegister();
+    auto memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+    heights = memDriver->Create("", width, height, 1, GDT_Float64, nullptr);
+    sources = memDriver->Create("", width, height, 2, GDT_Float64, nullptr);
+
+    double gt[6];
+    copy(begin(geotransform.geotransform), end(geotransform.geotransform), gt);
+    gt[0] += originX * gt[1];
+    gt[3] += originY * gt[5];
+    heights->SetGeoTransform(gt);
+    sources->SetGeoTransform(gt);
+
+    vector<double> values;
+    for (int y = 0; y < height; y++)
+      for (int x = 0; x < width; x++)
+        values.push_back((x + y) % 17 == 0 ? -1 : 6000 + 150 * sin(x / 7.0) * cos(y / 5.0));
+    values[towerY * width + towerX] = towerHeight;
+
+    auto band = heights->GetRasterBand(1);
+    band->SetNoDataValue(-1);
+    BOOST_TEST(band->RasterIO(GF_Write, 0, 0, width, height, values.data(), width, height, GDT_Float64, 0, 0, nullptr) == CE_None);
+  }
+
+  ~InverseWarpFixture()
+  {
+    GDALClose(heights);
+    GDALClose(sources);
+  }
+
+  pair<double, double> pixelCenter(int x, int y)
+  {
+    return geotransform.calcGeoCoordsFromPix(originX + x + 0.5, originY + y + 0.5);
+  }
+
+  /// Height of pixel containing geos coordinates, surface outside of raster or without data
+  double heightAt(pair<double, double> coords, int &x, int &y)
+  {
+    double step = geotransform.geotransform[1];
+    x = static_cast<int>(floor((coords.first - geotransform.geotransform[0]) / step)) - originX;
+    y = static_cast<int>(floor((coords.second - geotransform.geotransform[3]) / geotransform.geotransform[5])) - originY;
+    if (x < 0 || y < 0 || x >= width || y >= height)
+      return 0;
+
+    double h;
+    heights->GetRasterBand(1)->RasterIO(GF_Read, x, y, 1, 1, &h, 1, 1, GDT_Float64, 0, 0, nullptr);
+    return h < 0 ? 0 : h;
+  }
+};
+
+BOOST_FIXTURE_TEST_SUITE(inverse_warp_suite, InverseWarpFixture)
+
+BOOST_AUTO_TEST_CASE(inverse_warp_round_trip_test)
+{
+  corrector.calculateSourceCoordinatesForRaster(heights, sources, 1, 100);
+
+  vector<double> sourceX(width * height), sourceY(width * height);
+  sources->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, width, height, sourceX.data(), width, height, GDT_Float64, 0, 0, nullptr);
+  sources->GetRasterBand(2)->RasterIO(GF_Read, 0, 0, width, height, sourceY.data(), width, height, GDT_Float64, 0, 0, nullptr);
+
+  double requiredAccuracy = 1;
+  double pixelSize = fabs(geotransform.geotransform[1]);
+  double maxError = 0;
+  int exact = 0;
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+    {
+      auto source = make_pair(sourceX[y * width + x], sourceY[y * width + x]);
+      BOOST_TEST_REQUIRE((!isnan(source.first) && !isnan(source.second)));
+
+      // Object observed in source, corrected with its own height, lies above output pixel
+      int sx, sy;
+      double h = heightAt(source, sx, sy);
+      auto corrected = h > 0 ? corrector.transformToGeosCoordinates(corrector.calculateNewCoordinates(source, corrector.transformToEllipsCoordinates(source), h, requiredAccuracy, 100, NumericMethod::LEVENBERG_MARQUARD))
+                             : source;
+
+      auto center = pixelCenter(x, y);
+      if (hypot(corrected.first - center.first, corrected.second - center.second) <= 2 * requiredAccuracy)
+        exact++;
+
+      maxError = max(maxError, hypot(corrected.first - center.first, corrected.second - center.second));
+    }
+
+  // Line of sight to pixels next to gaps in the deck or next to the tower passes through cloud wall,
+  // which has no exact solution. Those pixels are taken from boundary of cloud pixel instead,
+  // so their error is bounded by parallax of the tower (about 3 px).
+  BOOST_TEST_MESSAGE("Exact inverse for " << exact << " of " << width * height << " pixels, maximal error " << maxError / pixelSize << " px");
+  BOOST_TEST(exact >= 0.8 * width * height);
+  BOOST_TEST(maxError <= 4 * pixelSize);
+}
+
+BOOST_AUTO_TEST_CASE(inverse_warp_z_buffer_test)
+{
+  corrector.calculateSourceCoordinatesForRaster(heights, sources, 1, 100);
+
+  // Tower is observed above its nadir, although line of sight to deck pixel there is not blocked
+  auto nadir = corrector.calculateNewCoordinates(pixelCenter(towerX, towerY), corrector.transformToEllipsCoordinates(pixelCenter(towerX, towerY)),
+                                                 towerHeight, 1, 100, NumericMethod::LEVENBERG_MARQUARD);
+  nadir = corrector.transformToGeosCoordinates(nadir);
+
+  int x = static_cast<int>(floor((nadir.first - geotransform.geotransform[0]) / geotransform.geotransform[1])) - originX;
+  int y = static_cast<int>(floor((nadir.second - geotransform.geotransform[3]) / geotransform.geotransform[5])) - originY;
+  BOOST_TEST_REQUIRE((x >= 0 && y >= 0 && x < width && y < height));
+
+  double source[2];
+  sources->RasterIO(GF_Read, x, y, 1, 1, source, 1, 1, GDT_Float64, 2, nullptr, sizeof(double) * 2, 0, sizeof(double), nullptr);
+
+  int sx, sy;
+  BOOST_TEST(heightAt(make_pair(source[0], source[1]), sx, sy) == towerHeight);
+  BOOST_TEST(sx == towerX);
+  BOOST_TEST(sy == towerY);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+///
+/// Two band image on grid of InverseWarpFixture heights, corrected at once and in strips
+struct StripFixture : public InverseWarpFixture
+{
+  GDALDataset *image = nullptr;
+
+  StripFixture()
+  {
+    image = createRaster(2);
+    vector<double> values;
+    for (int b = 1; b <= 2; b++)
+    {
+      values.clear();
+      for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+          values.push_back(b == 1 ? x + 0.5 * y : (x * y) % 7);
+      BOOST_TEST(image->GetRasterBand(b)->RasterIO(GF_Write, 0, 0, width, height, values.data(), width, height, GDT_Float64, 0, 0, nullptr) == CE_None);
+    }
+  }
+
+  ~StripFixture()
+  {
+    GDALClose(image);
+  }
+
+  GDALDataset *createRaster(int bands)
+  {
+    auto raster = GetGDALDriverManager()->GetDriverByName("MEM")->Create("", width, height, bands, GDT_Float64, nullptr);
+    double gt[6];
+    heights->GetGeoTransform(gt);
+    raster->SetGeoTransform(gt);
+    raster->SetProjection(heights->GetProjectionRef());
+    return raster;
+  }
+
+  vector<double> correct(const ImageCorrectionSettings &settings, int &strips)
+  {
+    auto output = createRaster(2);
+    ImageCorrector imageCorrector(corrector, image, heights, 1);
+    imageCorrector.correct(output, settings);
+    strips = imageCorrector.getStripsCount();
+
+    vector<double> values(2 * width * height);
+    output->RasterIO(GF_Read, 0, 0, width, height, values.data(), width, height, GDT_Float64, 2, nullptr, 0, 0, 0, nullptr);
+    GDALClose(output);
+    return values;
+  }
+};
+
+static vector<CorrectionMode> modes = {CorrectionMode::FORWARD, CorrectionMode::INVERSE};
+
+BOOST_FIXTURE_TEST_SUITE(strip_correction_suite, StripFixture)
+
+BOOST_DATA_TEST_CASE(strip_correction_test, data::make(modes), mode)
+{
+  ImageCorrectionSettings settings;
+  settings.mode = mode;
+
+  int strips;
+  auto whole = correct(settings, strips);
+  BOOST_TEST(strips == 1);
+
+  // Limit leaves room for windows of about 20 rows only
+  settings.memoryLimit = currentMemoryUsage() + GDALGetCacheMax64() + 20 * width * 15 * sizeof(double);
+  auto striped = correct(settings, strips);
+  BOOST_TEST_MESSAGE("Image corrected in " << strips << " strips");
+  BOOST_TEST(strips > 1);
+
+  for (size_t i = 0; i < whole.size(); i++)
+    BOOST_TEST_REQUIRE(((isnan(whole[i]) && isnan(striped[i])) || whole[i] == striped[i]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(upsampling_suite)
+
+BOOST_AUTO_TEST_CASE(upsample_displacements_test)
+{
+  // Two layers of coarse pixels, whose displacement per metre of height changes linearly across grid
+  const int coarseWidth = 4, coarseHeight = 3, ratio = 3;
+  auto perMetre = [](double u, double v) { return make_pair(0.5 + 0.01 * u - 0.02 * v, -1 + 0.03 * u); };
+
+  vector<double> coarseHeights, displacementX, displacementY;
+  for (int y = 0; y < coarseHeight; y++)
+    for (int x = 0; x < coarseWidth; x++)
+    {
+      double h = x < 2 ? 5000 : 10000;
+      coarseHeights.push_back(h);
+      displacementX.push_back(h * perMetre(x + 0.5, y + 0.5).first);
+      displacementY.push_back(h * perMetre(x + 0.5, y + 0.5).second);
+    }
+  coarseHeights[11] = NAN;
+
+  // Pixels of image three times finer than coarse grid, and one pixel outside of it
+  vector<double> column, line;
+  for (int y = 0; y < coarseHeight * ratio; y++)
+    for (int x = 0; x < coarseWidth * ratio; x++)
+    {
+      column.push_back((x + 0.5) / ratio);
+      line.push_back((y + 0.5) / ratio);
+    }
+  column.push_back(-0.5);
+  line.push_back(1);
+
+  size_t count = column.size();
+  vector<double> heights(count), outputX(count), outputY(count);
+  upsampleDisplacements(coarseWidth, coarseHeight, coarseHeights.data(), displacementX.data(), displacementY.data(),
+                        column.data(), line.data(), count, 500, heights.data(), outputX.data(), outputY.data());
+
+  for (size_t i = 0; i + 1 < count; i++)
+  {
+    size_t own = static_cast<size_t>(line[i]) * coarseWidth + static_cast<size_t>(column[i]);
+    if (isnan(coarseHeights[own]))
+    {
+      BOOST_TEST(isnan(heights[i]));
+      BOOST_TEST(outputX[i] == displacementX[own]);
+      continue;
+    }
+
+    // Edge of layers stays where it is in coarse grid
+    BOOST_TEST(heights[i] == coarseHeights[own]);
+
+    // Interior of layer is interpolated exactly, pixels near its edge use only the layer
+    double u = column[i], v = line[i];
+    bool interior = u >= 0.5 && u <= coarseWidth - 0.5 && v >= 0.5 && v <= coarseHeight - 0.5 &&
+                    (u <= 1.5 || u >= 2.5) && !(u >= 2.5 && v >= 1.5);
+    auto expected = perMetre(u, v);
+    if (interior)
+    {
+      BOOST_TEST(outputX[i] == heights[i] * expected.first, boost::test_tools::tolerance(1e-9));
+      BOOST_TEST(outputY[i] == heights[i] * expected.second, boost::test_tools::tolerance(1e-9));
+    }
+    else
+    {
+      BOOST_TEST(fabs(outputX[i] / heights[i] - expected.first) <= 0.05);
+      BOOST_TEST(fabs(outputY[i] / heights[i] - expected.second) <= 0.05);
+    }
+  }
+
+  BOOST_TEST(isnan(heights.back()));
+  BOOST_TEST(outputX.back() == 0);
+  BOOST_TEST(outputY.back() == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(coarse_heights_test, StripFixture)
+{
+  // Heights three times coarser than image, and the same heights warped onto image grid
+  const int ratio = 3, coarseWidth = width / ratio, coarseHeight = height / ratio;
+  double gt[6];
+  heights->GetGeoTransform(gt);
+  gt[1] *= ratio;
+  gt[5] *= ratio;
+
+  vector<double> coarse, fine(width * height);
+  for (int y = 0; y < coarseHeight; y++)
+    for (int x = 0; x < coarseWidth; x++)
+      coarse.push_back((x * y) % 5 == 4 ? -1 : 4000 + 1000 * ((x / 3 + y / 4) % 4));
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      fine[y * width + x] = coarse[(y / ratio) * coarseWidth + x / ratio];
+
+  auto coarseHeights = GetGDALDriverManager()->GetDriverByName("MEM")->Create("", coarseWidth, coarseHeight, 1, GDT_Float64, nullptr);
+  coarseHeights->SetGeoTransform(gt);
+  coarseHeights->SetProjection(heights->GetProjectionRef());
+  coarseHeights->GetRasterBand(1)->SetNoDataValue(-1);
+  BOOST_TEST(coarseHeights->GetRasterBand(1)->RasterIO(GF_Write, 0, 0, coarseWidth, coarseHeight, coarse.data(), coarseWidth, coarseHeight, GDT_Float64, 0, 0, nullptr) == CE_None);
+  BOOST_TEST(heights->GetRasterBand(1)->RasterIO(GF_Write, 0, 0, width, height, fine.data(), width, height, GDT_Float64, 0, 0, nullptr) == CE_None);
+
+  ImageCorrectionSettings settings;
+  settings.algorithms = {GriddingAlgorithm::NEAREST, GriddingAlgorithm::NEAREST};
+  int strips;
+  auto expected = correct(settings, strips);
+
+  auto output = createRaster(2);
+  ImageCorrector imageCorrector(corrector, image, coarseHeights, 1);
+  imageCorrector.correct(output, settings);
+  vector<double> values(2 * width * height);
+  output->RasterIO(GF_Read, 0, 0, width, height, values.data(), width, height, GDT_Float64, 2, nullptr, 0, 0, 0, nullptr);
+  GDALClose(output);
+  GDALClose(coarseHeights);
+
+  // Upsampled displacements differ from solved ones by small part of pixel, so only few pixels change
+  size_t same = 0;
+  for (size_t i = 0; i < values.size(); i++)
+    if ((isnan(values[i]) && isnan(expected[i])) || values[i] == expected[i])
+      same++;
+  BOOST_TEST_MESSAGE(same << " of " << values.size() << " values are the same as with heights on image grid");
+  BOOST_TEST(same >= 0.95 * values.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,138 @@
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <gdal_priv.h>
+#include "incremental_correction.h"
+#include "correction_statistics.h"
+#include "output_encoding.h"
+#include "fixtures.h"
+
+using namespace std;
+using namespace ksg;
+
+BOOST_AUTO_TEST_SUITE(incremental_correction_suite)
+
+BOOST_AUTO_TEST_CASE(find_unchanged_pixels_test)
+{
+  const double nan = numeric_limits<double>::quiet_NaN();
+  vector<double> heights = {1000, 1000, 1000, -1, -1, nan, 2000, 3000};
+  vector<double> previous = {1000, 1004, 1006, 1000, -1, 1000, 2000, nan};
+  vector<double> coords(2 * heights.size(), 1);
+  coords[2 * 6 + 1] = nan;
+
+  vector<uint8_t> unchanged(heights.size());
+  BOOST_TEST(findUnchangedPixels(heights.size(), heights.data(), previous.data(), coords.data(), -1, nan, 5, unchanged.data()) == 2u);
+  BOOST_TEST(unchanged == vector<uint8_t>({1, 1, 0, 0, 0, 0, 0, 0}), boost::test_tools::per_element());
+
+  BOOST_TEST(findUnchangedPixels(heights.size(), heights.data(), previous.data(), coords.data(), -1, nan, 0, unchanged.data()) == 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(incremental_raster_test, PixelFixture)
+{
+  // Window crossing western edge of view disc, so some pixels are off disc
+  const int width = 96, height = 64;
+  const double noData = -1;
+  auto createHeights = [&](const vector<double> &values) {
+    auto raster = createHeightsRaster(width, height, 0, 1800, values);
+    raster->GetRasterBand(1)->SetNoDataValue(noData);
+    return raster;
+  };
+
+  vector<double> values;
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      values.push_back(x % 7 == 0 ? noData : (x * 397 + y * 113) % 12000);
+  auto previousHeights = createHeights(values);
+
+  // Cloud moved within small window of the next slot, some its pixels have no height anymore
+  for (int y = 20; y < 30; y++)
+    for (int x = 40; x < 60; x++)
+      values[y * width + x] = x % 5 == 0 ? noData : values[y * width + x] + 500;
+  // Change within tolerance
+  values[10 * width + 50] += 1;
+  auto heights = createHeights(values);
+
+  auto memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+  double gt[6];
+  heights->GetGeoTransform(gt);
+
+  auto correct = [&](GDALDataset *input, const PreviousCorrection *previous, CorrectionStatistics &statistics, bool solvedHeights = false) {
+    auto output = memDriver->Create("", width, height, solvedHeights ? 3 : 2, GDT_Float64, nullptr);
+    output->SetGeoTransform(gt);
+    if (solvedHeights)
+    {
+      output->SetMetadataItem(SOLVED_HEIGHTS_BAND_ITEM, "3");
+      output->GetRasterBand(3)->SetNoDataValue(numeric_limits<double>::quiet_NaN());
+    }
+    corrector.calculateNewCoordinatesForRaster(input, output, 1, 1, 100, NumericMethod::LEVENBERG_MARQUARD, false,
+                                               InitialGuess::INFLATED_ELLIPSOID, false, nullptr, &statistics, nullptr, nullptr, previous);
+    return output;
+  };
+
+  CorrectionStatistics previousStatistics, fullStatistics, statistics;
+  PreviousCorrection previous;
+  previous.heights = previousHeights;
+  previous.coordinates = correct(previousHeights, nullptr, previousStatistics);
+  previous.heightTolerance = 2;
+
+  auto expected = correct(heights, nullptr, fullStatistics);
+  auto output = correct(heights, &previous, statistics);
+
+  BOOST_TEST(fullStatistics.resolvedFraction() == 1);
+  BOOST_TEST(statistics.unchanged > 0u);
+  BOOST_TEST(statistics.resolvedFraction() < 0.2);
+  BOOST_TEST(statistics.noData == fullStatistics.noData);
+  BOOST_TEST(statistics.offDisc == fullStatistics.offDisc);
+  BOOST_TEST(statistics.converged + statistics.unchanged == fullStatistics.converged);
+
+  vector<double> expectedCoords(2 * width * height), coords(2 * width * height);
+  readCoordinates(expected, 0, 0, width, height, expectedCoords.data());
+  readCoordinates(output, 0, 0, width, height, coords.data());
+  for (size_t i = 0; i < coords.size(); i++)
+  {
+    // Pixel whose height changed within tolerance keeps coordinates of previous height
+    double tolerance = i / 2 == 10 * width + 50 ? 20 : 1;
+    BOOST_TEST(isnan(coords[i]) == isnan(expectedCoords[i]));
+    if (!isnan(coords[i]))
+      BOOST_TEST(fabs(coords[i] - expectedCoords[i]) <= tolerance);
+  }
+
+  // In chain of slots height rising slowly is compared with height of its coordinates, not with previous slot
+  const size_t rising = 10 * width + 50, steady = 12 * width + 50;
+  CorrectionStatistics chainedStatistics, nextStatistics, nextFullStatistics;
+  auto chained = correct(heights, &previous, chainedStatistics, true);
+
+  values[rising] += 1.5;
+  values[steady] += 1.5;
+  auto nextHeights = createHeights(values);
+  PreviousCorrection chainedPrevious;
+  chainedPrevious.coordinates = chained;
+  chainedPrevious.heightTolerance = 2;
+  auto next = correct(nextHeights, &chainedPrevious, nextStatistics, true);
+  auto nextExpected = correct(nextHeights, nullptr, nextFullStatistics);
+
+  BOOST_TEST(nextStatistics.converged == 1u);
+  readCoordinates(nextExpected, 0, 0, width, height, expectedCoords.data());
+  readCoordinates(next, 0, 0, width, height, coords.data());
+  BOOST_TEST(hypot(coords[2 * rising] - expectedCoords[2 * rising], coords[2 * rising + 1] - expectedCoords[2 * rising + 1]) <= 1);
+
+  vector<double> solved(width * height);
+  BOOST_TEST(next->GetRasterBand(3)->RasterIO(GF_Read, 0, 0, width, height, solved.data(), width, height, GDT_Float64, 0, 0, nullptr) == CE_None);
+  BOOST_TEST(solved[rising] == values[rising]);
+  BOOST_TEST(solved[steady] == values[steady] - 1.5);
+  BOOST_TEST(isnan(solved[0]));
+
+  // Previous correction of other geometry is refused
+  auto other = memDriver->Create("", width, height - 1, 1, GDT_Float64, nullptr);
+  previous.heights = other;
+  BOOST_CHECK_THROW(corrector.calculateNewCoordinatesForRaster(heights, output, 1, 1, 100, NumericMethod::LEVENBERG_MARQUARD, false,
+                                                               InitialGuess::INFLATED_ELLIPSOID, false, nullptr, nullptr, nullptr, nullptr, &previous),
+                    runtime_error);
+
+  for (auto raster : {previousHeights, heights, previous.coordinates, expected, output, chained, nextHeights, next, nextExpected, other})
+    GDALClose(raster);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
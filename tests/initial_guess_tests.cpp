@@ -0,0 +1,157 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <cmath>
+#include <string>
+
+#include "fixtures.h"
+#include "cloud_simulation.h"
+#include "test_utils.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+static vector<double> requiredAccuracies = {10, 1};
+static vector<NumericMethod> numericMethods = {NumericMethod::NETWON, NumericMethod::LEVENBERG_MARQUARD};
+static vector<bool> quadraticForms = {false, true};
+static vector<InitialGuess> initialGuesses = {InitialGuess::HEURISTIC, InitialGuess::INFLATED_ELLIPSOID};
+
+///
+/// Iterations histogram of pixels sampled over whole view disc
+struct IterationsHistogram
+{
+  map<int, size_t> counts;
+  size_t failures = 0;
+  size_t total = 0;
+  double sum = 0;
+
+  double mean() const { return sum / total; }
+
+  size_t atMost(int iterations) const
+  {
+    size_t ret = 0;
+    for (auto &bin : counts)
+      if (bin.first <= iterations)
+        ret += bin.second;
+    return ret;
+  }
+};
+
+static ostream &operator<<(ostream &out, const IterationsHistogram &histogram)
+{
+  for (auto &bin : histogram.counts)
+    out << "  " << bin.first << ": " << bin.second << "\n";
+  out << "  failed: " << histogram.failures << ", mean: " << histogram.mean();
+  return out;
+}
+
+static IterationsHistogram collectHistogram(PixelFixture &fixture, InitialGuess initialGuess, NumericMethod numericMethod, bool quadraticForm, double requiredAccuracy)
+{
+  IterationsHistogram histogram;
+
+  for (int y = 58; y < 3712; y += 116)
+    for (int x = 58; x < 3712; x += 116)
+    {
+      auto geos = fixture.geotransform.calcGeoCoordsFromPix(x + 0.5, y + 0.5);
+      auto ellips = fixture.corrector.transformToEllipsCoordinates(geos);
+
+      if (isnan(ellips.first) || isnan(ellips.second))
+        continue;
+
+      for (double cloudHeight = 1000; cloudHeight < 20000; cloudHeight += 3000)
+      {
+        auto cloudXYZ = calculateCloudPosition(ellips.second * M_PI / 180.0, ellips.first * M_PI / 180.0, cloudHeight, fixture.a, fixture.eSqr, fixture.central_m);
+        auto simGeos = calculateGEOSCorrdsFromXYZ(cloudXYZ, fixture.a, fixture.satelliteHeight);
+        auto simEllips = fixture.corrector.transformToEllipsCoordinates(simGeos);
+
+        if (isnan(simEllips.first) || isnan(simEllips.second))
+          continue;
+
+        int iterations = 0;
+        auto corrected = fixture.corrector.calculateNewCoordinates(simGeos, simEllips, cloudHeight, requiredAccuracy, 100,
+                                                                   numericMethod, quadraticForm, initialGuess, &iterations);
+        histogram.total++;
+        histogram.sum += iterations;
+
+        if (isnan(corrected.first) || isnan(corrected.second))
+        {
+          histogram.failures++;
+          continue;
+        }
+
+        histogram.counts[iterations]++;
+
+        auto correctedGeos = fixture.corrector.transformToGeosCoordinates(corrected);
+        auto res = sqrt(pow(correctedGeos.first - geos.first, 2) + pow(correctedGeos.second - geos.second, 2));
+        BOOST_TEST(res <= requiredAccuracy);
+      }
+    }
+
+  return histogram;
+}
+
+BOOST_FIXTURE_TEST_SUITE(initial_guess_suite, PixelFixture)
+
+BOOST_DATA_TEST_CASE(
+    initial_guess_iterations_test,
+    data::make(requiredAccuracies) *
+    data::make(numericMethods) *
+    data::make(quadraticForms),
+    requiredAccuracy, numericMethod, quadraticForm)
+{
+  map<InitialGuess, IterationsHistogram> histograms;
+
+  for (auto initialGuess : initialGuesses)
+  {
+    histograms[initialGuess] = collectHistogram(*this, initialGuess, numericMethod, quadraticForm, requiredAccuracy);
+
+    stringstream message;
+    message << "Iterations histogram (" << requiredAccuracy << " m, " << numericMethod << (quadraticForm ? ", squared" : "") << ", " << initialGuess << "):\n"
+            << histograms[initialGuess];
+    BOOST_TEST_MESSAGE(message.str());
+  }
+
+  auto &heuristic = histograms[InitialGuess::HEURISTIC];
+  auto &inflated = histograms[InitialGuess::INFLATED_ELLIPSOID];
+
+  BOOST_TEST(inflated.total == heuristic.total);
+  BOOST_TEST(inflated.failures <= heuristic.failures);
+  BOOST_TEST(inflated.mean() < heuristic.mean());
+  // Most of pixels should only be refined by numeric method
+  BOOST_TEST(inflated.atMost(2) >= 0.9 * inflated.total);
+}
+
+BOOST_DATA_TEST_CASE(initial_guess_antimeridian_test, data::make({140.7, -137.0}), centralMeridian)
+{
+  OGRSpatialReference srs;
+  BOOST_TEST(srs.importFromProj4(("+proj=geos +lon_0=" + to_string(centralMeridian) + " +h=35785831 +x_0=0 +y_0=0 +datum=WGS84 +units=m +no_defs").c_str()) == CE_None);
+  GEOSHeightCorrector corrector(srs);
+  PixelFixture fixture;
+
+  // Pixels on both sides of antimeridian get the same longitude whatever start point solver used
+  size_t crossing = 0;
+  for (int x = 58; x < 3712; x += 29)
+  {
+    auto geos = fixture.geotransform.calcGeoCoordsFromPix(x + 0.5, 1500.5);
+    auto ellips = corrector.transformToEllipsCoordinates(geos);
+    if (isnan(ellips.first) || isnan(ellips.second))
+      continue;
+
+    auto heuristic = corrector.calculateNewCoordinates(geos, ellips, 10000, 0.1, 100, NumericMethod::LEVENBERG_MARQUARD, false, InitialGuess::HEURISTIC);
+    auto inflated = corrector.calculateNewCoordinates(geos, ellips, 10000, 0.1, 100, NumericMethod::LEVENBERG_MARQUARD, false, InitialGuess::INFLATED_ELLIPSOID);
+    if (isnan(heuristic.first) || isnan(inflated.first))
+      continue;
+
+    BOOST_TEST(heuristic.first >= -180);
+    BOOST_TEST(heuristic.first < 180);
+    BOOST_TEST(fabs(inflated.first - heuristic.first) < 1e-5);
+    crossing += fabs(ellips.first) > 170;
+  }
+  BOOST_TEST(crossing > 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
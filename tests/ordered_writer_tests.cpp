@@ -0,0 +1,63 @@
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ordered_writer.h"
+
+using namespace std;
+using namespace ksg;
+
+BOOST_AUTO_TEST_SUITE(ordered_writer_suite)
+
+BOOST_AUTO_TEST_CASE(reorder_test)
+{
+  ostringstream out;
+  OrderedWriter writer(out, 10);
+
+  writer.submit(12, "c");
+  writer.submit(11, "b");
+  BOOST_TEST(out.str() == "");
+  BOOST_TEST(writer.getWaiting() == 2u);
+
+  writer.submit(10, "a");
+  BOOST_TEST(out.str() == "abc");
+  BOOST_TEST(writer.getWaiting() == 0u);
+  BOOST_TEST(writer.getNext() == 13u);
+
+  writer.submit(14, "e");
+  writer.submit(13, "d");
+  BOOST_TEST(out.str() == "abcde");
+}
+
+BOOST_AUTO_TEST_CASE(parallel_submit_test)
+{
+  const size_t count = 2000;
+  vector<size_t> order(count);
+  for (size_t i = 0; i < count; i++)
+    order[i] = i;
+  shuffle(order.begin(), order.end(), mt19937(7));
+
+  ostringstream out, expected;
+  for (size_t i = 0; i < count; i++)
+    expected << i << "\n";
+
+  OrderedWriter writer(out);
+  vector<thread> threads;
+  const size_t workers = 4;
+  for (size_t w = 0; w < workers; w++)
+    threads.emplace_back([&, w]() {
+      for (size_t i = w; i < count; i += workers)
+        writer.submit(order[i], to_string(order[i]) + "\n");
+    });
+  for (auto &t : threads)
+    t.join();
+
+  BOOST_TEST(out.str() == expected.str());
+  BOOST_TEST(writer.getNext() == count);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
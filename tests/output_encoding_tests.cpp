@@ -0,0 +1,106 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include <gdal_priv.h>
+#include "output_encoding.h"
+#include "fixtures.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+BOOST_AUTO_TEST_SUITE(output_encoding_suite)
+
+BOOST_AUTO_TEST_CASE(encode_displacement_test)
+{
+  double geotransform[] = {1000, 100, 0, 2000, 0, -100};
+  double nan = numeric_limits<double>::quiet_NaN();
+
+  // Centers of pixels (0, 0), (1, 0) and (1, 1) are (1050, 1950), (1150, 1950) and (1150, 1850)
+  vector<double> coords = {1050 + 12.4, 1950 - 7.6, 1150 + 3e6, 1950, nan, nan, 1150, 1850};
+  vector<int16_t> displacement(coords.size());
+
+  BOOST_TEST(encodeDisplacement(geotransform, 2, 0, 0, 2, 2, coords.data(), displacement.data()) == 1u);
+  BOOST_TEST(displacement[0] == 6);
+  BOOST_TEST(displacement[1] == -4);
+  BOOST_TEST(displacement[2] == DISPLACEMENT_NO_DATA);
+  BOOST_TEST(displacement[3] == DISPLACEMENT_NO_DATA);
+  BOOST_TEST(displacement[4] == DISPLACEMENT_NO_DATA);
+  BOOST_TEST(displacement[5] == DISPLACEMENT_NO_DATA);
+  BOOST_TEST(displacement[6] == 0);
+  BOOST_TEST(displacement[7] == 0);
+}
+
+static vector<OutputEncoding> encodings = {OutputEncoding::FLOAT32, OutputEncoding::DISPLACEMENT_INT16};
+static vector<Compression> compressions = {Compression::NONE, Compression::DEFLATE};
+
+BOOST_DATA_TEST_CASE_F(PixelFixture, encoded_correction_test, data::make(encodings) * data::make(compressions), encoding, compression)
+{
+  // Window near northern edge of view disc, where displacements are the largest
+  const int width = 48, height = 48;
+  vector<double> values;
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      values.push_back((x * 397 + y * 113) % 20000);
+  auto heights = createHeightsRaster(width, height, 1800, 150, values);
+
+  auto memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+  auto reference = memDriver->Create("", width, height, 2, GDT_Float64, nullptr);
+  corrector.calculateNewCoordinatesForRaster(heights, reference, 1, 1, 100, NumericMethod::LEVENBERG_MARQUARD);
+
+  OutputFormat format;
+  format.encoding = encoding;
+  format.compression = compression;
+  format.displacementScale = 2;
+  format.solvedHeights = true;
+
+  string path = "/tmp/output_encoding_test_" + to_string(getpid()) + ".tif";
+  auto output = createCoordinatesRaster(path, heights, format);
+  corrector.calculateNewCoordinatesForRaster(heights, output, 1, 1, 100, NumericMethod::LEVENBERG_MARQUARD);
+  GDALClose(output);
+
+  output = (GDALDataset *)GDALOpen(path.c_str(), GA_ReadOnly);
+  BOOST_TEST_REQUIRE(output != nullptr);
+  BOOST_TEST((getOutputEncoding(output) == encoding));
+
+  vector<double> expected(2 * width * height), decoded(2 * width * height);
+  readCoordinates(reference, 0, 0, width, height, expected.data());
+  readCoordinates(output, 0, 0, width, height, decoded.data());
+
+  // Float32 keeps about 0.5 m near edge of disc, displacement is rounded to half of its unit
+  double tolerance = encoding == OutputEncoding::FLOAT32 ? 0.5 : format.displacementScale / 2 + 1e-6;
+  double maxDifference = 0;
+  size_t corrected = 0;
+  for (size_t i = 0; i < expected.size(); i++)
+  {
+    BOOST_TEST(isnan(expected[i]) == isnan(decoded[i]));
+    if (isnan(expected[i]) || isnan(decoded[i]))
+      continue;
+    maxDifference = max(maxDifference, fabs(expected[i] - decoded[i]));
+    corrected++;
+  }
+  BOOST_TEST(corrected > expected.size() / 2);
+  BOOST_TEST(maxDifference <= tolerance);
+
+  // Heights of corrected pixels are recorded with them, as whole metres in Int16
+  BOOST_TEST_REQUIRE(getSolvedHeightsBand(output) == 3);
+  vector<double> solved(width * height);
+  BOOST_TEST(output->GetRasterBand(3)->RasterIO(GF_Read, 0, 0, width, height, solved.data(), width, height, GDT_Float64, 0, 0, nullptr) == CE_None);
+  for (size_t i = 0; i < solved.size(); i++)
+    if (!isnan(decoded[2 * i]))
+      BOOST_TEST(solved[i] == values[i]);
+
+  GDALClose(output);
+  GDALClose(reference);
+  GDALClose(heights);
+  remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
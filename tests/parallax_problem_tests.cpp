@@ -0,0 +1,75 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <vector>
+#include <cmath>
+
+#include "parallax_problem.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+// WGS84 first eccentricity squared and geostationary satellite distance, normalised with semi-major axis
+static const double eSqr = 0.00669437999014;
+static const double l = 1 + 35785831 / 6378137.0;
+
+static vector<double> latitudes = {-70, -30, 0, 15, 45, 75};
+
+BOOST_AUTO_TEST_SUITE(parallax_problem_suite)
+
+BOOST_DATA_TEST_CASE(
+    fused_jacobian_test,
+    data::make(latitudes) * data::make(vector<bool>{false, true}),
+    latitude, squared)
+{
+  double h = 12000 / 6378137.0;
+  auto arg = createTargetFunctionArg(latitude * M_PI / 180, 0.3, 5.6);
+
+  TargetFunctionResult value;
+  TargetFunctionDerivative jacobian;
+  if (squared)
+    ParallaxProblemSquared(1, eSqr, h, 0.12, 0.05, l).targetFunctionValueAndJacobian(arg, value, jacobian);
+  else
+    ParallaxProblem(1, eSqr, h, 0.12, 0.05, l).targetFunctionValueAndJacobian(arg, value, jacobian);
+
+  auto evaluate = [&](const TargetFunctionArg &x) {
+    return squared ? ParallaxProblemSquared(1, eSqr, h, 0.12, 0.05, l).targetFunctionVectorValue(x)
+                   : ParallaxProblem(1, eSqr, h, 0.12, 0.05, l).targetFunctionVectorValue(x);
+  };
+
+  auto expected = evaluate(arg);
+  for (int fun = 0; fun < 3; fun++)
+    BOOST_TEST(value(fun) == expected(fun), boost::test_tools::tolerance(1e-12));
+
+  // Central differences
+  const double eps = 1e-6;
+  for (int var = 0; var < 3; var++)
+  {
+    auto forward = arg, backward = arg;
+    forward(var) += eps;
+    backward(var) -= eps;
+    auto plus = evaluate(forward), minus = evaluate(backward);
+    for (int fun = 0; fun < 3; fun++)
+      BOOST_TEST(fabs(jacobian(fun, var) - (plus(fun) - minus(fun)) / (2 * eps)) < 1e-7);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(solve_linear_system_test)
+{
+  dlib::matrix<double, 3, 3> m;
+  m(0, 0) = 4; m(0, 1) = -2; m(0, 2) = 1;
+  m(1, 0) = 3; m(1, 1) = 6;  m(1, 2) = -4;
+  m(2, 0) = 2; m(2, 1) = 1;  m(2, 2) = 8;
+
+  auto expected = createTargetFunctionArg(1.5, -2, 0.25);
+  TargetFunctionArg v;
+  for (int r = 0; r < 3; r++)
+    v(r) = m(r, 0) * expected(0) + m(r, 1) * expected(1) + m(r, 2) * expected(2);
+
+  auto x = solveLinearSystem(m, v);
+  for (int k = 0; k < 3; k++)
+    BOOST_TEST(x(k) == expected(k), boost::test_tools::tolerance(1e-12));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
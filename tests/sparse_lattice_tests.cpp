@@ -0,0 +1,221 @@
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <vector>
+
+#include <gdal_priv.h>
+#include "sparse_lattice.h"
+#include "correction_statistics.h"
+#include "geodetic_utils.h"
+#include "fixtures.h"
+
+using namespace std;
+using namespace ksg;
+
+BOOST_AUTO_TEST_SUITE(sparse_lattice_suite)
+
+BOOST_AUTO_TEST_CASE(sparse_lattice_test)
+{
+  const vector<double> heights = {0, 10000};
+  const size_t columns = 200, lines = 150;
+
+  // Cubic field is reproduced by bicubic interpolation, except of disc of pixels which cannot be solved
+  auto field = [](long x, long y, double h) {
+    return make_pair(1e-6 * x * x * x + 0.01 * x * y + h / 1000, 0.002 * y * y - 0.5 * x);
+  };
+  auto solvable = [](long x, long y) { return hypot(x - 150, y - 100) > 20; };
+
+  SparseLattice lattice(heights, 0.01, 32);
+  lattice.build(0, 0, columns, lines, [&](long x, long y, const vector<double> &solved, pair<double, double> *displacements) {
+    for (size_t hi = 0; hi < solved.size(); hi++)
+      displacements[hi] = field(x, y, solved[hi]);
+    return solvable(x, y);
+  });
+
+  BOOST_TEST(lattice.isBuilt());
+  BOOST_TEST(lattice.getNodesCount() * 10 < columns * lines);
+
+  size_t interpolated = 0;
+  vector<pair<double, double>> displacements(heights.size());
+  for (size_t y = 0; y < lines; y++)
+    for (size_t x = 0; x < columns; x++)
+    {
+      if (!lattice.interpolate(x, y, displacements.data()))
+      {
+        // Only pixels near unsolvable ones are left to be solved directly
+        BOOST_TEST(hypot(x - 150.0, y - 100.0) < 20 + 3 * SparseLattice::MIN_CELL_SIZE);
+        continue;
+      }
+
+      interpolated++;
+      BOOST_TEST(solvable(x, y));
+      for (size_t hi = 0; hi < heights.size(); hi++)
+      {
+        auto expected = field(x, y, heights[hi]);
+        BOOST_TEST(hypot(displacements[hi].first - expected.first, displacements[hi].second - expected.second) <= 0.01);
+      }
+    }
+  BOOST_TEST(interpolated > columns * lines * 9 / 10);
+
+  // Heights between grid heights are interpolated too, heights out of grid are not
+  pair<double, double> displacement;
+  BOOST_TEST(lattice.interpolate(10, 10, 2500, displacement));
+  BOOST_TEST(displacement.first == field(10, 10, 2500).first, boost::test_tools::tolerance(0.01));
+  BOOST_TEST(!lattice.interpolate(10, 10, 12000, displacement));
+  BOOST_TEST(!lattice.interpolate(columns, 10, displacements.data()));
+
+  BOOST_CHECK_THROW(SparseLattice(heights, 1, 48), logic_error);
+}
+
+BOOST_AUTO_TEST_CASE(sparse_lattice_between_heights_test)
+{
+  const vector<double> heights = {0, 10000};
+  const size_t columns = 64, lines = 64;
+
+  // Displacement smooth across raster, whose curvature in height cannot be interpolated from two heights
+  auto field = [](long x, long y, double h) { return make_pair(0.01 * x + 1e-9 * h * h, 0.01 * y); };
+  auto build = [&](SparseLattice &lattice) {
+    lattice.build(0, 0, columns, lines, [&](long x, long y, const vector<double> &solved, pair<double, double> *displacements) {
+      for (size_t hi = 0; hi < solved.size(); hi++)
+        displacements[hi] = field(x, y, solved[hi]);
+      return true;
+    });
+  };
+
+  SparseLattice lattice(heights, 0.01, 32);
+  build(lattice);
+  pair<double, double> displacement;
+  BOOST_TEST(!lattice.interpolate(10, 10, 5000, displacement));
+  BOOST_TEST(!lattice.interpolate(45, 30, 2500, displacement));
+
+  // Lattice of grid heights only does not check them
+  SparseLattice gridLattice(heights, 0.01, 32, false);
+  build(gridLattice);
+  vector<pair<double, double>> displacements(heights.size());
+  BOOST_TEST(gridLattice.interpolate(10, 10, displacements.data()));
+  BOOST_TEST(!gridLattice.interpolate(10, 10, 5000, displacement));
+
+  // Finer grid keeps error of interpolation in height within allowed error
+  SparseLattice fineLattice({0, 2500, 5000, 7500, 10000}, 0.01, 32);
+  build(fineLattice);
+  for (double h : {1250.0, 4000.0, 8750.0})
+  {
+    BOOST_TEST(fineLattice.interpolate(45, 30, h, displacement));
+    auto expected = field(45, 30, h);
+    BOOST_TEST(hypot(displacement.first - expected.first, displacement.second - expected.second) <= 0.01);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(table_lattice_antimeridian_test, PixelFixture)
+{
+  // Satellite whose view disc crosses antimeridian, table lattice of local offsets like in table generator
+  OGRSpatialReference srs;
+  BOOST_TEST(srs.importFromProj4("+proj=geos +lon_0=140.7 +h=35785831 +x_0=0 +y_0=0 +datum=WGS84 +units=m +no_defs") == CE_None);
+  GEOSHeightCorrector corrector(srs);
+  const vector<double> heights = {0, 5000, 10000};
+  const double accuracy = 2;
+  const long line = 1500;
+
+  // Longitude jumps by 360 degrees between neighbouring pixels of antimeridian
+  long crossing = 0;
+  double previous = corrector.transformToEllipsCoordinates(geotransform.calcGeoCoordsFromPix(0.5, line + 0.5)).first;
+  for (long x = 1; x < 3712 && crossing == 0; x++)
+  {
+    double longitude = corrector.transformToEllipsCoordinates(geotransform.calcGeoCoordsFromPix(x + 0.5, line + 0.5)).first;
+    if (fabs(longitude - previous) > 180)
+      crossing = x;
+    previous = longitude;
+  }
+  BOOST_REQUIRE(crossing > 0);
+
+  auto solvePixel = [&](long x, long y, vector<pair<double, double>> &coordinates) {
+    auto geos = geotransform.calcGeoCoordsFromPix(x + 0.5, y + 0.5);
+    auto ellips = corrector.transformToEllipsCoordinates(geos);
+    for (size_t hi = 0; hi < heights.size(); hi++)
+      coordinates[hi] = corrector.calculateNewCoordinates(geos, ellips, heights[hi], accuracy / 4, 100, NumericMethod::LEVENBERG_MARQUARD);
+    return ellips;
+  };
+
+  const size_t columns = 64, lines = 32;
+  SparseLattice lattice(heights, accuracy / 2, 16, false);
+  lattice.build(crossing - columns / 2, line, columns, lines, [&](long x, long y, const vector<double> &, pair<double, double> *offsets) {
+    vector<pair<double, double>> coordinates(heights.size());
+    auto ellips = solvePixel(x, y, coordinates);
+    for (size_t hi = 0; hi < heights.size(); hi++)
+      offsets[hi] = localOffset(ellips, coordinates[hi]);
+    return !isnan(ellips.first);
+  });
+
+  size_t interpolated = 0;
+  vector<pair<double, double>> offsets(heights.size()), expected(heights.size());
+  for (size_t y = line; y < line + lines; y++)
+    for (size_t x = crossing - columns / 2; x < crossing + columns / 2; x++)
+    {
+      if (!lattice.interpolate(x, y, offsets.data()))
+        continue;
+
+      interpolated++;
+      auto ellips = solvePixel(x, y, expected);
+      for (size_t hi = 0; hi < heights.size(); hi++)
+      {
+        // Interpolated and solved pixels use the same longitude convention, so they are compared without wrapping
+        auto coordinates = offsetPoint(ellips, offsets[hi]);
+        BOOST_TEST(coordinates.first >= -180);
+        BOOST_TEST(coordinates.first < 180);
+        BOOST_TEST(DEGREE_LENGTH * hypot((coordinates.first - expected[hi].first) * cos(coordinates.second * M_PI / 180),
+                                         coordinates.second - expected[hi].second) <= accuracy);
+      }
+    }
+  BOOST_TEST(interpolated > columns * lines / 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(raster_lattice_test, PixelFixture)
+{
+  const double accuracy = 2;
+
+  // Window crossing western edge of view disc
+  const int width = 160, height = 64;
+  vector<double> values;
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      values.push_back((x * 397 + y * 113) % 12000);
+  auto heights = createHeightsRaster(width, height, 0, 1800, values);
+  auto memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+
+  vector<double> grid;
+  for (double h = 0; h <= 12000; h += 2000)
+    grid.push_back(h);
+  SparseLattice lattice(grid, accuracy / 2, 32);
+  corrector.buildLattice(lattice, heights, accuracy, 100, NumericMethod::LEVENBERG_MARQUARD);
+
+  auto expected = memDriver->Create("", width, height, 2, GDT_Float64, nullptr);
+  auto output = memDriver->Create("", width, height, 2, GDT_Float64, nullptr);
+  corrector.calculateNewCoordinatesForRaster(heights, expected, 1, accuracy / 2, 100, NumericMethod::LEVENBERG_MARQUARD);
+
+  CorrectionStatistics statistics;
+  statistics.latticeNodes = lattice.getNodesCount();
+  corrector.calculateNewCoordinatesForRaster(heights, output, 1, accuracy, 100, NumericMethod::LEVENBERG_MARQUARD, false,
+                                             InitialGuess::INFLATED_ELLIPSOID, false, nullptr, &statistics, nullptr, &lattice);
+
+  BOOST_TEST(statistics.interpolated > 0u);
+  BOOST_TEST(statistics.converged > 0u);
+  BOOST_TEST(statistics.solvedFraction() < 0.5);
+
+  vector<double> expectedX(width * height), expectedY(width * height), x(width * height), y(width * height);
+  expected->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, width, height, expectedX.data(), width, height, GDT_Float64, 0, 0, nullptr);
+  expected->GetRasterBand(2)->RasterIO(GF_Read, 0, 0, width, height, expectedY.data(), width, height, GDT_Float64, 0, 0, nullptr);
+  output->GetRasterBand(1)->RasterIO(GF_Read, 0, 0, width, height, x.data(), width, height, GDT_Float64, 0, 0, nullptr);
+  output->GetRasterBand(2)->RasterIO(GF_Read, 0, 0, width, height, y.data(), width, height, GDT_Float64, 0, 0, nullptr);
+
+  for (size_t i = 0; i < x.size(); i++)
+  {
+    BOOST_TEST(isnan(x[i]) == isnan(expectedX[i]));
+    if (!isnan(x[i]))
+      BOOST_TEST(hypot(x[i] - expectedX[i], y[i] - expectedY[i]) <= accuracy);
+  }
+
+  GDALClose(heights);
+  GDALClose(expected);
+  GDALClose(output);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,233 @@
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "table_shards.h"
+#include "correction_table.h"
+
+using namespace std;
+using namespace ksg;
+
+struct ShardsFixture
+{
+  filesystem::path directory;
+
+  ShardsFixture()
+      : directory(filesystem::temp_directory_path() / "ksg_table_shards_test")
+  {
+    filesystem::remove_all(directory);
+    filesystem::create_directories(directory);
+  }
+
+  ~ShardsFixture()
+  {
+    filesystem::remove_all(directory);
+  }
+
+  string path(const string &name) const
+  {
+    return (directory / name).string();
+  }
+
+  static string read(const string &path)
+  {
+    ifstream file(path);
+    return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+  }
+};
+
+BOOST_AUTO_TEST_SUITE(table_shards_suite)
+
+BOOST_AUTO_TEST_CASE(shard_parse_test)
+{
+  TableShard shard;
+  istringstream("3/8") >> shard;
+  BOOST_TEST(shard.index == 3u);
+  BOOST_TEST(shard.count == 8u);
+
+  BOOST_CHECK_THROW(istringstream("0/2") >> shard, logic_error);
+  BOOST_CHECK_THROW(istringstream("3/2") >> shard, logic_error);
+  BOOST_CHECK_THROW(istringstream("3,2") >> shard, logic_error);
+}
+
+BOOST_AUTO_TEST_CASE(balance_shard_test)
+{
+  // Lines of view disc between empty lines above and below it
+  vector<double> costs(200, 0);
+  for (size_t line = 20; line < 180; line++)
+    costs[line] = 2 * sqrt(80.0 * 80.0 - (line - 99.5) * (line - 99.5));
+  double total = accumulate(costs.begin(), costs.end(), 0.0);
+
+  for (size_t count : {1, 3, 7, 16})
+  {
+    size_t next = 0;
+    for (size_t index = 1; index <= count; index++)
+    {
+      auto lines = balanceShard(costs, {index, count});
+      BOOST_TEST(lines.first == next);
+      BOOST_TEST(lines.second > lines.first);
+      next = lines.second;
+
+      double cost = accumulate(costs.begin() + lines.first, costs.begin() + lines.second, 0.0);
+      BOOST_TEST(fabs(cost - total / count) <= 160);
+    }
+    BOOST_TEST(next == costs.size());
+  }
+
+  // Every shard has a line even if all cost is in one line
+  vector<double> single(4, 0);
+  single[0] = 1;
+  BOOST_TEST((balanceShard(single, {1, 3}) == make_pair<size_t, size_t>(0, 1)));
+  BOOST_TEST((balanceShard(single, {2, 3}) == make_pair<size_t, size_t>(1, 2)));
+  BOOST_TEST((balanceShard(single, {3, 3}) == make_pair<size_t, size_t>(2, 4)));
+
+  BOOST_TEST((balanceShard(vector<double>(10, 0), {2, 2}) == make_pair<size_t, size_t>(5, 10)));
+  BOOST_CHECK_THROW(balanceShard(single, {1, 5}), logic_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(manifest_test, ShardsFixture)
+{
+  auto manifestPath = path("table.txt.manifest");
+  {
+    TableManifest manifest(manifestPath, "settings", 100, 50);
+    BOOST_TEST(!manifest.isResumed());
+    BOOST_TEST(manifest.getNextLine() == 100u);
+    manifest.checkpoint(109, 1000);
+    manifest.checkpoint(119, 2500);
+  }
+
+  // Checkpoint interrupted while it was written is ignored
+  ofstream(manifestPath, ios::app) << "done 140 40";
+
+  {
+    TableManifest manifest(manifestPath, "settings", 100, 50);
+    BOOST_TEST(manifest.isResumed());
+    BOOST_TEST(manifest.getNextLine() == 120u);
+    BOOST_TEST(manifest.getOutputSize() == 2500u);
+    manifest.checkpoint(149, 6000);
+    BOOST_TEST(manifest.isComplete());
+  }
+
+  TableManifest finished(manifestPath);
+  BOOST_TEST(finished.isComplete());
+  BOOST_TEST(finished.getOutputSize() == 6000u);
+
+  BOOST_CHECK_THROW(TableManifest(manifestPath, "other settings", 100, 50), runtime_error);
+  BOOST_CHECK_THROW(TableManifest(manifestPath, "settings", 100, 60), runtime_error);
+  BOOST_CHECK_THROW(TableManifest(path("missing.manifest")), runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(merge_binary_test, ShardsFixture)
+{
+  CorrectionTableInfo info;
+  info.srs = "GEOS";
+  info.imageWidth = 100;
+  info.imageHeight = 100;
+  info.firstColumn = 10;
+  info.columns = 20;
+  info.heights = {1000, 2000};
+  info.requiredAccuracy = 10;
+  info.numericMethod = "NETWON";
+
+  auto coordinates = [](size_t column, size_t line) {
+    return vector<pair<double, double>>{{column * 0.5, line * 0.25}, {column * 0.5 + 1, line * 0.25 + 1}};
+  };
+
+  // Shards of lines 30 - 34, 35 - 36 and 37 - 39, given out of order
+  vector<pair<size_t, size_t>> scopes = {{35, 2}, {30, 5}, {37, 3}};
+  vector<string> shards;
+  for (auto &scope : scopes)
+  {
+    info.firstLine = scope.first;
+    info.lines = scope.second;
+    shards.push_back(path("shard" + to_string(scope.first) + ".bin"));
+
+    CorrectionTableWriter writer(shards.back(), info);
+    for (size_t line = scope.first; line < scope.first + scope.second; line++)
+      for (size_t column = 10; column < 30; column++)
+        if ((column + line) % 4 != 0)
+          writer.setPixel(column, line, coordinates(column, line).data());
+  }
+
+  mergeTableShards(shards, path("table.bin"));
+
+  CorrectionTable table(path("table.bin"));
+  BOOST_TEST(table.getInfo().firstLine == 30u);
+  BOOST_TEST(table.getInfo().lines == 10u);
+  BOOST_TEST(table.getInfo().heights == info.heights);
+
+  for (size_t line = 30; line < 40; line++)
+    for (size_t column = 10; column < 30; column++)
+    {
+      BOOST_TEST(table.isValid(column, line) == ((column + line) % 4 != 0));
+      if (table.isValid(column, line))
+        BOOST_TEST((table.getCoordinates(column, line, 1) == coordinates(column, line)[1]));
+    }
+
+  // Missing shard
+  BOOST_CHECK_THROW(mergeTableShards({shards[1], shards[2]}, path("table.bin")), runtime_error);
+
+  // Unfinished shard
+  {
+    TableManifest manifest(shards[0] + ".manifest", "settings", 35, 2);
+    BOOST_CHECK_THROW(mergeTableShards(shards, path("table.bin")), runtime_error);
+    manifest.checkpoint(36, 0);
+  }
+  BOOST_CHECK_NO_THROW(mergeTableShards(shards, path("table.bin")));
+}
+
+BOOST_FIXTURE_TEST_CASE(merge_text_test, ShardsFixture)
+{
+  ofstream(path("b.txt")) << "4 7 1 2\n4 8 1 2\n6 1 1 2\n";
+  ofstream(path("a.txt")) << "1 3 1 2\n3 9 1 2\n";
+  ofstream(path("empty.txt"));
+
+  mergeTableShards({path("b.txt"), path("empty.txt"), path("a.txt")}, path("table.txt"));
+  BOOST_TEST(read(path("table.txt")) == "1 3 1 2\n3 9 1 2\n4 7 1 2\n4 8 1 2\n6 1 1 2\n");
+
+  ofstream(path("c.txt")) << "5 1 1 2\n";
+  BOOST_CHECK_THROW(mergeTableShards({path("a.txt"), path("b.txt"), path("c.txt")}, path("table.txt")), runtime_error);
+
+  // Shards with manifests of lines 1 - 3, 4 - 6 and 7 - 9, the last of which has no pixels
+  ofstream(path("d.txt")) << "7 1 1 2\n";
+  vector<pair<string, size_t>> scopes = {{"a.txt", 0}, {"b.txt", 3}, {"empty.txt", 6}};
+  for (auto &scope : scopes)
+  {
+    TableManifest manifest(path(scope.first + ".manifest"), "settings", scope.second, 3);
+    manifest.checkpoint(scope.second + 2, 0);
+  }
+
+  BOOST_CHECK_NO_THROW(mergeTableShards({path("empty.txt"), path("b.txt"), path("a.txt")}, path("table.txt")));
+  // Missing shard
+  BOOST_CHECK_THROW(mergeTableShards({path("empty.txt"), path("a.txt")}, path("table.txt")), runtime_error);
+  // Pixels out of scope of manifest
+  filesystem::copy_file(path("b.txt.manifest"), path("d.txt.manifest"));
+  BOOST_CHECK_THROW(mergeTableShards({path("a.txt"), path("d.txt")}, path("table.txt")), runtime_error);
+
+  // Binary table among text ones
+  CorrectionTableInfo info;
+  info.srs = "GEOS";
+  info.imageWidth = info.imageHeight = 10;
+  info.lines = info.columns = 10;
+  info.heights = {1000, 2000};
+  {
+    CorrectionTableWriter writer(path("binary.bin"), info);
+  }
+  BOOST_CHECK_THROW(mergeTableShards({path("a.txt"), path("binary.bin")}, path("table.txt")), runtime_error);
+  BOOST_CHECK_THROW(mergeTableShards({path("binary.bin"), path("a.txt")}, path("table.txt")), runtime_error);
+
+  // Output which is one of shards is refused before it is truncated
+  BOOST_CHECK_THROW(mergeTableShards({path("b.txt"), path("a.txt")}, path("a.txt")), runtime_error);
+  BOOST_TEST(read(path("a.txt")) == "1 3 1 2\n3 9 1 2\n");
+  auto binarySize = filesystem::file_size(path("binary.bin"));
+  BOOST_CHECK_THROW(mergeTableShards({path("binary.bin")}, path("binary.bin")), runtime_error);
+  BOOST_TEST(filesystem::file_size(path("binary.bin")) == binarySize);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,161 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "view_symmetry.h"
+#include "geodetic_utils.h"
+#include "fixtures.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+BOOST_AUTO_TEST_SUITE(view_symmetry_suite)
+
+BOOST_AUTO_TEST_CASE(view_symmetry_axes_test)
+{
+  // Standard SEVIRI full disc
+  double seviri[6] = {5566500, -3000, 0, -5566500, 0, 3000};
+  ViewSymmetry symmetry(seviri);
+  BOOST_TEST(symmetry.getAxisColumn() == 1855, boost::test_tools::tolerance(1e-9));
+  BOOST_TEST(symmetry.getAxisLine() == 1855, boost::test_tools::tolerance(1e-9));
+  BOOST_TEST(symmetry.isColumnMirrorExact());
+  BOOST_TEST(symmetry.isLineMirrorExact());
+
+  auto m = symmetry.mirror(100, 3000);
+  BOOST_TEST(m.acrossMeridian);
+  BOOST_TEST(!m.acrossEquator);
+  BOOST_TEST(m.column == 3610, boost::test_tools::tolerance(1e-9));
+  BOOST_TEST(m.line == 3000, boost::test_tools::tolerance(1e-9));
+
+  // Grid shifted by third of pixel
+  double shifted[6] = {5566500 + 1000, -3000, 0, -5566500 - 1000, 0, 3000};
+  ViewSymmetry shiftedSymmetry(shifted);
+  BOOST_TEST(!shiftedSymmetry.isColumnMirrorExact());
+  BOOST_TEST(!shiftedSymmetry.isLineMirrorExact());
+
+  double rotated[6] = {5566500, -3000, 1, -5566500, 0, 3000};
+  BOOST_CHECK_THROW(ViewSymmetry rotatedSymmetry(rotated), logic_error);
+}
+
+BOOST_DATA_TEST_CASE_F(PixelFixture, quadrant_table_test, data::make(vector<double>{0, 0.3}), shift)
+{
+  const double accuracy = 1;
+  const vector<double> heights = {2000, 12000};
+
+  double gt[6];
+  copy(begin(geotransform.geotransform), end(geotransform.geotransform), gt);
+  gt[0] += shift * gt[1];
+  gt[3] += shift * gt[5];
+  ViewSymmetry symmetry(gt);
+
+  // Scope crossing central meridian, far from equator, where displacements change fast
+  const size_t firstColumn = 1830, firstLine = 300, columns = 50, lines = 12;
+  QuadrantTable quadrant(symmetry, 3712, 3712, firstColumn, firstLine, columns, lines, heights.size());
+  BOOST_TEST(quadrant.getColumns() * quadrant.getLines() < columns * lines);
+
+  auto observe = [&](size_t x, size_t y, pair<double, double> &geos) {
+    geos = make_pair(gt[0] + gt[1] * (x + 0.5), gt[3] + gt[5] * (y + 0.5));
+    return corrector.transformToEllipsCoordinates(geos);
+  };
+
+  vector<pair<double, double>> results(heights.size()), mirrored(heights.size());
+  for (size_t y = quadrant.getFirstLine(); y < quadrant.getFirstLine() + quadrant.getLines(); y++)
+    for (size_t x = quadrant.getFirstColumn(); x < quadrant.getFirstColumn() + quadrant.getColumns(); x++)
+    {
+      pair<double, double> geos;
+      auto ellips = observe(x, y, geos);
+      for (size_t hi = 0; hi < heights.size(); hi++)
+        results[hi] = corrector.calculateNewCoordinates(geos, ellips, heights[hi], accuracy / 2, 100, NumericMethod::LEVENBERG_MARQUARD);
+      quadrant.setPixel(x, y, ellips, results.data());
+    }
+
+  size_t taken = 0;
+  for (size_t y = firstLine; y < firstLine + lines; y++)
+    for (size_t x = firstColumn; x < firstColumn + columns; x++)
+    {
+      pair<double, double> geos;
+      auto ellips = observe(x, y, geos);
+      if (!quadrant.getPixel(x, y, ellips, accuracy / 2, mirrored.data()))
+        continue;
+
+      taken++;
+      for (size_t hi = 0; hi < heights.size(); hi++)
+      {
+        auto expected = corrector.calculateNewCoordinates(geos, ellips, heights[hi], accuracy / 2, 100, NumericMethod::LEVENBERG_MARQUARD);
+        double dLongitude = (mirrored[hi].first - expected.first) * cos(expected.second * M_PI / 180);
+        double dLatitude = mirrored[hi].second - expected.second;
+
+        // Both full and mirrored solutions are within required accuracy
+        BOOST_TEST(DEGREE_LENGTH * hypot(dLongitude, dLatitude) <= 2 * accuracy);
+      }
+    }
+
+  // Only pixels next to quadrant edges may require full solution
+  BOOST_TEST(taken >= columns * lines * 9 / 10);
+}
+
+BOOST_FIXTURE_TEST_CASE(quadrant_table_antimeridian_test, PixelFixture)
+{
+  // Satellite whose view disc crosses antimeridian, pixels there are mirrored from the other side of central meridian
+  OGRSpatialReference srs;
+  BOOST_TEST(srs.importFromProj4("+proj=geos +lon_0=140.7 +h=35785831 +x_0=0 +y_0=0 +datum=WGS84 +units=m +no_defs") == CE_None);
+  GEOSHeightCorrector corrector(srs);
+  const double accuracy = 1;
+  const vector<double> heights = {2000, 12000};
+  const size_t firstLine = 1500, lines = 4;
+
+  auto observe = [&](size_t x, size_t y, pair<double, double> &geos) {
+    geos = geotransform.calcGeoCoordsFromPix(x + 0.5, y + 0.5);
+    return corrector.transformToEllipsCoordinates(geos);
+  };
+
+  // Longitude jumps by 360 degrees between neighbouring pixels of antimeridian
+  size_t crossing = 0;
+  pair<double, double> geos;
+  for (size_t x = 1; x < 3712 && crossing == 0; x++)
+    if (fabs(observe(x, firstLine, geos).first - observe(x - 1, firstLine, geos).first) > 180)
+      crossing = x;
+  BOOST_REQUIRE(crossing > 0u);
+
+  size_t mirror = 3711 - crossing;
+  size_t firstColumn = min(crossing, mirror) - 8, columns = max(crossing, mirror) + 8 - firstColumn;
+  ViewSymmetry symmetry(geotransform.geotransform);
+  QuadrantTable quadrant(symmetry, 3712, 3712, firstColumn, firstLine, columns, lines, heights.size());
+
+  vector<pair<double, double>> results(heights.size()), mirrored(heights.size());
+  for (size_t y = quadrant.getFirstLine(); y < quadrant.getFirstLine() + quadrant.getLines(); y++)
+    for (size_t x = quadrant.getFirstColumn(); x < quadrant.getFirstColumn() + quadrant.getColumns(); x++)
+    {
+      auto ellips = observe(x, y, geos);
+      for (size_t hi = 0; hi < heights.size(); hi++)
+        results[hi] = corrector.calculateNewCoordinates(geos, ellips, heights[hi], accuracy / 2, 100, NumericMethod::LEVENBERG_MARQUARD);
+      quadrant.setPixel(x, y, ellips, results.data());
+    }
+
+  size_t taken = 0;
+  for (size_t y = firstLine; y < firstLine + lines; y++)
+    for (size_t x = crossing - 8; x < crossing + 8; x++)
+    {
+      auto ellips = observe(x, y, geos);
+      if (!quadrant.getPixel(x, y, ellips, accuracy / 2, mirrored.data()))
+        continue;
+
+      taken++;
+      for (size_t hi = 0; hi < heights.size(); hi++)
+      {
+        // Mirrored and solved pixels use the same longitude convention, so they are compared without wrapping
+        auto expected = corrector.calculateNewCoordinates(geos, ellips, heights[hi], accuracy / 2, 100, NumericMethod::LEVENBERG_MARQUARD);
+        BOOST_TEST(mirrored[hi].first >= -180);
+        BOOST_TEST(mirrored[hi].first < 180);
+        BOOST_TEST(DEGREE_LENGTH * hypot((mirrored[hi].first - expected.first) * cos(expected.second * M_PI / 180),
+                                         mirrored[hi].second - expected.second) <= 2 * accuracy);
+      }
+    }
+  BOOST_TEST(taken > 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,141 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/data/monomorphic.hpp>
+#include <vector>
+#include <sstream>
+#include <cmath>
+
+#include "fixtures.h"
+#include "cloud_simulation.h"
+#include "test_utils.h"
+
+using namespace std;
+using namespace ksg;
+namespace data = boost::unit_test::data;
+
+static vector<NumericMethod> numericMethods = {NumericMethod::NETWON, NumericMethod::LEVENBERG_MARQUARD, NumericMethod::LINE_OF_SIGHT};
+static vector<bool> quadraticForms = {false, true};
+static vector<InitialGuess> initialGuesses = {InitialGuess::HEURISTIC, InitialGuess::INFLATED_ELLIPSOID};
+
+///
+/// Stratiform cloud deck near north edge of view disc, with some gaps
+struct CloudDeck
+{
+  static constexpr int width = 48, height = 48;
+  static constexpr PixPosition origin = {1464, 3400};
+
+  vector<pair<double, double>> orginalGeos, geos, ellips;
+  vector<double> heights;
+
+  CloudDeck(PixelFixture &fixture)
+  {
+    for (int y = 0; y < height; y++)
+      for (int x = 0; x < width; x++)
+      {
+        auto pixelGeos = fixture.geotransform.calcGeoCoordsFromPix(origin.x + x + 0.5, origin.y + y + 0.5);
+        auto pixelEllips = fixture.corrector.transformToEllipsCoordinates(pixelGeos);
+        double cloudHeight = (x + y) % 17 == 0 ? NAN : 6000 + 150 * sin(x / 7.0) * cos(y / 5.0);
+
+        orginalGeos.push_back(pixelGeos);
+        heights.push_back(cloudHeight);
+
+        if (isnan(cloudHeight))
+        {
+          geos.push_back(make_pair(NAN, NAN));
+          ellips.push_back(make_pair(NAN, NAN));
+          continue;
+        }
+
+        auto cloudXYZ = calculateCloudPosition(pixelEllips.second * M_PI / 180.0, pixelEllips.first * M_PI / 180.0, cloudHeight, fixture.a, fixture.eSqr, fixture.central_m);
+        geos.push_back(calculateGEOSCorrdsFromXYZ(cloudXYZ, fixture.a, fixture.satelliteHeight));
+        ellips.push_back(fixture.corrector.transformToEllipsCoordinates(geos.back()));
+      }
+  }
+};
+
+struct IterationsStatistics
+{
+  double mean = 0, deviation = 0;
+  int maximum = 0;
+
+  IterationsStatistics(const vector<int> &iterations, const vector<double> &heights)
+  {
+    size_t count = 0;
+    for (size_t i = 0; i < iterations.size(); i++)
+      if (!isnan(heights[i]))
+      {
+        mean += iterations[i];
+        maximum = max(maximum, iterations[i]);
+        count++;
+      }
+    mean /= count;
+
+    for (size_t i = 0; i < iterations.size(); i++)
+      if (!isnan(heights[i]))
+        deviation += pow(iterations[i] - mean, 2);
+    deviation = sqrt(deviation / count);
+  }
+};
+
+static ostream &operator<<(ostream &out, const IterationsStatistics &statistics)
+{
+  out << "mean: " << statistics.mean << ", standard deviation: " << statistics.deviation << ", maximum: " << statistics.maximum;
+  return out;
+}
+
+BOOST_FIXTURE_TEST_SUITE(warm_start_suite, PixelFixture)
+
+BOOST_DATA_TEST_CASE(
+    warm_start_test,
+    data::make(numericMethods) *
+    data::make(quadraticForms) *
+    data::make(initialGuesses),
+    numericMethod, quadraticForm, initialGuess)
+{
+  CloudDeck deck(*this);
+  size_t count = deck.heights.size();
+  double requiredAccuracy = 10;
+
+  vector<pair<double, double>> coldResults(count), warmResults(count);
+  vector<int> coldIterations(count), warmIterations(count);
+
+  for (size_t i = 0; i < count; i++)
+    if (!isnan(deck.heights[i]))
+      coldResults[i] = corrector.calculateNewCoordinates(deck.geos[i], deck.ellips[i], deck.heights[i], requiredAccuracy, 100,
+                                                         numericMethod, quadraticForm, initialGuess, &coldIterations[i]);
+
+  corrector.calculateNewCoordinatesWarmStarted(CloudDeck::width, CloudDeck::height, deck.geos.data(), deck.ellips.data(), deck.heights.data(), warmResults.data(),
+                                               requiredAccuracy, 100, numericMethod, quadraticForm, initialGuess, warmIterations.data());
+
+  for (size_t i = 0; i < count; i++)
+  {
+    if (isnan(deck.heights[i]))
+    {
+      BOOST_TEST((isnan(warmResults[i].first) && isnan(warmResults[i].second)));
+      continue;
+    }
+
+    BOOST_TEST_CONTEXT("pixel " << i)
+    {
+      BOOST_TEST((!isnan(warmResults[i].first) && !isnan(warmResults[i].second)));
+
+      auto corrected = corrector.transformToGeosCoordinates(warmResults[i]);
+      auto res = sqrt(pow(deck.orginalGeos[i].first - corrected.first, 2) + pow(deck.orginalGeos[i].second - corrected.second, 2));
+      BOOST_TEST(res <= requiredAccuracy);
+    }
+  }
+
+  IterationsStatistics cold(coldIterations, deck.heights), warm(warmIterations, deck.heights);
+
+  stringstream message;
+  message << "Iterations (" << numericMethod << (quadraticForm ? ", squared" : "") << ", " << initialGuess << ")\n"
+          << "  cold start: " << cold << "\n"
+          << "  warm start: " << warm;
+  BOOST_TEST_MESSAGE(message.str());
+
+  BOOST_TEST(warm.mean <= cold.mean);
+  if (initialGuess == InitialGuess::HEURISTIC)
+    BOOST_TEST(warm.mean < cold.mean);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "view_symmetry.h"
+#include "geodetic_utils.h"
+
+using namespace std;
+
+namespace ksg
+{
+    /// Tolerance of pixel position of mirrored pixel center
+    constexpr double MIRROR_TOLERANCE = 1e-6;
+
+    static bool isWhole(double position)
+    {
+        return fabs(position - round(position)) < MIRROR_TOLERANCE;
+    }
+
+    ViewSymmetry::ViewSymmetry(const double geotransform[6], double falseEasting, double falseNorthing)
+    {
+        if (geotransform[2] != 0 || geotransform[4] != 0)
+            throw logic_error("View symmetry requires north up raster");
+
+        axisColumn = (falseEasting - geotransform[0]) / geotransform[1] - 0.5;
+        axisLine = (falseNorthing - geotransform[3]) / geotransform[5] - 0.5;
+        columnMirrorExact = isWhole(2 * axisColumn);
+        lineMirrorExact = isWhole(2 * axisLine);
+    }
+
+    ViewSymmetry::Mirror ViewSymmetry::mirror(size_t column, size_t line) const
+    {
+        Mirror m;
+        m.acrossMeridian = column < axisColumn;
+        m.acrossEquator = line < axisLine;
+        m.column = m.acrossMeridian ? 2 * axisColumn - column : column;
+        m.line = m.acrossEquator ? 2 * axisLine - line : line;
+        return m;
+    }
+
+    ///
+    /// Range of canonical pixels (along one axis) required by scope [first, last]. Pixels mirrored between
+    /// pixel centers require two neighbours on both sides, to interpolate and estimate second difference.
+    static pair<long, long> requiredRange(size_t first, size_t last, double axis, size_t size)
+    {
+        long low = numeric_limits<long>::max(), high = numeric_limits<long>::min();
+        for (size_t position = first; position <= last; position++)
+        {
+            double mirrored = position < axis ? 2 * axis - position : position;
+            long lower = isWhole(mirrored) ? lround(mirrored) : static_cast<long>(floor(mirrored)) - 1;
+            long upper = isWhole(mirrored) ? lround(mirrored) : static_cast<long>(floor(mirrored)) + 2;
+            low = min(low, lower);
+            high = max(high, upper);
+        }
+
+        low = max(low, static_cast<long>(ceil(axis - MIRROR_TOLERANCE)));
+        high = min(high, static_cast<long>(size) - 1);
+        return {low, high};
+    }
+
+    QuadrantTable::QuadrantTable(const ViewSymmetry &symmetry, size_t imageWidth, size_t imageHeight,
+                                 size_t firstColumn, size_t firstLine, size_t columns, size_t lines, size_t heightsCount)
+        : symmetry(symmetry), heightsCount(heightsCount)
+    {
+        if (columns == 0 || lines == 0)
+            return;
+
+        auto columnRange = requiredRange(firstColumn, firstColumn + columns - 1, symmetry.getAxisColumn(), imageWidth);
+        auto lineRange = requiredRange(firstLine, firstLine + lines - 1, symmetry.getAxisLine(), imageHeight);
+        if (columnRange.first > columnRange.second || lineRange.first > lineRange.second)
+            return;
+
+        this->firstColumn = columnRange.first;
+        this->firstLine = lineRange.first;
+        this->columns = columnRange.second - columnRange.first + 1;
+        this->lines = lineRange.second - lineRange.first + 1;
+
+        double nan = numeric_limits<double>::quiet_NaN();
+        observed.assign(this->columns * this->lines, make_pair(nan, nan));
+        displacements.assign(this->columns * this->lines * heightsCount, make_pair(nan, nan));
+    }
+
+    bool QuadrantTable::contains(long column, long line) const
+    {
+        return column >= static_cast<long>(firstColumn) && column < static_cast<long>(firstColumn + columns) &&
+               line >= static_cast<long>(firstLine) && line < static_cast<long>(firstLine + lines);
+    }
+
+    const pair<double, double> *QuadrantTable::displacement(long column, long line) const
+    {
+        if (!contains(column, line))
+            return nullptr;
+
+        size_t pixel = (line - firstLine) * columns + column - firstColumn;
+        if (isnan(observed[pixel].first))
+            return nullptr;
+
+        return &displacements[pixel * heightsCount];
+    }
+
+    void QuadrantTable::setPixel(size_t column, size_t line, pair<double, double> observed, const pair<double, double> *coordinates)
+    {
+        if (!contains(column, line))
+            throw logic_error("Pixel is out of quadrant table");
+
+        size_t pixel = (line - firstLine) * columns + column - firstColumn;
+        this->observed[pixel] = observed;
+        for (size_t hi = 0; hi < heightsCount; hi++)
+            displacements[pixel * heightsCount + hi] = make_pair(wrapLongitude(coordinates[hi].first - observed.first),
+                                                                 coordinates[hi].second - observed.second);
+    }
+
+    bool QuadrantTable::getPixel(size_t column, size_t line, pair<double, double> observed, double maxError,
+                                 pair<double, double> *coordinates) const
+    {
+        auto m = symmetry.mirror(column, line);
+
+        // Mirrored pixel lies in cell [c0, c0 + 1] x [l0, l0 + 1], weights are zero on pixel centers
+        long c0 = isWhole(m.column) ? lround(m.column) : static_cast<long>(floor(m.column));
+        long l0 = isWhole(m.line) ? lround(m.line) : static_cast<long>(floor(m.line));
+        double tc = isWhole(m.column) ? 0 : m.column - c0;
+        double tl = isWhole(m.line) ? 0 : m.line - l0;
+
+        const pair<double, double> *corners[2][2] = {{displacement(c0, l0), nullptr}, {nullptr, nullptr}};
+        if (tc > 0)
+            corners[0][1] = displacement(c0 + 1, l0);
+        if (tl > 0)
+            corners[1][0] = displacement(c0, l0 + 1);
+        if (tc > 0 && tl > 0)
+            corners[1][1] = displacement(c0 + 1, l0 + 1);
+
+        if (corners[0][0] == nullptr || (tc > 0 && corners[0][1] == nullptr) ||
+            (tl > 0 && corners[1][0] == nullptr) || (tc > 0 && tl > 0 && corners[1][1] == nullptr))
+            return false;
+
+        // Bilinear interpolation error is bounded by eighth of second difference along each interpolated axis
+        const pair<double, double> *before = nullptr, *after = nullptr, *lineBefore = nullptr, *lineAfter = nullptr;
+        if (tc > 0 && ((before = displacement(c0 - 1, l0)) == nullptr || (after = displacement(c0 + 2, l0)) == nullptr))
+            return false;
+        if (tl > 0 && ((lineBefore = displacement(c0, l0 - 1)) == nullptr || (lineAfter = displacement(c0, l0 + 2)) == nullptr))
+            return false;
+
+        double cosLatitude = cos(observed.second * M_PI / 180);
+        auto length = [&](double dLongitude, double dLatitude) {
+            return DEGREE_LENGTH * hypot(dLongitude * cosLatitude, dLatitude);
+        };
+        auto secondDifference = [&](const pair<double, double> &p, const pair<double, double> &q, const pair<double, double> &r) {
+            return length(p.first - 2 * q.first + r.first, p.second - 2 * q.second + r.second);
+        };
+
+        for (size_t hi = 0; hi < heightsCount; hi++)
+        {
+            auto d = corners[0][0][hi];
+            if (tc > 0)
+                d = make_pair((1 - tc) * d.first + tc * corners[0][1][hi].first, (1 - tc) * d.second + tc * corners[0][1][hi].second);
+            if (tl > 0)
+            {
+                auto upper = corners[1][0][hi];
+                if (tc > 0)
+                    upper = make_pair((1 - tc) * upper.first + tc * corners[1][1][hi].first,
+                                      (1 - tc) * upper.second + tc * corners[1][1][hi].second);
+                d = make_pair((1 - tl) * d.first + tl * upper.first, (1 - tl) * d.second + tl * upper.second);
+            }
+
+            double error = 0;
+            if (tc > 0)
+                error += max(secondDifference(before[hi], corners[0][0][hi], corners[0][1][hi]),
+                             secondDifference(corners[0][0][hi], corners[0][1][hi], after[hi])) / 8;
+            if (tl > 0)
+                error += max(secondDifference(lineBefore[hi], corners[0][0][hi], corners[1][0][hi]),
+                             secondDifference(corners[0][0][hi], corners[1][0][hi], lineAfter[hi])) / 8;
+
+            // NaN displacement of pixel which was not corrected fails comparison too
+            if (isnan(d.first) || isnan(d.second) || !(error <= maxError))
+                return false;
+
+            coordinates[hi] = make_pair(wrapLongitude(observed.first + (m.acrossMeridian ? -d.first : d.first)),
+                                        observed.second + (m.acrossEquator ? -d.second : d.second));
+        }
+
+        return true;
+    }
+}
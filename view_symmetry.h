@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace ksg
+{
+    ///
+    /// Mirror symmetry of geostationary view about equator and central meridian. Satellite is above equator,
+    /// so parallax correction of pixel mirrored about central meridian or equator is mirrored as well, and
+    /// correction of whole raster follows from correction of single quadrant.
+    ///
+    /// Symmetry is described in pixel coordinates of north up raster. Canonical quadrant contains pixels
+    /// whose column and line are not lower than those of axes.
+    class ViewSymmetry
+    {
+    public:
+        ///
+        /// Pixel mirrored into canonical quadrant.
+        struct Mirror
+        {
+            /// 0 based, fractional position of mirrored pixel center
+            double column, line;
+            /// True if pixel was mirrored about central meridian (geos x changes sign) or equator (geos y changes sign)
+            bool acrossMeridian, acrossEquator;
+        };
+
+        ///
+        /// @param falseEasting, falseNorthing geos coordinates of subsatellite point [m]
+        /// @throws std::logic_error if geotransform is rotated
+        ViewSymmetry(const double geotransform[6], double falseEasting = 0, double falseNorthing = 0);
+
+        ///
+        /// @return 0 based, fractional column and line whose centers lie on central meridian and on equator
+        double getAxisColumn() const { return axisColumn; }
+        double getAxisLine() const { return axisLine; }
+
+        ///
+        /// @return true if pixels mirrored about central meridian or equator land on pixel centers
+        bool isColumnMirrorExact() const { return columnMirrorExact; }
+        bool isLineMirrorExact() const { return lineMirrorExact; }
+
+        Mirror mirror(size_t column, size_t line) const;
+
+    private:
+        double axisColumn, axisLine;
+        bool columnMirrorExact, lineMirrorExact;
+    };
+
+    ///
+    /// Corrected coordinates of pixels of canonical quadrant for every height, from which coordinates of pixels
+    /// mirrored into it are taken. Pixels which are not mirrored onto pixel centers are interpolated bilinearly
+    /// from displacements of neighbouring pixels, as long as interpolation error estimated from their second
+    /// differences allows it.
+    class QuadrantTable
+    {
+    public:
+        ///
+        /// Prepares table for canonical pixels required by given scope of raster.
+        /// @param firstColumn, firstLine, columns, lines 0 based scope of raster
+        QuadrantTable(const ViewSymmetry &symmetry, size_t imageWidth, size_t imageHeight,
+                      size_t firstColumn, size_t firstLine, size_t columns, size_t lines, size_t heightsCount);
+
+        ///
+        /// Box of canonical pixels which have to be solved, empty if scope needs none.
+        size_t getFirstColumn() const { return firstColumn; }
+        size_t getFirstLine() const { return firstLine; }
+        size_t getColumns() const { return columns; }
+        size_t getLines() const { return lines; }
+
+        ///
+        /// Stores canonical pixel. Safe to call from many threads for different pixels.
+        /// @param observed observed ellipsoid coordinates of pixel (longitude, latitude) [deg]
+        /// @param coordinates corrected (longitude, latitude) for every height [deg], NaN if pixel was not corrected
+        void setPixel(size_t column, size_t line, std::pair<double, double> observed, const std::pair<double, double> *coordinates);
+
+        ///
+        /// Mirrors pixel of scope from canonical quadrant.
+        /// @param observed observed ellipsoid coordinates of pixel (longitude, latitude) [deg]
+        /// @param maxError maximal allowed interpolation error [m]
+        /// @param coordinates receives corrected (longitude, latitude) for every height [deg], longitude wrapped into
+        /// [-180, 180) like those of solved pixels
+        /// @return false if pixel has to be solved directly: its mirror is out of table, it was not corrected
+        /// or interpolation is not accurate enough
+        bool getPixel(size_t column, size_t line, std::pair<double, double> observed, double maxError,
+                      std::pair<double, double> *coordinates) const;
+
+    private:
+        ViewSymmetry symmetry;
+        size_t firstColumn = 0, firstLine = 0, columns = 0, lines = 0;
+        size_t heightsCount;
+
+        /// Observed coordinates of pixels, NaN for pixels which were not stored
+        std::vector<std::pair<double, double>> observed;
+        /// Displacements of corrected coordinates from observed ones, for every height of pixel
+        std::vector<std::pair<double, double>> displacements;
+
+        bool contains(long column, long line) const;
+        const std::pair<double, double> *displacement(long column, long line) const;
+    };
+}